@@ -787,6 +787,7 @@ static int main_config_parser_cb(const char *path,
 			    (strcmp(path, "totem.token_coefficient") == 0) ||
 			    (strcmp(path, "totem.token_retransmit") == 0) ||
 			    (strcmp(path, "totem.token_warning") == 0) ||
+			    (strcmp(path, "totem.token_phi_threshold") == 0) ||
 			    (strcmp(path, "totem.hold") == 0) ||
 			    (strcmp(path, "totem.token_retransmits_before_loss_const") == 0) ||
 			    (strcmp(path, "totem.join") == 0) ||
@@ -801,6 +802,15 @@ static int main_config_parser_cb(const char *path,
 			    (strcmp(path, "totem.window_size") == 0) ||
 			    (strcmp(path, "totem.max_messages") == 0) ||
 			    (strcmp(path, "totem.miss_count_const") == 0) ||
+			    (strcmp(path, "totem.sort_queue_bytes") == 0) ||
+			    (strcmp(path, "totem.fec_group_size") == 0) ||
+			    (strcmp(path, "totem.side_channel_threshold") == 0) ||
+			    (strcmp(path, "totem.buffer_pool_size") == 0) ||
+			    (strcmp(path, "totem.token_hold_idle_max") == 0) ||
+			    (strcmp(path, "totem.coalesce_delay") == 0) ||
+			    (strcmp(path, "totem.coalesce_bytes") == 0) ||
+			    (strcmp(path, "totem.compression_threshold") == 0) ||
+			    (strcmp(path, "totem.compression_level") == 0) ||
 			    (strcmp(path, "totem.knet_pmtud_interval") == 0) ||
 			    (strcmp(path, "totem.knet_mtu") == 0) ||
 			    (strcmp(path, "totem.knet_compression_threshold") == 0) ||
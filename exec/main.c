@@ -496,12 +496,43 @@ static void corosync_mlockall (void)
 }
 
 
+/*
+ * Upper bound of the histogram bucket containing the given percentile
+ */
+static uint64_t latency_percentile_get (const totemsrp_latency_stats_t *latency,
+	unsigned int percentile)
+{
+	uint64_t threshold;
+	uint64_t seen = 0;
+	uint64_t upper;
+	int i;
+
+	if (latency->count == 0) {
+		return (0);
+	}
+	threshold = (latency->count * percentile + 99) / 100;
+	for (i = 0; i < TOTEM_LATENCY_BUCKETS - 1; i++) {
+		seen += latency->bucket[i];
+		if (seen >= threshold) {
+			break;
+		}
+	}
+	if (i == TOTEM_LATENCY_BUCKETS - 1) {
+		return (latency->max_us);
+	}
+	upper = totem_latency_bucket_lower (i + 1) - 1;
+	return (upper < latency->max_us ? upper : latency->max_us);
+}
+
 static void corosync_totem_stats_updater (void *data)
 {
 	totempg_stats_t * stats;
 	uint32_t total_mtt_rx_token;
 	uint32_t total_backlog_calc;
 	uint32_t total_token_holdtime;
+	uint32_t total_window_size;
+	uint32_t min_window_size;
+	uint32_t max_window_size;
 	int t, prev;
 	int32_t token_count;
 	const char *cstr;
@@ -536,6 +567,9 @@ static void corosync_totem_stats_updater (void *data)
 	total_mtt_rx_token = 0;
 	total_token_holdtime = 0;
 	total_backlog_calc = 0;
+	total_window_size = 0;
+	min_window_size = 0;
+	max_window_size = 0;
 	token_count = 0;
 	t = stats->srp->latest_token;
 	while (1) {
@@ -551,6 +585,13 @@ static void corosync_totem_stats_updater (void *data)
 			total_mtt_rx_token += (stats->srp->token[t].rx - stats->srp->token[prev].rx);
 			total_token_holdtime += (stats->srp->token[t].tx - stats->srp->token[t].rx);
 			total_backlog_calc += stats->srp->token[t].backlog_calc;
+			total_window_size += stats->srp->token[t].window_size;
+			if (token_count == 0 || stats->srp->token[t].window_size < min_window_size) {
+				min_window_size = stats->srp->token[t].window_size;
+			}
+			if (stats->srp->token[t].window_size > max_window_size) {
+				max_window_size = stats->srp->token[t].window_size;
+			}
 			token_count++;
 		}
 		t = prev;
@@ -559,10 +600,21 @@ static void corosync_totem_stats_updater (void *data)
 		stats->srp->mtt_rx_token = (total_mtt_rx_token / token_count);
 		stats->srp->avg_token_workload = (total_token_holdtime / token_count);
 		stats->srp->avg_backlog_calc = (total_backlog_calc / token_count);
+		stats->srp->avg_fcc_window_size = (total_window_size / token_count);
+		stats->srp->min_fcc_window_size = min_window_size;
+		stats->srp->max_fcc_window_size = max_window_size;
 	}
 
 	stats->srp->time_since_token_last_received = qb_util_nano_current_get () / QB_TIME_NS_IN_MSEC -
 		stats->srp->token[stats->srp->latest_token].rx;
+	stats->srp->token_phi = totem_phi_get (stats->srp->time_since_token_last_received * 1000,
+		stats->srp->token_interval_mean_us, stats->srp->token_interval_stddev_us);
+
+	for (t = 0; t < TOTEM_LATENCY_MAX; t++) {
+		stats->srp->latency[t].p50_us = latency_percentile_get (&stats->srp->latency[t], 50);
+		stats->srp->latency[t].p90_us = latency_percentile_get (&stats->srp->latency[t], 90);
+		stats->srp->latency[t].p99_us = latency_percentile_get (&stats->srp->latency[t], 99);
+	}
 
 	stats_trigger_trackers();
 
@@ -643,6 +695,184 @@ int main_mcast (
 	return (totempg_groups_mcast_joined (corosync_group_handle, iovec, iov_len, guarantee));
 }
 
+/*
+ * Ring id persistence
+ *
+ * The ring id file holds a mark which is always above every ring sequence
+ * number used so far, so a restarted processor never reuses one.  Each new
+ * ring asks the writer thread to move the mark RINGID_STORE_HEADROOM ahead,
+ * which keeps the fsync off the main thread; requests arriving while a write
+ * is in progress are coalesced into the next write.  Only when a ring reaches
+ * the mark known to be on disk (the writer fell behind or failed) is the mark
+ * written synchronously, exactly like before.
+ */
+#define RINGID_STORE_HEADROOM	1024
+
+static struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;		/* a mark was requested */
+	pthread_cond_t done_cond;	/* the writer finished a write */
+	pthread_t thread;
+	int thread_started;
+	int writing;
+	unsigned int nodeid;
+	uint64_t requested;	/* mark waiting for the writer, 0 if none */
+	uint64_t stored;	/* mark on stable storage */
+	struct ringid_store_stats stats;
+} ringid_store = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.done_cond = PTHREAD_COND_INITIALIZER,
+};
+
+/*
+ * Write the mark to a temporary file and rename it, so a crash never leaves
+ * a truncated ring id file behind.  The rename is only durable once the
+ * directory is synced as well.
+ */
+static int corosync_ring_id_file_write (unsigned int nodeid, uint64_t seq)
+{
+	char filename[PATH_MAX];
+	char tmp_filename[PATH_MAX];
+	int fd;
+	int dir_fd;
+	int res;
+
+	snprintf (filename, sizeof(filename), "%s/ringid_%u",
+		get_state_dir(), nodeid);
+	snprintf (tmp_filename, sizeof(tmp_filename), "%s/ringid_%u.tmp",
+		get_state_dir(), nodeid);
+
+	fd = open (tmp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd == -1) {
+		return (-1);
+	}
+	res = write (fd, &seq, sizeof(seq));
+	if (res != sizeof(seq) || fdatasync (fd) == -1) {
+		if (res >= 0 && res != sizeof(seq)) {
+			errno = EIO;
+		}
+		close (fd);
+		return (-1);
+	}
+	if (close (fd) == -1) {
+		return (-1);
+	}
+	if (rename (tmp_filename, filename) == -1) {
+		return (-1);
+	}
+
+	dir_fd = open (get_state_dir(), O_RDONLY | O_DIRECTORY);
+	if (dir_fd == -1) {
+		return (-1);
+	}
+	if (fsync (dir_fd) == -1) {
+		res = errno;
+		close (dir_fd);
+		errno = res;
+		return (-1);
+	}
+	return (close (dir_fd));
+}
+
+/*
+ * Called with ringid_store.mutex held
+ */
+static void corosync_ring_id_write_account (uint64_t start_nsec, int sync)
+{
+	uint64_t write_us = (qb_util_nano_current_get () - start_nsec) / QB_TIME_NS_IN_USEC;
+
+	ringid_store.stats.writes++;
+	if (sync) {
+		ringid_store.stats.sync_writes++;
+	}
+	ringid_store.stats.write_last_us = write_us;
+	ringid_store.stats.write_sum_us += write_us;
+	if (write_us > ringid_store.stats.write_max_us) {
+		ringid_store.stats.write_max_us = write_us;
+	}
+	ringid_store.stats.stored_seq = ringid_store.stored;
+}
+
+static void *corosync_ring_id_writer (void *data)
+{
+	uint64_t seq;
+	uint64_t start_nsec;
+	int res;
+
+	pthread_mutex_lock (&ringid_store.mutex);
+	while (1) {
+		while (ringid_store.requested == 0) {
+			pthread_cond_wait (&ringid_store.cond, &ringid_store.mutex);
+		}
+		seq = ringid_store.requested;
+		ringid_store.requested = 0;
+		if (seq <= ringid_store.stored) {
+			/*
+			 * Overtaken by a synchronous write
+			 */
+			continue;
+		}
+		ringid_store.writing = 1;
+		pthread_mutex_unlock (&ringid_store.mutex);
+
+		start_nsec = qb_util_nano_current_get ();
+		res = corosync_ring_id_file_write (ringid_store.nodeid, seq);
+		if (res == -1) {
+			LOGSYS_PERROR (errno, LOGSYS_LEVEL_WARNING,
+				"Couldn't store ring id mark " CS_PRI_RING_ID_SEQ " to stable storage",
+				seq);
+		}
+
+		pthread_mutex_lock (&ringid_store.mutex);
+		ringid_store.writing = 0;
+		if (res == -1) {
+			ringid_store.stats.write_errors++;
+		} else {
+			ringid_store.stored = seq;
+			corosync_ring_id_write_account (start_nsec, 0);
+		}
+		pthread_cond_signal (&ringid_store.done_cond);
+	}
+
+	return (NULL);
+}
+
+/*
+ * Called with ringid_store.mutex held, exits if the mark can't be stored.
+ * Writes are serialized with the writer thread so the mark on disk never
+ * goes back.
+ */
+static void corosync_ring_id_store_sync (uint64_t seq)
+{
+	uint64_t start_nsec;
+
+	while (ringid_store.writing) {
+		pthread_cond_wait (&ringid_store.done_cond, &ringid_store.mutex);
+	}
+	if (seq <= ringid_store.stored) {
+		return;
+	}
+
+	start_nsec = qb_util_nano_current_get ();
+	if (corosync_ring_id_file_write (ringid_store.nodeid, seq) == -1) {
+		LOGSYS_PERROR (errno, LOGSYS_LEVEL_ERROR,
+			"Couldn't store new ring id " CS_PRI_RING_ID_SEQ " to stable storage",
+			seq);
+
+		corosync_exit_error (COROSYNC_DONE_STORE_RINGID);
+	}
+	ringid_store.stored = seq;
+	corosync_ring_id_write_account (start_nsec, 1);
+}
+
+void corosync_ringid_store_stats_get (struct ringid_store_stats *stats)
+{
+	pthread_mutex_lock (&ringid_store.mutex);
+	memcpy (stats, &ringid_store.stats, sizeof (struct ringid_store_stats));
+	pthread_mutex_unlock (&ringid_store.mutex);
+}
+
 static void corosync_ring_id_create_or_load (
 	struct memb_ring_id *memb_ring_id,
 	unsigned int nodeid)
@@ -666,23 +896,27 @@ static void corosync_ring_id_create_or_load (
 	 */
 	if ((fd == -1) || (res != sizeof (uint64_t))) {
 		memb_ring_id->seq = 0;
-		fd = creat (filename, 0600);
-		if (fd != -1) {
-			res = write (fd, &memb_ring_id->seq, sizeof (uint64_t));
-			close (fd);
-			if (res == -1) {
-				LOGSYS_PERROR (errno, LOGSYS_LEVEL_ERROR,
-					"Couldn't write ringid file '%s'", filename);
+	}
 
-				corosync_exit_error (COROSYNC_DONE_STORE_RINGID);
-			}
+	/*
+	 * Reserve the first marks before any ring is formed
+	 */
+	pthread_mutex_lock (&ringid_store.mutex);
+	ringid_store.nodeid = nodeid;
+	if (memb_ring_id->seq > ringid_store.stored) {
+		ringid_store.stored = memb_ring_id->seq;
+	}
+	corosync_ring_id_store_sync (memb_ring_id->seq + RINGID_STORE_HEADROOM);
+	if (ringid_store.thread_started == 0) {
+		if (pthread_create (&ringid_store.thread, NULL,
+			corosync_ring_id_writer, NULL) != 0) {
+			log_printf (LOGSYS_LEVEL_WARNING,
+				"Couldn't start ring id writer thread, storing ring ids synchronously");
 		} else {
-			LOGSYS_PERROR (errno, LOGSYS_LEVEL_ERROR,
-				"Couldn't create ringid file '%s'", filename);
-
-			corosync_exit_error (COROSYNC_DONE_STORE_RINGID);
+			ringid_store.thread_started = 1;
 		}
 	}
+	pthread_mutex_unlock (&ringid_store.mutex);
 
 	memb_ring_id->rep = nodeid;
 }
@@ -691,32 +925,28 @@ static void corosync_ring_id_store (
 	const struct memb_ring_id *memb_ring_id,
 	unsigned int nodeid)
 {
-	char filename[PATH_MAX];
-	int fd;
-	int res;
+	uint64_t mark = memb_ring_id->seq + RINGID_STORE_HEADROOM;
 
-	snprintf (filename, sizeof(filename), "%s/ringid_%u",
-		get_state_dir(), nodeid);
-
-	fd = creat (filename, 0600);
-	if (fd == -1) {
-		LOGSYS_PERROR(errno, LOGSYS_LEVEL_ERROR,
-			"Couldn't store new ring id " CS_PRI_RING_ID_SEQ " to stable storage",
-			    memb_ring_id->seq);
-
-		corosync_exit_error (COROSYNC_DONE_STORE_RINGID);
-	}
 	log_printf (LOGSYS_LEVEL_DEBUG,
 		"Storing new sequence id for ring " CS_PRI_RING_ID_SEQ, memb_ring_id->seq);
-	res = write (fd, &memb_ring_id->seq, sizeof(memb_ring_id->seq));
-	close (fd);
-	if (res != sizeof(memb_ring_id->seq)) {
-		LOGSYS_PERROR(errno, LOGSYS_LEVEL_ERROR,
-			"Couldn't store new ring id " CS_PRI_RING_ID_SEQ " to stable storage",
-			memb_ring_id->seq);
 
-		corosync_exit_error (COROSYNC_DONE_STORE_RINGID);
+	pthread_mutex_lock (&ringid_store.mutex);
+	while (memb_ring_id->seq >= ringid_store.stored && ringid_store.writing) {
+		pthread_cond_wait (&ringid_store.done_cond, &ringid_store.mutex);
+	}
+	if (memb_ring_id->seq >= ringid_store.stored ||
+	    ringid_store.thread_started == 0) {
+		corosync_ring_id_store_sync (mark);
+	} else {
+		if (ringid_store.requested != 0) {
+			ringid_store.stats.coalesced++;
+		}
+		if (mark > ringid_store.requested) {
+			ringid_store.requested = mark;
+		}
+		pthread_cond_signal (&ringid_store.cond);
 	}
+	pthread_mutex_unlock (&ringid_store.mutex);
 }
 
 static qb_loop_timer_handle recheck_the_q_level_timer;
@@ -38,6 +38,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stddef.h>
 #include <unistd.h>
 #include <libknet.h>
@@ -71,9 +72,24 @@ static unsigned int highest_schedmiss_event;
 
 #define SCHEDMISS_PREFIX "stats.schedmiss"
 
+#define SRP_LATENCY_PREFIX "stats.srp.latency"
+static const char *srp_latency_names[TOTEM_LATENCY_MAX] = {
+	[TOTEM_LATENCY_QUEUE] = "queue",
+	[TOTEM_LATENCY_ORDER] = "order",
+	[TOTEM_LATENCY_DELIVERY] = "delivery",
+};
+
+#define SRP_LANE_PREFIX "stats.srp.lane"
+static const char *srp_lane_names[TOTEM_LANE_MAX] = {
+	[TOTEM_LANE_NORMAL] = "normal",
+	[TOTEM_LANE_HIGH] = "high",
+};
+
+#define SRP_RECONF_PREFIX "stats.srp.reconf"
+
 /* Convert iterator number to text and a stats pointer */
 struct cs_stats_conv {
-	enum {STAT_PG, STAT_SRP, STAT_KNET, STAT_KNET_HANDLE, STAT_IPCSC, STAT_IPCSG, STAT_SCHEDMISS} type;
+	enum {STAT_PG, STAT_SRP, STAT_KNET, STAT_KNET_HANDLE, STAT_IPCSC, STAT_IPCSG, STAT_SCHEDMISS, STAT_SRP_LATENCY, STAT_SRP_LANE, STAT_SRP_RECONF, STAT_RINGID} type;
 	const char *name;
 	const size_t offset;
 	const icmap_value_types_t value_type;
@@ -82,6 +98,33 @@ struct cs_stats_conv {
 struct cs_stats_conv cs_pg_stats[] = {
 	{ STAT_PG, "msg_queue_avail",         offsetof(totempg_stats_t, msg_queue_avail),         ICMAP_VALUETYPE_UINT32},
 	{ STAT_PG, "msg_reserved",            offsetof(totempg_stats_t, msg_reserved),            ICMAP_VALUETYPE_UINT32},
+	{ STAT_PG, "fragment_copy_bytes",     offsetof(totempg_stats_t, fragment_copy_bytes),     ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "mcast_copy_bytes",        offsetof(totempg_stats_t, mcast_copy_bytes),        ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "mcast_msgs",              offsetof(totempg_stats_t, mcast_msgs),              ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "mcast_frames",            offsetof(totempg_stats_t, mcast_frames),            ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "coalesce_deferred",       offsetof(totempg_stats_t, coalesce_deferred),       ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "coalesce_delay_us_avg",   offsetof(totempg_stats_t, coalesce_delay_us_avg),   ICMAP_VALUETYPE_UINT32},
+	{ STAT_PG, "coalesce_delay_us_max",   offsetof(totempg_stats_t, coalesce_delay_us_max),   ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "payload_tx",              offsetof(totempg_stats_t, payload_tx),              ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "payload_rx",              offsetof(totempg_stats_t, payload_rx),              ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "payload_stalled",         offsetof(totempg_stats_t, payload_stalled),         ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "payload_dropped",         offsetof(totempg_stats_t, payload_dropped),         ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "payload_chunk_tx",        offsetof(totempg_stats_t, payload_chunk_tx),        ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "payload_chunk_rx",        offsetof(totempg_stats_t, payload_chunk_rx),        ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "payload_chunk_retx",      offsetof(totempg_stats_t, payload_chunk_retx),      ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "payload_nack_tx",         offsetof(totempg_stats_t, payload_nack_tx),         ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "payload_hold_us_max",     offsetof(totempg_stats_t, payload_hold_us_max),     ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "payload_held",            offsetof(totempg_stats_t, payload_held),            ICMAP_VALUETYPE_UINT32},
+	{ STAT_PG, "assembly_bytes",          offsetof(totempg_stats_t, assembly_bytes),          ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "assembly_bytes_max",      offsetof(totempg_stats_t, assembly_bytes_max),      ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "assembly_in_use",         offsetof(totempg_stats_t, assembly_in_use),         ICMAP_VALUETYPE_UINT32},
+	{ STAT_PG, "compress_tx",             offsetof(totempg_stats_t, compress_tx),             ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "compress_rx",             offsetof(totempg_stats_t, compress_rx),             ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "compress_bytes_saved",    offsetof(totempg_stats_t, compress_bytes_saved),    ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "compress_incompressible", offsetof(totempg_stats_t, compress_incompressible), ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "compress_errors",         offsetof(totempg_stats_t, compress_errors),         ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "compress_cpu_us",         offsetof(totempg_stats_t, compress_cpu_us),         ICMAP_VALUETYPE_UINT64},
+	{ STAT_PG, "decompress_cpu_us",       offsetof(totempg_stats_t, decompress_cpu_us),       ICMAP_VALUETYPE_UINT64},
 };
 struct cs_stats_conv cs_srp_stats[] = {
 	{ STAT_SRP, "orf_token_tx",           offsetof(totemsrp_stats_t, orf_token_tx),           ICMAP_VALUETYPE_UINT64},
@@ -92,6 +135,8 @@ struct cs_stats_conv cs_srp_stats[] = {
 	{ STAT_SRP, "memb_join_rx",           offsetof(totemsrp_stats_t, memb_join_rx),           ICMAP_VALUETYPE_UINT64},
 	{ STAT_SRP, "mcast_tx",               offsetof(totemsrp_stats_t, mcast_tx),               ICMAP_VALUETYPE_UINT64},
 	{ STAT_SRP, "mcast_retx",             offsetof(totemsrp_stats_t, mcast_retx),             ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "mcast_retx_ranges",      offsetof(totemsrp_stats_t, mcast_retx_ranges),      ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "rtr_ranges_dropped",     offsetof(totemsrp_stats_t, rtr_ranges_dropped),     ICMAP_VALUETYPE_UINT64},
 	{ STAT_SRP, "mcast_rx",               offsetof(totemsrp_stats_t, mcast_rx),               ICMAP_VALUETYPE_UINT64},
 	{ STAT_SRP, "memb_commit_token_tx",   offsetof(totemsrp_stats_t, memb_commit_token_tx),   ICMAP_VALUETYPE_UINT64},
 	{ STAT_SRP, "memb_commit_token_rx",   offsetof(totemsrp_stats_t, memb_commit_token_rx),   ICMAP_VALUETYPE_UINT64},
@@ -107,13 +152,43 @@ struct cs_stats_conv cs_srp_stats[] = {
 	{ STAT_SRP, "recovery_token_lost",    offsetof(totemsrp_stats_t, recovery_token_lost),    ICMAP_VALUETYPE_UINT64},
 	{ STAT_SRP, "consensus_timeouts",     offsetof(totemsrp_stats_t, consensus_timeouts),     ICMAP_VALUETYPE_UINT64},
 	{ STAT_SRP, "rx_msg_dropped",         offsetof(totemsrp_stats_t, rx_msg_dropped),         ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "endian_conversions",     offsetof(totemsrp_stats_t, endian_conversions),     ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "rtr_pending_rotations",  offsetof(totemsrp_stats_t, rtr_pending_rotations),  ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "mcast_tx_copy_bytes",    offsetof(totemsrp_stats_t, mcast_tx_copy_bytes),    ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "mcast_tx_zerocopy",      offsetof(totemsrp_stats_t, mcast_tx_zerocopy),      ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "fcc_window_increases",   offsetof(totemsrp_stats_t, fcc_window_increases),   ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "fcc_window_decreases",   offsetof(totemsrp_stats_t, fcc_window_decreases),   ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "mcast_fec_tx",           offsetof(totemsrp_stats_t, mcast_fec_tx),           ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "mcast_fec_rx",           offsetof(totemsrp_stats_t, mcast_fec_rx),           ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "mcast_fec_recovered",    offsetof(totemsrp_stats_t, mcast_fec_recovered),    ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "mcast_rtr_recovered",    offsetof(totemsrp_stats_t, mcast_rtr_recovered),    ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "lane_normal_deferred",   offsetof(totemsrp_stats_t, lane_normal_deferred),   ICMAP_VALUETYPE_UINT64},
 	{ STAT_SRP, "time_since_token_last_received", offsetof(totemsrp_stats_t, time_since_token_last_received), ICMAP_VALUETYPE_UINT64},
 	{ STAT_SRP, "continuous_gather",      offsetof(totemsrp_stats_t, continuous_gather),      ICMAP_VALUETYPE_UINT32},
 	{ STAT_SRP, "continuous_sendmsg_failures", offsetof(totemsrp_stats_t, continuous_sendmsg_failures), ICMAP_VALUETYPE_UINT32},
 	{ STAT_SRP, "firewall_enabled_or_nic_failure", offsetof(totemsrp_stats_t, firewall_enabled_or_nic_failure), ICMAP_VALUETYPE_UINT8},
 	{ STAT_SRP, "mtt_rx_token",           offsetof(totemsrp_stats_t, mtt_rx_token),           ICMAP_VALUETYPE_UINT32},
+	{ STAT_SRP, "token_interval_mean_us",   offsetof(totemsrp_stats_t, token_interval_mean_us),   ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "token_interval_stddev_us", offsetof(totemsrp_stats_t, token_interval_stddev_us), ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "token_timeout_effective",  offsetof(totemsrp_stats_t, token_timeout_effective),  ICMAP_VALUETYPE_UINT32},
+	{ STAT_SRP, "token_phi",                offsetof(totemsrp_stats_t, token_phi),                ICMAP_VALUETYPE_FLOAT},
+	{ STAT_SRP, "token_adaptive_lost",      offsetof(totemsrp_stats_t, token_adaptive_lost),      ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "token_hold_idle",          offsetof(totemsrp_stats_t, token_hold_idle),          ICMAP_VALUETYPE_UINT32},
 	{ STAT_SRP, "avg_token_workload",     offsetof(totemsrp_stats_t, avg_token_workload),     ICMAP_VALUETYPE_UINT32},
 	{ STAT_SRP, "avg_backlog_calc",       offsetof(totemsrp_stats_t, avg_backlog_calc),       ICMAP_VALUETYPE_UINT32},
+	{ STAT_SRP, "fcc_window_size",        offsetof(totemsrp_stats_t, fcc_window_size),        ICMAP_VALUETYPE_UINT32},
+	{ STAT_SRP, "fcc_max_messages",       offsetof(totemsrp_stats_t, fcc_max_messages),       ICMAP_VALUETYPE_UINT32},
+	{ STAT_SRP, "avg_fcc_window_size",    offsetof(totemsrp_stats_t, avg_fcc_window_size),    ICMAP_VALUETYPE_UINT32},
+	{ STAT_SRP, "min_fcc_window_size",    offsetof(totemsrp_stats_t, min_fcc_window_size),    ICMAP_VALUETYPE_UINT32},
+	{ STAT_SRP, "max_fcc_window_size",    offsetof(totemsrp_stats_t, max_fcc_window_size),    ICMAP_VALUETYPE_UINT32},
+	{ STAT_SRP, "sort_queue_size",        offsetof(totemsrp_stats_t, sort_queue_size),        ICMAP_VALUETYPE_UINT32},
+	{ STAT_SRP, "sort_queue_bytes",       offsetof(totemsrp_stats_t, sort_queue_bytes),       ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "sort_queue_full",        offsetof(totemsrp_stats_t, sort_queue_full),        ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "buffer_pool_hits",       offsetof(totemsrp_stats_t, buffer_pool_hits),       ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "buffer_alloc_failures",  offsetof(totemsrp_stats_t, buffer_alloc_failures),  ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP, "buffer_pool_free",       offsetof(totemsrp_stats_t, buffer_pool_free),       ICMAP_VALUETYPE_UINT32},
+	{ STAT_SRP, "buffers_in_use",         offsetof(totemsrp_stats_t, buffers_in_use),         ICMAP_VALUETYPE_UINT32},
+	{ STAT_SRP, "buffers_in_use_max",     offsetof(totemsrp_stats_t, buffers_in_use_max),     ICMAP_VALUETYPE_UINT32},
 };
 
 struct cs_stats_conv cs_knet_stats[] = {
@@ -201,6 +276,48 @@ struct cs_stats_conv cs_ipcs_global_stats[] = {
 	{ STAT_IPCSG, "global.active",        offsetof(struct ipcs_global_stats, active),           ICMAP_VALUETYPE_UINT64},
 	{ STAT_IPCSG, "global.closed",        offsetof(struct ipcs_global_stats, closed),           ICMAP_VALUETYPE_UINT64},
 };
+struct cs_stats_conv cs_srp_latency_stats[] = {
+	{ STAT_SRP_LATENCY, "count",      offsetof(totemsrp_latency_stats_t, count),      ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP_LATENCY, "sum_us",     offsetof(totemsrp_latency_stats_t, sum_us),     ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP_LATENCY, "max_us",     offsetof(totemsrp_latency_stats_t, max_us),     ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP_LATENCY, "p50_us",     offsetof(totemsrp_latency_stats_t, p50_us),     ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP_LATENCY, "p90_us",     offsetof(totemsrp_latency_stats_t, p90_us),     ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP_LATENCY, "p99_us",     offsetof(totemsrp_latency_stats_t, p99_us),     ICMAP_VALUETYPE_UINT64},
+};
+/* One entry shared by all buckets, the offset is adjusted by the bucket index */
+struct cs_stats_conv cs_srp_latency_bucket_stats =
+	{ STAT_SRP_LATENCY, "bucket",     offsetof(totemsrp_latency_stats_t, bucket),     ICMAP_VALUETYPE_UINT64};
+struct cs_stats_conv cs_srp_lane_stats[] = {
+	{ STAT_SRP_LANE, "mcast_tx",         offsetof(totemsrp_lane_stats_t, mcast_tx),         ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP_LANE, "wait_sum_us",      offsetof(totemsrp_lane_stats_t, wait_sum_us),      ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP_LANE, "wait_max_us",      offsetof(totemsrp_lane_stats_t, wait_max_us),      ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP_LANE, "queue_depth",      offsetof(totemsrp_lane_stats_t, queue_depth),      ICMAP_VALUETYPE_UINT32},
+	{ STAT_SRP_LANE, "queue_depth_max",  offsetof(totemsrp_lane_stats_t, queue_depth_max),  ICMAP_VALUETYPE_UINT32},
+};
+struct cs_stats_conv cs_srp_reconf_stats[] = {
+	{ STAT_SRP_RECONF, "ring_seq",        offsetof(totemsrp_reconf_stats_t, ring_seq),        ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP_RECONF, "ring_rep",        offsetof(totemsrp_reconf_stats_t, ring_rep),        ICMAP_VALUETYPE_UINT32},
+	{ STAT_SRP_RECONF, "members",         offsetof(totemsrp_reconf_stats_t, members),         ICMAP_VALUETYPE_UINT32},
+	{ STAT_SRP_RECONF, "gather_entered",  offsetof(totemsrp_reconf_stats_t, gather_entered),  ICMAP_VALUETYPE_UINT32},
+	{ STAT_SRP_RECONF, "duration_us",     offsetof(totemsrp_reconf_stats_t, duration_us),     ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP_RECONF, "token_lost_us",   offsetof(totemsrp_reconf_stats_t, timestamp_us[TOTEM_RECONF_TOKEN_LOST]),  ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP_RECONF, "gather_us",       offsetof(totemsrp_reconf_stats_t, timestamp_us[TOTEM_RECONF_GATHER]),      ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP_RECONF, "consensus_us",    offsetof(totemsrp_reconf_stats_t, timestamp_us[TOTEM_RECONF_CONSENSUS]),   ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP_RECONF, "commit_us",       offsetof(totemsrp_reconf_stats_t, timestamp_us[TOTEM_RECONF_COMMIT]),      ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP_RECONF, "recovery_us",     offsetof(totemsrp_reconf_stats_t, timestamp_us[TOTEM_RECONF_RECOVERY]),    ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP_RECONF, "operational_us",  offsetof(totemsrp_reconf_stats_t, timestamp_us[TOTEM_RECONF_OPERATIONAL]), ICMAP_VALUETYPE_UINT64},
+	{ STAT_SRP_RECONF, "sync_done_us",    offsetof(totemsrp_reconf_stats_t, timestamp_us[TOTEM_RECONF_SYNC_DONE]),   ICMAP_VALUETYPE_UINT64},
+};
+struct cs_stats_conv cs_ringid_stats[] = {
+	{ STAT_RINGID, "writes",          offsetof(struct ringid_store_stats, writes),          ICMAP_VALUETYPE_UINT64},
+	{ STAT_RINGID, "sync_writes",     offsetof(struct ringid_store_stats, sync_writes),     ICMAP_VALUETYPE_UINT64},
+	{ STAT_RINGID, "coalesced",       offsetof(struct ringid_store_stats, coalesced),       ICMAP_VALUETYPE_UINT64},
+	{ STAT_RINGID, "write_errors",    offsetof(struct ringid_store_stats, write_errors),    ICMAP_VALUETYPE_UINT64},
+	{ STAT_RINGID, "write_last_us",   offsetof(struct ringid_store_stats, write_last_us),   ICMAP_VALUETYPE_UINT64},
+	{ STAT_RINGID, "write_max_us",    offsetof(struct ringid_store_stats, write_max_us),    ICMAP_VALUETYPE_UINT64},
+	{ STAT_RINGID, "write_sum_us",    offsetof(struct ringid_store_stats, write_sum_us),    ICMAP_VALUETYPE_UINT64},
+	{ STAT_RINGID, "stored_seq",      offsetof(struct ringid_store_stats, stored_seq),      ICMAP_VALUETYPE_UINT64},
+};
 struct cs_stats_conv cs_schedmiss_stats[] = {
 	{ STAT_SCHEDMISS, "timestamp",    offsetof(struct schedmiss_entry, timestamp), ICMAP_VALUETYPE_UINT64},
 	{ STAT_SCHEDMISS, "delay",        offsetof(struct schedmiss_entry, delay),     ICMAP_VALUETYPE_FLOAT},
@@ -212,6 +329,10 @@ struct cs_stats_conv cs_schedmiss_stats[] = {
 #define NUM_KNET_HANDLE_STATS (sizeof(cs_knet_handle_stats) / sizeof(struct cs_stats_conv))
 #define NUM_IPCSC_STATS (sizeof(cs_ipcs_conn_stats) / sizeof(struct cs_stats_conv))
 #define NUM_IPCSG_STATS (sizeof(cs_ipcs_global_stats) / sizeof(struct cs_stats_conv))
+#define NUM_SRP_LATENCY_STATS (sizeof(cs_srp_latency_stats) / sizeof(struct cs_stats_conv))
+#define NUM_SRP_LANE_STATS (sizeof(cs_srp_lane_stats) / sizeof(struct cs_stats_conv))
+#define NUM_SRP_RECONF_STATS (sizeof(cs_srp_reconf_stats) / sizeof(struct cs_stats_conv))
+#define NUM_RINGID_STATS (sizeof(cs_ringid_stats) / sizeof(struct cs_stats_conv))
 
 /* What goes in the trie */
 struct stats_item {
@@ -288,7 +409,7 @@ static void stats_map_free_cb(uint32_t event,
 
 cs_error_t stats_map_init(const struct corosync_api_v1 *corosync_api)
 {
-	int i;
+	int i, j;
 	char param[ICMAP_KEYNAME_MAXLEN];
 	int32_t err;
 
@@ -312,6 +433,36 @@ cs_error_t stats_map_init(const struct corosync_api_v1 *corosync_api)
 		sprintf(param, "stats.ipcs.%s", cs_ipcs_global_stats[i].name);
 		stats_add_entry(param, &cs_ipcs_global_stats[i]);
 	}
+	for (i = 0; i<TOTEM_LATENCY_MAX; i++) {
+		for (j = 0; j<NUM_SRP_LATENCY_STATS; j++) {
+			sprintf(param, SRP_LATENCY_PREFIX ".%s.%s", srp_latency_names[i],
+			    cs_srp_latency_stats[j].name);
+			stats_add_entry(param, &cs_srp_latency_stats[j]);
+		}
+		for (j = 0; j<TOTEM_LATENCY_BUCKETS; j++) {
+			sprintf(param, SRP_LATENCY_PREFIX ".%s.bucket.%"PRIu64, srp_latency_names[i],
+			    totem_latency_bucket_lower(j));
+			stats_add_entry(param, &cs_srp_latency_bucket_stats);
+		}
+	}
+	for (i = 0; i<TOTEM_LANE_MAX; i++) {
+		for (j = 0; j<NUM_SRP_LANE_STATS; j++) {
+			sprintf(param, SRP_LANE_PREFIX ".%s.%s", srp_lane_names[i],
+			    cs_srp_lane_stats[j].name);
+			stats_add_entry(param, &cs_srp_lane_stats[j]);
+		}
+	}
+	for (i = 0; i<NUM_RINGID_STATS; i++) {
+		sprintf(param, "stats.ringid.%s", cs_ringid_stats[i].name);
+		stats_add_entry(param, &cs_ringid_stats[i]);
+	}
+	for (i = 0; i<TOTEM_RECONF_HISTORY_MAX; i++) {
+		for (j = 0; j<NUM_SRP_RECONF_STATS; j++) {
+			sprintf(param, SRP_RECONF_PREFIX ".%d.%s", i,
+			    cs_srp_reconf_stats[j].name);
+			stats_add_entry(param, &cs_srp_reconf_stats[j]);
+		}
+	}
 
 	/* KNET, IPCS & SCHEDMISS stats are added when appropriate */
 
@@ -342,6 +493,15 @@ cs_error_t stats_map_get(const char *key_name,
 	unsigned int sm_event;
 	char *sm_type;
 	void *conn_ptr;
+	char latency_name[ICMAP_KEYNAME_MAXLEN];
+	totemsrp_latency_stats_t *latency;
+	uint64_t bucket_lower;
+	int latency_type;
+	char lane_name[ICMAP_KEYNAME_MAXLEN];
+	int lane;
+	totemsrp_reconf_stats_t empty_reconf;
+	struct ringid_store_stats ringid_stats;
+	int reconf_index;
 
 	item = qb_map_get(stats_map, key_name);
 	if (!item) {
@@ -419,6 +579,70 @@ cs_error_t stats_map_get(const char *key_name,
 				*type = ICMAP_VALUETYPE_FLOAT;
 			}
 			break;
+		case STAT_SRP_LATENCY:
+			if (sscanf(key_name, SRP_LATENCY_PREFIX ".%[^.]", latency_name) != 1) {
+				return CS_ERR_NOT_EXIST;
+			}
+			for (latency_type = 0; latency_type < TOTEM_LATENCY_MAX; latency_type++) {
+				if (strcmp(latency_name, srp_latency_names[latency_type]) == 0) {
+					break;
+				}
+			}
+			if (latency_type == TOTEM_LATENCY_MAX) {
+				return CS_ERR_NOT_EXIST;
+			}
+			pg_stats = api->totem_get_stats();
+			latency = &pg_stats->srp->latency[latency_type];
+
+			if (statinfo == &cs_srp_latency_bucket_stats) {
+				sm_type = strrchr(key_name, '.');
+				if (sm_type == NULL ||
+				    sscanf(sm_type + 1, "%"SCNu64, &bucket_lower) != 1) {
+					return CS_ERR_NOT_EXIST;
+				}
+				/* Point stat_array at the bucket so the shared offset applies */
+				stats_map_set_value(statinfo,
+				    (char *)latency + totem_latency_bucket(bucket_lower) * sizeof(uint64_t),
+				    value, value_len, type);
+			} else {
+				stats_map_set_value(statinfo, latency, value, value_len, type);
+			}
+			break;
+		case STAT_SRP_LANE:
+			if (sscanf(key_name, SRP_LANE_PREFIX ".%[^.]", lane_name) != 1) {
+				return CS_ERR_NOT_EXIST;
+			}
+			for (lane = 0; lane < TOTEM_LANE_MAX; lane++) {
+				if (strcmp(lane_name, srp_lane_names[lane]) == 0) {
+					break;
+				}
+			}
+			if (lane == TOTEM_LANE_MAX) {
+				return CS_ERR_NOT_EXIST;
+			}
+			pg_stats = api->totem_get_stats();
+			stats_map_set_value(statinfo, &pg_stats->srp->lane[lane], value, value_len, type);
+			break;
+		case STAT_RINGID:
+			corosync_ringid_store_stats_get(&ringid_stats);
+			stats_map_set_value(statinfo, &ringid_stats, value, value_len, type);
+			break;
+		case STAT_SRP_RECONF:
+			/* 0 is the latest reconfiguration, like for schedmiss */
+			if (sscanf(key_name, SRP_RECONF_PREFIX ".%d", &reconf_index) != 1 ||
+			    reconf_index < 0 || reconf_index >= TOTEM_RECONF_HISTORY_MAX) {
+				return CS_ERR_NOT_EXIST;
+			}
+			pg_stats = api->totem_get_stats();
+			if ((uint32_t)reconf_index >= pg_stats->srp->reconf_entries) {
+				memset(&empty_reconf, 0, sizeof(empty_reconf));
+				stats_map_set_value(statinfo, &empty_reconf, value, value_len, type);
+				break;
+			}
+			reconf_index = (pg_stats->srp->reconf_latest + TOTEM_RECONF_HISTORY_MAX - reconf_index) %
+			    TOTEM_RECONF_HISTORY_MAX;
+			stats_map_set_value(statinfo, &pg_stats->srp->reconf[reconf_index], value, value_len, type);
+			break;
 		default:
 			return CS_ERR_LIBRARY;
 	}
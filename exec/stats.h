@@ -71,3 +71,16 @@ void stats_ipcs_del_connection(int service_id, uint32_t pid, void *ptr);
 cs_error_t cs_ipcs_get_conn_stats(int service_id, uint32_t pid, void *conn_ptr, struct ipcs_conn_stats *ipcs_stats);
 
 void stats_add_schedmiss_event(uint64_t, float delay);
+
+struct ringid_store_stats {
+	uint64_t writes;
+	uint64_t sync_writes;	/* done on the main thread */
+	uint64_t coalesced;	/* requests merged into a later write */
+	uint64_t write_errors;
+	uint64_t write_last_us;
+	uint64_t write_max_us;
+	uint64_t write_sum_us;
+	uint64_t stored_seq;	/* mark on stable storage */
+};
+
+void corosync_ringid_store_stats_get(struct ringid_store_stats *stats);
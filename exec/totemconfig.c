@@ -69,6 +69,9 @@
 #define TOKEN_TIMEOUT				3000
 #define TOKEN_WARNING				75
 #define TOKEN_COEFFICIENT			650
+#define TOKEN_ADAPTIVE				0
+#define TOKEN_PHI_THRESHOLD			8
+#define TOKEN_PHI_THRESHOLD_MAX			30
 #define JOIN_TIMEOUT				50
 #define MERGE_TIMEOUT				200
 #define DOWNCHECK_TIMEOUT			1000
@@ -79,9 +82,34 @@
 #define MAX_NETWORK_DELAY			50
 #define WINDOW_SIZE				50
 #define MAX_MESSAGES				17
+#define WINDOW_SIZE_ADAPTIVE			0
+#define WINDOW_SIZE_MIN				10
+#define WINDOW_SIZE_MAX				300
+#define WINDOW_SIZE_LIMIT			8192
+#define WINDOW_SIZE_MIN_LIMIT			1
+#define SORT_QUEUE_BYTES			(64 * 1024 * 1024)
+#define SORT_QUEUE_BYTES_MIN			(1024 * 1024)
+#define FEC_GROUP_SIZE				0
+#define SIDE_CHANNEL_THRESHOLD			0
+#define SIDE_CHANNEL_THRESHOLD_MIN		(16 * 1024)
+#define BUFFER_POOL_SIZE			128
+#define BUFFER_POOL_SIZE_MAX			65536
+#define BUFFER_POOL_PREFILL			0
+#define TOKEN_HOLD_IDLE_MAX			0
+#define TOKEN_HOLD_IDLE_MAX_LIMIT		60000
+#define COALESCE_DELAY				0
+#define COALESCE_DELAY_MAX			100000
+#define COALESCE_BYTES				0
+#define COMPRESSION_THRESHOLD			4096
+#define COMPRESSION_THRESHOLD_MIN		128
+#define COMPRESSION_LEVEL			1
+#define COMPRESSION_LEVEL_MIN			1
+#define COMPRESSION_LEVEL_MAX			9
 #define MISS_COUNT_CONST			5
 #define BLOCK_UNLISTED_IPS			1
 #define CANCEL_TOKEN_HOLD_ON_RETRANSMIT		0
+#define RETRANSMIT_RANGES			1
+#define PRIORITY_LANES				0
 /* This constant is not used for knet */
 #define UDP_NETMTU                              1500
 
@@ -106,6 +134,10 @@ static void *totem_get_param_by_name(struct totem_config *totem_config, const ch
 		return &totem_config->token_timeout;
 	if (strcmp(param_name, "totem.token_warning") == 0)
 		return &totem_config->token_warning;
+	if (strcmp(param_name, "totem.token_adaptive") == 0)
+		return &totem_config->token_adaptive;
+	if (strcmp(param_name, "totem.token_phi_threshold") == 0)
+		return &totem_config->token_phi_threshold;
 	if (strcmp(param_name, "totem.token_retransmit") == 0)
 		return &totem_config->token_retransmit_timeout;
 	if (strcmp(param_name, "totem.hold") == 0)
@@ -134,8 +166,36 @@ static void *totem_get_param_by_name(struct totem_config *totem_config, const ch
 		return &totem_config->window_size;
 	if (strcmp(param_name, "totem.max_messages") == 0)
 		return &totem_config->max_messages;
+	if (strcmp(param_name, "totem.window_size_adaptive") == 0)
+		return &totem_config->window_size_adaptive;
+	if (strcmp(param_name, "totem.window_size_min") == 0)
+		return &totem_config->window_size_min;
+	if (strcmp(param_name, "totem.window_size_max") == 0)
+		return &totem_config->window_size_max;
 	if (strcmp(param_name, "totem.miss_count_const") == 0)
 		return &totem_config->miss_count_const;
+	if (strcmp(param_name, "totem.sort_queue_bytes") == 0)
+		return &totem_config->sort_queue_bytes;
+	if (strcmp(param_name, "totem.fec_group_size") == 0)
+		return &totem_config->fec_group_size;
+	if (strcmp(param_name, "totem.side_channel_threshold") == 0)
+		return &totem_config->side_channel_threshold;
+	if (strcmp(param_name, "totem.buffer_pool_size") == 0)
+		return &totem_config->buffer_pool_size;
+	if (strcmp(param_name, "totem.buffer_pool_prefill") == 0)
+		return &totem_config->buffer_pool_prefill;
+	if (strcmp(param_name, "totem.token_hold_idle_max") == 0)
+		return &totem_config->token_hold_idle_max;
+	if (strcmp(param_name, "totem.coalesce_delay") == 0)
+		return &totem_config->coalesce_delay;
+	if (strcmp(param_name, "totem.coalesce_bytes") == 0)
+		return &totem_config->coalesce_bytes;
+	if (strcmp(param_name, "totem.compression_model") == 0)
+		return totem_config->compression_model;
+	if (strcmp(param_name, "totem.compression_threshold") == 0)
+		return &totem_config->compression_threshold;
+	if (strcmp(param_name, "totem.compression_level") == 0)
+		return &totem_config->compression_level;
 	if (strcmp(param_name, "totem.knet_pmtud_interval") == 0)
 		return &totem_config->knet_pmtud_interval;
 	if (strcmp(param_name, "totem.knet_mtu") == 0)
@@ -150,6 +210,10 @@ static void *totem_get_param_by_name(struct totem_config *totem_config, const ch
 		return &totem_config->block_unlisted_ips;
 	if (strcmp(param_name, "totem.cancel_token_hold_on_retransmit") == 0)
 		return &totem_config->cancel_token_hold_on_retransmit;
+	if (strcmp(param_name, "totem.retransmit_ranges") == 0)
+		return &totem_config->retransmit_ranges;
+	if (strcmp(param_name, "totem.priority_lanes") == 0)
+		return &totem_config->priority_lanes;
 
 	return NULL;
 }
@@ -319,9 +383,11 @@ void totem_volatile_config_read (struct totem_config *totem_config, icmap_map_t
 
 	totem_volatile_config_set_uint32_value(totem_config, temp_map, "totem.token_warning", deleted_key, TOKEN_WARNING, 1);
 
+	u32 = TOKEN_COEFFICIENT;
+	icmap_get_uint32_r(temp_map, "totem.token_coefficient", &u32);
+	totem_config->token_coefficient = u32;
+
 	if (totem_config->interfaces[0].member_count > 2) {
-		u32 = TOKEN_COEFFICIENT;
-		icmap_get_uint32_r(temp_map, "totem.token_coefficient", &u32);
 		totem_config->token_timeout += (totem_config->interfaces[0].member_count - 2) * u32;
 
 		/*
@@ -330,13 +396,48 @@ void totem_volatile_config_read (struct totem_config *totem_config, icmap_map_t
 		icmap_set_uint32_r(temp_map, "runtime.config.totem.token", totem_config->token_timeout);
 	}
 
+	totem_volatile_config_set_boolean_value(totem_config, temp_map, "totem.token_adaptive", deleted_key,
+	    TOKEN_ADAPTIVE);
+
+	totem_volatile_config_set_uint32_value(totem_config, temp_map, "totem.token_phi_threshold", deleted_key,
+	    TOKEN_PHI_THRESHOLD, 0);
+
 	totem_volatile_config_set_uint32_value(totem_config, temp_map, "totem.max_network_delay", deleted_key, MAX_NETWORK_DELAY, 0);
 
 	totem_volatile_config_set_uint32_value(totem_config, temp_map, "totem.window_size", deleted_key, WINDOW_SIZE, 0);
 
 	totem_volatile_config_set_uint32_value(totem_config, temp_map, "totem.max_messages", deleted_key, MAX_MESSAGES, 0);
 
+	totem_volatile_config_set_boolean_value(totem_config, temp_map, "totem.window_size_adaptive", deleted_key,
+	    WINDOW_SIZE_ADAPTIVE);
+
+	totem_volatile_config_set_uint32_value(totem_config, temp_map, "totem.window_size_min", deleted_key,
+	    WINDOW_SIZE_MIN, 0);
+
+	totem_volatile_config_set_uint32_value(totem_config, temp_map, "totem.window_size_max", deleted_key,
+	    WINDOW_SIZE_MAX, 0);
+
 	totem_volatile_config_set_uint32_value(totem_config, temp_map, "totem.miss_count_const", deleted_key, MISS_COUNT_CONST, 0);
+	totem_volatile_config_set_uint32_value(totem_config, temp_map, "totem.sort_queue_bytes", deleted_key,
+	    SORT_QUEUE_BYTES, 0);
+	totem_volatile_config_set_uint32_value(totem_config, temp_map, "totem.fec_group_size", deleted_key,
+	    FEC_GROUP_SIZE, 1);
+	totem_volatile_config_set_uint32_value(totem_config, temp_map, "totem.side_channel_threshold", deleted_key,
+	    SIDE_CHANNEL_THRESHOLD, 1);
+	totem_volatile_config_set_uint32_value(totem_config, temp_map, "totem.buffer_pool_size", deleted_key,
+	    BUFFER_POOL_SIZE, 1);
+	totem_volatile_config_set_boolean_value(totem_config, temp_map, "totem.buffer_pool_prefill", deleted_key,
+	    BUFFER_POOL_PREFILL);
+	totem_volatile_config_set_uint32_value(totem_config, temp_map, "totem.coalesce_delay", deleted_key,
+	    COALESCE_DELAY, 1);
+	totem_volatile_config_set_uint32_value(totem_config, temp_map, "totem.coalesce_bytes", deleted_key,
+	    COALESCE_BYTES, 1);
+	totem_volatile_config_set_string_value(totem_config, temp_map, "totem.compression_model", deleted_key,
+	    "none");
+	totem_volatile_config_set_uint32_value(totem_config, temp_map, "totem.compression_threshold", deleted_key,
+	    COMPRESSION_THRESHOLD, 0);
+	totem_volatile_config_set_uint32_value(totem_config, temp_map, "totem.compression_level", deleted_key,
+	    COMPRESSION_LEVEL, 0);
 	totem_volatile_config_set_uint32_value(totem_config, temp_map, "totem.knet_pmtud_interval", deleted_key, KNET_PMTUD_INTERVAL, 0);
 	totem_volatile_config_set_uint32_value(totem_config, temp_map, "totem.knet_mtu", deleted_key, KNET_MTU, 0);
 
@@ -346,6 +447,9 @@ void totem_volatile_config_read (struct totem_config *totem_config, icmap_map_t
 	totem_volatile_config_set_uint32_value(totem_config, temp_map, "totem.hold", deleted_key,
 	    (int)(totem_config->token_retransmit_timeout * 0.8 - (1000/HZ)), 0);
 
+	totem_volatile_config_set_uint32_value(totem_config, temp_map, "totem.token_hold_idle_max", deleted_key,
+	    TOKEN_HOLD_IDLE_MAX, 1);
+
 	totem_volatile_config_set_uint32_value(totem_config, temp_map, "totem.join", deleted_key, JOIN_TIMEOUT, 0);
 
 	totem_volatile_config_set_uint32_value(totem_config, temp_map, "totem.consensus", deleted_key,
@@ -375,6 +479,12 @@ void totem_volatile_config_read (struct totem_config *totem_config, icmap_map_t
 
 	totem_volatile_config_set_boolean_value(totem_config, temp_map, "totem.cancel_token_hold_on_retransmit",
 	    deleted_key, CANCEL_TOKEN_HOLD_ON_RETRANSMIT);
+
+	totem_volatile_config_set_boolean_value(totem_config, temp_map, "totem.retransmit_ranges",
+	    deleted_key, RETRANSMIT_RANGES);
+
+	totem_volatile_config_set_boolean_value(totem_config, temp_map, "totem.priority_lanes",
+	    deleted_key, PRIORITY_LANES);
 }
 
 int totem_volatile_config_validate (
@@ -413,6 +523,14 @@ int totem_volatile_config_validate (
 		goto parse_error;
 	}
 
+	if (totem_config->token_phi_threshold < 1 ||
+	    totem_config->token_phi_threshold > TOKEN_PHI_THRESHOLD_MAX) {
+		snprintf (local_error_reason, sizeof(local_error_reason),
+			"The token_phi_threshold parameter (%d) must be between 1 and %d.",
+			totem_config->token_phi_threshold, TOKEN_PHI_THRESHOLD_MAX);
+		goto parse_error;
+	}
+
 	if (totem_config->token_retransmit_timeout < MINIMUM_TIMEOUT) {
 		if (icmap_get_uint32_r(temp_map, "totem.token_retransmit", &tmp_config_value) == CS_OK) {
 			snprintf (local_error_reason, sizeof(local_error_reason),
@@ -433,6 +551,15 @@ int totem_volatile_config_validate (
 		goto parse_error;
 	}
 
+	if (totem_config->token_hold_idle_max != 0 &&
+	    (totem_config->token_hold_idle_max < totem_config->token_hold_timeout ||
+	     totem_config->token_hold_idle_max > TOKEN_HOLD_IDLE_MAX_LIMIT)) {
+		snprintf (local_error_reason, sizeof(local_error_reason),
+			"The token_hold_idle_max parameter (%d ms) must be 0 (disabled) or between the token hold timeout (%d ms) and %d ms.",
+			totem_config->token_hold_idle_max, totem_config->token_hold_timeout, TOKEN_HOLD_IDLE_MAX_LIMIT);
+		goto parse_error;
+	}
+
 	if (totem_config->join_timeout < MINIMUM_TIMEOUT) {
 		snprintf (local_error_reason, sizeof(local_error_reason),
 			"The join timeout parameter (%d ms) may not be less than (%d ms).",
@@ -468,6 +595,104 @@ int totem_volatile_config_validate (
 		goto parse_error;
 	}
 
+	if (totem_config->window_size_min < WINDOW_SIZE_MIN_LIMIT) {
+		snprintf (local_error_reason, sizeof(local_error_reason),
+			"The window_size_min parameter (%d messages) may not be less than (%d messages).",
+			totem_config->window_size_min, WINDOW_SIZE_MIN_LIMIT);
+		goto parse_error;
+	}
+
+	if (totem_config->window_size_min > totem_config->window_size_max) {
+		snprintf (local_error_reason, sizeof(local_error_reason),
+			"The window_size_min parameter (%d messages) may not be greater than window_size_max (%d messages).",
+			totem_config->window_size_min, totem_config->window_size_max);
+		goto parse_error;
+	}
+
+	if (totem_config->window_size_max > WINDOW_SIZE_LIMIT) {
+		snprintf (local_error_reason, sizeof(local_error_reason),
+			"The window_size_max parameter (%d messages) may not be greater than (%d messages).",
+			totem_config->window_size_max, WINDOW_SIZE_LIMIT);
+		goto parse_error;
+	}
+
+	/*
+	 * The adaptive window starts at window_size and is kept within
+	 * window_size_min and window_size_max
+	 */
+	if (totem_config->window_size_adaptive &&
+	    (totem_config->window_size < totem_config->window_size_min ||
+	    totem_config->window_size > totem_config->window_size_max)) {
+		snprintf (local_error_reason, sizeof(local_error_reason),
+			"The window_size parameter (%d messages) must be within window_size_min (%d messages) and window_size_max (%d messages) when window_size_adaptive is enabled.",
+			totem_config->window_size, totem_config->window_size_min,
+			totem_config->window_size_max);
+		goto parse_error;
+	}
+
+	if (totem_config->sort_queue_bytes < SORT_QUEUE_BYTES_MIN) {
+		snprintf (local_error_reason, sizeof(local_error_reason),
+			"The sort_queue_bytes parameter (%u bytes) may not be less than (%d bytes).",
+			totem_config->sort_queue_bytes, SORT_QUEUE_BYTES_MIN);
+		goto parse_error;
+	}
+
+	if (totem_config->fec_group_size > FEC_GROUP_SIZE_MAX) {
+		snprintf (local_error_reason, sizeof(local_error_reason),
+			"The fec_group_size parameter (%d messages) may not be greater than (%d messages).",
+			totem_config->fec_group_size, FEC_GROUP_SIZE_MAX);
+		goto parse_error;
+	}
+
+	if (totem_config->side_channel_threshold != 0 &&
+	    (totem_config->side_channel_threshold < SIDE_CHANNEL_THRESHOLD_MIN ||
+	     totem_config->side_channel_threshold > MESSAGE_SIZE_MAX)) {
+		snprintf (local_error_reason, sizeof(local_error_reason),
+			"The side_channel_threshold parameter (%u bytes) must be 0 (disabled) or between %d and %d bytes.",
+			totem_config->side_channel_threshold, SIDE_CHANNEL_THRESHOLD_MIN, MESSAGE_SIZE_MAX);
+		goto parse_error;
+	}
+
+	if (totem_config->buffer_pool_size > BUFFER_POOL_SIZE_MAX) {
+		snprintf (local_error_reason, sizeof(local_error_reason),
+			"The buffer_pool_size parameter (%u buffers) may not be greater than (%d buffers).",
+			totem_config->buffer_pool_size, BUFFER_POOL_SIZE_MAX);
+		goto parse_error;
+	}
+
+	if (totem_config->coalesce_delay > COALESCE_DELAY_MAX) {
+		snprintf (local_error_reason, sizeof(local_error_reason),
+			"The coalesce_delay parameter (%u us) may not be greater than (%d us).",
+			totem_config->coalesce_delay, COALESCE_DELAY_MAX);
+		goto parse_error;
+	}
+
+	if (strcmp (totem_config->compression_model, "none") != 0
+#ifdef HAVE_ZLIB
+	    && strcmp (totem_config->compression_model, "zlib") != 0
+#endif
+	    ) {
+		snprintf (local_error_reason, sizeof(local_error_reason),
+			"The compression_model parameter (%s) is not supported by this build.",
+			totem_config->compression_model);
+		goto parse_error;
+	}
+
+	if (totem_config->compression_threshold < COMPRESSION_THRESHOLD_MIN) {
+		snprintf (local_error_reason, sizeof(local_error_reason),
+			"The compression_threshold parameter (%u bytes) may not be less than (%d bytes).",
+			totem_config->compression_threshold, COMPRESSION_THRESHOLD_MIN);
+		goto parse_error;
+	}
+
+	if (totem_config->compression_level < COMPRESSION_LEVEL_MIN ||
+	    totem_config->compression_level > COMPRESSION_LEVEL_MAX) {
+		snprintf (local_error_reason, sizeof(local_error_reason),
+			"The compression_level parameter (%u) must be between %d and %d.",
+			totem_config->compression_level, COMPRESSION_LEVEL_MIN, COMPRESSION_LEVEL_MAX);
+		goto parse_error;
+	}
+
 	/* Check that we have nodelist 'name' if there is more than one link */
 	num_configured = 0;
 	members = -1;
@@ -2341,8 +2566,11 @@ static void debug_dump_totem_config(const struct totem_config *totem_config)
 
 	} else
 		log_printf(LOGSYS_LEVEL_DEBUG, "Token warnings disabled");
+	log_printf(LOGSYS_LEVEL_DEBUG, "adaptive token timeout (%s) phi threshold (%d)",
+	    totem_config->token_adaptive ? "yes" : "no", totem_config->token_phi_threshold);
 	log_printf(LOGSYS_LEVEL_DEBUG, "token hold (%d ms) retransmits before loss (%d retrans)",
 	    totem_config->token_hold_timeout, totem_config->token_retransmits_before_loss_const);
+	log_printf(LOGSYS_LEVEL_DEBUG, "idle token hold up to (%d ms)", totem_config->token_hold_idle_max);
 	log_printf(LOGSYS_LEVEL_DEBUG, "join (%d ms) send_join (%d ms) consensus (%d ms) merge (%d ms)",
 	    totem_config->join_timeout, totem_config->send_join_timeout, totem_config->consensus_timeout,
 	    totem_config->merge_timeout);
@@ -2354,7 +2582,24 @@ static void debug_dump_totem_config(const struct totem_config *totem_config)
 	log_printf(LOGSYS_LEVEL_DEBUG,
 	    "window size per rotation (%d messages) maximum messages per rotation (%d messages)",
 	    totem_config->window_size, totem_config->max_messages);
+	log_printf(LOGSYS_LEVEL_DEBUG, "adaptive window size (%s) between %d and %d messages",
+	    totem_config->window_size_adaptive ? "yes" : "no",
+	    totem_config->window_size_min, totem_config->window_size_max);
 	log_printf(LOGSYS_LEVEL_DEBUG, "missed count const (%d messages)", totem_config->miss_count_const);
+	log_printf(LOGSYS_LEVEL_DEBUG, "sort queue (%u bytes)", totem_config->sort_queue_bytes);
+	log_printf(LOGSYS_LEVEL_DEBUG, "fec group size (%d messages)", totem_config->fec_group_size);
+	log_printf(LOGSYS_LEVEL_DEBUG, "side channel threshold (%u bytes)", totem_config->side_channel_threshold);
+	log_printf(LOGSYS_LEVEL_DEBUG, "buffer pool (%u buffers) prefill (%s)",
+	    totem_config->buffer_pool_size, totem_config->buffer_pool_prefill ? "yes" : "no");
+	log_printf(LOGSYS_LEVEL_DEBUG, "coalesce delay (%u us) bytes (%u bytes)",
+	    totem_config->coalesce_delay, totem_config->coalesce_bytes);
+	log_printf(LOGSYS_LEVEL_DEBUG, "compression (%s) threshold (%u bytes) level (%u)",
+	    totem_config->compression_model, totem_config->compression_threshold,
+	    totem_config->compression_level);
+	log_printf(LOGSYS_LEVEL_DEBUG, "retransmit ranges (%s)",
+	    totem_config->retransmit_ranges ? "yes" : "no");
+	log_printf(LOGSYS_LEVEL_DEBUG, "priority lanes (%s)",
+	    totem_config->priority_lanes ? "yes" : "no");
 	log_printf(LOGSYS_LEVEL_DEBUG, "heartbeat_failures_allowed (%d)",
 	    totem_config->heartbeat_failures_allowed);
 	log_printf(LOGSYS_LEVEL_DEBUG, "max_network_delay (%d ms)", totem_config->max_network_delay);
@@ -1501,6 +1501,26 @@ int totemknet_token_send (
 
 	return (res);
 }
+
+int totemknet_unicast_send (
+	void *knet_context,
+	unsigned int nodeid,
+	const void *msg,
+	unsigned int msg_len)
+{
+	struct totemknet_instance *instance = (struct totemknet_instance *)knet_context;
+	struct totem_ip_address system_to;
+	int res = 0;
+
+	/*
+	 * Only the node id is used, knet routes the packet in dst_host_filter
+	 */
+	memset (&system_to, 0, sizeof (system_to));
+	system_to.nodeid = nodeid;
+	ucast_sendmsg (instance, &system_to, msg, msg_len);
+
+	return (res);
+}
 int totemknet_mcast_flush_send (
 	void *knet_context,
 	const void *msg,
@@ -82,6 +82,12 @@ extern int totemknet_token_send (
 	const void *msg,
 	unsigned int msg_len);
 
+extern int totemknet_unicast_send (
+	void *knet_context,
+	unsigned int nodeid,
+	const void *msg,
+	unsigned int msg_len);
+
 extern int totemknet_mcast_flush_send (
 	void *knet_context,
 	const void *msg,
@@ -0,0 +1,716 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <config.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <qb/qblist.h>
+#include <qb/qbdefs.h>
+#include <qb/qbloop.h>
+
+#define LOGSYS_UTILS_ONLY 1
+#include <corosync/logsys.h>
+#include "totemloop.h"
+
+#include "cs_queue.h"
+
+/*
+ * Packets waiting in the receive queue of one instance, like the receive
+ * buffer of a socket.  Packets sent to a full queue are dropped.
+ */
+#define TOTEMLOOP_RECV_QUEUE_SIZE	8192
+
+/*
+ * One copy of every packet is shared by all instances it was sent to
+ */
+struct totemloop_packet {
+	unsigned int refcount;
+	unsigned int msg_len;
+	int mcast;
+	struct sockaddr_storage system_from;
+	char msg[];
+};
+
+struct totemloop_instance {
+	struct qb_list_head list;
+
+	qb_loop_t *totemloop_poll_handle;
+
+	struct totem_interface *totem_interface;
+
+	void *context;
+
+	int (*totemloop_deliver_fn) (
+		void *context,
+		const void *msg,
+		unsigned int msg_len,
+		const struct sockaddr_storage *system_from);
+
+	int (*totemloop_iface_change_fn) (
+		void *context,
+		const struct totem_ip_address *iface_address,
+		unsigned int ring_no);
+
+	void (*totemloop_target_set_completed) (void *context);
+
+	/*
+	 * Function and data used to log messages
+	 */
+	int totemloop_log_level_error;
+
+	int totemloop_log_level_warning;
+
+	int totemloop_log_level_notice;
+
+	int totemloop_log_level_debug;
+
+	int totemloop_subsys_id;
+
+	void (*totemloop_log_printf) (
+		int level,
+		int subsys,
+		const char *function,
+		const char *file,
+		int line,
+		const char *format,
+		...)__attribute__((format(printf, 6, 7)));
+
+	struct totem_config *totem_config;
+
+	totemsrp_stats_t *stats;
+
+	struct totem_ip_address my_id;
+
+	struct sockaddr_storage my_sockaddr;
+
+	unsigned int token_target;
+
+	unsigned int my_memb_entries;
+
+	struct cs_queue recv_queue;
+
+	int recv_scheduled;
+
+	int iface_change_scheduled;
+
+	int isolated;
+};
+
+/*
+ * All instances of the process, this is the network
+ */
+static QB_LIST_DECLARE (totemloop_instance_list);
+
+/*
+ * Percentage of multicast packets lost between different instances
+ */
+static unsigned int totemloop_mcast_loss = 0;
+
+#define log_printf(level, format, args...)		\
+do {							\
+        instance->totemloop_log_printf (		\
+		level, instance->totemloop_subsys_id,	\
+                __FUNCTION__, __FILE__, __LINE__,	\
+		(const char *)format, ##args);		\
+} while (0);
+
+static void totemloop_recv_dispatch (void *data);
+
+static struct totemloop_instance *find_instance_by_nodeid (unsigned int nodeid)
+{
+	struct qb_list_head *list;
+	struct totemloop_instance *instance;
+
+	qb_list_for_each(list, &totemloop_instance_list) {
+		instance = qb_list_entry (list, struct totemloop_instance, list);
+
+		if (instance->my_id.nodeid == nodeid) {
+			return (instance);
+		}
+	}
+
+	return (NULL);
+}
+
+static struct totemloop_packet *packet_create (
+	struct totemloop_instance *instance,
+	const void *msg,
+	unsigned int msg_len,
+	int mcast)
+{
+	struct totemloop_packet *packet;
+
+	packet = malloc (sizeof (struct totemloop_packet) + msg_len);
+	if (packet == NULL) {
+		return (NULL);
+	}
+	/*
+	 * The reference of the sender is dropped once the packet is queued
+	 */
+	packet->refcount = 1;
+	packet->msg_len = msg_len;
+	packet->mcast = mcast;
+	memcpy (&packet->system_from, &instance->my_sockaddr,
+		sizeof (struct sockaddr_storage));
+	memcpy (packet->msg, msg, msg_len);
+
+	return (packet);
+}
+
+static void packet_put (struct totemloop_packet *packet)
+{
+	if (--packet->refcount == 0) {
+		free (packet);
+	}
+}
+
+static void packet_queue (
+	struct totemloop_instance *instance,
+	struct totemloop_packet *packet)
+{
+	if (cs_queue_is_full (&instance->recv_queue)) {
+		return;
+	}
+
+	packet->refcount++;
+	cs_queue_item_add (&instance->recv_queue, &packet);
+
+	if (instance->recv_scheduled == 0) {
+		instance->recv_scheduled = 1;
+		qb_loop_job_add (instance->totemloop_poll_handle,
+			QB_LOOP_MED,
+			instance,
+			totemloop_recv_dispatch);
+	}
+}
+
+static void totemloop_recv_dispatch (void *data)
+{
+	struct totemloop_instance *instance = (struct totemloop_instance *)data;
+	struct totemloop_packet *packet;
+	int count;
+
+	instance->recv_scheduled = 0;
+
+	/*
+	 * Only deliver the packets queued so far.  Packets sent by the deliver
+	 * function are handled by the next job, which lets the timers and
+	 * the other instances run in between.
+	 */
+	count = cs_queue_used (&instance->recv_queue);
+	while (count-- > 0) {
+		packet = *(struct totemloop_packet **)cs_queue_item_get (&instance->recv_queue);
+		cs_queue_item_remove (&instance->recv_queue);
+
+		instance->totemloop_deliver_fn (
+			instance->context,
+			packet->msg,
+			packet->msg_len,
+			&packet->system_from);
+
+		packet_put (packet);
+	}
+
+	if (!cs_queue_is_empty (&instance->recv_queue) &&
+	    instance->recv_scheduled == 0) {
+		instance->recv_scheduled = 1;
+		qb_loop_job_add (instance->totemloop_poll_handle,
+			QB_LOOP_MED,
+			instance,
+			totemloop_recv_dispatch);
+	}
+}
+
+static void recv_queue_flush (struct totemloop_instance *instance)
+{
+	struct totemloop_packet *packet;
+
+	while (!cs_queue_is_empty (&instance->recv_queue)) {
+		packet = *(struct totemloop_packet **)cs_queue_item_get (&instance->recv_queue);
+		cs_queue_item_remove (&instance->recv_queue);
+		packet_put (packet);
+	}
+}
+
+/*
+ * Drop the multicast packets, like the mcast socket of the other transports
+ * is emptied.  Unicast packets (the token and side channel data) stay queued
+ * in their order.
+ */
+static int recv_queue_mcast_flush (struct totemloop_instance *instance)
+{
+	struct totemloop_packet *packet;
+	int msg_processed = 0;
+	int count;
+
+	count = cs_queue_used (&instance->recv_queue);
+	while (count-- > 0) {
+		packet = *(struct totemloop_packet **)cs_queue_item_get (&instance->recv_queue);
+		cs_queue_item_remove (&instance->recv_queue);
+		if (packet->mcast) {
+			packet_put (packet);
+			msg_processed = 1;
+			continue;
+		}
+		cs_queue_item_add (&instance->recv_queue, &packet);
+	}
+
+	return (msg_processed);
+}
+
+static void totemloop_iface_change (void *data)
+{
+	struct totemloop_instance *instance = (struct totemloop_instance *)data;
+
+	instance->iface_change_scheduled = 0;
+
+	log_printf (instance->totemloop_log_level_notice,
+		"The loopback interface of node %u is now up.",
+		instance->my_id.nodeid);
+
+	instance->totemloop_iface_change_fn (instance->context, &instance->my_id, 0);
+}
+
+int totemloop_crypto_set (
+	void *loop_context,
+	const char *cipher_type,
+	const char *hash_type)
+{
+
+	return (0);
+}
+
+int totemloop_finalize (
+	void *loop_context)
+{
+	struct totemloop_instance *instance = (struct totemloop_instance *)loop_context;
+
+	qb_list_del (&instance->list);
+
+	if (instance->recv_scheduled) {
+		qb_loop_job_del (instance->totemloop_poll_handle,
+			QB_LOOP_MED, instance, totemloop_recv_dispatch);
+	}
+	if (instance->iface_change_scheduled) {
+		qb_loop_job_del (instance->totemloop_poll_handle,
+			QB_LOOP_MED, instance, totemloop_iface_change);
+	}
+
+	recv_queue_flush (instance);
+	cs_queue_free (&instance->recv_queue);
+	free (instance);
+
+	return (0);
+}
+
+/*
+ * Create an instance
+ */
+int totemloop_initialize (
+	qb_loop_t *poll_handle,
+	void **loop_context,
+	struct totem_config *totem_config,
+	totemsrp_stats_t *stats,
+	void *context,
+
+	int (*deliver_fn) (
+		void *context,
+		const void *msg,
+		unsigned int msg_len,
+		const struct sockaddr_storage *system_from),
+
+	int (*iface_change_fn) (
+		void *context,
+		const struct totem_ip_address *iface_address,
+		unsigned int ring_no),
+
+	void (*mtu_changed) (
+		void *context,
+		int net_mtu),
+
+	void (*target_set_completed) (
+		void *context))
+{
+	struct totemloop_instance *instance;
+	int addrlen;
+
+	instance = malloc (sizeof (struct totemloop_instance));
+	if (instance == NULL) {
+		return (-1);
+	}
+	memset (instance, 0, sizeof (struct totemloop_instance));
+
+	instance->totem_config = totem_config;
+	instance->stats = stats;
+
+	/*
+	 * Configure logging
+	 */
+	instance->totemloop_log_level_error = totem_config->totem_logging_configuration.log_level_error;
+	instance->totemloop_log_level_warning = totem_config->totem_logging_configuration.log_level_warning;
+	instance->totemloop_log_level_notice = totem_config->totem_logging_configuration.log_level_notice;
+	instance->totemloop_log_level_debug = totem_config->totem_logging_configuration.log_level_debug;
+	instance->totemloop_subsys_id = totem_config->totem_logging_configuration.log_subsys_id;
+	instance->totemloop_log_printf = totem_config->totem_logging_configuration.log_printf;
+
+	if (find_instance_by_nodeid (totem_config->node_id) != NULL) {
+		log_printf (instance->totemloop_log_level_error,
+			"Node %u is already on the loopback network.",
+			totem_config->node_id);
+		free (instance);
+		return (-1);
+	}
+
+	if (cs_queue_init (&instance->recv_queue, TOTEMLOOP_RECV_QUEUE_SIZE,
+		sizeof (struct totemloop_packet *), 0) != 0) {
+		free (instance);
+		return (-1);
+	}
+
+	instance->totemloop_poll_handle = poll_handle;
+	instance->totem_interface = &totem_config->interfaces[0];
+
+	instance->context = context;
+	instance->totemloop_deliver_fn = deliver_fn;
+	instance->totemloop_iface_change_fn = iface_change_fn;
+	instance->totemloop_target_set_completed = target_set_completed;
+
+	/*
+	 * There is always atleast 1 processor
+	 */
+	instance->my_memb_entries = 1;
+
+	/*
+	 * There is no interface to look for, the node is bound to the
+	 * configured address right away
+	 */
+	totemip_copy (&instance->my_id, &instance->totem_interface->bindnet);
+	instance->my_id.nodeid = totem_config->node_id;
+	totemip_copy (&instance->totem_interface->boundto, &instance->my_id);
+	totemip_totemip_to_sockaddr_convert (&instance->my_id,
+		instance->totem_interface->ip_port, &instance->my_sockaddr, &addrlen);
+
+	qb_list_init (&instance->list);
+	qb_list_add_tail (&instance->list, &totemloop_instance_list);
+
+	/*
+	 * totemsrp isn't ready to receive the interface change until
+	 * initialization returns
+	 */
+	instance->iface_change_scheduled = 1;
+	qb_loop_job_add (instance->totemloop_poll_handle,
+		QB_LOOP_MED,
+		instance,
+		totemloop_iface_change);
+
+	*loop_context = instance;
+	return (0);
+}
+
+void *totemloop_buffer_alloc (void)
+{
+	return malloc (FRAME_SIZE_MAX);
+}
+
+void totemloop_buffer_release (void *ptr)
+{
+	return free (ptr);
+}
+
+int totemloop_processor_count_set (
+	void *loop_context,
+	int processor_count)
+{
+	struct totemloop_instance *instance = (struct totemloop_instance *)loop_context;
+
+	instance->my_memb_entries = processor_count;
+
+	return (0);
+}
+
+int totemloop_recv_flush (void *loop_context)
+{
+	int res = 0;
+
+	return (res);
+}
+
+int totemloop_send_flush (void *loop_context)
+{
+	int res = 0;
+
+	return (res);
+}
+
+static int ucast_sendmsg (
+	struct totemloop_instance *instance,
+	unsigned int nodeid,
+	const void *msg,
+	unsigned int msg_len,
+	int lossy)
+{
+	struct totemloop_instance *target;
+	struct totemloop_packet *packet;
+
+	/*
+	 * A packet sent to a node which left is lost, as on a real network
+	 */
+	target = find_instance_by_nodeid (nodeid);
+	if (target == NULL ||
+	    (target != instance && (target->isolated || instance->isolated))) {
+		return (0);
+	}
+	if (lossy && target != instance && totemloop_mcast_loss > 0 &&
+	    (unsigned int)(random () % 100) < totemloop_mcast_loss) {
+		return (0);
+	}
+
+	packet = packet_create (instance, msg, msg_len, 0);
+	if (packet == NULL) {
+		return (-1);
+	}
+	packet_queue (target, packet);
+	packet_put (packet);
+
+	return (0);
+}
+
+int totemloop_token_send (
+	void *loop_context,
+	const void *msg,
+	unsigned int msg_len)
+{
+	struct totemloop_instance *instance = (struct totemloop_instance *)loop_context;
+
+	return (ucast_sendmsg (instance, instance->token_target, msg, msg_len, 0));
+}
+
+/*
+ * Side channel data is lost like multicast data, the token never is
+ */
+int totemloop_unicast_send (
+	void *loop_context,
+	unsigned int nodeid,
+	const void *msg,
+	unsigned int msg_len)
+{
+	struct totemloop_instance *instance = (struct totemloop_instance *)loop_context;
+
+	return (ucast_sendmsg (instance, nodeid, msg, msg_len, 1));
+}
+
+static int mcast_sendmsg (
+	struct totemloop_instance *instance,
+	const void *msg,
+	unsigned int msg_len)
+{
+	struct qb_list_head *list;
+	struct totemloop_instance *target;
+	struct totemloop_packet *packet;
+
+	packet = packet_create (instance, msg, msg_len, 1);
+	if (packet == NULL) {
+		return (-1);
+	}
+
+	qb_list_for_each(list, &totemloop_instance_list) {
+		target = qb_list_entry (list, struct totemloop_instance, list);
+
+		if (target != instance) {
+			if (target->isolated || instance->isolated) {
+				continue;
+			}
+			if (totemloop_mcast_loss > 0 &&
+			    (unsigned int)(random () % 100) < totemloop_mcast_loss) {
+				continue;
+			}
+		}
+		packet_queue (target, packet);
+	}
+	packet_put (packet);
+
+	return (0);
+}
+
+int totemloop_mcast_flush_send (
+	void *loop_context,
+	const void *msg,
+	unsigned int msg_len)
+{
+	struct totemloop_instance *instance = (struct totemloop_instance *)loop_context;
+
+	return (mcast_sendmsg (instance, msg, msg_len));
+}
+
+int totemloop_mcast_noflush_send (
+	void *loop_context,
+	const void *msg,
+	unsigned int msg_len)
+{
+	struct totemloop_instance *instance = (struct totemloop_instance *)loop_context;
+
+	return (mcast_sendmsg (instance, msg, msg_len));
+}
+
+int totemloop_iface_check (void *loop_context)
+{
+	int res = 0;
+
+	return (res);
+}
+
+void totemloop_net_mtu_adjust (void *loop_context, struct totem_config *totem_config)
+{
+	/*
+	 * No protocol headers are added to packets
+	 */
+}
+
+int totemloop_nodestatus_get (void *loop_context, unsigned int nodeid,
+	struct totem_node_status *node_status)
+{
+	struct totemloop_instance *instance = (struct totemloop_instance *)loop_context;
+	struct totemloop_instance *member;
+
+	member = find_instance_by_nodeid (nodeid);
+	if (member == NULL) {
+		return (0);
+	}
+
+	node_status->nodeid = nodeid;
+	/* reachable is filled in by totemsrp */
+	node_status->link_status[0].enabled = 1;
+	node_status->link_status[0].connected = node_status->reachable;
+	node_status->link_status[0].mtu = instance->totem_config->net_mtu;
+	strncpy(node_status->link_status[0].src_ipaddr, totemip_print(&member->my_id), KNET_MAX_HOST_LEN-1);
+
+	return (0);
+}
+
+int totemloop_ifaces_get (
+	void *loop_context,
+	char ***status,
+	unsigned int *iface_count)
+{
+	static char *statuses[INTERFACE_MAX] = {(char*)"OK"};
+
+	if (status) {
+		*status = statuses;
+	}
+	*iface_count = 1;
+
+	return (0);
+}
+
+int totemloop_token_target_set (
+	void *loop_context,
+	unsigned int nodeid)
+{
+	struct totemloop_instance *instance = (struct totemloop_instance *)loop_context;
+
+	instance->token_target = nodeid;
+	instance->totemloop_target_set_completed (instance->context);
+
+	return (0);
+}
+
+int totemloop_recv_mcast_empty (
+	void *loop_context)
+{
+	struct totemloop_instance *instance = (struct totemloop_instance *)loop_context;
+
+	return (recv_queue_mcast_flush (instance));
+}
+
+int totemloop_iface_set (void *loop_context,
+	const struct totem_ip_address *local_addr,
+	unsigned short ip_port,
+	unsigned int iface_no)
+{
+	/* Not supported */
+	return (-1);
+}
+
+int totemloop_member_add (
+	void *loop_context,
+	const struct totem_ip_address *local,
+	const struct totem_ip_address *member,
+	int ring_no)
+{
+	/*
+	 * Every instance of the process is reachable
+	 */
+	return (0);
+}
+
+int totemloop_member_remove (
+	void *loop_context,
+	const struct totem_ip_address *member,
+	int ring_no)
+{
+	return (0);
+}
+
+int totemloop_reconfigure (
+	void *loop_context,
+	struct totem_config *totem_config)
+{
+	/* Not supported */
+	return (-1);
+}
+
+int totemloop_node_isolate (
+	unsigned int nodeid,
+	int isolated)
+{
+	struct totemloop_instance *instance;
+
+	instance = find_instance_by_nodeid (nodeid);
+	if (instance == NULL) {
+		return (-1);
+	}
+	instance->isolated = isolated;
+
+	return (0);
+}
+
+void totemloop_mcast_loss_set (unsigned int percent)
+{
+	totemloop_mcast_loss = percent;
+}
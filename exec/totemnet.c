@@ -36,10 +36,12 @@
 #include <config.h>
 
 #include <assert.h>
+#include <pthread.h>
 
 #include <totemudp.h>
 #include <totemudpu.h>
 #include <totemknet.h>
+#include <totemloop.h>
 #include <totemnet.h>
 #include <qb/qbloop.h>
 
@@ -87,6 +89,15 @@ struct transport {
 		const void *msg,
 		unsigned int msg_len);
 
+	/*
+	 * Send to a single node, optional, NULL if the transport can't
+	 */
+	int (*unicast_send) (
+		void *transport_context,
+		unsigned int nodeid,
+		const void *msg,
+		unsigned int msg_len);
+
 	int (*mcast_flush_send) (
 		void *transport_context,
 		const void *msg,
@@ -225,6 +236,7 @@ struct transport transport_entries[] = {
 		.buffer_release = totemknet_buffer_release,
 		.processor_count_set = totemknet_processor_count_set,
 		.token_send = totemknet_token_send,
+		.unicast_send = totemknet_unicast_send,
 		.mcast_flush_send = totemknet_mcast_flush_send,
 		.mcast_noflush_send = totemknet_mcast_noflush_send,
 		.recv_flush = totemknet_recv_flush,
@@ -243,6 +255,32 @@ struct transport transport_entries[] = {
 		.reconfigure = totemknet_reconfigure,
 		.crypto_reconfigure_phase = totemknet_crypto_reconfigure_phase,
 		.stats_clear = totemknet_stats_clear
+	},
+	{
+		.name = "In-process loopback",
+		.initialize = totemloop_initialize,
+		.buffer_alloc = totemloop_buffer_alloc,
+		.buffer_release = totemloop_buffer_release,
+		.processor_count_set = totemloop_processor_count_set,
+		.token_send = totemloop_token_send,
+		.unicast_send = totemloop_unicast_send,
+		.mcast_flush_send = totemloop_mcast_flush_send,
+		.mcast_noflush_send = totemloop_mcast_noflush_send,
+		.recv_flush = totemloop_recv_flush,
+		.send_flush = totemloop_send_flush,
+		.iface_set = totemloop_iface_set,
+		.iface_check = totemloop_iface_check,
+		.finalize = totemloop_finalize,
+		.net_mtu_adjust = totemloop_net_mtu_adjust,
+		.ifaces_get = totemloop_ifaces_get,
+		.nodestatus_get = totemloop_nodestatus_get,
+		.token_target_set = totemloop_token_target_set,
+		.crypto_set = totemloop_crypto_set,
+		.recv_mcast_empty = totemloop_recv_mcast_empty,
+		.member_add = totemloop_member_add,
+		.member_remove = totemloop_member_remove,
+		.reconfigure = totemloop_reconfigure,
+		.crypto_reconfigure_phase = NULL
 	}
 };
 
@@ -250,6 +288,23 @@ struct totemnet_instance {
 	void *transport_context;
 
 	struct transport *transport;
+
+	struct totem_config *totem_config;
+
+	totemsrp_stats_t *stats;
+
+	/*
+	 * Free transport buffers kept for reuse, linked through their first
+	 * word.  Multicasts may be queued from other threads in threaded mode.
+	 */
+	pthread_mutex_t buffer_pool_mutex;
+
+	void *buffer_pool;
+
+	unsigned int buffer_pool_entries;
+
+	unsigned int buffers_in_use;
+
         void (*totemnet_log_printf) (
                 int level,
 		int subsys,
@@ -287,6 +342,60 @@ static void totemnet_instance_initialize (
 		"Initializing transport (%s).", transport_entries[transport].name);
 
 	instance->transport = &transport_entries[transport];
+
+	instance->totem_config = config;
+	pthread_mutex_init (&instance->buffer_pool_mutex, NULL);
+	instance->buffer_pool = NULL;
+	instance->buffer_pool_entries = 0;
+	instance->buffers_in_use = 0;
+}
+
+/*
+ * Must be called with buffer_pool_mutex held
+ */
+static void buffer_pool_stats_update (struct totemnet_instance *instance)
+{
+	instance->stats->buffer_pool_free = instance->buffer_pool_entries;
+	instance->stats->buffers_in_use = instance->buffers_in_use;
+	if (instance->buffers_in_use > instance->stats->buffers_in_use_max) {
+		instance->stats->buffers_in_use_max = instance->buffers_in_use;
+	}
+}
+
+static void buffer_pool_prefill (struct totemnet_instance *instance)
+{
+	void *buffer;
+
+	pthread_mutex_lock (&instance->buffer_pool_mutex);
+	while (instance->buffer_pool_entries < instance->totem_config->buffer_pool_size) {
+		buffer = instance->transport->buffer_alloc ();
+		if (buffer == NULL) {
+			instance->stats->buffer_alloc_failures++;
+			break;
+		}
+		*(void **)buffer = instance->buffer_pool;
+		instance->buffer_pool = buffer;
+		instance->buffer_pool_entries++;
+	}
+	buffer_pool_stats_update (instance);
+	pthread_mutex_unlock (&instance->buffer_pool_mutex);
+
+	log_printf (LOGSYS_LEVEL_DEBUG, "Preallocated %u transport buffers",
+		instance->buffer_pool_entries);
+}
+
+static void buffer_pool_drain (struct totemnet_instance *instance)
+{
+	void *buffer;
+
+	pthread_mutex_lock (&instance->buffer_pool_mutex);
+	while (instance->buffer_pool != NULL) {
+		buffer = instance->buffer_pool;
+		instance->buffer_pool = *(void **)buffer;
+		instance->transport->buffer_release (buffer);
+	}
+	instance->buffer_pool_entries = 0;
+	pthread_mutex_unlock (&instance->buffer_pool_mutex);
 }
 
 int totemnet_crypto_set (
@@ -310,6 +419,8 @@ int totemnet_finalize (
 	int res = 0;
 
 	res = instance->transport->finalize (instance->transport_context);
+	buffer_pool_drain (instance);
+	pthread_mutex_destroy (&instance->buffer_pool_mutex);
 
 	return (res);
 }
@@ -347,6 +458,7 @@ int totemnet_initialize (
 		return (-1);
 	}
 	totemnet_instance_initialize (instance, totem_config);
+	instance->stats = stats;
 
 	res = instance->transport->initialize (loop_pt,
 		&instance->transport_context, totem_config, stats,
@@ -356,10 +468,15 @@ int totemnet_initialize (
 		goto error_destroy;
 	}
 
+	if (totem_config->buffer_pool_prefill) {
+		buffer_pool_prefill (instance);
+	}
+
 	*net_context = instance;
 	return (0);
 
 error_destroy:
+	pthread_mutex_destroy (&instance->buffer_pool_mutex);
 	free (instance);
 	return (-1);
 }
@@ -367,17 +484,53 @@ error_destroy:
 void *totemnet_buffer_alloc (void *net_context)
 {
 	struct totemnet_instance *instance = net_context;
+	void *buffer;
+
 	assert (instance != NULL);
 	assert (instance->transport != NULL);
-	return instance->transport->buffer_alloc();
+
+	pthread_mutex_lock (&instance->buffer_pool_mutex);
+	buffer = instance->buffer_pool;
+	if (buffer != NULL) {
+		instance->buffer_pool = *(void **)buffer;
+		instance->buffer_pool_entries--;
+		instance->stats->buffer_pool_hits++;
+	} else {
+		buffer = instance->transport->buffer_alloc();
+		if (buffer == NULL) {
+			instance->stats->buffer_alloc_failures++;
+		}
+	}
+	if (buffer != NULL) {
+		instance->buffers_in_use++;
+	}
+	buffer_pool_stats_update (instance);
+	pthread_mutex_unlock (&instance->buffer_pool_mutex);
+
+	return (buffer);
 }
 
 void totemnet_buffer_release (void *net_context, void *ptr)
 {
 	struct totemnet_instance *instance = net_context;
+
 	assert (instance != NULL);
 	assert (instance->transport != NULL);
-	instance->transport->buffer_release (ptr);
+
+	pthread_mutex_lock (&instance->buffer_pool_mutex);
+	instance->buffers_in_use--;
+	if (instance->buffer_pool_entries < instance->totem_config->buffer_pool_size) {
+		*(void **)ptr = instance->buffer_pool;
+		instance->buffer_pool = ptr;
+		instance->buffer_pool_entries++;
+		ptr = NULL;
+	}
+	buffer_pool_stats_update (instance);
+	pthread_mutex_unlock (&instance->buffer_pool_mutex);
+
+	if (ptr != NULL) {
+		instance->transport->buffer_release (ptr);
+	}
 }
 
 int totemnet_processor_count_set (
@@ -423,6 +576,31 @@ int totemnet_token_send (
 
 	return (res);
 }
+int totemnet_unicast_available (
+	void *net_context)
+{
+	struct totemnet_instance *instance = (struct totemnet_instance *)net_context;
+
+	return (instance->transport->unicast_send != NULL);
+}
+
+int totemnet_unicast_send (
+	void *net_context,
+	unsigned int nodeid,
+	const void *msg,
+	unsigned int msg_len)
+{
+	struct totemnet_instance *instance = (struct totemnet_instance *)net_context;
+	int res = -1;
+
+	if (instance->transport->unicast_send) {
+		res = instance->transport->unicast_send (instance->transport_context,
+			nodeid, msg, msg_len);
+	}
+
+	return (res);
+}
+
 int totemnet_mcast_flush_send (
 	void *net_context,
 	const void *msg,
@@ -92,6 +92,15 @@ extern int totemnet_token_send (
 	const void *msg,
 	unsigned int msg_len);
 
+extern int totemnet_unicast_available (
+	void *net_context);
+
+extern int totemnet_unicast_send (
+	void *net_context,
+	unsigned int nodeid,
+	const void *msg,
+	unsigned int msg_len);
+
 extern int totemnet_mcast_flush_send (
 	void *net_context,
 	const void *msg,
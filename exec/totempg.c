@@ -99,10 +99,15 @@
 #include <pthread.h>
 #include <errno.h>
 #include <limits.h>
+#include <time.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #include <corosync/swab.h>
 #include <qb/qblist.h>
 #include <qb/qbloop.h>
+#include <qb/qbutil.h>
 #include <qb/qbipcs.h>
 #include <corosync/totem/totempg.h>
 #define LOGSYS_UTILS_ONLY 1
@@ -126,7 +131,8 @@ struct totempg_mcast_header {
 /*
  * totempg_mcast structure
  *
- * header:				Identify the mcast.
+ * header:				Identify the mcast, type is the lane
+ * 						it was sent in.
  * fragmented:			Set if this message continues into next message
  * continuation:		Set if this message is a continuation from last message
  * msg_count			Indicates how many packed messages are contained
@@ -153,13 +159,6 @@ struct totempg_mcast {
 #define TOTEMPG_PACKET_SIZE (totempg_totem_config->net_mtu - \
 	sizeof (struct totempg_mcast))
 
-/*
- * Local variables used for packing small messages
- */
-static unsigned short mcast_packed_msg_lens[FRAME_SIZE_MAX];
-
-static int mcast_packed_msg_count = 0;
-
 static int totempg_reserved = 1;
 
 static unsigned int totempg_size_limit;
@@ -196,9 +195,24 @@ enum throw_away_mode {
 	THROW_AWAY_ACTIVE
 };
 
+/*
+ * Assembly buffers start small and double up to the largest message plus
+ * one packet.  Buffers grown beyond ASSEMBLY_DATA_KEEP by a fragmented
+ * message are released once it is delivered.  At most ASSEMBLY_FREE_MAX
+ * released assemblies are kept for reuse, each with up to ASSEMBLY_DATA_KEEP
+ * bytes, the others are freed.
+ */
+#define ASSEMBLY_DATA_MIN	4096
+#define ASSEMBLY_DATA_KEEP	(2 * KNET_MAX_PACKET_SIZE)
+#define ASSEMBLY_DATA_MAX	(MESSAGE_SIZE_MAX + KNET_MAX_PACKET_SIZE)
+#define ASSEMBLY_FREE_MAX	16
+
 struct assembly {
 	unsigned int nodeid;
-	unsigned char data[MESSAGE_SIZE_MAX+KNET_MAX_PACKET_SIZE];
+	enum totem_lane lane;
+	int trans;
+	unsigned char *data;
+	size_t data_size;
 	int index;
 	unsigned char last_frag_num;
 	enum throw_away_mode throw_away_mode;
@@ -210,14 +224,21 @@ static void assembly_deref (struct assembly *assembly);
 static int callback_token_received_fn (enum totem_callback_token_type type,
 	const void *data);
 
-QB_LIST_DECLARE(assembly_list_inuse);
+/*
+ * Assemblies in use are hashed by node id, the lanes of a node and its
+ * transitional assemblies share a bucket
+ */
+#define ASSEMBLY_HASH_BITS	9
+#define ASSEMBLY_HASH_SIZE	(1 << ASSEMBLY_HASH_BITS)
+
+static struct qb_list_head assembly_hash[ASSEMBLY_HASH_SIZE];
 
 /*
  * Free list is used both for transitional and operational assemblies
  */
 QB_LIST_DECLARE(assembly_list_free);
 
-QB_LIST_DECLARE(assembly_list_inuse_trans);
+static unsigned int assembly_free_count = 0;
 
 QB_LIST_DECLARE(totempg_groups_list);
 
@@ -230,12 +251,176 @@ QB_LIST_DECLARE(totempg_groups_list);
  * the size of message data and where to place new message data.
  * fragment_contuation indicates whether the first packed message in
  * the buffer is a continuation of a previously packed fragment.
+ *
+ * Every lane packs into its own buffer, so the packets of a fragmented
+ * message are never interleaved with packets of another message of the
+ * same lane.  Receivers assemble every lane of a node separately.
+ *
+ * Only data which goes out right away is copied straight from the caller
+ * into the transport buffer.  Staged messages are copied twice, once into
+ * fragmentation_data and again into the transport buffer when the packet
+ * is sent, since the length of the packed length table in front of them is
+ * not known before then.
+ *
+ * The staged messages are sent when the token arrives.  With coalesce_delay
+ * set they are kept for later tokens until they fill coalesce_bytes or the
+ * first of them, staged at staged_time, waited coalesce_delay microseconds.
+ */
+struct totempg_lane {
+	unsigned char *fragmentation_data;
+	int fragment_size;
+	int fragment_continuation;
+	unsigned char next_fragment;
+	unsigned short mcast_packed_msg_lens[FRAME_SIZE_MAX];
+	int mcast_packed_msg_count;
+	uint64_t staged_time;
+};
+
+static struct totempg_lane totempg_lanes[TOTEM_LANE_MAX];
+
+static qb_loop_timer_handle coalesce_timer;
+
+static int coalesce_timer_running;
+
+/*
+ * Large payload side channel
+ *
+ * A message of at least side_channel_threshold bytes is sent in chunks
+ * straight to every other member, only a descriptor with its origin, id,
+ * size and hash goes through the ring.  The descriptor is a totempg_mcast
+ * of type TOTEMPG_TYPE_PAYLOAD, which processors without the side channel
+ * ignore as a message of an unknown lane.
+ *
+ * Once the descriptor is delivered and all chunks are present, a processor
+ * announces that it holds the data with a TOTEMPG_TYPE_PAYLOAD_HAVE message
+ * through the ring, and delivers the message when its own announcement is
+ * delivered.  Until then every following message and configuration change is
+ * held back, so the agreed order and virtual synchrony are kept.  Missing
+ * chunks are requested from the origin, or from all members once the origin
+ * left or didn't answer within the token plus consensus timeout, since every
+ * processor serves the chunks it has.
+ *
+ * A processor only delivers the message after its announcement is ordered,
+ * so when a regular configuration change is delivered, the origin left and
+ * no member of the new ring announced the data, no surviving processor
+ * delivered it and none can serve it.  Every processor then drops the
+ * message at that point of the total order, delivery never waits on the data
+ * of a failed node.
+ *
+ * Memory is bounded by the sender: a message only goes through the side
+ * channel while the payloads kept by the sender, which are those of every
+ * member, leave room for it.  Otherwise it is sent in band and totem flow
+ * control applies.  A receiver keeps every ordered payload, and keeps a
+ * delivered one until nobody requested it for the token plus consensus
+ * timeout.
+ */
+#define TOTEMPG_TYPE_PAYLOAD		0x100
+#define TOTEMPG_TYPE_PAYLOAD_HAVE	0x101
+
+/*
+ * Payload data a processor may keep before new messages go in band.  Ordered
+ * payloads of other members are accepted beyond it.
+ */
+#define PAYLOAD_BYTES_MAX		(64 * 1024 * 1024)
+
+#define PAYLOAD_TIMER_MSEC		50
+
+enum totempg_payload_type {
+	TOTEMPG_PAYLOAD_CHUNK = 0,	/* data at index * chunk_size */
+	TOTEMPG_PAYLOAD_NACK = 1	/* index chunk numbers of missing chunks follow */
+};
+
+struct totempg_payload_descriptor {
+	unsigned int id;
+	unsigned int size;
+	uint64_t hash;
+	unsigned int chunk_size;
+} __attribute__((packed));
+
+struct totempg_payload_have {
+	unsigned int origin;
+	unsigned int id;
+	uint64_t hash;
+} __attribute__((packed));
+
+struct totempg_payload_header {
+	unsigned int type;
+	unsigned int origin;
+	unsigned int id;
+	unsigned int size;
+	uint64_t hash;
+	unsigned int chunk_size;
+	unsigned int index;
+} __attribute__((packed));
+
+struct totempg_payload {
+	unsigned int origin;
+	unsigned int id;
+	unsigned int size;
+	uint64_t hash;
+	unsigned int chunk_size;
+	unsigned int chunks;
+	unsigned int chunks_received;
+	unsigned char *received;	/* one flag per chunk */
+	unsigned char *data;
+	int endian_conversion_required;
+	int complete;			/* all chunks received and hash verified */
+	int ordered;			/* descriptor delivered */
+	int delivered;
+	int stalled;			/* not obtained within the retain time */
+	int have_sent;			/* holding the data announced */
+	int agreed;			/* own announcement delivered */
+	uint64_t ordered_time;
+	uint64_t activity_time;		/* creation or last chunk received */
+	uint64_t delivered_time;	/* or last request served since */
+	unsigned int have_entries;
+	unsigned int have[PROCESSOR_COUNT_MAX];	/* nodes which announced the data */
+	struct qb_list_head list;
+};
+
+enum totempg_held_type {
+	TOTEMPG_HELD_MESSAGE,
+	TOTEMPG_HELD_PAYLOAD,
+	TOTEMPG_HELD_CONFCHG
+};
+
+/*
+ * Delivery held back behind a payload which is not present yet, the lists
+ * of a configuration change or the message follow in data
  */
-static unsigned char *fragmentation_data;
+struct totempg_held {
+	enum totempg_held_type type;
+	unsigned int nodeid;
+	unsigned int msg_len;
+	int endian_conversion_required;
+	struct totempg_payload *payload;
+	enum totem_configuration_type configuration_type;
+	size_t member_list_entries;
+	size_t left_list_entries;
+	size_t joined_list_entries;
+	struct memb_ring_id ring_id;
+	uint64_t held_time;
+	struct qb_list_head list;
+	unsigned char data[];
+};
+
+QB_LIST_DECLARE(payload_list);
+
+QB_LIST_DECLARE(payload_held_list);
+
+static size_t payload_bytes;
+
+static unsigned int payload_next_id;
+
+static unsigned int payload_members[PROCESSOR_COUNT_MAX];
+
+static size_t payload_member_entries;
 
-static int fragment_size = 0;
+static qb_loop_t *totempg_poll_handle;
 
-static int fragment_continuation = 0;
+static qb_loop_timer_handle payload_timer;
+
+static int payload_timer_running;
 
 static int totempg_waiting_transack = 0;
 
@@ -255,14 +440,16 @@ struct totempg_group_instance {
 
 	struct totempg_group *groups;
 
+	uint64_t *group_hashes;		/* of the groups, in the same order */
+
+	uint64_t group_filter;		/* group_filter_bits of all groups */
+
 	int groups_cnt;
 	int32_t q_level;
 
 	struct qb_list_head list;
 };
 
-static unsigned char next_fragment = 1;
-
 static pthread_mutex_t totempg_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static pthread_mutex_t callback_token_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -281,98 +468,147 @@ static int msg_count_send_ok (int msg_count);
 
 static int byte_count_send_ok (int byte_count);
 
+static int mcast_msg (
+	struct iovec *iovec_in,
+	unsigned int iov_len,
+	int guarantee);
+
 static void totempg_waiting_trans_ack_cb (int waiting_trans_ack)
 {
 	log_printf(LOG_DEBUG, "waiting_trans_ack changed to %u", waiting_trans_ack);
 	totempg_waiting_transack = waiting_trans_ack;
 }
 
-static struct assembly *assembly_ref (unsigned int nodeid)
+static struct qb_list_head *assembly_bucket (unsigned int nodeid)
 {
-	struct assembly *assembly;
-	struct qb_list_head *list;
-	struct qb_list_head *active_assembly_list_inuse;
+	return (&assembly_hash[(nodeid * 2654435761U) >> (32 - ASSEMBLY_HASH_BITS)]);
+}
 
-	if (totempg_waiting_transack) {
-		active_assembly_list_inuse = &assembly_list_inuse_trans;
-	} else {
-		active_assembly_list_inuse = &assembly_list_inuse;
+static void assembly_bytes_update (ssize_t change)
+{
+	totempg_stats.assembly_bytes += change;
+	if (totempg_stats.assembly_bytes > totempg_stats.assembly_bytes_max) {
+		totempg_stats.assembly_bytes_max = totempg_stats.assembly_bytes;
 	}
+}
+
+static struct assembly *assembly_ref (unsigned int nodeid, enum totem_lane lane)
+{
+	struct assembly *assembly;
+	struct qb_list_head *bucket;
+	struct qb_list_head *list;
+	int trans = totempg_waiting_transack;
 
 	/*
-	 * Search inuse list for node id and return assembly buffer if found
+	 * Search the bucket of the node for the lane and return the assembly
+	 * buffer if found
 	 */
-	qb_list_for_each(list, active_assembly_list_inuse) {
+	bucket = assembly_bucket (nodeid);
+	qb_list_for_each(list, bucket) {
 		assembly = qb_list_entry (list, struct assembly, list);
 
-		if (nodeid == assembly->nodeid) {
+		if (nodeid == assembly->nodeid && lane == assembly->lane &&
+		    trans == assembly->trans) {
 			return (assembly);
 		}
 	}
 
 	/*
-	 * Nothing found in inuse list get one from free list if available
+	 * Nothing found in the bucket get one from free list if available
 	 */
 	if (qb_list_empty (&assembly_list_free) == 0) {
 		assembly = qb_list_first_entry (&assembly_list_free, struct assembly, list);
 		qb_list_del (&assembly->list);
-		qb_list_add (&assembly->list, active_assembly_list_inuse);
-		assembly->nodeid = nodeid;
-		assembly->index = 0;
-		assembly->last_frag_num = 0;
-		assembly->throw_away_mode = THROW_AWAY_INACTIVE;
-		return (assembly);
+		assembly_free_count--;
+	} else {
+		/*
+		 * Nothing available in the free list, so allocate a new one.
+		 * Its data buffer is only allocated when data arrives.
+		 */
+		assembly = malloc (sizeof (struct assembly));
+		/*
+		 * TODO handle memory allocation failure here
+		 */
+		assert (assembly);
+		assembly->data = NULL;
+		assembly->data_size = 0;
+		assembly_bytes_update (sizeof (struct assembly));
 	}
-
-	/*
-	 * Nothing available in inuse or free list, so allocate a new one
-	 */
-	assembly = malloc (sizeof (struct assembly));
-	/*
-	 * TODO handle memory allocation failure here
-	 */
-	assert (assembly);
 	assembly->nodeid = nodeid;
-	assembly->data[0] = 0;
+	assembly->lane = lane;
+	assembly->trans = trans;
 	assembly->index = 0;
 	assembly->last_frag_num = 0;
 	assembly->throw_away_mode = THROW_AWAY_INACTIVE;
-	qb_list_init (&assembly->list);
-	qb_list_add (&assembly->list, active_assembly_list_inuse);
+	qb_list_add (&assembly->list, bucket);
+	totempg_stats.assembly_in_use++;
 
 	return (assembly);
 }
 
+/*
+ * Make room for len more bytes after the data already assembled
+ */
+static void assembly_data_reserve (struct assembly *assembly, size_t len)
+{
+	size_t needed = assembly->index + len;
+	size_t new_size;
+	unsigned char *new_data;
+
+	if (needed <= assembly->data_size && assembly->data != NULL) {
+		return;
+	}
+
+	new_size = assembly->data_size ? assembly->data_size : ASSEMBLY_DATA_MIN;
+	while (new_size < needed) {
+		new_size *= 2;
+	}
+	if (new_size > ASSEMBLY_DATA_MAX) {
+		new_size = ASSEMBLY_DATA_MAX;
+	}
+
+	new_data = realloc (assembly->data, new_size);
+	/*
+	 * Like assembly_ref, there is no way to go on without the message
+	 */
+	assert (new_data);
+	assembly_bytes_update (new_size - assembly->data_size);
+	assembly->data = new_data;
+	assembly->data_size = new_size;
+}
+
 static void assembly_deref (struct assembly *assembly)
 {
 	qb_list_del (&assembly->list);
+	totempg_stats.assembly_in_use--;
+	if (assembly_free_count >= ASSEMBLY_FREE_MAX) {
+		assembly_bytes_update (-(ssize_t)(assembly->data_size + sizeof (struct assembly)));
+		free (assembly->data);
+		free (assembly);
+		return;
+	}
+	if (assembly->data_size > ASSEMBLY_DATA_KEEP) {
+		assembly_bytes_update (-(ssize_t)assembly->data_size);
+		free (assembly->data);
+		assembly->data = NULL;
+		assembly->data_size = 0;
+	}
 	qb_list_add (&assembly->list, &assembly_list_free);
+	assembly_free_count++;
 }
 
 static void assembly_deref_from_normal_and_trans (int nodeid)
 {
-	int j;
 	struct qb_list_head *list, *tmp_iter;
-	struct qb_list_head *active_assembly_list_inuse;
 	struct assembly *assembly;
 
-	for (j = 0; j < 2; j++) {
-		if (j == 0) {
-			active_assembly_list_inuse = &assembly_list_inuse;
-		} else {
-			active_assembly_list_inuse = &assembly_list_inuse_trans;
-		}
-
-		qb_list_for_each_safe(list, tmp_iter, active_assembly_list_inuse) {
-			assembly = qb_list_entry (list, struct assembly, list);
+	qb_list_for_each_safe(list, tmp_iter, assembly_bucket (nodeid)) {
+		assembly = qb_list_entry (list, struct assembly, list);
 
-			if (nodeid == assembly->nodeid) {
-				qb_list_del (&assembly->list);
-				qb_list_add (&assembly->list, &assembly_list_free);
-			}
+		if (nodeid == assembly->nodeid) {
+			assembly_deref (assembly);
 		}
 	}
-
 }
 
 static inline void app_confchg_fn (
@@ -412,6 +648,51 @@ static inline void app_confchg_fn (
 	}
 }
 
+/*
+ * FNV-1a, the transport already protects the data, the hash only makes sure
+ * chunks of different payloads or group names are told apart quickly
+ */
+static uint64_t totempg_hash (const void *data, size_t len)
+{
+	const unsigned char *bytes = data;
+	uint64_t hash = 14695981039346656037ULL;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return (hash);
+}
+
+/*
+ * Two bit bloom filter of a group name hash.  An instance whose filter
+ * shares no bit with the filter of a message has none of its groups.
+ */
+static inline uint64_t group_filter_bits (uint64_t hash)
+{
+	return ((1ULL << (hash & 63)) | (1ULL << ((hash >> 6) & 63)));
+}
+
+/*
+ * The group names of a message are hashed once per delivery when more than
+ * GROUP_HASHES_MIN groups are joined in total, a few groups are compared
+ * faster by name.  Names past GROUP_HASHES_MAX are compared by name only.
+ */
+#define GROUP_HASHES_MIN	2
+#define GROUP_HASHES_MAX	32
+
+struct totempg_msg_groups {
+	const unsigned short *group_len;	/* count followed by lengths */
+	const char *group_name;
+	unsigned int adjust_iovec;		/* bytes before the app data */
+	int hashed;				/* names with a hash */
+	uint64_t hashes[GROUP_HASHES_MAX];
+	uint64_t filter;
+};
+
+static int totempg_groups_joined;
+
 static inline void group_endian_convert (
 	void *msg,
 	int msg_len)
@@ -445,55 +726,63 @@ static inline void group_endian_convert (
 	}
 }
 
-static inline int group_matches (
-	struct iovec *iovec,
-	unsigned int iov_len,
-	struct totempg_group *groups_b,
-	unsigned int group_b_cnt,
-	unsigned int *adjust_iovec)
+static inline void msg_groups_parse (
+	const void *msg,
+	struct totempg_msg_groups *msg_groups)
 {
-	unsigned short *group_len;
-	char *group_name;
+	const unsigned short *group_len = msg;
+	const char *group_name;
 	int i;
-	int j;
-#ifdef TOTEMPG_NEED_ALIGN
-        struct iovec iovec_aligned = { NULL, 0 };
-#endif
-
-	assert (iov_len == 1);
 
-#ifdef TOTEMPG_NEED_ALIGN
-	/*
-	 * Align data structure for not i386 or x86_64
-	 */
-	if ((size_t)iovec->iov_base % sizeof(char *) != 0) {
-		iovec_aligned.iov_base = alloca(iovec->iov_len);
-		memcpy(iovec_aligned.iov_base, iovec->iov_base, iovec->iov_len);
-		iovec_aligned.iov_len = iovec->iov_len;
-		iovec = &iovec_aligned;
-	}
-#endif
-
-	group_len = (unsigned short *)iovec->iov_base;
-	group_name = ((char *)iovec->iov_base) +
+	msg_groups->group_len = group_len;
+	msg_groups->group_name = group_name = ((const char *)msg) +
 		sizeof (unsigned short) * (group_len[0] + 1);
-
+	msg_groups->hashed = 0;
+	msg_groups->filter = 0;
+	if (totempg_groups_joined <= GROUP_HASHES_MIN ||
+	    group_len[0] > GROUP_HASHES_MAX) {
+		msg_groups->filter = ~0ULL;
+	}
 
 	/*
 	 * Calculate amount to adjust the iovec by before delivering to app
 	 */
-	*adjust_iovec = sizeof (unsigned short) * (group_len[0] + 1);
+	msg_groups->adjust_iovec = sizeof (unsigned short) * (group_len[0] + 1);
 	for (i = 1; i < group_len[0] + 1; i++) {
-		*adjust_iovec += group_len[i];
+		if (msg_groups->filter != ~0ULL) {
+			msg_groups->hashes[i - 1] = totempg_hash (group_name, group_len[i]);
+			msg_groups->filter |= group_filter_bits (msg_groups->hashes[i - 1]);
+			msg_groups->hashed = i;
+		}
+		msg_groups->adjust_iovec += group_len[i];
+		group_name += group_len[i];
+	}
+}
+
+/*
+ * Determine if a message should be delivered to an instance
+ */
+static inline int group_matches (
+	const struct totempg_msg_groups *msg_groups,
+	const struct totempg_group_instance *instance)
+{
+	const unsigned short *group_len = msg_groups->group_len;
+	const char *group_name = msg_groups->group_name;
+	int i;
+	int j;
+
+	if ((msg_groups->filter & instance->group_filter) == 0) {
+		return (0);
 	}
 
-	/*
-	 * Determine if this message should be delivered to this instance
-	 */
 	for (i = 1; i < group_len[0] + 1; i++) {
-		for (j = 0; j < group_b_cnt; j++) {
-			if ((group_len[i] == groups_b[j].group_len) &&
-				(memcmp (groups_b[j].group, group_name, group_len[i]) == 0)) {
+		for (j = 0; j < instance->groups_cnt; j++) {
+			if (i <= msg_groups->hashed &&
+			    msg_groups->hashes[i - 1] != instance->group_hashes[j]) {
+				continue;
+			}
+			if ((group_len[i] == instance->groups[j].group_len) &&
+				(memcmp (instance->groups[j].group, group_name, group_len[i]) == 0)) {
 				return (1);
 			}
 		}
@@ -503,59 +792,509 @@ static inline int group_matches (
 }
 
 
-static inline void app_deliver_fn (
+/*
+ * Message compression
+ *
+ * With compression_model set, a message of at least compression_threshold
+ * bytes is sent compressed if that makes it smaller.  It is then addressed
+ * to the reserved group TOTEMPG_COMPRESSED_GROUP, which no service joins,
+ * and followed by a totempg_compress_header and the compressed message, its
+ * group header included.
+ *
+ * After every regular configuration change each processor multicasts the
+ * codecs it can decompress to the reserved group TOTEMPG_CODECS_GROUP.  A
+ * message is only compressed while every member of the ring has advertised
+ * the codec, so processors of older versions or built without the codec
+ * receive it uncompressed.
+ */
+#define TOTEMPG_COMPRESSED_GROUP	"\0totempg.compressed"
+#define TOTEMPG_COMPRESSED_GROUP_LEN	(sizeof (TOTEMPG_COMPRESSED_GROUP) - 1)
+#define TOTEMPG_CODECS_GROUP		"\0totempg.codecs"
+#define TOTEMPG_CODECS_GROUP_LEN	(sizeof (TOTEMPG_CODECS_GROUP) - 1)
+
+enum totempg_compress_codec {
+	TOTEMPG_COMPRESS_NONE = 0,
+	TOTEMPG_COMPRESS_ZLIB = 1
+};
+
+struct totempg_compress_header {
+	unsigned int codec;
+	unsigned int size;		/* of the message before compression */
+} __attribute__((packed));
+
+struct totempg_codecs {
+	unsigned int codecs;		/* bit (1 << codec) per codec */
+} __attribute__((packed));
+
+struct totempg_codecs_member {
+	unsigned int nodeid;
+	unsigned int codecs;
+};
+
+static unsigned short compress_group_len[2] = { 1, TOTEMPG_COMPRESSED_GROUP_LEN };
+
+static unsigned short codecs_group_len[2] = { 1, TOTEMPG_CODECS_GROUP_LEN };
+
+static struct totempg_codecs_member codecs_members[PROCESSOR_COUNT_MAX];
+
+static size_t codecs_member_entries;
+
+static struct totempg_compress_header compress_header;
+
+static unsigned char *compress_buffer;
+
+static size_t compress_buffer_size;
+
+static unsigned char *decompress_buffer;
+
+static size_t decompress_buffer_size;
+
+static uint64_t compress_cpu_ns;
+
+static uint64_t decompress_cpu_ns;
+
+#ifdef HAVE_ZLIB
+static z_stream compress_stream;
+
+static int compress_stream_ready;
+
+static unsigned int compress_stream_level;
+
+static z_stream decompress_stream;
+
+static int decompress_stream_ready;
+#endif
+
+static uint64_t thread_cpu_time_get (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ((uint64_t)ts.tv_sec * QB_TIME_NS_IN_SEC + ts.tv_nsec);
+}
+
+static unsigned int codecs_supported (void)
+{
+	unsigned int codecs = 0;
+
+#ifdef HAVE_ZLIB
+	codecs |= 1 << TOTEMPG_COMPRESS_ZLIB;
+#endif
+	return (codecs);
+}
+
+/*
+ * Forget what the members advertised on a regular configuration change and
+ * advertise the codecs of this processor to the new ring
+ */
+static void codecs_members_set (
+	const unsigned int *member_list,
+	size_t member_list_entries)
+{
+	struct iovec iovec[3];
+	struct totempg_codecs codecs;
+	unsigned int my_nodeid;
+	size_t i;
+
+	my_nodeid = totemsrp_my_nodeid_get (totemsrp_context);
+	codecs.codecs = codecs_supported ();
+	for (i = 0; i < member_list_entries; i++) {
+		codecs_members[i].nodeid = member_list[i];
+		codecs_members[i].codecs = 0;
+		if (member_list[i] == my_nodeid) {
+			codecs_members[i].codecs = codecs.codecs;
+		}
+	}
+	codecs_member_entries = member_list_entries;
+
+	if (codecs.codecs == 0) {
+		return;
+	}
+	iovec[0].iov_base = codecs_group_len;
+	iovec[0].iov_len = sizeof (codecs_group_len);
+	iovec[1].iov_base = (void *)TOTEMPG_CODECS_GROUP;
+	iovec[1].iov_len = TOTEMPG_CODECS_GROUP_LEN;
+	iovec[2].iov_base = &codecs;
+	iovec[2].iov_len = sizeof (codecs);
+	if (mcast_msg (iovec, 3, TOTEMPG_AGREED) != 0) {
+		log_printf (LOG_WARNING,
+			"Unable to advertise the compression codecs, messages are sent uncompressed.");
+	}
+}
+
+static void codecs_member_advertised (
 	unsigned int nodeid,
-	void *msg,
+	const struct totempg_msg_groups *msg_groups,
+	const void *msg,
 	unsigned int msg_len,
 	int endian_conversion_required)
 {
-	struct totempg_group_instance *instance;
-	struct iovec stripped_iovec;
-	unsigned int adjust_iovec;
-	struct iovec *iovec;
-	struct qb_list_head *list;
-
-        struct iovec aligned_iovec = { NULL, 0 };
+	struct totempg_codecs codecs;
+	size_t i;
 
+	if (msg_len < msg_groups->adjust_iovec + sizeof (codecs)) {
+		return;
+	}
+	memcpy (&codecs, (const char *)msg + msg_groups->adjust_iovec, sizeof (codecs));
 	if (endian_conversion_required) {
-		group_endian_convert (msg, msg_len);
+		codecs.codecs = swab32 (codecs.codecs);
 	}
+	for (i = 0; i < codecs_member_entries; i++) {
+		if (codecs_members[i].nodeid == nodeid) {
+			codecs_members[i].codecs = codecs.codecs;
+		}
+	}
+}
 
-	/*
-	 * TODO: segmentation/assembly need to be redesigned to provide aligned access
-	 * in all cases to avoid memory copies on non386 archs. Probably broke backwars
-	 * compatibility
-	 */
+/*
+ * The configured codec, if every member of the ring can decompress it
+ */
+static enum totempg_compress_codec compress_codec_get (void)
+{
+	enum totempg_compress_codec codec = TOTEMPG_COMPRESS_NONE;
+	size_t i;
 
-#ifdef TOTEMPG_NEED_ALIGN
-	/*
-	 * Align data structure for not i386 or x86_64
-	 */
-	aligned_iovec.iov_base = alloca(msg_len);
-	aligned_iovec.iov_len = msg_len;
-	memcpy(aligned_iovec.iov_base, msg, msg_len);
-#else
-	aligned_iovec.iov_base = msg;
-	aligned_iovec.iov_len = msg_len;
+#ifdef HAVE_ZLIB
+	if (strcmp (totempg_totem_config->compression_model, "zlib") == 0) {
+		codec = TOTEMPG_COMPRESS_ZLIB;
+	}
 #endif
+	if (codec == TOTEMPG_COMPRESS_NONE) {
+		return (codec);
+	}
+	for (i = 0; i < codecs_member_entries; i++) {
+		if ((codecs_members[i].codecs & (1 << codec)) == 0) {
+			return (TOTEMPG_COMPRESS_NONE);
+		}
+	}
+	return (codec);
+}
 
-	iovec = &aligned_iovec;
+/*
+ * Grow a buffer kept for the following messages to at least size bytes
+ */
+static unsigned char *compress_buffer_reserve (
+	unsigned char **buffer,
+	size_t *buffer_size,
+	size_t size)
+{
+	unsigned char *new_buffer;
 
-	qb_list_for_each(list, &totempg_groups_list) {
-		instance = qb_list_entry (list, struct totempg_group_instance, list);
-		if (group_matches (iovec, 1, instance->groups, instance->groups_cnt, &adjust_iovec)) {
-			stripped_iovec.iov_len = iovec->iov_len - adjust_iovec;
-			stripped_iovec.iov_base = (char *)iovec->iov_base + adjust_iovec;
+	if (size <= *buffer_size) {
+		return (*buffer);
+	}
+	new_buffer = realloc (*buffer, size);
+	if (new_buffer == NULL) {
+		return (NULL);
+	}
+	*buffer = new_buffer;
+	*buffer_size = size;
+	return (new_buffer);
+}
 
-#ifdef TOTEMPG_NEED_ALIGN
-			/*
-			 * Align data structure for not i386 or x86_64
-			 */
-			if ((uintptr_t)((char *)iovec->iov_base + adjust_iovec) % (sizeof(char *)) != 0) {
-				/*
-				 * Deal with misalignment
-				 */
-				stripped_iovec.iov_base =
+#ifdef HAVE_ZLIB
+/*
+ * Deflate the iovecs into out, fails if the result doesn't fit out_len bytes
+ */
+static int zlib_compress (
+	const struct iovec *iovec,
+	unsigned int iov_len,
+	unsigned char *out,
+	size_t *out_len)
+{
+	unsigned int level = totempg_totem_config->compression_level;
+	unsigned int i;
+	int res = Z_OK;
+
+	if (compress_stream_ready == 0 || compress_stream_level != level) {
+		if (compress_stream_ready) {
+			deflateEnd (&compress_stream);
+			compress_stream_ready = 0;
+		}
+		memset (&compress_stream, 0, sizeof (compress_stream));
+		if (deflateInit (&compress_stream, level) != Z_OK) {
+			return (-1);
+		}
+		compress_stream_ready = 1;
+		compress_stream_level = level;
+	} else {
+		deflateReset (&compress_stream);
+	}
+
+	compress_stream.next_out = out;
+	compress_stream.avail_out = *out_len;
+	for (i = 0; i < iov_len; i++) {
+		compress_stream.next_in = iovec[i].iov_base;
+		compress_stream.avail_in = iovec[i].iov_len;
+		res = deflate (&compress_stream,
+			(i == iov_len - 1) ? Z_FINISH : Z_NO_FLUSH);
+		if (res == Z_STREAM_ERROR || compress_stream.avail_in) {
+			return (-1);
+		}
+	}
+	if (res != Z_STREAM_END) {
+		return (-1);
+	}
+	*out_len -= compress_stream.avail_out;
+	return (0);
+}
+
+static int zlib_decompress (
+	const unsigned char *in,
+	size_t in_len,
+	unsigned char *out,
+	size_t out_len)
+{
+	if (decompress_stream_ready == 0) {
+		memset (&decompress_stream, 0, sizeof (decompress_stream));
+		if (inflateInit (&decompress_stream) != Z_OK) {
+			return (-1);
+		}
+		decompress_stream_ready = 1;
+	} else {
+		inflateReset (&decompress_stream);
+	}
+
+	decompress_stream.next_in = (unsigned char *)in;
+	decompress_stream.avail_in = in_len;
+	decompress_stream.next_out = out;
+	decompress_stream.avail_out = out_len;
+	if (inflate (&decompress_stream, Z_FINISH) != Z_STREAM_END ||
+	    decompress_stream.avail_out != 0) {
+		return (-1);
+	}
+	return (0);
+}
+#endif
+
+/*
+ * Compress a message of total_size bytes described by iovec.  If it gets
+ * smaller, iovec is replaced with the compressed message and total_size
+ * updated.  Returns the number of iovecs of the message to send.
+ */
+static unsigned int message_compress (
+	struct iovec *iovec,
+	unsigned int iov_len,
+	int *total_size)
+{
+	enum totempg_compress_codec codec;
+	size_t header_len;
+	size_t out_len;
+	uint64_t start;
+	int res = -1;
+
+	if (*total_size < totempg_totem_config->compression_threshold) {
+		return (iov_len);
+	}
+	codec = compress_codec_get ();
+	if (codec == TOTEMPG_COMPRESS_NONE) {
+		return (iov_len);
+	}
+
+	header_len = sizeof (compress_group_len) + TOTEMPG_COMPRESSED_GROUP_LEN +
+		sizeof (struct totempg_compress_header);
+	out_len = *total_size - header_len;
+	if (compress_buffer_reserve (&compress_buffer, &compress_buffer_size,
+	    out_len) == NULL) {
+		return (iov_len);
+	}
+
+	start = thread_cpu_time_get ();
+	switch (codec) {
+#ifdef HAVE_ZLIB
+	case TOTEMPG_COMPRESS_ZLIB:
+		res = zlib_compress (iovec, iov_len, compress_buffer, &out_len);
+		break;
+#endif
+	default:
+		break;
+	}
+	compress_cpu_ns += thread_cpu_time_get () - start;
+	totempg_stats.compress_cpu_us = compress_cpu_ns / QB_TIME_NS_IN_USEC;
+
+	if (res != 0) {
+		totempg_stats.compress_incompressible++;
+		return (iov_len);
+	}
+
+	compress_header.codec = codec;
+	compress_header.size = *total_size;
+	iovec[0].iov_base = compress_group_len;
+	iovec[0].iov_len = sizeof (compress_group_len);
+	iovec[1].iov_base = (void *)TOTEMPG_COMPRESSED_GROUP;
+	iovec[1].iov_len = TOTEMPG_COMPRESSED_GROUP_LEN;
+	iovec[2].iov_base = &compress_header;
+	iovec[2].iov_len = sizeof (compress_header);
+	iovec[3].iov_base = compress_buffer;
+	iovec[3].iov_len = out_len;
+
+	totempg_stats.compress_tx++;
+	totempg_stats.compress_bytes_saved += *total_size - (header_len + out_len);
+	*total_size = header_len + out_len;
+	return (4);
+}
+
+static inline int msg_groups_compressed (
+	const struct totempg_msg_groups *msg_groups)
+{
+	return (msg_groups->group_len[0] == 1 &&
+		msg_groups->group_len[1] == TOTEMPG_COMPRESSED_GROUP_LEN &&
+		memcmp (msg_groups->group_name, TOTEMPG_COMPRESSED_GROUP,
+			TOTEMPG_COMPRESSED_GROUP_LEN) == 0);
+}
+
+static inline int msg_groups_codecs (
+	const struct totempg_msg_groups *msg_groups)
+{
+	return (msg_groups->group_len[0] == 1 &&
+		msg_groups->group_len[1] == TOTEMPG_CODECS_GROUP_LEN &&
+		memcmp (msg_groups->group_name, TOTEMPG_CODECS_GROUP,
+			TOTEMPG_CODECS_GROUP_LEN) == 0);
+}
+
+/*
+ * Decompress a message sent to TOTEMPG_COMPRESSED_GROUP into the decompress
+ * buffer.  Senders only compress for a ring which advertised the codec, so a
+ * message which can't be decompressed is corrupt.  It comes off the wire, so
+ * it is logged and dropped instead of taking this processor down.
+ */
+static void *message_decompress (
+	unsigned int nodeid,
+	const struct totempg_msg_groups *msg_groups,
+	const void *msg,
+	unsigned int msg_len,
+	int endian_conversion_required,
+	unsigned int *size)
+{
+	struct totempg_compress_header header;
+	size_t data_offset = msg_groups->adjust_iovec + sizeof (header);
+	uint64_t start;
+	int res = -1;
+
+	memset (&header, 0, sizeof (header));
+	if (msg_len < data_offset) {
+		goto error_exit;
+	}
+	memcpy (&header, (const char *)msg + msg_groups->adjust_iovec, sizeof (header));
+	if (endian_conversion_required) {
+		header.codec = swab32 (header.codec);
+		header.size = swab32 (header.size);
+	}
+	if (header.size > MESSAGE_SIZE_MAX ||
+	    compress_buffer_reserve (&decompress_buffer, &decompress_buffer_size,
+	    header.size) == NULL) {
+		goto error_exit;
+	}
+
+	start = thread_cpu_time_get ();
+	switch (header.codec) {
+#ifdef HAVE_ZLIB
+	case TOTEMPG_COMPRESS_ZLIB:
+		res = zlib_decompress ((const unsigned char *)msg + data_offset,
+			msg_len - data_offset, decompress_buffer, header.size);
+		break;
+#endif
+	default:
+		break;
+	}
+	decompress_cpu_ns += thread_cpu_time_get () - start;
+	totempg_stats.decompress_cpu_us = decompress_cpu_ns / QB_TIME_NS_IN_USEC;
+
+	if (res != 0) {
+		goto error_exit;
+	}
+	totempg_stats.compress_rx++;
+	*size = header.size;
+	return (decompress_buffer);
+
+error_exit:
+	log_printf(LOG_ERR,
+		"Compressed message of node " CS_PRI_NODE_ID " (codec %u, %u bytes) could not be decompressed, dropping it.",
+		nodeid, header.codec, msg_len);
+	totempg_stats.compress_errors++;
+	return (NULL);
+}
+
+static inline void app_deliver_fn (
+	unsigned int nodeid,
+	void *msg,
+	unsigned int msg_len,
+	int endian_conversion_required)
+{
+	struct totempg_group_instance *instance;
+	struct iovec stripped_iovec;
+	unsigned int adjust_iovec;
+	struct iovec *iovec;
+	struct qb_list_head *list;
+	struct totempg_msg_groups msg_groups;
+
+        struct iovec aligned_iovec = { NULL, 0 };
+
+	if (endian_conversion_required) {
+		group_endian_convert (msg, msg_len);
+	}
+
+	/*
+	 * TODO: segmentation/assembly need to be redesigned to provide aligned access
+	 * in all cases to avoid memory copies on non386 archs. Probably broke backwars
+	 * compatibility
+	 */
+
+#ifdef TOTEMPG_NEED_ALIGN
+	/*
+	 * Align data structure for not i386 or x86_64
+	 */
+	if ((uintptr_t)msg % sizeof(char *) != 0) {
+		aligned_iovec.iov_base = alloca(msg_len);
+		memcpy(aligned_iovec.iov_base, msg, msg_len);
+	} else {
+		aligned_iovec.iov_base = msg;
+	}
+	aligned_iovec.iov_len = msg_len;
+#else
+	aligned_iovec.iov_base = msg;
+	aligned_iovec.iov_len = msg_len;
+#endif
+
+	iovec = &aligned_iovec;
+
+	msg_groups_parse (iovec->iov_base, &msg_groups);
+	if (msg_groups_codecs (&msg_groups)) {
+		codecs_member_advertised (nodeid, &msg_groups,
+			iovec->iov_base, iovec->iov_len,
+			endian_conversion_required);
+		return;
+	}
+	if (msg_groups_compressed (&msg_groups)) {
+		iovec->iov_base = message_decompress (nodeid, &msg_groups,
+			iovec->iov_base, iovec->iov_len,
+			endian_conversion_required, &msg_len);
+		if (iovec->iov_base == NULL) {
+			return;
+		}
+		iovec->iov_len = msg_len;
+		if (endian_conversion_required) {
+			group_endian_convert (iovec->iov_base, msg_len);
+		}
+		msg_groups_parse (iovec->iov_base, &msg_groups);
+	}
+	adjust_iovec = msg_groups.adjust_iovec;
+
+	qb_list_for_each(list, &totempg_groups_list) {
+		instance = qb_list_entry (list, struct totempg_group_instance, list);
+		if (group_matches (&msg_groups, instance)) {
+			stripped_iovec.iov_len = iovec->iov_len - adjust_iovec;
+			stripped_iovec.iov_base = (char *)iovec->iov_base + adjust_iovec;
+
+#ifdef TOTEMPG_NEED_ALIGN
+			/*
+			 * Align data structure for not i386 or x86_64
+			 */
+			if ((uintptr_t)((char *)iovec->iov_base + adjust_iovec) % (sizeof(char *)) != 0) {
+				/*
+				 * Deal with misalignment
+				 */
+				stripped_iovec.iov_base =
 					alloca (stripped_iovec.iov_len);
 				memcpy (stripped_iovec.iov_base,
 					 (char *)iovec->iov_base + adjust_iovec,
@@ -571,6 +1310,731 @@ static inline void app_deliver_fn (
 	}
 }
 
+static void payload_held_flush (void);
+
+static void payload_timer_fn (void *data);
+
+static void payload_timer_start (void)
+{
+	if (payload_timer_running) {
+		return;
+	}
+	if (qb_loop_timer_add (totempg_poll_handle, QB_LOOP_MED,
+	    PAYLOAD_TIMER_MSEC * QB_TIME_NS_IN_MSEC, NULL,
+	    payload_timer_fn, &payload_timer) == 0) {
+		payload_timer_running = 1;
+	}
+}
+
+static int payload_member (unsigned int nodeid)
+{
+	size_t i;
+
+	for (i = 0; i < payload_member_entries; i++) {
+		if (payload_members[i] == nodeid) {
+			return (1);
+		}
+	}
+	return (0);
+}
+
+static struct totempg_payload *payload_find (
+	unsigned int origin,
+	unsigned int id)
+{
+	struct totempg_payload *payload;
+	struct qb_list_head *list;
+
+	qb_list_for_each(list, &payload_list) {
+		payload = qb_list_entry (list, struct totempg_payload, list);
+		if (payload->origin == origin && payload->id == id) {
+			return (payload);
+		}
+	}
+	return (NULL);
+}
+
+static int payload_valid (
+	unsigned int size,
+	unsigned int chunk_size)
+{
+	return (size != 0 && size <= MESSAGE_SIZE_MAX + KNET_MAX_PACKET_SIZE &&
+		chunk_size != 0 && chunk_size <= FRAME_SIZE_MAX);
+}
+
+static int payload_room (size_t size)
+{
+	return (payload_bytes + size <= PAYLOAD_BYTES_MAX);
+}
+
+static struct totempg_payload *payload_create (
+	unsigned int origin,
+	unsigned int id,
+	unsigned int size,
+	uint64_t hash,
+	unsigned int chunk_size)
+{
+	struct totempg_payload *payload;
+
+	if (payload_valid (size, chunk_size) == 0) {
+		return (NULL);
+	}
+
+	payload = calloc (1, sizeof (struct totempg_payload));
+	if (payload == NULL) {
+		return (NULL);
+	}
+	payload->origin = origin;
+	payload->id = id;
+	payload->size = size;
+	payload->hash = hash;
+	payload->chunk_size = chunk_size;
+	payload->chunks = (size + chunk_size - 1) / chunk_size;
+	payload->activity_time = qb_util_nano_current_get ();
+	payload->data = malloc (size);
+	payload->received = calloc (payload->chunks, 1);
+	if (payload->data == NULL || payload->received == NULL) {
+		free (payload->data);
+		free (payload->received);
+		free (payload);
+		return (NULL);
+	}
+
+	qb_list_init (&payload->list);
+	qb_list_add_tail (&payload->list, &payload_list);
+	payload_bytes += size;
+	payload_timer_start ();
+
+	return (payload);
+}
+
+static void payload_free (struct totempg_payload *payload)
+{
+	qb_list_del (&payload->list);
+	payload_bytes -= payload->size;
+	free (payload->data);
+	free (payload->received);
+	free (payload);
+}
+
+static void payload_chunk_send (
+	struct totempg_payload *payload,
+	unsigned int nodeid,
+	unsigned int index)
+{
+	struct totempg_payload_header header;
+	struct iovec iovec[2];
+	size_t offset = (size_t)index * payload->chunk_size;
+
+	header.type = TOTEMPG_PAYLOAD_CHUNK;
+	header.origin = payload->origin;
+	header.id = payload->id;
+	header.size = payload->size;
+	header.hash = payload->hash;
+	header.chunk_size = payload->chunk_size;
+	header.index = index;
+
+	iovec[0].iov_base = &header;
+	iovec[0].iov_len = sizeof (header);
+	iovec[1].iov_base = &payload->data[offset];
+	iovec[1].iov_len = min (payload->chunk_size, payload->size - offset);
+
+	if (totemsrp_payload_send (totemsrp_context, nodeid, iovec, 2) == 0) {
+		totempg_stats.payload_chunk_tx++;
+	}
+}
+
+/*
+ * Request missing chunks from the origin, or from every member once the
+ * origin left
+ */
+static void payload_nack_send (struct totempg_payload *payload)
+{
+	struct totempg_payload_header header;
+	unsigned int missing[FRAME_SIZE_MAX / sizeof (unsigned int)];
+	unsigned int missing_max;
+	unsigned int my_nodeid;
+	struct iovec iovec[2];
+	unsigned int i;
+	size_t j;
+
+	missing_max = (totempg_totem_config->net_mtu - sizeof (header)) / sizeof (unsigned int);
+	header.index = 0;
+	for (i = 0; i < payload->chunks && header.index < missing_max; i++) {
+		if (payload->received[i] == 0) {
+			missing[header.index++] = i;
+		}
+	}
+	if (header.index == 0) {
+		return;
+	}
+
+	header.type = TOTEMPG_PAYLOAD_NACK;
+	header.origin = payload->origin;
+	header.id = payload->id;
+	header.size = payload->size;
+	header.hash = payload->hash;
+	header.chunk_size = payload->chunk_size;
+
+	iovec[0].iov_base = &header;
+	iovec[0].iov_len = sizeof (header);
+	iovec[1].iov_base = missing;
+	iovec[1].iov_len = header.index * sizeof (unsigned int);
+
+	totempg_stats.payload_nack_tx++;
+	if (payload_member (payload->origin) && payload->stalled == 0) {
+		(void)totemsrp_payload_send (totemsrp_context, payload->origin, iovec, 2);
+		return;
+	}
+	my_nodeid = totemsrp_my_nodeid_get (totemsrp_context);
+	for (j = 0; j < payload_member_entries; j++) {
+		if (payload_members[j] != my_nodeid) {
+			(void)totemsrp_payload_send (totemsrp_context, payload_members[j], iovec, 2);
+		}
+	}
+}
+
+/*
+ * Announce through the ring that the data of an ordered payload is held here,
+ * the timer tries again if the message can't be queued now
+ */
+static void payload_have_send (struct totempg_payload *payload)
+{
+	struct totempg_payload_have have;
+	struct totempg_mcast mcast;
+	unsigned char *buffer;
+	size_t buffer_len_max;
+
+	if (payload->ordered == 0 || payload->complete == 0 || payload->have_sent) {
+		return;
+	}
+
+	buffer = totemsrp_mcast_buffer_alloc (totemsrp_context, &buffer_len_max);
+	if (buffer == NULL) {
+		return;
+	}
+	memset (&mcast, 0, sizeof (mcast));
+	mcast.header.version = 0;
+	mcast.header.type = TOTEMPG_TYPE_PAYLOAD_HAVE;
+	have.origin = payload->origin;
+	have.id = payload->id;
+	have.hash = payload->hash;
+	memcpy (buffer, &mcast, sizeof (mcast));
+	memcpy (&buffer[sizeof (mcast)], &have, sizeof (have));
+
+	if (totemsrp_mcast_buffer_submit (totemsrp_context, buffer,
+	    sizeof (mcast) + sizeof (have), TOTEMPG_AGREED) == -1) {
+		totemsrp_mcast_buffer_release (totemsrp_context, buffer);
+		return;
+	}
+	payload->have_sent = 1;
+}
+
+static void payload_header_endian_convert (struct totempg_payload_header *header)
+{
+	header->type = swab32 (header->type);
+	header->origin = swab32 (header->origin);
+	header->id = swab32 (header->id);
+	header->size = swab32 (header->size);
+	header->hash = swab64 (header->hash);
+	header->chunk_size = swab32 (header->chunk_size);
+	header->index = swab32 (header->index);
+}
+
+/*
+ * Chunk received, the data is announced once the payload is complete
+ */
+static void payload_chunk_receive (
+	const struct totempg_payload_header *header,
+	const unsigned char *data,
+	unsigned int data_len,
+	int endian_conversion_required)
+{
+	struct totempg_payload *payload;
+	size_t offset;
+	size_t expected_len;
+
+	payload = payload_find (header->origin, header->id);
+	if (payload != NULL &&
+	    (payload->size != header->size || payload->hash != header->hash ||
+	     payload->chunk_size != header->chunk_size)) {
+		if (payload->ordered) {
+			return;
+		}
+		/*
+		 * Stale data of an earlier incarnation of the origin
+		 */
+		payload_free (payload);
+		payload = NULL;
+	}
+	if (payload == NULL) {
+		/*
+		 * Data ahead of its descriptor is only kept while there is room,
+		 * it is requested again once the descriptor is delivered
+		 */
+		if (payload_room (header->size) == 0) {
+			return;
+		}
+		payload = payload_create (header->origin, header->id, header->size,
+			header->hash, header->chunk_size);
+		if (payload == NULL) {
+			return;
+		}
+		payload->endian_conversion_required = endian_conversion_required;
+	}
+	if (payload->complete || header->index >= payload->chunks ||
+	    payload->received[header->index]) {
+		return;
+	}
+
+	offset = (size_t)header->index * payload->chunk_size;
+	expected_len = min (payload->chunk_size, payload->size - offset);
+	if (data_len != expected_len) {
+		log_printf(LOG_WARNING,
+		    "Payload chunk of node " CS_PRI_NODE_ID " has length %u, expected %zu...  Ignoring.",
+		    header->origin, data_len, expected_len);
+		return;
+	}
+
+	memcpy (&payload->data[offset], data, data_len);
+	payload->received[header->index] = 1;
+	payload->chunks_received++;
+	payload->activity_time = qb_util_nano_current_get ();
+	totempg_stats.payload_chunk_rx++;
+
+	if (payload->chunks_received < payload->chunks) {
+		return;
+	}
+	if (totempg_hash (payload->data, payload->size) != payload->hash) {
+		log_printf(LOG_WARNING,
+		    "Payload %u of node " CS_PRI_NODE_ID " doesn't match its hash, requesting it again.",
+		    payload->id, payload->origin);
+		memset (payload->received, 0, payload->chunks);
+		payload->chunks_received = 0;
+		return;
+	}
+	payload->complete = 1;
+	payload_have_send (payload);
+}
+
+/*
+ * Serve the chunks of a request which are present here
+ */
+static void payload_nack_receive (
+	unsigned int nodeid,
+	const struct totempg_payload_header *header,
+	const unsigned char *data,
+	unsigned int data_len,
+	int endian_conversion_required)
+{
+	struct totempg_payload *payload;
+	unsigned int index;
+	unsigned int i;
+
+	if (data_len < header->index * sizeof (unsigned int)) {
+		return;
+	}
+	payload = payload_find (header->origin, header->id);
+	if (payload == NULL || payload->hash != header->hash) {
+		return;
+	}
+	/*
+	 * Keep a delivered payload while somebody still needs it
+	 */
+	if (payload->delivered) {
+		payload->delivered_time = qb_util_nano_current_get ();
+	}
+	for (i = 0; i < header->index; i++) {
+		memcpy (&index, &data[i * sizeof (unsigned int)], sizeof (unsigned int));
+		if (endian_conversion_required) {
+			index = swab32 (index);
+		}
+		if (index < payload->chunks && payload->received[index]) {
+			payload_chunk_send (payload, nodeid, index);
+			totempg_stats.payload_chunk_retx++;
+		}
+	}
+}
+
+/*
+ * Side channel data received from totemsrp
+ */
+static void payload_deliver_fn (
+	unsigned int nodeid,
+	const void *msg,
+	unsigned int msg_len,
+	int endian_conversion_required)
+{
+	struct totempg_payload_header header;
+	const unsigned char *data = (const unsigned char *)msg + sizeof (header);
+
+	if (msg_len < sizeof (header)) {
+		log_printf(LOG_WARNING,
+		    "Payload message received from node " CS_PRI_NODE_ID " is too short...  Ignoring.", nodeid);
+		return;
+	}
+	memcpy (&header, msg, sizeof (header));
+	if (endian_conversion_required) {
+		payload_header_endian_convert (&header);
+	}
+
+	if (totempg_threaded_mode == 1) {
+		pthread_mutex_lock (&mcast_msg_mutex);
+	}
+	switch (header.type) {
+	case TOTEMPG_PAYLOAD_CHUNK:
+		payload_chunk_receive (&header, data, msg_len - sizeof (header),
+			endian_conversion_required);
+		break;
+	case TOTEMPG_PAYLOAD_NACK:
+		payload_nack_receive (nodeid, &header, data, msg_len - sizeof (header),
+			endian_conversion_required);
+		break;
+	default:
+		break;
+	}
+	if (totempg_threaded_mode == 1) {
+		pthread_mutex_unlock (&mcast_msg_mutex);
+	}
+}
+
+static void payload_timer_fn (void *data)
+{
+	struct totempg_payload *payload;
+	struct qb_list_head *list, *tmp_iter;
+	uint64_t retain_ns;
+	uint64_t now;
+
+	/*
+	 * Long enough for the membership to exclude a failed origin and for
+	 * the other processors to serve its data
+	 */
+	retain_ns = (uint64_t)(totempg_totem_config->token_timeout +
+		totempg_totem_config->consensus_timeout) * QB_TIME_NS_IN_MSEC;
+	now = qb_util_nano_current_get ();
+
+	if (totempg_threaded_mode == 1) {
+		pthread_mutex_lock (&mcast_msg_mutex);
+	}
+	payload_timer_running = 0;
+	qb_list_for_each_safe(list, tmp_iter, &payload_list) {
+		payload = qb_list_entry (list, struct totempg_payload, list);
+
+		if (payload->delivered) {
+			if (now - payload->delivered_time > retain_ns) {
+				payload_free (payload);
+			}
+		} else
+		if (payload->ordered) {
+			if (payload->complete) {
+				payload_have_send (payload);
+				continue;
+			}
+			if (payload->stalled == 0 && now - payload->ordered_time > retain_ns) {
+				log_printf(LOG_WARNING,
+				    "Payload %u (%u bytes) of node " CS_PRI_NODE_ID " not obtained yet, requesting it from all members.",
+				    payload->id, payload->size, payload->origin);
+				payload->stalled = 1;
+				totempg_stats.payload_stalled++;
+			}
+			if (now - payload->activity_time >= PAYLOAD_TIMER_MSEC * QB_TIME_NS_IN_MSEC) {
+				payload_nack_send (payload);
+			}
+		} else
+		if (now - payload->activity_time > retain_ns) {
+			/*
+			 * The descriptor never came
+			 */
+			payload_free (payload);
+		}
+	}
+	if (qb_list_empty (&payload_list) == 0) {
+		payload_timer_start ();
+	}
+	if (totempg_threaded_mode == 1) {
+		pthread_mutex_unlock (&mcast_msg_mutex);
+	}
+}
+
+static struct totempg_held *held_add (
+	enum totempg_held_type type,
+	size_t data_len)
+{
+	struct totempg_held *held;
+
+	held = malloc (sizeof (struct totempg_held) + data_len);
+	/*
+	 * Like assembly_ref, there is no way to recover from losing a message
+	 */
+	assert (held);
+	memset (held, 0, sizeof (struct totempg_held));
+	held->type = type;
+	held->held_time = qb_util_nano_current_get ();
+	qb_list_init (&held->list);
+	qb_list_add_tail (&held->list, &payload_held_list);
+	totempg_stats.payload_held++;
+
+	return (held);
+}
+
+static void held_payload_deliver (struct totempg_held *held)
+{
+	struct totempg_payload *payload = held->payload;
+	unsigned char *msg = payload->data;
+	uint64_t hold_us;
+
+	/*
+	 * The group header is converted in place, keep the data intact
+	 * for processors still requesting it
+	 */
+	if (payload->endian_conversion_required) {
+		msg = malloc (payload->size);
+		assert (msg);
+		memcpy (msg, payload->data, payload->size);
+	}
+	app_deliver_fn (payload->origin, msg, payload->size,
+		payload->endian_conversion_required);
+	if (msg != payload->data) {
+		free (msg);
+	}
+	totempg_stats.payload_rx++;
+
+	hold_us = (qb_util_nano_current_get () - held->held_time) / QB_TIME_NS_IN_USEC;
+	if (hold_us > totempg_stats.payload_hold_us_max) {
+		totempg_stats.payload_hold_us_max = hold_us;
+	}
+	payload->delivered = 1;
+	payload->delivered_time = qb_util_nano_current_get ();
+}
+
+/*
+ * Deliver held messages and configuration changes up to the first payload
+ * whose announcement by this processor was not delivered yet
+ */
+static void payload_held_flush (void)
+{
+	struct totempg_held *held;
+	unsigned int *member_list;
+	unsigned int *left_list;
+	unsigned int *joined_list;
+
+	while (qb_list_empty (&payload_held_list) == 0) {
+		held = qb_list_first_entry (&payload_held_list, struct totempg_held, list);
+		if (held->type == TOTEMPG_HELD_PAYLOAD &&
+		    held->payload != NULL && held->payload->agreed == 0) {
+			break;
+		}
+		qb_list_del (&held->list);
+		totempg_stats.payload_held--;
+
+		switch (held->type) {
+		case TOTEMPG_HELD_PAYLOAD:
+			if (held->payload != NULL) {
+				held_payload_deliver (held);
+			}
+			break;
+		case TOTEMPG_HELD_MESSAGE:
+			app_deliver_fn (held->nodeid, held->data, held->msg_len,
+				held->endian_conversion_required);
+			break;
+		case TOTEMPG_HELD_CONFCHG:
+			member_list = (unsigned int *)held->data;
+			left_list = member_list + held->member_list_entries;
+			joined_list = left_list + held->left_list_entries;
+			app_confchg_fn (held->configuration_type,
+				member_list, held->member_list_entries,
+				left_list, held->left_list_entries,
+				joined_list, held->joined_list_entries,
+				&held->ring_id);
+			break;
+		}
+		free (held);
+	}
+}
+
+/*
+ * Descriptor delivered in agreed order
+ */
+static void payload_descriptor_deliver (
+	unsigned int nodeid,
+	const void *msg,
+	unsigned int msg_len,
+	int endian_conversion_required)
+{
+	struct totempg_payload_descriptor descriptor;
+	struct totempg_payload *payload;
+	struct totempg_held *held;
+
+	if (msg_len < sizeof (descriptor)) {
+		log_printf(LOG_WARNING,
+		    "Payload descriptor received from node " CS_PRI_NODE_ID " is too short...  Ignoring.", nodeid);
+		return;
+	}
+	memcpy (&descriptor, msg, sizeof (descriptor));
+	if (endian_conversion_required) {
+		descriptor.id = swab32 (descriptor.id);
+		descriptor.size = swab32 (descriptor.size);
+		descriptor.hash = swab64 (descriptor.hash);
+		descriptor.chunk_size = swab32 (descriptor.chunk_size);
+	}
+	/*
+	 * Every member gets the same descriptor and ignores it alike
+	 */
+	if (payload_valid (descriptor.size, descriptor.chunk_size) == 0) {
+		log_printf(LOG_WARNING,
+		    "Payload descriptor received from node " CS_PRI_NODE_ID " is invalid...  Ignoring.", nodeid);
+		return;
+	}
+
+	if (totempg_threaded_mode == 1) {
+		pthread_mutex_lock (&mcast_msg_mutex);
+	}
+	payload = payload_find (nodeid, descriptor.id);
+	if (payload != NULL &&
+	    (payload->ordered || payload->size != descriptor.size ||
+	     payload->hash != descriptor.hash ||
+	     payload->chunk_size != descriptor.chunk_size)) {
+		if (payload->ordered == 0) {
+			payload_free (payload);
+		}
+		payload = NULL;
+	}
+	if (payload == NULL) {
+		payload = payload_create (nodeid, descriptor.id, descriptor.size,
+			descriptor.hash, descriptor.chunk_size);
+		/*
+		 * Like held_add, an ordered message can't be dropped
+		 */
+		assert (payload);
+	}
+	payload->ordered = 1;
+	payload->ordered_time = qb_util_nano_current_get ();
+	payload->endian_conversion_required = endian_conversion_required;
+	payload_have_send (payload);
+	if (totempg_threaded_mode == 1) {
+		pthread_mutex_unlock (&mcast_msg_mutex);
+	}
+
+	held = held_add (TOTEMPG_HELD_PAYLOAD, 0);
+	held->payload = payload;
+	payload_held_flush ();
+}
+
+/*
+ * A member announced that it holds the data of an ordered payload, this
+ * processor delivers it once its own announcement is delivered
+ */
+static void payload_have_deliver (
+	unsigned int nodeid,
+	const void *msg,
+	unsigned int msg_len,
+	int endian_conversion_required)
+{
+	struct totempg_payload_have have;
+	struct totempg_payload *payload;
+	unsigned int i;
+	int agreed = 0;
+
+	if (msg_len < sizeof (have)) {
+		log_printf(LOG_WARNING,
+		    "Payload announcement received from node " CS_PRI_NODE_ID " is too short...  Ignoring.", nodeid);
+		return;
+	}
+	memcpy (&have, msg, sizeof (have));
+	if (endian_conversion_required) {
+		have.origin = swab32 (have.origin);
+		have.id = swab32 (have.id);
+		have.hash = swab64 (have.hash);
+	}
+
+	if (totempg_threaded_mode == 1) {
+		pthread_mutex_lock (&mcast_msg_mutex);
+	}
+	payload = payload_find (have.origin, have.id);
+	if (payload != NULL && payload->ordered && payload->hash == have.hash) {
+		for (i = 0; i < payload->have_entries; i++) {
+			if (payload->have[i] == nodeid) {
+				break;
+			}
+		}
+		if (i == payload->have_entries && i < PROCESSOR_COUNT_MAX) {
+			payload->have[payload->have_entries++] = nodeid;
+		}
+		if (nodeid == totemsrp_my_nodeid_get (totemsrp_context) &&
+		    payload->agreed == 0) {
+			payload->agreed = 1;
+			agreed = 1;
+		}
+	}
+	if (totempg_threaded_mode == 1) {
+		pthread_mutex_unlock (&mcast_msg_mutex);
+	}
+
+	if (agreed) {
+		payload_held_flush ();
+	}
+}
+
+/*
+ * On a regular configuration change drop the held payloads whose origin left
+ * and which no member of the new ring announced.  This processor didn't
+ * deliver them either, and every processor sees the same announcements
+ * before the change, so all of them drop the message here.
+ */
+static void payload_held_drop (void)
+{
+	struct totempg_held *held;
+	struct totempg_payload *payload;
+	struct qb_list_head *list;
+	unsigned int i;
+
+	qb_list_for_each(list, &payload_held_list) {
+		held = qb_list_entry (list, struct totempg_held, list);
+		payload = held->payload;
+		if (held->type != TOTEMPG_HELD_PAYLOAD || payload == NULL ||
+		    payload->agreed || payload_member (payload->origin)) {
+			continue;
+		}
+		for (i = 0; i < payload->have_entries; i++) {
+			if (payload_member (payload->have[i])) {
+				break;
+			}
+		}
+		if (i < payload->have_entries) {
+			continue;
+		}
+		log_printf(LOG_WARNING,
+		    "Payload %u (%u bytes) of node " CS_PRI_NODE_ID " is held by no member, dropping it.",
+		    payload->id, payload->size, payload->origin);
+		totempg_stats.payload_dropped++;
+		payload_free (payload);
+		held->payload = NULL;
+	}
+}
+
+/*
+ * Deliver a message unless a payload is being waited for
+ */
+static void deliver_or_hold (
+	unsigned int nodeid,
+	void *msg,
+	unsigned int msg_len,
+	int endian_conversion_required)
+{
+	struct totempg_held *held;
+
+	if (qb_list_empty (&payload_held_list)) {
+		app_deliver_fn (nodeid, msg, msg_len, endian_conversion_required);
+		return;
+	}
+
+	held = held_add (TOTEMPG_HELD_MESSAGE, msg_len);
+	held->nodeid = nodeid;
+	held->msg_len = msg_len;
+	held->endian_conversion_required = endian_conversion_required;
+	memcpy (held->data, msg, msg_len);
+}
+
 static void totempg_confchg_fn (
 	enum totem_configuration_type configuration_type,
 	const unsigned int *member_list, size_t member_list_entries,
@@ -578,12 +2042,45 @@ static void totempg_confchg_fn (
 	const unsigned int *joined_list, size_t joined_list_entries,
 	const struct memb_ring_id *ring_id)
 {
-// TODO optimize this
-	app_confchg_fn (configuration_type,
-		member_list, member_list_entries,
-		left_list, left_list_entries,
-		joined_list, joined_list_entries,
-		ring_id);
+	struct totempg_held *held;
+	unsigned int *lists;
+
+	/*
+	 * The side channel follows the current membership even while
+	 * deliveries are held
+	 */
+	if (configuration_type == TOTEM_CONFIGURATION_REGULAR) {
+		memcpy (payload_members, member_list,
+			member_list_entries * sizeof (unsigned int));
+		payload_member_entries = member_list_entries;
+		codecs_members_set (member_list, member_list_entries);
+		payload_held_drop ();
+		payload_held_flush ();
+	}
+
+	if (qb_list_empty (&payload_held_list)) {
+		app_confchg_fn (configuration_type,
+			member_list, member_list_entries,
+			left_list, left_list_entries,
+			joined_list, joined_list_entries,
+			ring_id);
+		return;
+	}
+
+	held = held_add (TOTEMPG_HELD_CONFCHG,
+		(member_list_entries + left_list_entries + joined_list_entries) *
+		sizeof (unsigned int));
+	held->configuration_type = configuration_type;
+	held->member_list_entries = member_list_entries;
+	held->left_list_entries = left_list_entries;
+	held->joined_list_entries = joined_list_entries;
+	memcpy (&held->ring_id, ring_id, sizeof (struct memb_ring_id));
+	lists = (unsigned int *)held->data;
+	memcpy (lists, member_list, member_list_entries * sizeof (unsigned int));
+	lists += member_list_entries;
+	memcpy (lists, left_list, left_list_entries * sizeof (unsigned int));
+	lists += left_list_entries;
+	memcpy (lists, joined_list, joined_list_entries * sizeof (unsigned int));
 }
 
 static void totempg_deliver_fn (
@@ -604,9 +2101,7 @@ static void totempg_deliver_fn (
 	int datasize;
 	struct iovec iov_delv;
 	size_t expected_msg_len;
-
-	assembly = assembly_ref (nodeid);
-	assert (assembly);
+	unsigned short lane;
 
 	if (msg_len < sizeof(struct totempg_mcast)) {
 		log_printf(LOG_WARNING,
@@ -622,9 +2117,39 @@ static void totempg_deliver_fn (
 
 	mcast = (struct totempg_mcast *)msg;
 	if (endian_conversion_required) {
+		mcast->header.type = swab16 (mcast->header.type);
 		mcast->msg_count = swab16 (mcast->msg_count);
 	}
 
+	if (mcast->header.type == TOTEMPG_TYPE_PAYLOAD) {
+		payload_descriptor_deliver (nodeid,
+			(const char *)msg + sizeof (struct totempg_mcast),
+			msg_len - sizeof (struct totempg_mcast),
+			endian_conversion_required);
+		return ;
+	}
+	if (mcast->header.type == TOTEMPG_TYPE_PAYLOAD_HAVE) {
+		payload_have_deliver (nodeid,
+			(const char *)msg + sizeof (struct totempg_mcast),
+			msg_len - sizeof (struct totempg_mcast),
+			endian_conversion_required);
+		return ;
+	}
+
+	/*
+	 * Senders without lanes always use type 0, the normal lane
+	 */
+	lane = mcast->header.type;
+	if (lane >= TOTEM_LANE_MAX) {
+		log_printf(LOG_WARNING,
+		    "Message (totempg_mcast) received from node " CS_PRI_NODE_ID
+		    " has unknown lane %u...  Ignoring.", nodeid, lane);
+
+		return ;
+	}
+	assembly = assembly_ref (nodeid, lane);
+	assert (assembly);
+
 	msg_count = mcast->msg_count;
 	datasize = sizeof (struct totempg_mcast) +
 		msg_count * sizeof (unsigned short);
@@ -637,10 +2162,23 @@ static void totempg_deliver_fn (
 		return ;
 	}
 
-	memcpy (header, msg, datasize);
 	data = msg;
 
+	/*
+	 * Message lengths are read in place unless they have to be converted
+	 * or aligned
+	 */
+#ifdef TOTEMPG_NEED_ALIGN
+	memcpy (header, msg, datasize);
 	msg_lens = (unsigned short *) (header + sizeof (struct totempg_mcast));
+#else
+	if (endian_conversion_required) {
+		memcpy (header, msg, datasize);
+		msg_lens = (unsigned short *) (header + sizeof (struct totempg_mcast));
+	} else {
+		msg_lens = (unsigned short *) (data + sizeof (struct totempg_mcast));
+	}
+#endif
 	expected_msg_len = datasize;
 	for (i = 0; i < mcast->msg_count; i++) {
 		if (endian_conversion_required) {
@@ -659,7 +2197,8 @@ static void totempg_deliver_fn (
 		return ;
 	}
 
-	assert((assembly->index+msg_len) < sizeof(assembly->data));
+	assert((assembly->index+msg_len) < ASSEMBLY_DATA_MAX);
+	assembly_data_reserve (assembly, msg_len - datasize);
 	memcpy (&assembly->data[assembly->index], &data[datasize],
 		msg_len - datasize);
 
@@ -701,7 +2240,7 @@ static void totempg_deliver_fn (
 		if (continuation == assembly->last_frag_num) {
 			assembly->last_frag_num = mcast->fragmented;
 			for  (i = start; i < msg_count; i++) {
-				app_deliver_fn(nodeid, iov_delv.iov_base, iov_delv.iov_len,
+				deliver_or_hold (nodeid, iov_delv.iov_base, iov_delv.iov_len,
 					endian_conversion_required);
 				assembly->index += msg_lens[i];
 				iov_delv.iov_base = (void *)&assembly->data[assembly->index];
@@ -745,50 +2284,220 @@ static void totempg_deliver_fn (
 
 void *callback_token_received_handle;
 
-int callback_token_received_fn (enum totem_callback_token_type type,
-				const void *data)
+/*
+ * Wait of the first staged message of a lane which is about to be sent
+ */
+static void coalesce_delay_update (struct totempg_lane *lane)
 {
-	struct totempg_mcast mcast;
-	struct iovec iovecs[3];
+	uint64_t delay_us;
 
-	if (totempg_threaded_mode == 1) {
-		pthread_mutex_lock (&mcast_msg_mutex);
+	delay_us = (qb_util_nano_current_get () - lane->staged_time) / QB_TIME_NS_IN_USEC;
+	lane->staged_time = 0;
+
+	if (delay_us > totempg_stats.coalesce_delay_us_max) {
+		totempg_stats.coalesce_delay_us_max = delay_us;
 	}
-	if (mcast_packed_msg_count == 0) {
-		if (totempg_threaded_mode == 1) {
-			pthread_mutex_unlock (&mcast_msg_mutex);
-		}
-		return (0);
+	/*
+	 * Moving average over about the last 16 packets
+	 */
+	totempg_stats.coalesce_delay_us_avg = (uint32_t)(((uint64_t)totempg_stats.coalesce_delay_us_avg * 15 +
+		delay_us) / 16);
+}
+
+/*
+ * Build a totempg packet directly in a totemsrp transport buffer: header,
+ * packed message lengths, messages already staged in fragmentation_data of
+ * the lane and the slices of caller data in iovec.  The packet is then
+ * queued without totemsrp having to copy it again.
+ */
+static int mcast_packet_send (
+	struct totempg_lane *lane,
+	const struct totempg_mcast *mcast,
+	const struct iovec *iovec,
+	unsigned int iov_len,
+	int guarantee)
+{
+	unsigned char *payload;
+	size_t payload_len_max;
+	size_t lens_len;
+	size_t data_len = 0;
+	size_t len;
+	unsigned int i;
+	int res;
+
+	payload = totemsrp_mcast_buffer_alloc (totemsrp_context, &payload_len_max);
+	if (payload == NULL) {
+		return (-1);
 	}
-	if (totemsrp_avail(totemsrp_context) == 0) {
-		if (totempg_threaded_mode == 1) {
-			pthread_mutex_unlock (&mcast_msg_mutex);
-		}
-		return (0);
+
+	lens_len = mcast->msg_count * sizeof (unsigned short);
+	for (i = 0; i < iov_len; i++) {
+		data_len += iovec[i].iov_len;
 	}
+	assert (sizeof (struct totempg_mcast) + lens_len + lane->fragment_size + data_len <=
+		payload_len_max);
+
+	memcpy (payload, mcast, sizeof (struct totempg_mcast));
+	len = sizeof (struct totempg_mcast);
+	memcpy (&payload[len], lane->mcast_packed_msg_lens, lens_len);
+	len += lens_len;
+	memcpy (&payload[len], lane->fragmentation_data, lane->fragment_size);
+	len += lane->fragment_size;
+	for (i = 0; i < iov_len; i++) {
+		memcpy (&payload[len], iovec[i].iov_base, iovec[i].iov_len);
+		len += iovec[i].iov_len;
+	}
+	totempg_stats.mcast_copy_bytes += lane->fragment_size + data_len;
+	totempg_stats.mcast_frames++;
+	if (lane->staged_time) {
+		coalesce_delay_update (lane);
+	}
+
+	res = totemsrp_mcast_buffer_submit (totemsrp_context, payload, len, guarantee);
+	if (res == -1) {
+		totemsrp_mcast_buffer_release (totemsrp_context, payload);
+	}
+	return (res);
+}
+
+/*
+ * Send the messages staged in a lane
+ */
+static void lane_staged_send (enum totem_lane lane_type)
+{
+	struct totempg_lane *lane = &totempg_lanes[lane_type];
+	struct totempg_mcast mcast;
+
 	mcast.header.version = 0;
-	mcast.header.type = 0;
+	mcast.header.type = lane_type;
 	mcast.fragmented = 0;
 
 	/*
 	 * Was the first message in this buffer a continuation of a
 	 * fragmented message?
 	 */
-	mcast.continuation = fragment_continuation;
-	fragment_continuation = 0;
+	mcast.continuation = lane->fragment_continuation;
+	lane->fragment_continuation = 0;
+
+	mcast.msg_count = lane->mcast_packed_msg_count;
+
+	(void)mcast_packet_send (lane, &mcast, NULL, 0,
+		(lane_type == TOTEM_LANE_HIGH) ? TOTEM_MCAST_PRIORITY_HIGH : 0);
+
+	lane->mcast_packed_msg_count = 0;
+	lane->fragment_size = 0;
+}
+
+/*
+ * Should the staged messages of a lane be sent now or be kept to coalesce
+ * with later messages.  The high priority lane is never kept.
+ */
+static int lane_staged_due (enum totem_lane lane_type, uint64_t now)
+{
+	struct totempg_lane *lane = &totempg_lanes[lane_type];
+	unsigned int coalesce_bytes = totempg_totem_config->coalesce_bytes;
+
+	if (totempg_totem_config->coalesce_delay == 0 ||
+	    lane_type == TOTEM_LANE_HIGH) {
+		return (1);
+	}
+	if (coalesce_bytes && lane->fragment_size >= coalesce_bytes) {
+		return (1);
+	}
+	return (now - lane->staged_time >=
+		(uint64_t)totempg_totem_config->coalesce_delay * QB_TIME_NS_IN_USEC);
+}
+
+/*
+ * Send the staged messages which are due, in the order of the lanes.
+ * Returns the staging time of the oldest message kept, 0 if none.
+ */
+static uint64_t lanes_staged_send (void)
+{
+	uint64_t now = qb_util_nano_current_get ();
+	uint64_t kept = 0;
+	int i;
+
+	/*
+	 * Flush the high priority lane first
+	 */
+	for (i = TOTEM_LANE_MAX - 1; i >= 0; i--) {
+		enum totem_lane lane_type = i;
+		struct totempg_lane *lane = &totempg_lanes[lane_type];
+
+		if (lane->mcast_packed_msg_count == 0) {
+			continue;
+		}
+		if (!lane_staged_due (lane_type, now)) {
+			if (kept == 0 || lane->staged_time < kept) {
+				kept = lane->staged_time;
+			}
+			continue;
+		}
+		if (totemsrp_avail(totemsrp_context) == 0) {
+			break;
+		}
+		lane_staged_send (lane_type);
+	}
+	return (kept);
+}
+
+static void coalesce_timer_fn (void *data);
+
+/*
+ * Make sure messages kept to coalesce don't wait for the next token longer
+ * than coalesce_delay, the token may be held on a ring which looks idle
+ */
+static void coalesce_timer_start (uint64_t staged_time)
+{
+	uint64_t expires;
+	uint64_t now;
+
+	if (coalesce_timer_running) {
+		return;
+	}
+	expires = staged_time +
+		(uint64_t)totempg_totem_config->coalesce_delay * QB_TIME_NS_IN_USEC;
+	now = qb_util_nano_current_get ();
+	if (qb_loop_timer_add (totempg_poll_handle, QB_LOOP_MED,
+	    (expires > now) ? expires - now : 0, NULL,
+	    coalesce_timer_fn, &coalesce_timer) == 0) {
+		coalesce_timer_running = 1;
+	}
+}
+
+static void coalesce_timer_fn (void *data)
+{
+	uint64_t kept;
+
+	if (totempg_threaded_mode == 1) {
+		pthread_mutex_lock (&mcast_msg_mutex);
+	}
+	coalesce_timer_running = 0;
+	kept = lanes_staged_send ();
+	if (kept) {
+		coalesce_timer_start (kept);
+	}
+	if (totempg_threaded_mode == 1) {
+		pthread_mutex_unlock (&mcast_msg_mutex);
+	}
 
-	mcast.msg_count = mcast_packed_msg_count;
+	totemsrp_event_signal (totemsrp_context, TOTEM_EVENT_NEW_MSG, 1);
+}
 
-	iovecs[0].iov_base = (void *)&mcast;
-	iovecs[0].iov_len = sizeof (struct totempg_mcast);
-	iovecs[1].iov_base = (void *)mcast_packed_msg_lens;
-	iovecs[1].iov_len = mcast_packed_msg_count * sizeof (unsigned short);
-	iovecs[2].iov_base = (void *)&fragmentation_data[0];
-	iovecs[2].iov_len = fragment_size;
-	(void)totemsrp_mcast (totemsrp_context, iovecs, 3, 0);
+int callback_token_received_fn (enum totem_callback_token_type type,
+				const void *data)
+{
+	uint64_t kept;
 
-	mcast_packed_msg_count = 0;
-	fragment_size = 0;
+	if (totempg_threaded_mode == 1) {
+		pthread_mutex_lock (&mcast_msg_mutex);
+	}
+	kept = lanes_staged_send ();
+	if (kept) {
+		totempg_stats.coalesce_deferred++;
+		coalesce_timer_start (kept);
+	}
 
 	if (totempg_threaded_mode == 1) {
 		pthread_mutex_unlock (&mcast_msg_mutex);
@@ -796,6 +2505,105 @@ int callback_token_received_fn (enum totem_callback_token_type type,
 	return (0);
 }
 
+/*
+ * Can a message of total_size bytes go through the side channel
+ */
+static int payload_send_ok (int total_size)
+{
+	unsigned int threshold = totempg_totem_config->side_channel_threshold;
+
+	return (threshold != 0 && total_size >= threshold &&
+		payload_member_entries > 1 &&
+		totemsrp_payload_available (totemsrp_context) &&
+		totemsrp_avail (totemsrp_context) >= 2);
+}
+
+/*
+ * Send the message in chunks to every other member and its descriptor
+ * through the ring.  Returns 1 if there is no room for the message, it is
+ * then sent in band.
+ */
+static int payload_send (
+	enum totem_lane lane_type,
+	const struct iovec *iovec,
+	unsigned int iov_len,
+	int total_size,
+	int guarantee)
+{
+	struct totempg_payload_descriptor descriptor;
+	struct totempg_payload *payload;
+	struct totempg_mcast mcast;
+	unsigned char *buffer;
+	size_t buffer_len_max;
+	unsigned int my_nodeid;
+	unsigned int chunk_size;
+	unsigned int i;
+	size_t offset;
+	size_t j;
+	int res;
+
+	my_nodeid = totemsrp_my_nodeid_get (totemsrp_context);
+	chunk_size = totempg_totem_config->net_mtu - sizeof (struct totempg_payload_header);
+
+	if (payload_room (total_size) == 0) {
+		return (1);
+	}
+	payload = payload_create (my_nodeid, payload_next_id++, total_size, 0, chunk_size);
+	if (payload == NULL) {
+		return (1);
+	}
+	for (i = 0, offset = 0; i < iov_len; i++) {
+		memcpy (&payload->data[offset], iovec[i].iov_base, iovec[i].iov_len);
+		offset += iovec[i].iov_len;
+	}
+	payload->hash = totempg_hash (payload->data, payload->size);
+	memset (payload->received, 1, payload->chunks);
+	payload->chunks_received = payload->chunks;
+	payload->complete = 1;
+
+	for (j = 0; j < payload_member_entries; j++) {
+		if (payload_members[j] == my_nodeid) {
+			continue;
+		}
+		for (i = 0; i < payload->chunks; i++) {
+			payload_chunk_send (payload, payload_members[j], i);
+		}
+	}
+
+	/*
+	 * Messages staged before must be ordered before the descriptor
+	 */
+	if (totempg_lanes[lane_type].mcast_packed_msg_count) {
+		lane_staged_send (lane_type);
+	}
+
+	buffer = totemsrp_mcast_buffer_alloc (totemsrp_context, &buffer_len_max);
+	if (buffer == NULL) {
+		payload_free (payload);
+		return (-1);
+	}
+	memset (&mcast, 0, sizeof (mcast));
+	mcast.header.version = 0;
+	mcast.header.type = TOTEMPG_TYPE_PAYLOAD;
+	descriptor.id = payload->id;
+	descriptor.size = payload->size;
+	descriptor.hash = payload->hash;
+	descriptor.chunk_size = payload->chunk_size;
+	memcpy (buffer, &mcast, sizeof (mcast));
+	memcpy (&buffer[sizeof (mcast)], &descriptor, sizeof (descriptor));
+
+	res = totemsrp_mcast_buffer_submit (totemsrp_context, buffer,
+		sizeof (mcast) + sizeof (descriptor), guarantee);
+	if (res == -1) {
+		totemsrp_mcast_buffer_release (totemsrp_context, buffer);
+		payload_free (payload);
+		return (-1);
+	}
+	totempg_stats.payload_tx++;
+
+	return (0);
+}
+
 /*
  * Initialize the totem process group abstraction
  */
@@ -804,8 +2612,10 @@ int totempg_initialize (
 	struct totem_config *totem_config)
 {
 	int res;
+	int i;
 
 	totempg_totem_config = totem_config;
+	totempg_poll_handle = poll_handle;
 	totempg_log_level_security = totem_config->totem_logging_configuration.log_level_security;
 	totempg_log_level_error = totem_config->totem_logging_configuration.log_level_error;
 	totempg_log_level_warning = totem_config->totem_logging_configuration.log_level_warning;
@@ -814,9 +2624,16 @@ int totempg_initialize (
 	totempg_log_printf = totem_config->totem_logging_configuration.log_printf;
 	totempg_subsys_id = totem_config->totem_logging_configuration.log_subsys_id;
 
-	fragmentation_data = malloc (TOTEMPG_PACKET_SIZE);
-	if (fragmentation_data == 0) {
-		return (-1);
+	for (i = 0; i < ASSEMBLY_HASH_SIZE; i++) {
+		qb_list_init (&assembly_hash[i]);
+	}
+
+	for (i = 0; i < TOTEM_LANE_MAX; i++) {
+		totempg_lanes[i].fragmentation_data = malloc (TOTEMPG_PACKET_SIZE);
+		if (totempg_lanes[i].fragmentation_data == 0) {
+			return (-1);
+		}
+		totempg_lanes[i].next_fragment = 1;
 	}
 
 	totemsrp_net_mtu_adjust (totem_config);
@@ -842,6 +2659,13 @@ int totempg_initialize (
 		callback_token_received_fn,
 		0);
 
+	totemsrp_payload_register (totemsrp_context, payload_deliver_fn);
+
+	/*
+	 * Receivers tell payloads of an earlier incarnation apart by the id
+	 */
+	payload_next_id = (unsigned int)(qb_util_nano_current_get () / QB_TIME_NS_IN_MSEC);
+
 	totempg_size_limit = (totemsrp_avail(totemsrp_context) - 1) *
 		(totempg_totem_config->net_mtu -
 		sizeof (struct totempg_mcast) - 16);
@@ -857,6 +2681,14 @@ void totempg_finalize (void)
 	if (totempg_threaded_mode == 1) {
 		pthread_mutex_lock (&totempg_mutex);
 	}
+	if (coalesce_timer_running) {
+		qb_loop_timer_del (totempg_poll_handle, coalesce_timer);
+		coalesce_timer_running = 0;
+	}
+	if (payload_timer_running) {
+		qb_loop_timer_del (totempg_poll_handle, payload_timer);
+		payload_timer_running = 0;
+	}
 	// coverity[SLEEP:SUPPRESS] sleep is not a problem because it is shutdown
 	totemsrp_finalize (totemsrp_context);
 	if (totempg_threaded_mode == 1) {
@@ -874,7 +2706,6 @@ static int mcast_msg (
 {
 	int res = 0;
 	struct totempg_mcast mcast;
-	struct iovec iovecs[3];
 	struct iovec iovec[64];
 	int i;
 	int dest, src;
@@ -882,10 +2713,32 @@ static int mcast_msg (
 	int copy_len = 0;
 	int copy_base = 0;
 	int total_size = 0;
+	int remaining;
+	int room;
+	int fragmented = 0;
+	struct iovec slices[64];
+	int slice_count;
+	int slice_left;
+	struct totempg_lane *lane;
+	enum totem_lane lane_type;
 
 	if (totempg_threaded_mode == 1) {
 		pthread_mutex_lock (&mcast_msg_mutex);
 	}
+
+	/*
+	 * The high priority flag is dropped unless all nodes are known to
+	 * assemble every lane separately
+	 */
+	if ((guarantee & TOTEM_MCAST_PRIORITY_HIGH) &&
+	    totempg_totem_config->priority_lanes) {
+		lane_type = TOTEM_LANE_HIGH;
+	} else {
+		lane_type = TOTEM_LANE_NORMAL;
+		guarantee &= ~TOTEM_MCAST_PRIORITY_HIGH;
+	}
+	lane = &totempg_lanes[lane_type];
+
 	totemsrp_event_signal (totemsrp_context, TOTEM_EVENT_NEW_MSG, 1);
 
 	/*
@@ -901,9 +2754,9 @@ static int mcast_msg (
 	iov_len = dest;
 
 	max_packet_size = TOTEMPG_PACKET_SIZE -
-		(sizeof (unsigned short) * (mcast_packed_msg_count + 1));
+		(sizeof (unsigned short) * (lane->mcast_packed_msg_count + 1));
 
-	mcast_packed_msg_lens[mcast_packed_msg_count] = 0;
+	lane->mcast_packed_msg_lens[lane->mcast_packed_msg_count] = 0;
 
 	/*
 	 * Check if we would overwrite new message queue
@@ -912,8 +2765,10 @@ static int mcast_msg (
 		total_size += iovec[i].iov_len;
 	}
 
-	if (byte_count_send_ok (total_size + sizeof(unsigned short) *
-		(mcast_packed_msg_count)) == 0) {
+	iov_len = message_compress (iovec, iov_len, &total_size);
+
+	if (byte_count_send_ok (total_size + lane->fragment_size +
+		sizeof(unsigned short) * (lane->mcast_packed_msg_count)) == 0) {
 
 		if (totempg_threaded_mode == 1) {
 			pthread_mutex_unlock (&mcast_msg_mutex);
@@ -921,110 +2776,109 @@ static int mcast_msg (
 		return(-1);
 	}
 
+	if (payload_send_ok (total_size)) {
+		res = payload_send (lane_type, iovec, iov_len, total_size, guarantee);
+		if (res != 1) {
+			goto error_exit;
+		}
+		res = 0;
+	}
+
+	totempg_stats.mcast_msgs++;
+
 	memset(&mcast, 0, sizeof(mcast));
 
 	mcast.header.version = 0;
-	for (i = 0; i < iov_len; ) {
+	mcast.header.type = lane_type;
+	remaining = total_size;
+	i = 0;
+	while (remaining > 0) {
 		mcast.fragmented = 0;
-		mcast.continuation = fragment_continuation;
-		copy_len = iovec[i].iov_len - copy_base;
+		mcast.continuation = lane->fragment_continuation;
+		room = max_packet_size - lane->fragment_size;
 
 		/*
-		 * If it all fits with room left over, copy it in.
+		 * If the rest of the message fits with room left over, stage
+		 * it to be packed with later messages.  The tail of a message
+		 * larger than a packet is sent right away instead, so none of
+		 * a large message is copied twice.
 		 * We need to leave at least sizeof(short) + 1 bytes in the
 		 * fragment_buffer on exit so that max_packet_size + fragment_size
 		 * doesn't exceed the size of the fragment_buffer on the next call.
 		 */
-		if ((iovec[i].iov_len + fragment_size) <
-			(max_packet_size - sizeof (unsigned short))) {
-
-			memcpy (&fragmentation_data[fragment_size],
-				(char *)iovec[i].iov_base + copy_base, copy_len);
-			fragment_size += copy_len;
-			mcast_packed_msg_lens[mcast_packed_msg_count] += copy_len;
-			next_fragment = 1;
-			// coverity[UNUSED_VALUE:SUPPRESS] defensive programming
-			copy_len = 0;
-			copy_base = 0;
-			i++;
-			continue;
+		if ((!fragmented || total_size < TOTEMPG_PACKET_SIZE) &&
+		    remaining < room - (int)sizeof (unsigned short)) {
+			for (; i < iov_len; i++) {
+				copy_len = iovec[i].iov_len - copy_base;
+				memcpy (&lane->fragmentation_data[lane->fragment_size],
+					(char *)iovec[i].iov_base + copy_base, copy_len);
+				lane->fragment_size += copy_len;
+				copy_base = 0;
+			}
+			totempg_stats.fragment_copy_bytes += remaining;
+			lane->mcast_packed_msg_lens[lane->mcast_packed_msg_count] += remaining;
+			lane->next_fragment = 1;
+			remaining = 0;
+			break;
+		}
 
 		/*
 		 * If it just fits or is too big, then send out what fits.
 		 */
-		} else {
-			unsigned char *data_ptr;
-
-			copy_len = min(copy_len, max_packet_size - fragment_size);
-			if( copy_len == max_packet_size )
-				data_ptr = (unsigned char *)iovec[i].iov_base + copy_base;
-			else {
-				data_ptr = fragmentation_data;
-			}
-
-			memcpy (&fragmentation_data[fragment_size],
-				(unsigned char *)iovec[i].iov_base + copy_base, copy_len);
-			mcast_packed_msg_lens[mcast_packed_msg_count] += copy_len;
-
-			/*
-			 * if we're not on the last iovec or the iovec is too large to
-			 * fit, then indicate a fragment. This also means that the next
-			 * message will have the continuation of this one.
-			 */
-			if ((i < (iov_len - 1)) ||
-					((copy_base + copy_len) < iovec[i].iov_len)) {
-				if (!next_fragment) {
-					next_fragment++;
-				}
-				fragment_continuation = next_fragment;
-				mcast.fragmented = next_fragment++;
-				assert(fragment_continuation != 0);
-				assert(mcast.fragmented != 0);
-			} else {
-				fragment_continuation = 0;
-			}
+		copy_len = min(remaining, room);
+		lane->mcast_packed_msg_lens[lane->mcast_packed_msg_count] += copy_len;
 
-			/*
-			 * assemble the message and send it
-			 */
-			mcast.msg_count = ++mcast_packed_msg_count;
-			iovecs[0].iov_base = (void *)&mcast;
-			iovecs[0].iov_len = sizeof(struct totempg_mcast);
-			iovecs[1].iov_base = (void *)mcast_packed_msg_lens;
-			iovecs[1].iov_len = mcast_packed_msg_count *
-				sizeof(unsigned short);
-			iovecs[2].iov_base = (void *)data_ptr;
-			iovecs[2].iov_len = fragment_size + copy_len;
-			assert (totemsrp_avail(totemsrp_context) > 0);
-			res = totemsrp_mcast (totemsrp_context, iovecs, 3, guarantee);
-			if (res == -1) {
-				goto error_exit;
+		/*
+		 * if more of the message is left, then indicate a fragment.
+		 * This also means that the next message will have the
+		 * continuation of this one.
+		 */
+		if (copy_len < remaining) {
+			if (!lane->next_fragment) {
+				lane->next_fragment++;
 			}
+			lane->fragment_continuation = lane->next_fragment;
+			mcast.fragmented = lane->next_fragment++;
+			assert(lane->fragment_continuation != 0);
+			assert(mcast.fragmented != 0);
+		} else {
+			lane->fragment_continuation = 0;
+		}
 
-			/*
-			 * Recalculate counts and indexes for the next.
-			 */
-			mcast_packed_msg_lens[0] = 0;
-			mcast_packed_msg_count = 0;
-			fragment_size = 0;
-			max_packet_size = TOTEMPG_PACKET_SIZE - (sizeof(unsigned short));
-
-			/*
-			 * If the iovec all fit, go to the next iovec
-			 */
-			if ((copy_base + copy_len) == iovec[i].iov_len) {
-				// coverity[UNUSED_VALUE:SUPPRESS] defensive programming
-				copy_len = 0;
+		/*
+		 * Describe the part of the caller data which goes into this
+		 * packet as slices of its iovecs, they are copied straight
+		 * into the transport buffer
+		 */
+		slice_count = 0;
+		for (slice_left = copy_len; slice_left > 0; ) {
+			slices[slice_count].iov_base = (char *)iovec[i].iov_base + copy_base;
+			slices[slice_count].iov_len = min(slice_left, iovec[i].iov_len - copy_base);
+			slice_left -= slices[slice_count].iov_len;
+			copy_base += slices[slice_count].iov_len;
+			slice_count++;
+			if (copy_base == iovec[i].iov_len) {
 				copy_base = 0;
 				i++;
-
-			/*
-			 * Continue with the rest of the current iovec.
-			 */
-			} else {
-				copy_base += copy_len;
 			}
 		}
+
+		mcast.msg_count = ++lane->mcast_packed_msg_count;
+		assert (totemsrp_avail(totemsrp_context) > 0);
+		res = mcast_packet_send (lane, &mcast, slices, slice_count, guarantee);
+		if (res == -1) {
+			goto error_exit;
+		}
+
+		/*
+		 * Recalculate counts and indexes for the next.
+		 */
+		lane->mcast_packed_msg_lens[0] = 0;
+		lane->mcast_packed_msg_count = 0;
+		lane->fragment_size = 0;
+		max_packet_size = TOTEMPG_PACKET_SIZE - (sizeof(unsigned short));
+		remaining -= copy_len;
+		fragmented = 1;
 	}
 
 	/*
@@ -1032,8 +2886,11 @@ static int mcast_msg (
 	 * the last buffer just fit into the fragmentation_data buffer
 	 * and we were at the last iovec.
 	 */
-	if (mcast_packed_msg_lens[mcast_packed_msg_count]) {
-			mcast_packed_msg_count++;
+	if (lane->mcast_packed_msg_lens[lane->mcast_packed_msg_count]) {
+			lane->mcast_packed_msg_count++;
+	}
+	if (lane->mcast_packed_msg_count && lane->staged_time == 0) {
+		lane->staged_time = qb_util_nano_current_get ();
 	}
 
 error_exit:
@@ -1164,6 +3021,8 @@ int totempg_groups_initialize (
 	instance->deliver_fn = deliver_fn;
 	instance->confchg_fn = confchg_fn;
 	instance->groups = 0;
+	instance->group_hashes = NULL;
+	instance->group_filter = 0;
 	instance->groups_cnt = 0;
 	instance->q_level = QB_LOOP_MED;
 	qb_list_init (&instance->list);
@@ -1189,7 +3048,9 @@ int totempg_groups_join (
 {
 	struct totempg_group_instance *instance = (struct totempg_group_instance *)totempg_groups_instance;
 	struct totempg_group *new_groups;
+	uint64_t *new_group_hashes;
 	int res = 0;
+	int i;
 
 	if (totempg_threaded_mode == 1) {
 		pthread_mutex_lock (&totempg_mutex);
@@ -1202,10 +3063,24 @@ int totempg_groups_join (
 		res = -1;
 		goto error_exit;
 	}
+	instance->groups = new_groups;
+	new_group_hashes = realloc (instance->group_hashes,
+		sizeof (uint64_t) * (instance->groups_cnt + group_cnt));
+	if (new_group_hashes == NULL) {
+		res = -1;
+		goto error_exit;
+	}
+	instance->group_hashes = new_group_hashes;
 	memcpy (&new_groups[instance->groups_cnt],
 		groups, group_cnt * sizeof (struct totempg_group));
-	instance->groups = new_groups;
+	for (i = 0; i < group_cnt; i++) {
+		new_group_hashes[instance->groups_cnt + i] =
+			totempg_hash (groups[i].group, groups[i].group_len);
+		instance->group_filter |=
+			group_filter_bits (new_group_hashes[instance->groups_cnt + i]);
+	}
 	instance->groups_cnt += group_cnt;
+	totempg_groups_joined += group_cnt;
 
 error_exit:
 	if (totempg_threaded_mode == 1) {
@@ -1581,6 +3456,12 @@ extern void totempg_stats_clear (int flags)
 	if (flags & TOTEMPG_STATS_CLEAR_TOTEM) {
 		totempg_stats.msg_reserved = 0;
 		totempg_stats.msg_queue_avail = 0;
+		totempg_stats.fragment_copy_bytes = 0;
+		totempg_stats.mcast_copy_bytes = 0;
+		totempg_stats.mcast_msgs = 0;
+		totempg_stats.mcast_frames = 0;
+		totempg_stats.coalesce_deferred = 0;
+		totempg_stats.coalesce_delay_us_max = 0;
 	}
 	return totemsrp_stats_clear (totemsrp_context, flags);
 }
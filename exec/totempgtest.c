@@ -0,0 +1,846 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Checks of the totempg side channel for large messages
+ *
+ * totempg.c is included, so its static functions and state can be reached.
+ * totemsrp is replaced by the functions below, which record the packets
+ * totempg multicasts and sends through the side channel, so a check can hand
+ * them back as if another member had sent them.  Every check prints its name
+ * and the program exits with 1 if any of them failed.
+ */
+
+#include "totempg.c"
+
+#define TEST_NODEID		1
+#define TEST_PEER		2
+#define TEST_OTHER		3
+
+#define TEST_MSG_SIZE		300000
+#define TEST_FRAME_SIZE		1500
+#define TEST_RING_MAX		512
+#define TEST_SENT_MAX		2048
+#define TEST_DELIVERED_MAX	16
+#define TEST_SENDERS		(2 * ASSEMBLY_FREE_MAX)
+
+struct test_packet {
+	unsigned int nodeid;
+	size_t len;
+	unsigned char buf[TEST_FRAME_SIZE];
+};
+
+static int failures;
+
+static struct test_packet ring[TEST_RING_MAX];
+
+static unsigned int ring_entries;
+
+static struct test_packet sent[TEST_SENT_MAX];
+
+static unsigned int sent_entries;
+
+static char delivered[TEST_DELIVERED_MAX][32];
+
+static unsigned int delivered_entries;
+
+static unsigned char big_msg[TEST_MSG_SIZE];
+
+static int big_msg_intact;
+
+static void (*srp_deliver_fn) (
+	unsigned int nodeid,
+	const void *msg,
+	unsigned int msg_len,
+	int endian_conversion_required);
+
+static void (*srp_confchg_fn) (
+	enum totem_configuration_type configuration_type,
+	const unsigned int *member_list, size_t member_list_entries,
+	const unsigned int *left_list, size_t left_list_entries,
+	const unsigned int *joined_list, size_t joined_list_entries,
+	const struct memb_ring_id *ring_id);
+
+static void (*srp_payload_fn) (
+	unsigned int nodeid,
+	const void *msg,
+	unsigned int msg_len,
+	int endian_conversion_required);
+
+static int (*srp_token_fn) (enum totem_callback_token_type type, const void *data);
+
+/*
+ * totemsrp of a ring which is always operational
+ */
+int totemsrp_initialize (
+	qb_loop_t *poll_handle,
+	void **srp_context,
+	struct totem_config *totem_config,
+	totempg_stats_t *stats,
+	void (*deliver_fn) (
+		unsigned int nodeid,
+		const void *msg,
+		unsigned int msg_len,
+		int endian_conversion_required),
+	void (*confchg_fn) (
+		enum totem_configuration_type configuration_type,
+		const unsigned int *member_list, size_t member_list_entries,
+		const unsigned int *left_list, size_t left_list_entries,
+		const unsigned int *joined_list, size_t joined_list_entries,
+		const struct memb_ring_id *ring_id),
+	void (*waiting_trans_ack_cb_fn) (
+		int waiting_trans_ack))
+{
+	srp_deliver_fn = deliver_fn;
+	srp_confchg_fn = confchg_fn;
+	waiting_trans_ack_cb_fn (0);
+	*srp_context = &srp_deliver_fn;
+	return (0);
+}
+
+void totemsrp_finalize (void *srp_context)
+{
+}
+
+int totemsrp_mcast (
+	void *srp_context,
+	struct iovec *iovec,
+	unsigned int iov_len,
+	int priority)
+{
+	return (-1);
+}
+
+void *totemsrp_mcast_buffer_alloc (
+	void *srp_context,
+	size_t *payload_len_max)
+{
+	*payload_len_max = TEST_FRAME_SIZE;
+	return (malloc (TEST_FRAME_SIZE));
+}
+
+int totemsrp_mcast_buffer_submit (
+	void *srp_context,
+	void *payload,
+	size_t payload_len,
+	int priority)
+{
+	assert (ring_entries < TEST_RING_MAX);
+	ring[ring_entries].nodeid = TEST_NODEID;
+	ring[ring_entries].len = payload_len;
+	memcpy (ring[ring_entries].buf, payload, payload_len);
+	ring_entries++;
+	free (payload);
+	return (0);
+}
+
+void totemsrp_mcast_buffer_release (
+	void *srp_context,
+	void *payload)
+{
+	free (payload);
+}
+
+int totemsrp_avail (void *srp_context)
+{
+	return (TEST_RING_MAX);
+}
+
+int totemsrp_callback_token_create (
+	void *srp_context,
+	void **handle_out,
+	enum totem_callback_token_type type,
+	int delete,
+	int (*callback_fn) (enum totem_callback_token_type type, const void *),
+	const void *data)
+{
+	srp_token_fn = callback_fn;
+	return (0);
+}
+
+void totemsrp_callback_token_destroy (
+	void *srp_context,
+	void **handle_out)
+{
+}
+
+void totemsrp_event_signal (void *srp_context, enum totem_event_type type, int value)
+{
+}
+
+void totemsrp_net_mtu_adjust (struct totem_config *totem_config)
+{
+}
+
+int totemsrp_nodestatus_get (void *srp_context, unsigned int nodeid,
+	struct totem_node_status *node_status)
+{
+	return (-1);
+}
+
+int totemsrp_ifaces_get (
+	void *srp_context,
+	unsigned int nodeid,
+	unsigned int *interface_id,
+	struct totem_ip_address *interfaces,
+	unsigned int interfaces_size,
+	char ***status,
+	unsigned int *iface_count)
+{
+	return (-1);
+}
+
+unsigned int totemsrp_my_nodeid_get (
+	void *srp_context)
+{
+	return (TEST_NODEID);
+}
+
+int totemsrp_my_family_get (
+	void *srp_context)
+{
+	return (AF_INET);
+}
+
+int totemsrp_crypto_set (
+	void *srp_context,
+	const char *cipher_type,
+	const char *hash_type)
+{
+	return (-1);
+}
+
+void totemsrp_service_ready_register (
+	void *srp_context,
+	void (*totem_service_ready) (void))
+{
+}
+
+void totemsrp_payload_register (
+	void *srp_context,
+	void (*deliver_fn) (
+		unsigned int nodeid,
+		const void *msg,
+		unsigned int msg_len,
+		int endian_conversion_required))
+{
+	srp_payload_fn = deliver_fn;
+}
+
+int totemsrp_payload_available (
+	void *srp_context)
+{
+	return (1);
+}
+
+int totemsrp_payload_send (
+	void *srp_context,
+	unsigned int nodeid,
+	const struct iovec *iovec,
+	unsigned int iov_len)
+{
+	unsigned int i;
+
+	assert (sent_entries < TEST_SENT_MAX);
+	sent[sent_entries].nodeid = nodeid;
+	sent[sent_entries].len = 0;
+	for (i = 0; i < iov_len; i++) {
+		memcpy (&sent[sent_entries].buf[sent[sent_entries].len],
+			iovec[i].iov_base, iovec[i].iov_len);
+		sent[sent_entries].len += iovec[i].iov_len;
+	}
+	sent_entries++;
+	return (0);
+}
+
+int totemsrp_iface_set (
+	void *srp_context,
+	const struct totem_ip_address *interface_addr,
+	unsigned short ip_port,
+	unsigned int iface_no)
+{
+	return (-1);
+}
+
+int totemsrp_member_add (
+	void *srp_context,
+	const struct totem_ip_address *member,
+	int ring_no)
+{
+	return (-1);
+}
+
+int totemsrp_member_remove (
+	void *srp_context,
+	const struct totem_ip_address *member,
+	int ring_no)
+{
+	return (-1);
+}
+
+void totemsrp_threaded_mode_enable (
+	void *srp_context)
+{
+}
+
+void totemsrp_trans_ack (
+	void *srp_context)
+{
+}
+
+int totemsrp_reconfigure (
+	void *context,
+	struct totem_config *totem_config)
+{
+	return (0);
+}
+
+int totemsrp_crypto_reconfigure_phase (
+	void *context,
+	struct totem_config *totem_config,
+	cfg_message_crypto_reconfig_phase_t phase)
+{
+	return (0);
+}
+
+void totemsrp_stats_clear (
+	void *srp_context, int flags)
+{
+}
+
+void totemsrp_force_gather (
+	void *context)
+{
+}
+
+static void check (int ok, const char *name)
+{
+	printf ("%s: %s\n", ok ? "PASS" : "FAIL", name);
+	if (!ok) {
+		failures++;
+	}
+}
+
+static void test_log_printf (
+	int level,
+	int subsys,
+	const char *function_name,
+	const char *file_name,
+	int file_line,
+	const char *format,
+	...) __attribute__((format(printf, 6, 7)));
+
+static void test_log_printf (
+	int level,
+	int subsys,
+	const char *function_name,
+	const char *file_name,
+	int file_line,
+	const char *format,
+	...)
+{
+}
+
+static void test_deliver_fn (
+	unsigned int nodeid,
+	const void *msg,
+	unsigned int msg_len,
+	int endian_conversion_required)
+{
+	assert (delivered_entries < TEST_DELIVERED_MAX);
+	snprintf (delivered[delivered_entries++], sizeof (delivered[0]),
+		"msg %u len %u", nodeid, msg_len);
+	if (msg_len == TEST_MSG_SIZE) {
+		big_msg_intact = (memcmp (msg, big_msg, TEST_MSG_SIZE) == 0);
+	}
+}
+
+static void test_confchg_fn (
+	enum totem_configuration_type configuration_type,
+	const unsigned int *member_list, size_t member_list_entries,
+	const unsigned int *left_list, size_t left_list_entries,
+	const unsigned int *joined_list, size_t joined_list_entries,
+	const struct memb_ring_id *ring_id)
+{
+	assert (delivered_entries < TEST_DELIVERED_MAX);
+	snprintf (delivered[delivered_entries++], sizeof (delivered[0]),
+		"confchg %d members %zu", configuration_type, member_list_entries);
+}
+
+static int delivered_match (const char **expected, unsigned int entries)
+{
+	unsigned int i;
+
+	if (delivered_entries != entries) {
+		return (0);
+	}
+	for (i = 0; i < entries; i++) {
+		if (strcmp (delivered[i], expected[i]) != 0) {
+			return (0);
+		}
+	}
+	return (1);
+}
+
+static void test_config_init (struct totem_config *totem_config)
+{
+	memset (totem_config, 0, sizeof (struct totem_config));
+
+	totem_config->node_id = TEST_NODEID;
+	totem_config->token_timeout = 1000;
+	totem_config->consensus_timeout = 1200;
+	totem_config->net_mtu = TEST_FRAME_SIZE;
+	totem_config->side_channel_threshold = 65536;
+
+	totem_config->totem_logging_configuration.log_printf = test_log_printf;
+}
+
+/*
+ * Deliver a configuration change, the codecs it makes this processor
+ * advertise are left out of the recorded packets
+ */
+static void confchg_deliver (
+	enum totem_configuration_type configuration_type,
+	const unsigned int *member_list, size_t member_list_entries,
+	const unsigned int *left_list, size_t left_list_entries)
+{
+	struct memb_ring_id ring_id;
+	unsigned int ring_entries_start = ring_entries;
+
+	memset (&ring_id, 0, sizeof (ring_id));
+	srp_confchg_fn (configuration_type, member_list, member_list_entries,
+		left_list, left_list_entries, NULL, 0, &ring_id);
+	srp_token_fn (TOTEM_CALLBACK_TOKEN_RECEIVED, NULL);
+	ring_entries = ring_entries_start;
+}
+
+/*
+ * Deliver the codecs advertised by nodeid
+ */
+static void codecs_deliver (unsigned int nodeid, unsigned int codecs)
+{
+	unsigned char buf[sizeof (codecs_group_len) + TOTEMPG_CODECS_GROUP_LEN +
+		sizeof (struct totempg_codecs)];
+
+	memcpy (buf, codecs_group_len, sizeof (codecs_group_len));
+	memcpy (&buf[sizeof (codecs_group_len)], TOTEMPG_CODECS_GROUP,
+		TOTEMPG_CODECS_GROUP_LEN);
+	memcpy (&buf[sizeof (codecs_group_len) + TOTEMPG_CODECS_GROUP_LEN],
+		&codecs, sizeof (codecs));
+	app_deliver_fn (nodeid, buf, sizeof (buf), 0);
+}
+
+/*
+ * Multicast a message and run the token, returns the number of packets
+ */
+static unsigned int msg_send (void *instance, const void *msg, size_t msg_len)
+{
+	struct iovec iovec;
+	unsigned int ring_entries_start = ring_entries;
+
+	iovec.iov_base = (void *)msg;
+	iovec.iov_len = msg_len;
+	assert (totempg_groups_mcast_joined (instance, &iovec, 1, TOTEMPG_AGREED) == 0);
+	srp_token_fn (TOTEM_CALLBACK_TOKEN_RECEIVED, NULL);
+
+	return (ring_entries - ring_entries_start);
+}
+
+/*
+ * Hand a chunk sent by this processor back as chunk of payload id of origin,
+ * received from nodeid
+ */
+static void chunk_receive (
+	const struct test_packet *chunk,
+	unsigned int nodeid,
+	unsigned int origin,
+	unsigned int id)
+{
+	unsigned char buf[TEST_FRAME_SIZE];
+	struct totempg_payload_header *header = (struct totempg_payload_header *)buf;
+
+	memcpy (buf, chunk->buf, chunk->len);
+	header->origin = origin;
+	header->id = id;
+	srp_payload_fn (nodeid, buf, chunk->len, 0);
+}
+
+static void descriptor_deliver (
+	const struct test_packet *packet,
+	unsigned int nodeid,
+	unsigned int id)
+{
+	unsigned char buf[TEST_FRAME_SIZE];
+	struct totempg_payload_descriptor descriptor;
+
+	memcpy (buf, packet->buf, packet->len);
+	memcpy (&descriptor, &buf[sizeof (struct totempg_mcast)], sizeof (descriptor));
+	descriptor.id = id;
+	memcpy (&buf[sizeof (struct totempg_mcast)], &descriptor, sizeof (descriptor));
+	srp_deliver_fn (nodeid, buf, packet->len, 0);
+}
+
+/*
+ * Deliver the announcement of nodeid that it holds the data of payload
+ */
+static void have_deliver (unsigned int nodeid, const struct totempg_payload *payload)
+{
+	unsigned char buf[sizeof (struct totempg_mcast) + sizeof (struct totempg_payload_have)];
+	struct totempg_payload_have have;
+	struct totempg_mcast mcast;
+
+	memset (&mcast, 0, sizeof (mcast));
+	mcast.header.type = TOTEMPG_TYPE_PAYLOAD_HAVE;
+	have.origin = payload->origin;
+	have.id = payload->id;
+	have.hash = payload->hash;
+	memcpy (buf, &mcast, sizeof (mcast));
+	memcpy (&buf[sizeof (mcast)], &have, sizeof (have));
+	srp_deliver_fn (nodeid, buf, sizeof (buf), 0);
+}
+
+static unsigned int descriptor_id (const struct test_packet *packet)
+{
+	struct totempg_payload_descriptor descriptor;
+
+	memcpy (&descriptor, &packet->buf[sizeof (struct totempg_mcast)], sizeof (descriptor));
+	return (descriptor.id);
+}
+
+/*
+ * Move the clock of a payload back by more than the retain time, then run
+ * the payload timer
+ */
+static void payload_age (struct totempg_payload *payload)
+{
+	uint64_t age;
+
+	age = (uint64_t)(totempg_totem_config->token_timeout +
+		totempg_totem_config->consensus_timeout + 1) * QB_TIME_NS_IN_MSEC;
+	payload->ordered_time -= age;
+	payload->activity_time -= age;
+	payload->delivered_time -= age;
+	payload_timer_fn (NULL);
+}
+
+int main (void)
+{
+	const unsigned int members[] = { TEST_NODEID, TEST_PEER, TEST_OTHER };
+	const unsigned int members_left[] = { TEST_NODEID, TEST_OTHER };
+	const unsigned int left[] = { TEST_PEER };
+	const struct totempg_group group = { "test", 4 };
+	struct totem_config totem_config;
+	struct totempg_payload *payload;
+	struct test_packet descriptor;
+	struct test_packet small;
+	unsigned char compressed[sizeof (compress_group_len) + TOTEMPG_COMPRESSED_GROUP_LEN +
+		sizeof (struct totempg_compress_header) + 16];
+	struct totempg_compress_header compressed_header;
+	uint64_t compress_tx;
+	unsigned char nack[sizeof (struct totempg_payload_header) + sizeof (unsigned int)];
+	struct totempg_payload_header *header = (struct totempg_payload_header *)nack;
+	unsigned int chunk_index[TEST_SENT_MAX];
+	unsigned int chunks = 0;
+	unsigned int sent_start;
+	unsigned int ring_start;
+	unsigned int ring_end;
+	unsigned int assembled;
+	unsigned int id;
+	unsigned int i;
+	qb_loop_t *loop;
+	void *instance;
+
+	loop = qb_loop_create ();
+	assert (loop != NULL);
+	test_config_init (&totem_config);
+	assert (totempg_initialize (loop, &totem_config) == 0);
+	assert (totempg_groups_initialize (&instance, test_deliver_fn, test_confchg_fn) == 0);
+	assert (totempg_groups_join (instance, &group, 1) == 0);
+	confchg_deliver (TOTEM_CONFIGURATION_REGULAR, members, 3, NULL, 0);
+
+	for (i = 0; i < TEST_MSG_SIZE; i++) {
+		big_msg[i] = i * 7;
+	}
+
+	/*
+	 * Only the descriptor of a large message goes through the ring
+	 */
+	delivered_entries = 0;
+	check (msg_send (instance, big_msg, TEST_MSG_SIZE) == 1 && sent_entries > 0,
+		"large message is sent through the side channel");
+	descriptor = ring[0];
+	id = descriptor_id (&descriptor);
+	for (i = 0; i < sent_entries; i++) {
+		if (sent[i].nodeid == TEST_PEER) {
+			chunk_index[chunks++] = i;
+		}
+	}
+	check (chunks * 2 == sent_entries, "every other member gets every chunk");
+	srp_deliver_fn (TEST_NODEID, descriptor.buf, descriptor.len, 0);
+	check (delivered_entries == 0 && ring_entries == 2,
+		"holding the data is announced once the descriptor is delivered");
+	srp_deliver_fn (TEST_NODEID, ring[1].buf, ring[1].len, 0);
+	check (delivered_entries == 1 && big_msg_intact,
+		"large message is delivered with its announcement");
+
+	assert (msg_send (instance, "after", 5) == 1);
+	small = ring[ring_entries - 1];
+
+	/*
+	 * Deliveries ordered after a payload wait for its missing chunks
+	 */
+	delivered_entries = 0;
+	big_msg_intact = 0;
+	for (i = 0; i < chunks; i++) {
+		if (i % 10 != 3) {
+			chunk_receive (&sent[chunk_index[i]], TEST_PEER, TEST_PEER, id);
+		}
+	}
+	descriptor_deliver (&descriptor, TEST_PEER, id);
+	srp_deliver_fn (TEST_PEER, small.buf, small.len, 0);
+	confchg_deliver (TOTEM_CONFIGURATION_REGULAR, members, 3, NULL, 0);
+	check (delivered_entries == 0 && totempg_stats.payload_held == 3,
+		"deliveries are held behind an incomplete payload");
+
+	payload = payload_find (TEST_PEER, id);
+	assert (payload != NULL);
+	payload->activity_time -= PAYLOAD_TIMER_MSEC * QB_TIME_NS_IN_MSEC;
+	sent_start = sent_entries;
+	payload_timer_fn (NULL);
+	check (sent_entries == sent_start + 1 && sent[sent_start].nodeid == TEST_PEER,
+		"missing chunks are requested from the origin");
+
+	ring_start = ring_entries;
+	for (i = 0; i < chunks; i++) {
+		if (i % 10 == 3) {
+			chunk_receive (&sent[chunk_index[i]], TEST_PEER, TEST_PEER, id);
+		}
+	}
+	check (delivered_entries == 0 && ring_entries == ring_start + 1,
+		"completed payload is announced");
+	srp_deliver_fn (TEST_NODEID, ring[ring_start].buf, ring[ring_start].len, 0);
+	{
+		const char *expected[] = { "msg 2 len 300000", "msg 2 len 5", "confchg 0 members 3" };
+
+		check (delivered_match (expected, 3) && big_msg_intact &&
+			totempg_stats.payload_held == 0,
+			"held deliveries follow the completed payload in order");
+	}
+
+	/*
+	 * The origin serves requests of other members, and keeps a delivered
+	 * payload while it is requested
+	 */
+	payload = payload_find (TEST_NODEID, id);
+	assert (payload != NULL && payload->delivered);
+	memcpy (nack, sent[chunk_index[0]].buf, sizeof (struct totempg_payload_header));
+	header->type = TOTEMPG_PAYLOAD_NACK;
+	header->index = 1;
+	i = 5;
+	memcpy (&nack[sizeof (struct totempg_payload_header)], &i, sizeof (i));
+	payload->delivered_time -= (uint64_t)(totem_config.token_timeout +
+		totem_config.consensus_timeout + 1) * QB_TIME_NS_IN_MSEC;
+	sent_start = sent_entries;
+	srp_payload_fn (TEST_OTHER, nack, sizeof (nack), 0);
+	check (sent_entries == sent_start + 1 && sent[sent_start].nodeid == TEST_OTHER &&
+		sent[sent_start].len == sent[chunk_index[5]].len &&
+		memcmp (sent[sent_start].buf, sent[chunk_index[5]].buf, sent[sent_start].len) == 0,
+		"requested chunk is served");
+	payload_timer_fn (NULL);
+	check (payload_find (TEST_NODEID, id) == payload,
+		"requested payload is kept");
+	payload_age (payload);
+	check (payload_find (TEST_NODEID, id) == NULL,
+		"payload is freed once nobody requests it");
+
+	/*
+	 * Once its origin left, a payload which another member announced is
+	 * requested from the members until it arrives
+	 */
+	delivered_entries = 0;
+	descriptor_deliver (&descriptor, TEST_PEER, id + 1000);
+	payload = payload_find (TEST_PEER, id + 1000);
+	assert (payload != NULL);
+	have_deliver (TEST_OTHER, payload);
+	srp_deliver_fn (TEST_PEER, small.buf, small.len, 0);
+	confchg_deliver (TOTEM_CONFIGURATION_TRANSITIONAL, members_left, 2, left, 1);
+	confchg_deliver (TOTEM_CONFIGURATION_REGULAR, members_left, 2, left, 1);
+	check (payload_find (TEST_PEER, id + 1000) == payload &&
+		totempg_stats.payload_dropped == 0,
+		"payload of a failed origin announced by a member is kept");
+	sent_start = sent_entries;
+	payload_age (payload);
+	check (delivered_entries == 0 && totempg_stats.payload_stalled == 1 &&
+		totempg_stats.payload_held == 4,
+		"payload of a failed origin is still held after the retain time");
+	check (sent_entries == sent_start + 1 && sent[sent_start].nodeid == TEST_OTHER,
+		"payload of a failed origin is requested from the other members");
+	ring_start = ring_entries;
+	for (i = 0; i < chunks; i++) {
+		chunk_receive (&sent[chunk_index[i]], TEST_OTHER, TEST_PEER, id + 1000);
+	}
+	srp_deliver_fn (TEST_NODEID, ring[ring_start].buf, ring[ring_start].len, 0);
+	{
+		const char *expected[] = { "msg 2 len 300000", "msg 2 len 5",
+			"confchg 1 members 2", "confchg 0 members 2" };
+
+		check (delivered_match (expected, 4) && big_msg_intact,
+			"payload of a failed origin is delivered once another member served it");
+	}
+
+	/*
+	 * A payload which no member announced is dropped by every processor at
+	 * the configuration change without its origin
+	 */
+	confchg_deliver (TOTEM_CONFIGURATION_REGULAR, members, 3, NULL, 0);
+	delivered_entries = 0;
+	descriptor_deliver (&descriptor, TEST_PEER, id + 3000);
+	srp_deliver_fn (TEST_PEER, small.buf, small.len, 0);
+	confchg_deliver (TOTEM_CONFIGURATION_TRANSITIONAL, members_left, 2, left, 1);
+	check (delivered_entries == 0 && payload_find (TEST_PEER, id + 3000) != NULL,
+		"payload is held until the regular configuration change");
+	confchg_deliver (TOTEM_CONFIGURATION_REGULAR, members_left, 2, left, 1);
+	{
+		const char *expected[] = { "msg 2 len 5", "confchg 1 members 2",
+			"confchg 0 members 2" };
+
+		check (delivered_match (expected, 3) && totempg_stats.payload_dropped == 1 &&
+			totempg_stats.payload_held == 0 &&
+			payload_find (TEST_PEER, id + 3000) == NULL,
+			"payload of a failed origin nobody announced is dropped");
+	}
+
+	/*
+	 * Payload memory is bounded by sending in band, not by dropping
+	 */
+	payload_bytes += PAYLOAD_BYTES_MAX;
+	sent_start = sent_entries;
+	ring_start = ring_entries;
+	check (msg_send (instance, big_msg, TEST_MSG_SIZE) > 1 && sent_entries == sent_start,
+		"large message is sent in band once payload memory is used up");
+	ring_end = ring_entries;
+	delivered_entries = 0;
+	descriptor_deliver (&descriptor, TEST_OTHER, id + 2000);
+	check (payload_find (TEST_OTHER, id + 2000) != NULL &&
+		totempg_stats.payload_held == 1,
+		"ordered descriptor is kept once payload memory is used up");
+	payload_bytes -= PAYLOAD_BYTES_MAX;
+	for (i = 0; i < chunks; i++) {
+		chunk_receive (&sent[chunk_index[i]], TEST_OTHER, TEST_OTHER, id + 2000);
+	}
+	srp_deliver_fn (TEST_NODEID, ring[ring_entries - 1].buf, ring[ring_entries - 1].len, 0);
+	check (delivered_entries == 1 && big_msg_intact,
+		"payload ordered beyond the limit is delivered");
+
+	/*
+	 * Only a bounded number of released assemblies is kept for reuse
+	 */
+	for (id = 0; id < TEST_SENDERS; id++) {
+		for (i = ring_start; i < ring_end - 1; i++) {
+			srp_deliver_fn (TEST_OTHER + 1 + id, ring[i].buf, ring[i].len, 0);
+		}
+	}
+	check (totempg_stats.assembly_in_use == TEST_SENDERS,
+		"every sender of a fragmented message has an assembly");
+	assembled = 0;
+	for (id = 0; id < TEST_SENDERS; id++) {
+		delivered_entries = 0;
+		big_msg_intact = 0;
+		srp_deliver_fn (TEST_OTHER + 1 + id, ring[ring_end - 1].buf,
+			ring[ring_end - 1].len, 0);
+		if (delivered_entries == 1 && big_msg_intact) {
+			assembled++;
+		}
+	}
+	check (assembled == TEST_SENDERS && totempg_stats.assembly_in_use == 0,
+		"fragmented messages of all senders are delivered");
+	check (assembly_free_count == ASSEMBLY_FREE_MAX &&
+		totempg_stats.assembly_bytes <=
+		ASSEMBLY_FREE_MAX * (ASSEMBLY_DATA_KEEP + sizeof (struct assembly)),
+		"released assemblies kept for reuse are bounded");
+
+	/*
+	 * Messages are only compressed for a ring which advertised the codec,
+	 * and a message which can't be decompressed is dropped
+	 */
+	confchg_deliver (TOTEM_CONFIGURATION_REGULAR, members, 3, NULL, 0);
+	memset (big_msg, 0, TEST_MSG_SIZE);
+#ifdef HAVE_ZLIB
+	strcpy (totem_config.compression_model, "zlib");
+	totem_config.compression_threshold = 128;
+	totem_config.compression_level = 1;
+	codecs_deliver (TEST_PEER, 1 << TOTEMPG_COMPRESS_ZLIB);
+	compress_tx = totempg_stats.compress_tx;
+	msg_send (instance, big_msg, 4096);
+	check (totempg_stats.compress_tx == compress_tx,
+		"message is sent uncompressed until every member advertised the codec");
+	codecs_deliver (TEST_OTHER, 1 << TOTEMPG_COMPRESS_ZLIB);
+	check (msg_send (instance, big_msg, 4096) == 1 &&
+		totempg_stats.compress_tx == compress_tx + 1,
+		"message is compressed once every member advertised the codec");
+	delivered_entries = 0;
+	srp_deliver_fn (TEST_PEER, ring[ring_entries - 1].buf, ring[ring_entries - 1].len, 0);
+	check (delivered_entries == 1 && strcmp (delivered[0], "msg 2 len 4096") == 0,
+		"compressed message is delivered");
+	confchg_deliver (TOTEM_CONFIGURATION_REGULAR, members, 3, NULL, 0);
+	msg_send (instance, big_msg, 4096);
+	check (totempg_stats.compress_tx == compress_tx + 1,
+		"advertised codecs are forgotten on a configuration change");
+	strcpy (totem_config.compression_model, "none");
+#else
+	compress_tx = totempg_stats.compress_tx;
+	msg_send (instance, big_msg, 4096);
+	check (totempg_stats.compress_tx == compress_tx,
+		"message is sent uncompressed without a codec");
+#endif
+	memcpy (compressed, compress_group_len, sizeof (compress_group_len));
+	memcpy (&compressed[sizeof (compress_group_len)], TOTEMPG_COMPRESSED_GROUP,
+		TOTEMPG_COMPRESSED_GROUP_LEN);
+	compressed_header.codec = TOTEMPG_COMPRESS_ZLIB + 100;
+	compressed_header.size = 4096;
+	memcpy (&compressed[sizeof (compress_group_len) + TOTEMPG_COMPRESSED_GROUP_LEN],
+		&compressed_header, sizeof (compressed_header));
+	delivered_entries = 0;
+	app_deliver_fn (TEST_PEER, compressed, sizeof (compressed), 0);
+	check (delivered_entries == 0 && totempg_stats.compress_errors == 1,
+		"message which can't be decompressed is dropped");
+
+	payload_timer_start ();
+	coalesce_timer_start (qb_util_nano_current_get ());
+	totempg_finalize ();
+	check (qb_loop_timer_is_running (loop, payload_timer) == 0 &&
+		qb_loop_timer_is_running (loop, coalesce_timer) == 0,
+		"finalize deletes the timers");
+	qb_loop_destroy (loop);
+
+	return (failures ? 1 : 0);
+}
@@ -0,0 +1,644 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Ring throughput benchmark
+ *
+ * Runs several totemsrp instances in this process, connected by the
+ * in-process loopback transport (totemloop), so ring experiments don't need
+ * a cluster of machines.  For every combination of window size and message
+ * size a fresh ring is formed, every node multicasts its share of the
+ * messages as fast as flow control allows and the run ends once every node
+ * has delivered every message.  All nodes run in one thread, so the CPU time
+ * per message is the cost of the whole ring.
+ *
+ * Every mode lives in its own file: with -r the benchmark measures recovery
+ * from the loss of a node instead (totemringbench_recovery.c), with -i the
+ * cost of an idle ring (totemringbench_idle.c).
+ *
+ * Multicast loss (-l, 1% by default with -r) leaves gaps so old ring
+ * messages have to be recovered in the new ring.
+ *
+ * With loss, the latency from sending to ordered delivery and the number of
+ * missing messages node 1 recovered through retransmits and through parity
+ * (-f, see totem.fec_group_size) show what forward error correction saves.
+ *
+ * -a enables totem.token_adaptive, with -r the reconf column then shows how
+ * much sooner the failed node is detected.
+ *
+ * -H sets totem.token_hold_idle_max, which matters with -i.
+ *
+ * -b sets totem.buffer_pool_size, -b 0 allocates a transport buffer for every
+ * message.
+ *
+ * -p adds the CPU cache misses per token handled by a node, counted with
+ * perf_event_open(2), to see how much of the instance the token path touches
+ * (totemringbench_perf.c).
+ *
+ * usage: totemringbench [-n nodes] [-c messages] [-w window[,window...]]
+ *                       [-s size[,size...]] [-m max_messages] [-l loss]
+ *                       [-f fec_group_size] [-b buffer_pool_size]
+ *                       [-i seconds] [-H token_hold_idle_max]
+ *                       [-a] [-p] [-r] [-v]
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
+
+#include <qb/qbdefs.h>
+#include <qb/qbloop.h>
+#include <qb/qbutil.h>
+
+#include <corosync/icmap.h>
+#include <corosync/logsys.h>
+
+#include "totemsrp.h"
+#include "totemloop.h"
+#include "totemconfig.h"
+#include "main.h"
+#include "totemringbench.h"
+
+#define BENCH_RUNS_MAX		16
+
+struct bench_node *nodes[BENCH_NODES_MAX];
+
+unsigned int node_count = 3;
+
+static unsigned int max_messages = 17;
+
+static unsigned int fec_group_size = 0;
+
+static unsigned int buffer_pool_size = 128;
+
+static unsigned int token_hold_idle_max = 0;
+
+static int token_adaptive = 0;
+
+static int recovery_mode = 0;
+
+static int perf_mode = 0;
+
+unsigned int ring_members;
+
+static int log_level = LOGSYS_LEVEL_WARNING;
+
+qb_loop_t *bench_loop;
+
+unsigned int rings_formed;
+
+unsigned int regular_confchgs;
+
+unsigned long long delivered;
+
+unsigned long long deliveries_expected;
+
+static int timed_out;
+
+size_t msg_size;
+
+char buffer[FRAME_SIZE_MAX];
+
+static void bench_log_printf (
+	int level,
+	int subsys,
+	const char *function_name,
+	const char *file_name,
+	int file_line,
+	const char *format,
+	...) __attribute__((format(printf, 6, 7)));
+
+static void bench_log_printf (
+	int level,
+	int subsys,
+	const char *function_name,
+	const char *file_name,
+	int file_line,
+	const char *format,
+	...)
+{
+	va_list ap;
+
+	if (level > log_level) {
+		return;
+	}
+	fprintf (stderr, "%s:%d ", function_name, file_line);
+	va_start (ap, format);
+	vfprintf (stderr, format, ap);
+	va_end (ap);
+	fprintf (stderr, "\n");
+}
+
+static void bench_ring_id_create_or_load (
+	struct memb_ring_id *memb_ring_id,
+	unsigned int nodeid)
+{
+	memb_ring_id->rep = nodeid;
+	memb_ring_id->seq = 0;
+}
+
+static void bench_ring_id_store (
+	const struct memb_ring_id *memb_ring_id,
+	unsigned int nodeid)
+{
+}
+
+static void bench_deliver_fn (
+	unsigned int nodeid,
+	const void *msg,
+	unsigned int msg_len,
+	int endian_conversion_required)
+{
+	if (++delivered == deliveries_expected) {
+		qb_loop_stop (bench_loop);
+	}
+}
+
+static void bench_confchg_fn (
+	enum totem_configuration_type configuration_type,
+	const unsigned int *member_list, size_t member_list_entries,
+	const unsigned int *left_list, size_t left_list_entries,
+	const unsigned int *joined_list, size_t joined_list_entries,
+	const struct memb_ring_id *ring_id)
+{
+	if (configuration_type != TOTEM_CONFIGURATION_REGULAR) {
+		return;
+	}
+	regular_confchgs++;
+	if (member_list_entries != ring_members) {
+		return;
+	}
+	if (++rings_formed == ring_members) {
+		qb_loop_stop (bench_loop);
+	}
+}
+
+static void bench_waiting_trans_ack_fn (int waiting_trans_ack)
+{
+}
+
+static void bench_timeout_fn (void *data)
+{
+	timed_out = 1;
+	qb_loop_stop (bench_loop);
+}
+
+/*
+ * Keep the pending queue of the node full until its share is sent
+ */
+static int bench_token_received_fn (
+	enum totem_callback_token_type type,
+	const void *data)
+{
+	struct bench_node *node = (struct bench_node *)data;
+	struct iovec iov;
+
+	iov.iov_base = buffer;
+	iov.iov_len = msg_size;
+
+	while (node->to_send > 0 && totemsrp_avail (node->srp_context) > 1) {
+		if (totemsrp_mcast (node->srp_context, &iov, 1, 0) == -1) {
+			break;
+		}
+		node->to_send--;
+	}
+	return (0);
+}
+
+static void bench_config_init (
+	struct totem_config *totem_config,
+	unsigned int nodeid,
+	unsigned int window_size)
+{
+	memset (totem_config, 0, sizeof (struct totem_config));
+
+	totem_config->interfaces = malloc (sizeof (struct totem_interface) * INTERFACE_MAX);
+	if (totem_config->interfaces == NULL) {
+		fprintf (stderr, "out of memory\n");
+		exit (1);
+	}
+	memset (totem_config->interfaces, 0, sizeof (struct totem_interface) * INTERFACE_MAX);
+	totem_config->interfaces[0].configured = 1;
+	totemip_parse (&totem_config->interfaces[0].bindnet, "127.0.0.1", TOTEM_IP_VERSION_4);
+
+	totem_config->node_id = nodeid;
+	totem_config->transport_number = TOTEM_TRANSPORT_LOOP;
+
+	/*
+	 * Defaults of totemconfig.c
+	 */
+	totem_config->token_timeout = 3000;
+	totem_config->token_coefficient = 650;
+	totem_config->token_adaptive = token_adaptive;
+	totem_config->token_phi_threshold = 8;
+	totem_config->token_retransmits_before_loss_const = 4;
+	totem_config->token_retransmit_timeout = (int)(totem_config->token_timeout /
+		(totem_config->token_retransmits_before_loss_const + 0.2));
+	totem_config->token_hold_timeout = (int)(totem_config->token_retransmit_timeout * 0.8 -
+		(1000/HZ));
+	totem_config->join_timeout = 50;
+	totem_config->send_join_timeout = 0;
+	totem_config->consensus_timeout = (int)(1.2 * totem_config->token_timeout);
+	totem_config->merge_timeout = 200;
+	totem_config->downcheck_timeout = 1000;
+	totem_config->fail_to_recv_const = 2500;
+	totem_config->seqno_unchanged_const = 30;
+	totem_config->max_network_delay = 50;
+	totem_config->miss_count_const = 5;
+	totem_config->retransmit_ranges = 1;
+	totem_config->sort_queue_bytes = 64 * 1024 * 1024;
+	totem_config->fec_group_size = fec_group_size;
+	totem_config->buffer_pool_size = buffer_pool_size;
+	totem_config->token_hold_idle_max = token_hold_idle_max;
+	totem_config->window_size = window_size;
+	totem_config->max_messages = max_messages;
+	totem_config->net_mtu = 1500;
+
+	totem_config->totem_logging_configuration.log_printf = bench_log_printf;
+	totem_config->totem_logging_configuration.log_level_security = LOGSYS_LEVEL_WARNING;
+	totem_config->totem_logging_configuration.log_level_error = LOGSYS_LEVEL_ERROR;
+	totem_config->totem_logging_configuration.log_level_warning = LOGSYS_LEVEL_WARNING;
+	totem_config->totem_logging_configuration.log_level_notice = LOGSYS_LEVEL_NOTICE;
+	totem_config->totem_logging_configuration.log_level_debug = LOGSYS_LEVEL_DEBUG;
+	totem_config->totem_logging_configuration.log_level_trace = LOGSYS_LEVEL_TRACE;
+
+	totem_config->totem_memb_ring_id_create_or_load = bench_ring_id_create_or_load;
+	totem_config->totem_memb_ring_id_store = bench_ring_id_store;
+
+	totemsrp_net_mtu_adjust (totem_config);
+}
+
+int bench_loop_run (unsigned int seconds)
+{
+	qb_loop_timer_handle timer;
+
+	timed_out = 0;
+	qb_loop_timer_add (bench_loop, QB_LOOP_LOW,
+		(uint64_t)seconds * QB_TIME_NS_IN_SEC, NULL, bench_timeout_fn, &timer);
+	qb_loop_run (bench_loop);
+	qb_loop_timer_del (bench_loop, timer);
+
+	return (timed_out ? -1 : 0);
+}
+
+double rusage_usec (void)
+{
+	struct rusage usage;
+
+	getrusage (RUSAGE_SELF, &usage);
+	return ((double)usage.ru_utime.tv_sec * 1000000.0 + usage.ru_utime.tv_usec +
+		(double)usage.ru_stime.tv_sec * 1000000.0 + usage.ru_stime.tv_usec);
+}
+
+/*
+ * Counters of node 1 and of the process when the messages start to flow
+ */
+struct bench_sample {
+	uint64_t nsec;
+	double cpu_usec;
+	uint64_t tokens_all;
+	totemsrp_stats_t srp;
+};
+
+static uint64_t bench_tokens_all (void)
+{
+	uint64_t tokens = 0;
+	unsigned int i;
+
+	for (i = 0; i < node_count; i++) {
+		tokens += nodes[i]->stats.srp->orf_token_rx;
+	}
+	return (tokens);
+}
+
+static void bench_sample_take (struct bench_sample *sample)
+{
+	sample->tokens_all = bench_tokens_all ();
+	memcpy (&sample->srp, nodes[0]->stats.srp, sizeof (totemsrp_stats_t));
+	sample->cpu_usec = rusage_usec ();
+	sample->nsec = qb_util_nano_current_get ();
+}
+
+static void bench_throughput_header (void)
+{
+	printf ("%6s %7s %7s %12s %10s %10s %10s %10s %8s %8s", "nodes", "window", "size",
+		"msgs/sec", "MB/sec", "rot (us)", "cpu/msg", "lat (us)", "rtr", "fec");
+	if (perf_mode) {
+		printf (" %10s", "miss/token");
+	}
+	printf ("\n");
+}
+
+static void bench_throughput_report (
+	unsigned int window_size,
+	unsigned int message_count,
+	const struct bench_sample *start)
+{
+	uint64_t end_nsec;
+	uint64_t cache_misses;
+	const totemsrp_stats_t *srp = nodes[0]->stats.srp;
+	const totemsrp_latency_stats_t *order_start, *order_end;
+	double cpu_end;
+	double seconds;
+	int perf_res;
+
+	perf_res = perf_stop (&cache_misses);
+	end_nsec = qb_util_nano_current_get ();
+	cpu_end = rusage_usec ();
+	seconds = (double)(end_nsec - start->nsec) / QB_TIME_NS_IN_SEC;
+
+	order_start = &start->srp.latency[TOTEM_LATENCY_ORDER];
+	order_end = &srp->latency[TOTEM_LATENCY_ORDER];
+	printf ("%6u %7u %7zu %12.0f %10.2f %10.1f %10.2f %10.1f %8"PRIu64" %8"PRIu64,
+		node_count, window_size, msg_size,
+		message_count / seconds,
+		(double)message_count * msg_size / seconds / (1024.0 * 1024.0),
+		(double)(end_nsec - start->nsec) / QB_TIME_NS_IN_USEC /
+			(srp->orf_token_rx - start->srp.orf_token_rx),
+		(cpu_end - start->cpu_usec) / message_count,
+		(double)(order_end->sum_us - order_start->sum_us) /
+			MAX (order_end->count - order_start->count, 1),
+		srp->mcast_rtr_recovered - start->srp.mcast_rtr_recovered,
+		srp->mcast_fec_recovered - start->srp.mcast_fec_recovered);
+	if (perf_mode) {
+		if (perf_res == 0) {
+			printf (" %10.1f", (double)cache_misses /
+				MAX (bench_tokens_all () - start->tokens_all, 1));
+		} else {
+			printf (" %10s", "-");
+		}
+	}
+	printf ("\n");
+}
+
+static int bench_run (
+	unsigned int window_size,
+	unsigned int message_count)
+{
+	unsigned int i;
+	struct bench_sample start;
+	int res = -1;
+
+	bench_loop = qb_loop_create ();
+	if (bench_loop == NULL) {
+		fprintf (stderr, "cannot create poll loop\n");
+		return (-1);
+	}
+
+	rings_formed = 0;
+	ring_members = node_count;
+	for (i = 0; i < node_count; i++) {
+		nodes[i] = malloc (sizeof (struct bench_node));
+		if (nodes[i] == NULL) {
+			fprintf (stderr, "out of memory\n");
+			exit (1);
+		}
+		memset (nodes[i], 0, sizeof (struct bench_node));
+		bench_config_init (&nodes[i]->totem_config, i + 1, window_size);
+
+		if (totemsrp_initialize (bench_loop, &nodes[i]->srp_context,
+			&nodes[i]->totem_config, &nodes[i]->stats,
+			bench_deliver_fn, bench_confchg_fn,
+			bench_waiting_trans_ack_fn) == -1) {
+			fprintf (stderr, "cannot initialize node %u\n", i + 1);
+			exit (1);
+		}
+	}
+
+	if (bench_loop_run (BENCH_FORM_TIMEOUT) == -1) {
+		fprintf (stderr, "ring of %u nodes not formed after %d seconds\n",
+			node_count, BENCH_FORM_TIMEOUT);
+		goto finalize;
+	}
+
+	/*
+	 * There is no synchronization layer, release the transitional
+	 * queues right away
+	 */
+	for (i = 0; i < node_count; i++) {
+		totemsrp_trans_ack (nodes[i]->srp_context);
+		nodes[i]->to_send = message_count / node_count +
+			(i < message_count % node_count ? 1 : 0);
+		if (recovery_mode) {
+			nodes[i]->to_send = UINT_MAX;
+		}
+		totemsrp_callback_token_create (nodes[i]->srp_context,
+			&nodes[i]->token_callback_handle,
+			TOTEM_CALLBACK_TOKEN_RECEIVED, 0,
+			bench_token_received_fn, nodes[i]);
+	}
+
+	delivered = 0;
+	deliveries_expected = (unsigned long long)message_count * node_count;
+	bench_sample_take (&start);
+	perf_start ();
+
+	if (bench_loop_run (BENCH_FORM_TIMEOUT + message_count / 1000) == -1) {
+		fprintf (stderr, "only %llu of %llu messages delivered\n",
+			delivered, deliveries_expected);
+		goto finalize;
+	}
+
+	if (recovery_mode) {
+		res = bench_recovery_run (window_size);
+	} else if (idle_seconds) {
+		res = bench_idle_run ();
+	} else {
+		bench_throughput_report (window_size, message_count, &start);
+		res = 0;
+	}
+
+finalize:
+	for (i = 0; i < node_count; i++) {
+		totemsrp_finalize (nodes[i]->srp_context);
+		free (nodes[i]->totem_config.interfaces);
+		free (nodes[i]);
+	}
+	qb_loop_destroy (bench_loop);
+
+	return (res);
+}
+
+static unsigned int list_parse (const char *str, unsigned int *list)
+{
+	unsigned int entries = 0;
+	char *end;
+
+	while (*str != '\0' && entries < BENCH_RUNS_MAX) {
+		list[entries++] = strtoul (str, &end, 10);
+		if (*end != ',') {
+			break;
+		}
+		str = end + 1;
+	}
+	return (entries);
+}
+
+static void usage (const char *name)
+{
+	printf ("usage: %s [-n nodes] [-c messages] [-w window[,window...]]\n"
+		"       [-s size[,size...]] [-m max_messages] [-l loss]\n"
+		"       [-f fec_group_size] [-b buffer_pool_size]\n"
+		"       [-i seconds] [-H token_hold_idle_max] [-a] [-p] [-r] [-v]\n", name);
+}
+
+int main (int argc, char *argv[])
+{
+	unsigned int windows[BENCH_RUNS_MAX] = { 50, 100, 300 };
+	unsigned int window_entries = 3;
+	unsigned int sizes[BENCH_RUNS_MAX] = { 64, 512, 1024 };
+	unsigned int size_entries = 3;
+	unsigned int message_count = 100000;
+	int loss = -1;
+	struct totem_config probe_config;
+	unsigned int w, s;
+	int opt;
+
+	while ((opt = getopt (argc, argv, "n:c:w:s:m:l:f:b:i:H:aprvh")) != -1) {
+		switch (opt) {
+		case 'n':
+			node_count = atoi (optarg);
+			break;
+		case 'c':
+			message_count = atoi (optarg);
+			break;
+		case 'w':
+			window_entries = list_parse (optarg, windows);
+			break;
+		case 's':
+			size_entries = list_parse (optarg, sizes);
+			break;
+		case 'm':
+			max_messages = atoi (optarg);
+			break;
+		case 'l':
+			loss = atoi (optarg);
+			break;
+		case 'f':
+			fec_group_size = atoi (optarg);
+			break;
+		case 'b':
+			buffer_pool_size = atoi (optarg);
+			break;
+		case 'i':
+			idle_seconds = atoi (optarg);
+			break;
+		case 'H':
+			token_hold_idle_max = atoi (optarg);
+			break;
+		case 'a':
+			token_adaptive = 1;
+			break;
+		case 'p':
+			perf_mode = 1;
+			break;
+		case 'r':
+			recovery_mode = 1;
+			break;
+		case 'v':
+			log_level = LOGSYS_LEVEL_DEBUG;
+			break;
+		case 'h':
+		default:
+			usage (argv[0]);
+			exit (1);
+		}
+	}
+	if (node_count == 0 || node_count > BENCH_NODES_MAX ||
+	    message_count == 0 || max_messages == 0 || loss > 100 ||
+	    fec_group_size > FEC_GROUP_SIZE_MAX) {
+		usage (argv[0]);
+		exit (1);
+	}
+	/*
+	 * Losing one of two nodes leaves a ring of one, which can't be told
+	 * apart from the ring of the node cut off
+	 */
+	if (recovery_mode && node_count < 3) {
+		fprintf (stderr, "recovery needs at least 3 nodes\n");
+		exit (1);
+	}
+	if (loss == -1) {
+		loss = recovery_mode ? 1 : 0;
+	}
+	totemloop_mcast_loss_set (loss);
+
+	if (perf_mode && !recovery_mode) {
+		if (perf_open () == -1) {
+			fprintf (stderr, "cache miss counter not available, %s\n",
+				strerror (errno));
+		}
+	}
+
+	/*
+	 * Larger messages would be fragmented by totempg, the benchmark
+	 * sends one totemsrp packet per message
+	 */
+	bench_config_init (&probe_config, 1, windows[0]);
+	free (probe_config.interfaces);
+	for (s = 0; s < size_entries; s++) {
+		if (sizes[s] == 0 || sizes[s] > probe_config.net_mtu) {
+			fprintf (stderr, "message size %u doesn't fit in one packet of %u bytes\n",
+				sizes[s], probe_config.net_mtu);
+			exit (1);
+		}
+	}
+
+	if (idle_seconds) {
+		bench_idle_header ();
+	} else if (recovery_mode) {
+		bench_recovery_header ();
+	} else {
+		bench_throughput_header ();
+	}
+	for (w = 0; w < window_entries; w++) {
+		for (s = 0; s < size_entries; s++) {
+			msg_size = sizes[s];
+			if (bench_run (windows[w], message_count) == -1) {
+				exit (1);
+			}
+		}
+	}
+
+	return (0);
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef TOTEMRINGBENCH_H_DEFINED
+#define TOTEMRINGBENCH_H_DEFINED
+
+#include <qb/qbloop.h>
+
+#include "totemsrp.h"
+
+/*
+ * State of the ring benchmark shared by its modes
+ */
+#define BENCH_NODES_MAX		64
+#define BENCH_FORM_TIMEOUT	30
+
+struct bench_node {
+	struct totem_config totem_config;
+	totempg_stats_t stats;
+	void *srp_context;
+	void *token_callback_handle;
+	unsigned int to_send;
+};
+
+extern struct bench_node *nodes[BENCH_NODES_MAX];
+
+extern unsigned int node_count;
+
+extern unsigned int ring_members;
+
+extern qb_loop_t *bench_loop;
+
+extern unsigned int rings_formed;
+
+/*
+ * Regular configurations installed by any node
+ */
+extern unsigned int regular_confchgs;
+
+extern unsigned long long delivered;
+
+extern unsigned long long deliveries_expected;
+
+extern size_t msg_size;
+
+extern char buffer[FRAME_SIZE_MAX];
+
+/*
+ * Run the poll loop until it is stopped, -1 if it ran for seconds instead
+ */
+extern int bench_loop_run (unsigned int seconds);
+
+/*
+ * CPU time used by the process in microseconds
+ */
+extern double rusage_usec (void);
+
+/*
+ * Recovery mode (-r), totemringbench_recovery.c
+ */
+extern void bench_recovery_header (void);
+
+extern int bench_recovery_run (unsigned int window_size);
+
+/*
+ * Idle mode (-i), totemringbench_idle.c
+ */
+extern unsigned int idle_seconds;
+
+extern void bench_idle_header (void);
+
+extern int bench_idle_run (void);
+
+/*
+ * Cache miss counter (-p), totemringbench_perf.c
+ */
+extern int perf_open (void);
+
+extern void perf_start (void);
+
+extern int perf_stop (uint64_t *count);
+
+#endif /* TOTEMRINGBENCH_H_DEFINED */
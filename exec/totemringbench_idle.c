@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Idle mode of the ring benchmark
+ *
+ * The ring is left idle for a number of seconds once the messages are
+ * delivered.  The token rotations per second of node 1, the wakeups per
+ * second of the process (all nodes share one thread) and its CPU usage show
+ * what an idle ring costs, then the last node sends one message and the time
+ * until every node delivered it shows how fast the ring wakes up again.
+ * An idle ring must not reconfigure, however long its token is held, the
+ * reconf column counts the configurations the nodes installed meanwhile.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
+
+#include <qb/qbdefs.h>
+#include <qb/qbloop.h>
+#include <qb/qbutil.h>
+
+#include "totemsrp.h"
+#include "totemringbench.h"
+
+unsigned int idle_seconds = 0;
+
+/*
+ * The poll loop blocks whenever nothing is due, so every wakeup of the
+ * process is a voluntary context switch
+ */
+static long rusage_wakeups (void)
+{
+	struct rusage usage;
+
+	getrusage (RUSAGE_SELF, &usage);
+	return (usage.ru_nvcsw);
+}
+
+void bench_idle_header (void)
+{
+	printf ("%6s %12s %12s %10s %10s %7s %12s\n", "nodes", "tokens/sec",
+		"wakeups/sec", "cpu (%)", "hold (ms)", "reconf", "first (ms)");
+}
+
+/*
+ * Leave the ring idle, then send one message and wait for its delivery
+ */
+int bench_idle_run (void)
+{
+	uint64_t start_nsec, end_nsec, send_nsec;
+	uint64_t tokens_start;
+	unsigned int confchgs_start;
+	long wakeups_start;
+	double cpu_start;
+	double seconds;
+	struct iovec iov;
+
+	tokens_start = nodes[0]->stats.srp->orf_token_rx;
+	confchgs_start = regular_confchgs;
+	wakeups_start = rusage_wakeups ();
+	cpu_start = rusage_usec ();
+	start_nsec = qb_util_nano_current_get ();
+
+	/*
+	 * Runs into the timeout, nothing else stops the loop
+	 */
+	(void)bench_loop_run (idle_seconds);
+
+	end_nsec = qb_util_nano_current_get ();
+	seconds = (double)(end_nsec - start_nsec) / QB_TIME_NS_IN_SEC;
+
+	printf ("%6u %12.1f %12.1f %10.2f %10u %7u",
+		node_count,
+		(nodes[0]->stats.srp->orf_token_rx - tokens_start) / seconds,
+		(rusage_wakeups () - wakeups_start) / seconds,
+		(rusage_usec () - cpu_start) / seconds / 10000.0,
+		nodes[0]->stats.srp->token_hold_idle,
+		regular_confchgs - confchgs_start);
+
+	iov.iov_base = buffer;
+	iov.iov_len = msg_size;
+	deliveries_expected = delivered + node_count;
+	send_nsec = qb_util_nano_current_get ();
+	/*
+	 * Like totempg, wake up the ring before queueing the message
+	 */
+	totemsrp_event_signal (nodes[node_count - 1]->srp_context, TOTEM_EVENT_NEW_MSG, 1);
+	if (totemsrp_mcast (nodes[node_count - 1]->srp_context, &iov, 1, 0) == -1 ||
+	    bench_loop_run (BENCH_FORM_TIMEOUT) == -1) {
+		printf ("\n");
+		fprintf (stderr, "message sent on the idle ring not delivered\n");
+		return (-1);
+	}
+	printf (" %12.1f\n",
+		(double)(qb_util_nano_current_get () - send_nsec) / QB_TIME_NS_IN_MSEC);
+
+	return (0);
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Cache miss counter of the ring benchmark
+ *
+ * Counts the CPU cache misses of the thread running all nodes with
+ * perf_event_open(2).  It needs a kernel and CPU exposing hardware counters
+ * to the process.
+ */
+
+#include <config.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "totemringbench.h"
+
+static int perf_fd = -1;
+
+/*
+ * Open the hardware cache miss counter of this thread, -1 if it isn't
+ * available
+ */
+int perf_open (void)
+{
+#if defined(__linux__)
+	struct perf_event_attr attr;
+
+	memset (&attr, 0, sizeof (attr));
+	attr.size = sizeof (attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	perf_fd = syscall (__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+	return (perf_fd);
+}
+
+void perf_start (void)
+{
+#if defined(__linux__)
+	if (perf_fd != -1) {
+		ioctl (perf_fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl (perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+}
+
+/*
+ * Cache misses since perf_start, -1 if the counter isn't available
+ */
+int perf_stop (uint64_t *count)
+{
+#if defined(__linux__)
+	if (perf_fd != -1) {
+		ioctl (perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read (perf_fd, count, sizeof (*count)) == sizeof (*count)) {
+			return (0);
+		}
+	}
+#endif
+	return (-1);
+}
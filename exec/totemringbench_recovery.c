@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Recovery mode of the ring benchmark
+ *
+ * Once the messages are delivered with all queues still full, the last node
+ * is cut off and the time until the remaining nodes have installed the new
+ * ring is measured, together with the longest stall of the poll loop during
+ * reconfiguration and how long node 1 spent forming the membership (token
+ * loss to commit), committing it and recovering messages of the old ring.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <qb/qbdefs.h>
+#include <qb/qbloop.h>
+#include <qb/qbutil.h>
+
+#include "totemsrp.h"
+#include "totemloop.h"
+#include "totemringbench.h"
+
+#define BENCH_STALL_INTERVAL	(QB_TIME_NS_IN_MSEC)
+
+static uint64_t stall_expected;
+
+static uint64_t stall_max;
+
+static qb_loop_timer_handle stall_timer;
+
+/*
+ * Poll loop stalls show up as late timers
+ */
+static void bench_stall_fn (void *data)
+{
+	uint64_t now;
+
+	now = qb_util_nano_current_get ();
+	if (now - stall_expected > stall_max) {
+		stall_max = now - stall_expected;
+	}
+	stall_expected = now + BENCH_STALL_INTERVAL;
+	qb_loop_timer_add (bench_loop, QB_LOOP_HIGH, BENCH_STALL_INTERVAL,
+		NULL, bench_stall_fn, &stall_timer);
+}
+
+void bench_recovery_header (void)
+{
+	printf ("%6s %7s %7s %12s %12s %12s %12s %12s\n", "nodes", "window", "size",
+		"reconf (ms)", "stall (ms)", "gather (ms)", "commit (ms)", "recover (ms)");
+}
+
+/*
+ * Cut the last node off while all queues are full and wait for the others
+ * to form a new ring
+ */
+int bench_recovery_run (unsigned int window_size)
+{
+	uint64_t start_nsec, end_nsec;
+	const totemsrp_reconf_stats_t *reconf;
+	uint64_t first_us;
+	int i;
+
+	rings_formed = 0;
+	ring_members = node_count - 1;
+	stall_max = 0;
+	stall_expected = qb_util_nano_current_get () + BENCH_STALL_INTERVAL;
+	qb_loop_timer_add (bench_loop, QB_LOOP_HIGH, BENCH_STALL_INTERVAL,
+		NULL, bench_stall_fn, &stall_timer);
+
+	start_nsec = qb_util_nano_current_get ();
+	totemloop_node_isolate (node_count, 1);
+
+	if (bench_loop_run (BENCH_FORM_TIMEOUT) == -1) {
+		fprintf (stderr, "ring of %u nodes not formed after %d seconds\n",
+			ring_members, BENCH_FORM_TIMEOUT);
+		qb_loop_timer_del (bench_loop, stall_timer);
+		return (-1);
+	}
+	end_nsec = qb_util_nano_current_get ();
+	qb_loop_timer_del (bench_loop, stall_timer);
+
+	reconf = &nodes[0]->stats.srp->reconf[nodes[0]->stats.srp->reconf_latest];
+	first_us = 0;
+	for (i = 0; i < TOTEM_RECONF_EVENT_MAX && first_us == 0; i++) {
+		first_us = reconf->timestamp_us[i];
+	}
+
+	printf ("%6u %7u %7zu %12.1f %12.1f %12.1f %12.1f %12.1f\n",
+		node_count, window_size, msg_size,
+		(double)(end_nsec - start_nsec) / QB_TIME_NS_IN_MSEC,
+		(double)stall_max / QB_TIME_NS_IN_MSEC,
+		(double)(reconf->timestamp_us[TOTEM_RECONF_COMMIT] - first_us) / 1000.0,
+		(double)(reconf->timestamp_us[TOTEM_RECONF_RECOVERY] -
+			reconf->timestamp_us[TOTEM_RECONF_COMMIT]) / 1000.0,
+		(double)(reconf->timestamp_us[TOTEM_RECONF_OPERATIONAL] -
+			reconf->timestamp_us[TOTEM_RECONF_RECOVERY]) / 1000.0);
+
+	return (0);
+}
@@ -79,7 +79,8 @@
 #include <qb/qbloop.h>
 
 #include <corosync/swab.h>
-#include <corosync/sq.h>
+#include <corosync/sqb.h>
+#include <corosync/nodeset.h>
 
 #define LOGSYS_UTILS_ONLY 1
 #include <corosync/logsys.h>
@@ -93,13 +94,28 @@
 #include "cs_queue.h"
 
 #define LOCALHOST_IP				inet_addr("127.0.0.1")
-#define QUEUE_RTR_ITEMS_SIZE_MAX		16384 /* allow 16384 retransmit items */
-#define RETRANS_MESSAGE_QUEUE_SIZE_MAX		16384 /* allow 500 messages to be queued */
+#define QUEUE_RTR_ITEMS_SIZE_MAX		65536 /* sort queues grow up to 65536 items */
+#define QUEUE_RTR_ITEMS_SIZE_MIN		1024 /* and shrink down to 1024 items */
+#define RETRANS_MESSAGE_QUEUE_SIZE_MAX		QUEUE_RTR_ITEMS_SIZE_MAX
 #define RECEIVED_MESSAGE_QUEUE_SIZE_MAX		500 /* allow 500 messages to be queued */
 #define MAXIOVS					5
 #define RETRANSMIT_ENTRIES_MAX			30
+#define RETRANSMIT_RANGES_MAX			32
+#define FCC_ADAPTIVE_INCREASE			4
+#define LANE_NORMAL_RESERVE_SHARE		4 /* 1/4 of the window kept for bulk */
+#define TOKEN_INTERVAL_SAMPLES_MIN		16 /* before token_adaptive takes over */
+#define TOKEN_HOLD_IDLE_SHIFT_MAX		16 /* doublings of the idle token hold */
+#define TOTEM_RTR_RANGES_MAGIC			0xC071
 #define TOKEN_SIZE_MAX				64000 /* bytes */
 #define LEAVE_DUMMY_NODEID                      0
+#define TOTEMSRP_CACHE_LINE			64 /* bytes */
+
+/*
+ * memb_index holds the proc, failed, memb and consensus nodes at once
+ */
+#if NODESET_INDEX_MAX < 4 * PROCESSOR_COUNT_MAX
+#error NODESET_INDEX_MAX is too small for PROCESSOR_COUNT_MAX
+#endif
 
 /*
  * SRP address.
@@ -150,6 +166,8 @@ enum message_type {
 	MESSAGE_TYPE_MEMB_JOIN = 3,			/* membership join message */
 	MESSAGE_TYPE_MEMB_COMMIT_TOKEN = 4,	/* membership commit token */
 	MESSAGE_TYPE_TOKEN_HOLD_CANCEL = 5,	/* cancel the holding of the token */
+	MESSAGE_TYPE_MCAST_PARITY = 6,		/* parity of a group of multicast messages */
+	MESSAGE_TYPE_PAYLOAD = 7,		/* unordered point-to-point side channel data */
 };
 
 enum encapsulation_type {
@@ -157,14 +175,6 @@ enum encapsulation_type {
 	MESSAGE_NOT_ENCAPSULATED = 2
 };
 
-/*
- * New membership algorithm local variables
- */
-struct consensus_list_item {
-	struct srp_addr addr;
-	int set;
-};
-
 
 struct token_callback_instance {
 	struct qb_list_head list;
@@ -191,6 +201,27 @@ struct mcast {
 } __attribute__((packed));
 
 
+/*
+ * XOR of the messages seq to seq + count - 1, each padded with zeros to
+ * parity_len bytes, follows the header
+ */
+struct mcast_parity {
+	struct totem_message_header header;
+	struct memb_ring_id ring_id;
+	unsigned int seq;
+	unsigned int count;
+	unsigned int msg_len_xor;
+	unsigned int parity_len;
+} __attribute__((packed));
+
+/*
+ * Side channel data of the upper layer follows the header, it is neither
+ * ordered nor reliable and bound to no ring
+ */
+struct payload_message {
+	struct totem_message_header header;
+} __attribute__((packed));
+
 struct rtr_item  {
 	struct memb_ring_id ring_id;
 	unsigned int seq;
@@ -212,6 +243,28 @@ struct orf_token {
 }__attribute__((packed));
 
 
+struct rtr_range {
+	unsigned int seq;
+	unsigned int count;
+}__attribute__((packed));
+
+
+/*
+ * Optional extension following rtr_list of the orf token.  It requests
+ * retransmission of whole ranges of messages of ring_id once rtr_list is
+ * full.  Older processors ignore trailing data and don't forward it, so
+ * the extension only travels between processors supporting it.
+ */
+struct orf_token_rtr_ranges {
+	unsigned short magic;
+	char version;
+	char reserved;
+	struct memb_ring_id ring_id;
+	int rtr_range_entries;
+	struct rtr_range rtr_range[0];
+}__attribute__((packed));
+
+
 struct memb_join {
 	struct totem_message_header header;
 	struct srp_addr system_from;
@@ -264,14 +317,25 @@ struct memb_commit_token {
  */
 }__attribute__((packed));
 
+/*
+ * Recovery items reference an old ring message in place, it is still owned
+ * by the regular sort queue and only encapsulated when it is sent
+ */
 struct message_item {
 	struct mcast *mcast;
 	unsigned int msg_len;
+	uint64_t submit_time;
+	int recovery_reference;
 };
 
+/*
+ * submit_time and send_time are only set for locally originated messages
+ */
 struct sort_queue_item {
 	struct mcast *mcast;
 	unsigned int msg_len;
+	uint64_t submit_time;
+	uint64_t send_time;
 };
 
 enum memb_state {
@@ -282,132 +346,248 @@ enum memb_state {
 };
 
 struct totemsrp_instance {
-	int iface_changes;
+	/*
+	 * Hot part, used on every token and every multicast by
+	 * message_handler_orf_token, message_handler_mcast,
+	 * messages_deliver_to_app and the functions they call.  It comes first
+	 * and the cold part starts on a new cache line, so handling a token
+	 * touches a few lines instead of fields spread over the whole instance.
+	 */
+	enum memb_state memb_state;
 
-	int failed_to_recv;
+	struct srp_addr my_id;
+
+	struct memb_ring_id my_ring_id;
+
+	int 	flushing;
+
+	uint32_t waiting_trans_ack;
+
+	unsigned int use_heartbeat;
+
+	uint32_t orf_token_discard;
+
+	int my_token_held;
 
 	/*
-	 * Flow control mcasts and remcasts on last and current orf_token
+	 * Received up to and including
 	 */
-	int fcc_remcast_last;
+	unsigned int my_aru;
 
-	int fcc_mcast_last;
+	unsigned int my_high_delivered;
 
-	int fcc_remcast_current;
+	unsigned int my_high_seq_received;
 
-	struct consensus_list_item consensus_list[PROCESSOR_COUNT_MAX];
+	unsigned int my_last_aru;
 
-	int consensus_list_entries;
+	int my_aru_count;
 
-	int lowest_active_if;
+	int my_seq_unchanged;
 
-	struct srp_addr my_id;
+	int my_received_flg;
 
-	struct totem_ip_address my_addrs[INTERFACE_MAX];
+	unsigned int my_token_seq;
 
-	struct srp_addr my_proc_list[PROCESSOR_COUNT_MAX];
+	unsigned int my_last_seq;
 
-	struct srp_addr my_failed_list[PROCESSOR_COUNT_MAX];
+	int my_rotation_counter;
 
-	struct srp_addr my_new_memb_list[PROCESSOR_COUNT_MAX];
+	int my_set_retrans_flg;
 
-	struct srp_addr my_trans_memb_list[PROCESSOR_COUNT_MAX];
+	int my_retrans_flg_count;
 
-	struct srp_addr my_memb_list[PROCESSOR_COUNT_MAX];
+	unsigned int my_install_seq;
 
-	struct srp_addr my_deliver_memb_list[PROCESSOR_COUNT_MAX];
+	unsigned int my_high_ring_delivered;
 
-	struct srp_addr my_left_memb_list[PROCESSOR_COUNT_MAX];
+	unsigned int last_released;
 
-	unsigned int my_leave_memb_list[PROCESSOR_COUNT_MAX];
+	unsigned int set_aru;
 
-	int my_proc_list_entries;
+	int old_ring_state_saved;
 
-	int my_failed_list_entries;
+	int global_seqno;
 
-	int my_new_memb_entries;
+	unsigned long long token_ring_id_seq;
 
-	int my_trans_memb_entries;
+	int rtr_range_entries;
 
-	int my_memb_entries;
+	int lane_normal_skipped;
 
-	int my_deliver_memb_entries;
+	/*
+	 * Valid tokens received in a row without new messages and the token
+	 * hold they led to, see token_hold_idle_get
+	 */
+	unsigned int token_idle_rotations;
 
-	int my_left_memb_entries;
+	unsigned int token_hold_idle;
 
-	int my_leave_memb_entries;
+	/*
+	 * Flow control mcasts and remcasts on last and current orf_token
+	 */
+	int fcc_remcast_last;
 
-	struct memb_ring_id my_ring_id;
+	int fcc_mcast_last;
 
-	struct memb_ring_id my_old_ring_id;
+	int fcc_remcast_current;
 
-	int my_aru_count;
+	unsigned int my_trc;
 
-	int my_merge_detect_timeout_outstanding;
+	unsigned int my_pbl;
 
-	unsigned int my_last_aru;
+	unsigned int my_cbl;
 
-	int my_seq_unchanged;
+	/*
+	 * Effective flow control limits (adjusted per rotation when
+	 * window_size_adaptive is enabled)
+	 */
+	unsigned int fcc_window_size;
 
-	int my_received_flg;
+	unsigned int fcc_max_messages;
 
-	unsigned int my_high_seq_received;
+	uint64_t fcc_token_rx_last;
 
-	unsigned int my_install_seq;
+	/*
+	 * Token inter-arrival time of the accrual failure detector, smoothed
+	 * like the TCP round trip time (RFC 6298)
+	 */
+	uint64_t token_interval_rx_last;
 
-	int my_rotation_counter;
+	int64_t token_interval_srtt_us;
 
-	int my_set_retrans_flg;
+	int64_t token_interval_rttvar_us;
 
-	int my_retrans_flg_count;
+	unsigned int token_interval_samples;
 
-	unsigned int my_high_ring_delivered;
+	unsigned int token_timeout_effective;
 
-	int heartbeat_timeout;
+	/*
+	 * Message bytes held by the regular sort queue
+	 */
+	uint64_t regular_sort_queue_bytes;
+
+	struct totem_config *totem_config;
+
+	void *totemnet_context;
+
+	qb_loop_t *totemsrp_poll_handle;
+
+	void (*totemsrp_deliver_fn) (
+		unsigned int nodeid,
+		const void *msg,
+		unsigned int msg_len,
+		int endian_conversion_required);
+
+	/*
+	 * Forward error correction, parity of the group being sent and the
+	 * buffer messages are reconstructed in
+	 */
+	struct mcast_parity *fec_parity;
+
+	char *fec_recovery_buffer;
+
+	qb_loop_timer_handle timer_orf_token_timeout;
+
+	qb_loop_timer_handle timer_orf_token_warning;
+
+	qb_loop_timer_handle timer_orf_token_retransmit_timeout;
+
+	qb_loop_timer_handle timer_orf_token_hold_retransmit_timeout;
+
+	struct qb_list_head token_callback_received_listhead;
+
+	struct qb_list_head token_callback_sent_listhead;
 
 	/*
 	 * Queues used to order, deliver, and recover messages
 	 */
-	struct cs_queue new_message_queue;
+	struct sqb regular_sort_queue;
 
-	struct cs_queue new_message_queue_trans;
+	struct sqb recovery_sort_queue;
+
+	struct cs_queue new_message_queue[TOTEM_LANE_MAX];
 
 	struct cs_queue retrans_message_queue;
 
-	struct sq regular_sort_queue;
+	/*
+	 * Cold part, membership, configuration, timers and stats
+	 */
+	int iface_changes __attribute__((aligned(TOTEMSRP_CACHE_LINE)));
 
-	struct sq recovery_sort_queue;
+	int failed_to_recv;
 
 	/*
-	 * Received up to and including
+	 * Bitmaps mirroring my_proc_list, my_failed_list and my_memb_list plus
+	 * the consensus database, all keyed by memb_index
 	 */
-	unsigned int my_aru;
+	struct nodeset_index memb_index;
 
-	unsigned int my_high_delivered;
+	struct nodeset my_proc_set;
 
-	struct qb_list_head token_callback_received_listhead;
+	struct nodeset my_failed_set;
 
-	struct qb_list_head token_callback_sent_listhead;
+	struct nodeset my_memb_set;
+
+	struct nodeset consensus_set;
+
+	int lowest_active_if;
+
+	struct totem_ip_address my_addrs[INTERFACE_MAX];
+
+	struct srp_addr my_proc_list[PROCESSOR_COUNT_MAX];
+
+	struct srp_addr my_failed_list[PROCESSOR_COUNT_MAX];
+
+	struct srp_addr my_new_memb_list[PROCESSOR_COUNT_MAX];
+
+	struct srp_addr my_trans_memb_list[PROCESSOR_COUNT_MAX];
+
+	struct srp_addr my_memb_list[PROCESSOR_COUNT_MAX];
+
+	struct srp_addr my_deliver_memb_list[PROCESSOR_COUNT_MAX];
+
+	struct srp_addr my_left_memb_list[PROCESSOR_COUNT_MAX];
+
+	unsigned int my_leave_memb_list[PROCESSOR_COUNT_MAX];
+
+	int my_proc_list_entries;
+
+	int my_failed_list_entries;
+
+	int my_new_memb_entries;
+
+	int my_trans_memb_entries;
+
+	int my_memb_entries;
+
+	int my_deliver_memb_entries;
+
+	int my_left_memb_entries;
+
+	int my_leave_memb_entries;
+
+	struct memb_ring_id my_old_ring_id;
+
+	int my_merge_detect_timeout_outstanding;
+
+	int heartbeat_timeout;
+
+	struct cs_queue new_message_queue_trans[TOTEM_LANE_MAX];
 
 	char orf_token_retransmit[TOKEN_SIZE_MAX];
 
 	int orf_token_retransmit_size;
 
-	unsigned int my_token_seq;
+	/*
+	 * Retransmit ranges of the token currently being processed
+	 */
+	struct rtr_range rtr_ranges[RETRANSMIT_RANGES_MAX];
 
 	/*
 	 * Timers
 	 */
 	qb_loop_timer_handle timer_pause_timeout;
 
-	qb_loop_timer_handle timer_orf_token_timeout;
-
-	qb_loop_timer_handle timer_orf_token_warning;
-
-	qb_loop_timer_handle timer_orf_token_retransmit_timeout;
-
-	qb_loop_timer_handle timer_orf_token_hold_retransmit_timeout;
-
 	qb_loop_timer_handle timer_merge_detect_timeout;
 
 	qb_loop_timer_handle memb_timer_state_gather_join_timeout;
@@ -443,20 +623,10 @@ struct totemsrp_instance {
 		int line,
 		const char *format, ...)__attribute__((format(printf, 6, 7)));;
 
-	enum memb_state memb_state;
-
 //TODO	struct srp_addr next_memb;
 
-	qb_loop_t *totemsrp_poll_handle;
-
 	struct totem_ip_address mcast_address;
 
-	void (*totemsrp_deliver_fn) (
-		unsigned int nodeid,
-		const void *msg,
-		unsigned int msg_len,
-		int endian_conversion_required);
-
 	void (*totemsrp_confchg_fn) (
 		enum totem_configuration_type configuration_type,
 		const unsigned int *member_list, size_t member_list_entries,
@@ -466,6 +636,12 @@ struct totemsrp_instance {
 
         void (*totemsrp_service_ready_fn) (void);
 
+	void (*totemsrp_payload_deliver_fn) (
+		unsigned int nodeid,
+		const void *msg,
+		unsigned int msg_len,
+		int endian_conversion_required);
+
 	void (*totemsrp_waiting_trans_ack_cb_fn) (
 		int waiting_trans_ack);
 
@@ -477,62 +653,36 @@ struct totemsrp_instance {
 		const struct memb_ring_id *memb_ring_id,
 		unsigned int nodeid);
 
-	int global_seqno;
-
-	int my_token_held;
-
-	unsigned long long token_ring_id_seq;
-
-	unsigned int last_released;
-
-	unsigned int set_aru;
-
-	int old_ring_state_saved;
-
 	int old_ring_state_aru;
 
 	unsigned int old_ring_state_high_seq_received;
 
-	unsigned int my_last_seq;
-
 	struct timeval tv_old;
 
-	void *totemnet_context;
-
-	struct totem_config *totem_config;
-
-	unsigned int use_heartbeat;
-
-	unsigned int my_trc;
-
-	unsigned int my_pbl;
-
-	unsigned int my_cbl;
-
 	uint64_t pause_timestamp;
 
 	struct memb_commit_token *commit_token;
 
 	totemsrp_stats_t stats;
 
-	uint32_t orf_token_discard;
+	/*
+	 * stats.reconf[stats.reconf_latest] is still being filled in
+	 */
+	int reconf_in_progress;
 
 	uint32_t originated_orf_token;
 
 	uint32_t threaded_mode_enabled;
 
-	uint32_t waiting_trans_ack;
-
-	int 	flushing;
-
 	void * token_recv_event_handle;
 	void * token_sent_event_handle;
 	char commit_token_storage[40000];
+
 };
 
 struct message_handlers {
 	int count;
-	int (*handler_functions[6]) (
+	int (*handler_functions[8]) (
 		struct totemsrp_instance *instance,
 		const void *msg,
 		size_t msg_len,
@@ -617,6 +767,25 @@ static int message_handler_token_hold_cancel (
 	size_t msg_len,
 	int endian_conversion_needed);
 
+static int message_handler_mcast_parity (
+	struct totemsrp_instance *instance,
+	const void *msg,
+	size_t msg_len,
+	int endian_conversion_needed);
+
+static int message_handler_payload (
+	struct totemsrp_instance *instance,
+	const void *msg,
+	size_t msg_len,
+	int endian_conversion_needed);
+
+static int mcast_receive (
+	struct totemsrp_instance *instance,
+	const void *msg,
+	size_t msg_len,
+	int endian_conversion_needed,
+	int fec_recovered);
+
 static void totemsrp_instance_initialize (struct totemsrp_instance *instance);
 
 static void srp_addr_to_nodeid (
@@ -635,6 +804,14 @@ static void messages_deliver_to_app (struct totemsrp_instance *instance, int ski
 static int orf_token_mcast (struct totemsrp_instance *instance, struct orf_token *oken,
 	int fcc_mcasts_allowed);
 static void messages_free (struct totemsrp_instance *instance, unsigned int token_aru);
+static void regular_sort_queue_shrink (struct totemsrp_instance *instance, unsigned int token_seq);
+static int sort_queue_reserve (struct totemsrp_instance *instance, struct sqb *sort_queue,
+	unsigned int seq);
+static void latency_record (struct totemsrp_instance *instance, enum totem_latency_type type,
+	uint64_t nsec);
+static void reconf_event_record (struct totemsrp_instance *instance, enum totem_reconf_event event);
+static void token_interval_reset (struct totemsrp_instance *instance);
+static unsigned int token_hold_idle_extra_get (struct totemsrp_instance *instance);
 
 static void memb_ring_id_set (struct totemsrp_instance *instance,
 	const struct memb_ring_id *ring_id);
@@ -649,6 +826,7 @@ static void orf_token_endian_convert (const struct orf_token *in, struct orf_tok
 static void memb_commit_token_endian_convert (const struct memb_commit_token *in, struct memb_commit_token *out);
 static void memb_join_endian_convert (const struct memb_join *in, struct memb_join *out);
 static void mcast_endian_convert (const struct mcast *in, struct mcast *out);
+static void mcast_parity_endian_convert (const struct mcast_parity *in, struct mcast_parity *out);
 static void memb_merge_detect_endian_convert (
 	const struct memb_merge_detect *in,
 	struct memb_merge_detect *out);
@@ -676,14 +854,16 @@ int main_iface_change_fn (
 	unsigned int iface_no);
 
 struct message_handlers totemsrp_message_handlers = {
-	6,
+	8,
 	{
 		message_handler_orf_token,            /* MESSAGE_TYPE_ORF_TOKEN */
 		message_handler_mcast,                /* MESSAGE_TYPE_MCAST */
 		message_handler_memb_merge_detect,    /* MESSAGE_TYPE_MEMB_MERGE_DETECT */
 		message_handler_memb_join,            /* MESSAGE_TYPE_MEMB_JOIN */
 		message_handler_memb_commit_token,    /* MESSAGE_TYPE_MEMB_COMMIT_TOKEN */
-		message_handler_token_hold_cancel     /* MESSAGE_TYPE_TOKEN_HOLD_CANCEL */
+		message_handler_token_hold_cancel,    /* MESSAGE_TYPE_TOKEN_HOLD_CANCEL */
+		message_handler_mcast_parity,         /* MESSAGE_TYPE_MCAST_PARITY */
+		message_handler_payload               /* MESSAGE_TYPE_PAYLOAD */
 	}
 };
 
@@ -791,6 +971,7 @@ static int token_event_stats_collector (enum totem_callback_token_type type, con
 			instance->stats.token[instance->stats.earliest_token].rx = 0;
 			instance->stats.token[instance->stats.earliest_token].tx = 0;
 			instance->stats.token[instance->stats.earliest_token].backlog_calc = 0;
+			instance->stats.token[instance->stats.earliest_token].window_size = 0;
 		}
 
 		instance->stats.token[instance->stats.latest_token].rx = time_now;
@@ -838,9 +1019,10 @@ int totemsrp_initialize (
 {
 	struct totemsrp_instance *instance;
 	int res;
+	int i;
 
-	instance = malloc (sizeof (struct totemsrp_instance));
-	if (instance == NULL) {
+	if (posix_memalign ((void **)&instance, TOTEMSRP_CACHE_LINE,
+	    sizeof (struct totemsrp_instance)) != 0) {
 		goto error_exit;
 	}
 
@@ -854,6 +1036,7 @@ int totemsrp_initialize (
 	instance->stats.earliest_token = 0;
 
 	instance->totem_config = totem_config;
+	token_interval_reset (instance);
 
 	/*
 	 * Configure logging
@@ -918,6 +1101,12 @@ int totemsrp_initialize (
 		"window size per rotation (%d messages) maximum messages per rotation (%d messages)",
 		totem_config->window_size, totem_config->max_messages);
 
+	if (totem_config->window_size_adaptive) {
+		log_printf (instance->totemsrp_log_level_debug,
+			"adaptive window size between %d and %d messages",
+			totem_config->window_size_min, totem_config->window_size_max);
+	}
+
 	log_printf (instance->totemsrp_log_level_debug,
 		"missed count const (%d messages)",
 		totem_config->miss_count_const);
@@ -934,11 +1123,19 @@ int totemsrp_initialize (
 	cs_queue_init (&instance->retrans_message_queue, RETRANS_MESSAGE_QUEUE_SIZE_MAX,
 		sizeof (struct message_item), instance->threaded_mode_enabled);
 
-	sq_init (&instance->regular_sort_queue,
-		QUEUE_RTR_ITEMS_SIZE_MAX, sizeof (struct sort_queue_item), 0);
+	sqb_init (&instance->regular_sort_queue,
+		QUEUE_RTR_ITEMS_SIZE_MIN, sizeof (struct sort_queue_item), 0);
+
+	sqb_init (&instance->recovery_sort_queue,
+		QUEUE_RTR_ITEMS_SIZE_MIN, sizeof (struct sort_queue_item), 0);
+	instance->stats.sort_queue_size = sqb_size_get (&instance->regular_sort_queue);
 
-	sq_init (&instance->recovery_sort_queue,
-		QUEUE_RTR_ITEMS_SIZE_MAX, sizeof (struct sort_queue_item), 0);
+	instance->fec_parity = malloc (sizeof (struct mcast_parity) + FRAME_SIZE_MAX);
+	instance->fec_recovery_buffer = malloc (FRAME_SIZE_MAX);
+	if (instance->fec_parity == NULL || instance->fec_recovery_buffer == NULL) {
+		goto error_exit;
+	}
+	instance->fec_parity->count = 0;
 
 	instance->totemsrp_poll_handle = poll_handle;
 
@@ -996,13 +1193,15 @@ int totemsrp_initialize (
 	/*
 	 * Must have net_mtu adjusted by totemnet_initialize first
 	 */
-	cs_queue_init (&instance->new_message_queue,
-		MESSAGE_QUEUE_MAX,
-		sizeof (struct message_item), instance->threaded_mode_enabled);
+	for (i = 0; i < TOTEM_LANE_MAX; i++) {
+		cs_queue_init (&instance->new_message_queue[i],
+			MESSAGE_QUEUE_MAX,
+			sizeof (struct message_item), instance->threaded_mode_enabled);
 
-	cs_queue_init (&instance->new_message_queue_trans,
-		MESSAGE_QUEUE_MAX,
-		sizeof (struct message_item), instance->threaded_mode_enabled);
+		cs_queue_init (&instance->new_message_queue_trans[i],
+			MESSAGE_QUEUE_MAX,
+			sizeof (struct message_item), instance->threaded_mode_enabled);
+	}
 
 	totemsrp_callback_token_create (instance,
 		&instance->token_recv_event_handle,
@@ -1027,14 +1226,19 @@ void totemsrp_finalize (
 	void *srp_context)
 {
 	struct totemsrp_instance *instance = (struct totemsrp_instance *)srp_context;
+	int i;
 
 	memb_leave_message_send (instance);
 	totemnet_finalize (instance->totemnet_context);
-	cs_queue_free (&instance->new_message_queue);
-	cs_queue_free (&instance->new_message_queue_trans);
+	for (i = 0; i < TOTEM_LANE_MAX; i++) {
+		cs_queue_free (&instance->new_message_queue[i]);
+		cs_queue_free (&instance->new_message_queue_trans[i]);
+	}
 	cs_queue_free (&instance->retrans_message_queue);
-	sq_free (&instance->regular_sort_queue);
-	sq_free (&instance->recovery_sort_queue);
+	sqb_free (&instance->regular_sort_queue);
+	sqb_free (&instance->recovery_sort_queue);
+	free (instance->fec_parity);
+	free (instance->fec_recovery_buffer);
 	free (instance);
 }
 
@@ -1175,9 +1379,197 @@ static struct srp_addr srp_addr_endian_convert (struct srp_addr in)
 	return (res);
 }
 
+/*
+ * Membership node sets
+ *
+ * The set algebra done for every received join message works on bitmaps
+ * instead of nested loops over the srp_addr arrays. The arrays are still
+ * kept, they are what is sent in join messages and logged.
+ */
+static void memb_index_rebuild (struct totemsrp_instance *instance)
+{
+	unsigned int consensus_nodeids[NODESET_INDEX_MAX];
+	int consensus_entries = 0;
+	int node_index;
+	int i;
+
+	for (node_index = nodeset_next (&instance->consensus_set, 0); node_index != -1;
+	    node_index = nodeset_next (&instance->consensus_set, node_index + 1)) {
+		consensus_nodeids[consensus_entries++] = instance->memb_index.nodeid[node_index];
+	}
+
+	nodeset_index_init (&instance->memb_index);
+	nodeset_clear (&instance->my_proc_set);
+	nodeset_clear (&instance->my_failed_set);
+	nodeset_clear (&instance->my_memb_set);
+	nodeset_clear (&instance->consensus_set);
+
+	for (i = 0; i < instance->my_proc_list_entries; i++) {
+		nodeset_set (&instance->my_proc_set,
+			nodeset_index_add (&instance->memb_index, instance->my_proc_list[i].nodeid));
+	}
+	for (i = 0; i < instance->my_failed_list_entries; i++) {
+		nodeset_set (&instance->my_failed_set,
+			nodeset_index_add (&instance->memb_index, instance->my_failed_list[i].nodeid));
+	}
+	for (i = 0; i < instance->my_memb_entries; i++) {
+		nodeset_set (&instance->my_memb_set,
+			nodeset_index_add (&instance->memb_index, instance->my_memb_list[i].nodeid));
+	}
+	for (i = 0; i < consensus_entries; i++) {
+		nodeset_set (&instance->consensus_set,
+			nodeset_index_add (&instance->memb_index, consensus_nodeids[i]));
+	}
+}
+
+/*
+ * Index of a node id, the index is compacted when it fills up
+ */
+static int memb_index_get (
+	struct totemsrp_instance *instance,
+	const struct srp_addr *addr)
+{
+	int node_index;
+
+	if (nodeset_index_free_entries (&instance->memb_index) == 0) {
+		memb_index_rebuild (instance);
+	}
+	node_index = nodeset_index_add (&instance->memb_index, addr->nodeid);
+	assert (node_index >= 0);
+
+	return (node_index);
+}
+
+static int memb_index_lookup (
+	struct totemsrp_instance *instance,
+	const struct srp_addr *addr)
+{
+	return (nodeset_index_lookup (&instance->memb_index, addr->nodeid));
+}
+
+/*
+ * Is addr in set. Nodes which were never indexed are in no set.
+ */
+static int memb_nodeset_isset (
+	struct totemsrp_instance *instance,
+	const struct nodeset *set,
+	const struct srp_addr *addr)
+{
+	return (nodeset_isset (set, memb_index_lookup (instance, addr)));
+}
+
+/*
+ * Is every entry of list in set
+ */
+static int memb_list_subset (
+	struct totemsrp_instance *instance,
+	const struct srp_addr *list, int list_entries,
+	const struct nodeset *set)
+{
+	int i;
+
+	if (list_entries > (int)set->count) {
+		return (0);
+	}
+	for (i = 0; i < list_entries; i++) {
+		if (memb_nodeset_isset (instance, set, &list[i]) == 0) {
+			return (0);
+		}
+	}
+	return (1);
+}
+
+/*
+ * Does list contain exactly the nodes of set (in any order)
+ */
+static int memb_list_equal (
+	struct totemsrp_instance *instance,
+	const struct srp_addr *list, int list_entries,
+	const struct nodeset *set)
+{
+	struct nodeset list_set;
+	int i;
+
+	if (list_entries != (int)set->count) {
+		return (0);
+	}
+
+	/*
+	 * Nodes which are not indexed can't be in set, so they can be skipped
+	 */
+	nodeset_clear (&list_set);
+	for (i = 0; i < list_entries; i++) {
+		int node_index = memb_index_lookup (instance, &list[i]);
+
+		if (node_index >= 0) {
+			nodeset_set (&list_set, node_index);
+		}
+	}
+	return (nodeset_subset (set, &list_set));
+}
+
+static void memb_proc_list_add (
+	struct totemsrp_instance *instance,
+	const struct srp_addr *addr)
+{
+	if (nodeset_set (&instance->my_proc_set, memb_index_get (instance, addr))) {
+		instance->my_proc_list[instance->my_proc_list_entries++] = *addr;
+	}
+}
+
+static void memb_proc_list_merge (
+	struct totemsrp_instance *instance,
+	const struct srp_addr *list, int list_entries)
+{
+	int i;
+
+	for (i = 0; i < list_entries; i++) {
+		memb_proc_list_add (instance, &list[i]);
+	}
+}
+
+static void memb_failed_list_add (
+	struct totemsrp_instance *instance,
+	const struct srp_addr *addr)
+{
+	if (nodeset_set (&instance->my_failed_set, memb_index_get (instance, addr))) {
+		instance->my_failed_list[instance->my_failed_list_entries++] = *addr;
+	}
+}
+
+static void memb_failed_list_merge (
+	struct totemsrp_instance *instance,
+	const struct srp_addr *list, int list_entries)
+{
+	int i;
+
+	for (i = 0; i < list_entries; i++) {
+		memb_failed_list_add (instance, &list[i]);
+	}
+}
+
+/*
+ * my_proc_list minus my_failed_list, in my_proc_list order
+ */
+static void memb_proc_minus_failed (
+	struct totemsrp_instance *instance,
+	struct srp_addr *out_list, int *out_list_entries)
+{
+	int i;
+
+	*out_list_entries = 0;
+	for (i = 0; i < instance->my_proc_list_entries; i++) {
+		if (memb_nodeset_isset (instance, &instance->my_failed_set,
+		    &instance->my_proc_list[i]) == 0) {
+			out_list[*out_list_entries] = instance->my_proc_list[i];
+			*out_list_entries = *out_list_entries + 1;
+		}
+	}
+}
+
 static void memb_consensus_reset (struct totemsrp_instance *instance)
 {
-	instance->consensus_list_entries = 0;
+	nodeset_clear (&instance->consensus_set);
 }
 
 static void memb_set_subtract (
@@ -1207,27 +1599,13 @@ static void memb_set_subtract (
 }
 
 /*
- * Set consensus for a specific processor
- */
-static void memb_consensus_set (
-	struct totemsrp_instance *instance,
-	const struct srp_addr *addr)
-{
-	int found = 0;
-	int i;
-
-	for (i = 0; i < instance->consensus_list_entries; i++) {
-		if (srp_addr_equal(addr, &instance->consensus_list[i].addr)) {
-			found = 1;
-			break; /* found entry */
-		}
-	}
-	instance->consensus_list[i].addr = *addr;
-	instance->consensus_list[i].set = 1;
-	if (found == 0) {
-		instance->consensus_list_entries++;
-	}
-	return;
+ * Set consensus for a specific processor
+ */
+static void memb_consensus_set (
+	struct totemsrp_instance *instance,
+	const struct srp_addr *addr)
+{
+	nodeset_set (&instance->consensus_set, memb_index_get (instance, addr));
 }
 
 /*
@@ -1237,14 +1615,7 @@ static int memb_consensus_isset (
 	struct totemsrp_instance *instance,
 	const struct srp_addr *addr)
 {
-	int i;
-
-	for (i = 0; i < instance->consensus_list_entries; i++) {
-		if (srp_addr_equal (addr, &instance->consensus_list[i].addr)) {
-			return (instance->consensus_list[i].set);
-		}
-	}
-	return (0);
+	return (memb_nodeset_isset (instance, &instance->consensus_set, addr));
 }
 
 /*
@@ -1253,21 +1624,12 @@ static int memb_consensus_isset (
 static int memb_consensus_agreed (
 	struct totemsrp_instance *instance)
 {
-	struct srp_addr token_memb[PROCESSOR_COUNT_MAX];
-	int token_memb_entries = 0;
-	int agreed = 1;
-	int i;
+	struct nodeset token_memb;
+	int agreed;
 
-	memb_set_subtract (token_memb, &token_memb_entries,
-		instance->my_proc_list, instance->my_proc_list_entries,
-		instance->my_failed_list, instance->my_failed_list_entries);
+	nodeset_subtract (&token_memb, &instance->my_proc_set, &instance->my_failed_set);
 
-	for (i = 0; i < token_memb_entries; i++) {
-		if (memb_consensus_isset (instance, &token_memb[i]) == 0) {
-			agreed = 0;
-			break;
-		}
-	}
+	agreed = nodeset_subset (&token_memb, &instance->consensus_set);
 
 	if (agreed && instance->failed_to_recv == 1) {
 		/*
@@ -1278,7 +1640,7 @@ static int memb_consensus_agreed (
 		 return (agreed);
 	}
 
-	assert (token_memb_entries >= 1);
+	assert (token_memb.count >= 1);
 
 	return (agreed);
 }
@@ -1359,32 +1721,6 @@ static int memb_set_subset (
 	}
 	return (1);
 }
-/*
- * merge subset into fullset taking care not to add duplicates
- */
-static void memb_set_merge (
-	const struct srp_addr *subset, int subset_entries,
-	struct srp_addr *fullset, int *fullset_entries)
-{
-	int found = 0;
-	int i;
-	int j;
-
-	for (i = 0; i < subset_entries; i++) {
-		for (j = 0; j < *fullset_entries; j++) {
-			if (srp_addr_equal (&fullset[j], &subset[i])) {
-				found = 1;
-				break;
-			}
-		}
-		if (found == 0) {
-			fullset[*fullset_entries] = subset[i];
-			*fullset_entries = *fullset_entries + 1;
-		}
-		found = 0;
-	}
-	return;
-}
 
 static void memb_set_and_with_ring_id (
 	struct srp_addr *set1,
@@ -1516,7 +1852,8 @@ static void reset_token_retransmit_timeout (struct totemsrp_instance *instance)
 		instance->timer_orf_token_retransmit_timeout);
 	res = qb_loop_timer_add (instance->totemsrp_poll_handle,
 		QB_LOOP_MED,
-		instance->totem_config->token_retransmit_timeout*QB_TIME_NS_IN_MSEC,
+		(uint64_t)(instance->totem_config->token_retransmit_timeout +
+		token_hold_idle_extra_get (instance)) * QB_TIME_NS_IN_MSEC,
 		(void *)instance,
 		timer_function_token_retransmit_timeout,
 		&instance->timer_orf_token_retransmit_timeout);
@@ -1585,6 +1922,174 @@ static void old_ring_state_reset (struct totemsrp_instance *instance)
 	instance->old_ring_state_saved = 0;
 }
 
+/*
+ * Token timeout in effect, the learned one of token_adaptive applies only to
+ * an operational ring
+ */
+static unsigned int token_timeout_get (struct totemsrp_instance *instance)
+{
+	if (instance->totem_config->token_adaptive &&
+	    instance->memb_state == MEMB_STATE_OPERATIONAL) {
+		return (instance->token_timeout_effective);
+	}
+	return (instance->totem_config->token_timeout);
+}
+
+/*
+ * Deviations from the mean after which totem_phi_get reaches phi_threshold
+ */
+static double token_phi_deviations (unsigned int phi_threshold)
+{
+	double low = 0.0;
+	double high = 64.0;
+	double mid;
+	int i;
+
+	for (i = 0; i < 40; i++) {
+		mid = (low + high) / 2;
+		if (mid * (1.5976 + 0.070566 * mid * mid) / TOTEM_PHI_LN10 < phi_threshold) {
+			low = mid;
+		} else {
+			high = mid;
+		}
+	}
+	return (high);
+}
+
+static void token_interval_reset (struct totemsrp_instance *instance)
+{
+	instance->token_interval_rx_last = 0;
+	instance->token_interval_srtt_us = 0;
+	instance->token_interval_rttvar_us = 0;
+	instance->token_interval_samples = 0;
+	instance->token_timeout_effective = instance->totem_config->token_timeout;
+	instance->stats.token_timeout_effective = instance->token_timeout_effective;
+}
+
+/*
+ * Token hold of an idle ring.  With token_hold_idle_max the ring rep holds
+ * the token twice as long on every rotation without new messages, up to
+ * token_hold_idle_max.  Every processor counts the same rotations.  The
+ * token a processor waits for next is held by the rep for the hold of the
+ * following rotation, so every processor extends its token timeouts by that
+ * hold (see token_hold_idle_extra_get) and the held token isn't taken for
+ * lost.  Only the rep forgets its count on a token hold cancel, which keeps
+ * the timeouts of the other processors at least as long as the rep's hold.
+ */
+static unsigned int token_hold_idle_rotation_get (
+	struct totemsrp_instance *instance,
+	unsigned int idle_rotations)
+{
+	struct totem_config *totem_config = instance->totem_config;
+	unsigned int shift;
+	uint64_t hold;
+
+	if (totem_config->token_hold_idle_max == 0 ||
+	    instance->memb_state != MEMB_STATE_OPERATIONAL ||
+	    idle_rotations <= totem_config->seqno_unchanged_const + 1) {
+		return (totem_config->token_hold_timeout);
+	}
+
+	shift = idle_rotations - totem_config->seqno_unchanged_const - 1;
+	if (shift > TOKEN_HOLD_IDLE_SHIFT_MAX) {
+		shift = TOKEN_HOLD_IDLE_SHIFT_MAX;
+	}
+	hold = (uint64_t)totem_config->token_hold_timeout << shift;
+	if (hold > totem_config->token_hold_idle_max) {
+		hold = totem_config->token_hold_idle_max;
+	}
+	return (hold);
+}
+
+static unsigned int token_hold_idle_get (struct totemsrp_instance *instance)
+{
+	return (token_hold_idle_rotation_get (instance, instance->token_idle_rotations));
+}
+
+static unsigned int token_hold_idle_extra_get (struct totemsrp_instance *instance)
+{
+	return (token_hold_idle_rotation_get (instance, instance->token_idle_rotations + 1) -
+		instance->totem_config->token_hold_timeout);
+}
+
+/*
+ * Count the rotations of an idle ring on every valid token
+ */
+static void token_hold_idle_update (
+	struct totemsrp_instance *instance,
+	int seq_unchanged)
+{
+	if (seq_unchanged) {
+		instance->token_idle_rotations++;
+	} else {
+		instance->token_idle_rotations = 0;
+	}
+	instance->token_hold_idle =
+		token_hold_idle_get (instance) != instance->totem_config->token_hold_timeout ?
+		token_hold_idle_get (instance) : 0;
+	instance->stats.token_hold_idle = instance->token_hold_idle;
+}
+
+/*
+ * Accrual failure detector: learn the token inter-arrival time on the current
+ * ring and pick the timeout at which phi reaches token_phi_threshold, bounded
+ * by token_coefficient (or token_retransmit) and the token timeout
+ */
+static void token_interval_sample (struct totemsrp_instance *instance)
+{
+	struct totem_config *totem_config = instance->totem_config;
+	uint64_t time_now = qb_util_nano_current_get ();
+	int64_t interval_us;
+	uint64_t stddev_us;
+	uint64_t timeout_ms;
+	unsigned int timeout_min;
+
+	if (instance->token_interval_rx_last == 0) {
+		instance->token_interval_rx_last = time_now;
+		return;
+	}
+	interval_us = (time_now - instance->token_interval_rx_last) / QB_TIME_NS_IN_USEC;
+	instance->token_interval_rx_last = time_now;
+
+	if (instance->token_interval_samples == 0) {
+		instance->token_interval_srtt_us = interval_us;
+		instance->token_interval_rttvar_us = interval_us / 2;
+	} else {
+		instance->token_interval_rttvar_us += (llabs (interval_us -
+			instance->token_interval_srtt_us) - instance->token_interval_rttvar_us) / 4;
+		instance->token_interval_srtt_us += (interval_us -
+			instance->token_interval_srtt_us) / 8;
+	}
+	instance->token_interval_samples++;
+
+	/*
+	 * The mean deviation is about 4/5 of the standard deviation, which
+	 * never goes below the network delay allowance
+	 */
+	stddev_us = instance->token_interval_rttvar_us * 5 / 4;
+	if (stddev_us < (uint64_t)totem_config->max_network_delay * 1000) {
+		stddev_us = (uint64_t)totem_config->max_network_delay * 1000;
+	}
+	instance->stats.token_interval_mean_us = instance->token_interval_srtt_us;
+	instance->stats.token_interval_stddev_us = stddev_us;
+
+	if (instance->token_interval_samples < TOKEN_INTERVAL_SAMPLES_MIN) {
+		return;
+	}
+
+	timeout_ms = (instance->token_interval_srtt_us +
+		token_phi_deviations (totem_config->token_phi_threshold) * stddev_us) / 1000 + 1;
+	timeout_min = MAX (totem_config->token_coefficient, totem_config->token_retransmit_timeout);
+	if (timeout_ms < timeout_min) {
+		timeout_ms = timeout_min;
+	}
+	if (timeout_ms > totem_config->token_timeout) {
+		timeout_ms = totem_config->token_timeout;
+	}
+	instance->token_timeout_effective = timeout_ms;
+	instance->stats.token_timeout_effective = timeout_ms;
+}
+
 static void reset_pause_timeout (struct totemsrp_instance *instance)
 {
 	int32_t res;
@@ -1607,7 +2112,8 @@ static void reset_token_warning (struct totemsrp_instance *instance) {
 	qb_loop_timer_del (instance->totemsrp_poll_handle, instance->timer_orf_token_warning);
 	res = qb_loop_timer_add (instance->totemsrp_poll_handle,
 		QB_LOOP_MED,
-		instance->totem_config->token_warning * instance->totem_config->token_timeout / 100 * QB_TIME_NS_IN_MSEC,
+		(uint64_t)instance->totem_config->token_warning *
+		(token_timeout_get (instance) + token_hold_idle_extra_get (instance)) / 100 * QB_TIME_NS_IN_MSEC,
 		(void *)instance,
 		timer_function_orf_token_warning,
 		&instance->timer_orf_token_warning);
@@ -1622,7 +2128,8 @@ static void reset_token_timeout (struct totemsrp_instance *instance) {
 	qb_loop_timer_del (instance->totemsrp_poll_handle, instance->timer_orf_token_timeout);
 	res = qb_loop_timer_add (instance->totemsrp_poll_handle,
 		QB_LOOP_MED,
-		instance->totem_config->token_timeout*QB_TIME_NS_IN_MSEC,
+		(uint64_t)(token_timeout_get (instance) + token_hold_idle_extra_get (instance)) *
+		QB_TIME_NS_IN_MSEC,
 		(void *)instance,
 		timer_function_orf_token_timeout,
 		&instance->timer_orf_token_timeout);
@@ -1676,7 +2183,7 @@ static void start_token_hold_retransmit_timeout (struct totemsrp_instance *insta
 
 	res = qb_loop_timer_add (instance->totemsrp_poll_handle,
 		QB_LOOP_MED,
-		instance->totem_config->token_hold_timeout*QB_TIME_NS_IN_MSEC,
+		(uint64_t)token_hold_idle_get (instance) * QB_TIME_NS_IN_MSEC,
 		(void *)instance,
 		timer_function_token_hold_retransmit_timeout,
 		&instance->timer_orf_token_hold_retransmit_timeout);
@@ -1712,8 +2219,7 @@ static void memb_state_consensus_timeout_expired (
 			instance->my_proc_list,
 			instance->my_proc_list_entries);
 
-		memb_set_merge (no_consensus_list, no_consensus_list_entries,
-			instance->my_failed_list, &instance->my_failed_list_entries);
+		memb_failed_list_merge (instance, no_consensus_list, no_consensus_list_entries);
 		memb_state_gather_enter (instance, TOTEMSRP_GSFROM_CONSENSUS_TIMEOUT);
 	}
 }
@@ -1768,9 +2274,13 @@ static void timer_function_orf_token_timeout (void *data)
 			log_printf (instance->totemsrp_log_level_notice,
 				"A processor failed, forming new configuration:"
 				" token timed out (%ums), waiting %ums for consensus.",
-				instance->totem_config->token_timeout,
+				token_timeout_get (instance),
 				instance->totem_config->consensus_timeout);
+			if (token_timeout_get (instance) < instance->totem_config->token_timeout) {
+				instance->stats.token_adaptive_lost++;
+			}
 			totemnet_iface_check (instance->totemnet_context);
+			reconf_event_record (instance, TOTEM_RECONF_TOKEN_LOST);
 			memb_state_gather_enter (instance, TOTEMSRP_GSFROM_THE_TOKEN_WAS_LOST_IN_THE_OPERATIONAL_STATE);
 			instance->stats.operational_token_lost++;
 			break;
@@ -1860,13 +2370,15 @@ static void deliver_messages_from_recovery_to_regular (struct totemsrp_instance
 	log_printf (instance->totemsrp_log_level_debug,
 		"recovery to regular %x-%x", SEQNO_START_MSG + 1, instance->my_aru);
 
+	memset (&regular_message_item, 0, sizeof (struct sort_queue_item));
+
 	range = instance->my_aru - SEQNO_START_MSG;
 	/*
 	 * Move messages from recovery to regular sort queue
 	 */
 // todo should i be initialized to 0 or 1 ?
 	for (i = 1; i <= range; i++) {
-		res = sq_item_get (&instance->recovery_sort_queue,
+		res = sqb_item_get (&instance->recovery_sort_queue,
 			i + SEQNO_START_MSG, &ptr);
 		if (res != 0) {
 			continue;
@@ -1906,9 +2418,15 @@ static void deliver_messages_from_recovery_to_regular (struct totemsrp_instance
 		if (memcmp (&instance->my_old_ring_id, &mcast->ring_id,
 			sizeof (struct memb_ring_id)) == 0) {
 
-			res = sq_item_inuse (&instance->regular_sort_queue, mcast->seq);
-			if (res == 0) {
-				sq_item_add (&instance->regular_sort_queue,
+			/*
+			 * The regular sort queue may have shrunk since the
+			 * message was sent, grow it first so seq doesn't alias
+			 * a slot of another message
+			 */
+			if (sort_queue_reserve (instance,
+			    &instance->regular_sort_queue, mcast->seq) == 0 &&
+			    sqb_item_inuse (&instance->regular_sort_queue, mcast->seq) == 0) {
+				sqb_item_add (&instance->regular_sort_queue,
 					&regular_message_item, mcast->seq);
 				if (sq_lt_compare (instance->old_ring_state_high_seq_received, mcast->seq)) {
 					instance->old_ring_state_high_seq_received = mcast->seq;
@@ -2028,7 +2546,8 @@ static void memb_state_operational_enter (struct totemsrp_instance *instance)
 	 * sort queue.  It is necessary to copy the state
 	 * into the regular sort queue.
 	 */
-	sq_copy (&instance->regular_sort_queue, &instance->recovery_sort_queue);
+	res = sqb_copy (&instance->regular_sort_queue, &instance->recovery_sort_queue);
+	assert (res == 0);
 	instance->my_last_aru = SEQNO_START_MSG;
 
 	/* When making my_proc_list smaller, ensure that the
@@ -2045,6 +2564,11 @@ static void memb_state_operational_enter (struct totemsrp_instance *instance)
 		sizeof (struct srp_addr) * instance->my_memb_entries);
 
 	instance->my_failed_list_entries = 0;
+
+	/*
+	 * New ring, start with a fresh node index
+	 */
+	memb_index_rebuild (instance);
 	/*
 	 * TODO Not exactly to spec
 	 *
@@ -2068,7 +2592,7 @@ static void memb_state_operational_enter (struct totemsrp_instance *instance)
 		void *ptr;
 
 		i -= 1;
-		res = sq_item_get (&instance->regular_sort_queue, i, &ptr);
+		res = sqb_item_get (&instance->regular_sort_queue, i, &ptr);
 		if (i == 0) {
 			break;
 		}
@@ -2079,7 +2603,7 @@ static void memb_state_operational_enter (struct totemsrp_instance *instance)
 	for (i = 0; i <= instance->my_high_delivered; i++) {
 		void *ptr;
 
-		res = sq_item_get (&instance->regular_sort_queue, i, &ptr);
+		res = sqb_item_get (&instance->regular_sort_queue, i, &ptr);
 		if (res == 0) {
 			struct sort_queue_item *regular_message;
 
@@ -2087,9 +2611,28 @@ static void memb_state_operational_enter (struct totemsrp_instance *instance)
 			free (regular_message->mcast);
 		}
 	}
-	sq_items_release (&instance->regular_sort_queue, instance->my_high_delivered);
+	sqb_items_release (&instance->regular_sort_queue, instance->my_high_delivered);
 	instance->last_released = instance->my_high_delivered;
 
+	/*
+	 * Account for what the recovery sort queue handed over
+	 */
+	instance->regular_sort_queue_bytes = 0;
+	for (i = instance->my_high_delivered + 1;
+	    sq_lte_compare (i, instance->my_high_seq_received); i++) {
+		void *ptr;
+
+		res = sqb_item_get (&instance->regular_sort_queue, i, &ptr);
+		if (res == 0) {
+			struct sort_queue_item *regular_message;
+
+			regular_message = ptr;
+			instance->regular_sort_queue_bytes += regular_message->msg_len;
+		}
+	}
+	instance->stats.sort_queue_size = sqb_size_get (&instance->regular_sort_queue);
+	instance->stats.sort_queue_bytes = instance->regular_sort_queue_bytes;
+
 	if (joined_list_entries) {
 		int sptr = 0;
 		sptr += snprintf(joined_node_msg, sizeof(joined_node_msg)-sptr, " joined:");
@@ -2146,6 +2689,11 @@ static void memb_state_operational_enter (struct totemsrp_instance *instance)
 
 	instance->stats.operational_entered++;
 	instance->stats.continuous_gather = 0;
+	reconf_event_record (instance, TOTEM_RECONF_OPERATIONAL);
+	token_interval_reset (instance);
+	instance->token_idle_rotations = 0;
+	instance->token_hold_idle = 0;
+	instance->stats.token_hold_idle = 0;
 
 	instance->my_received_flg = 1;
 
@@ -2172,9 +2720,7 @@ static void memb_state_gather_enter (
 
 	instance->originated_orf_token = 0;
 
-	memb_set_merge (
-		&instance->my_id, 1,
-		instance->my_proc_list, &instance->my_proc_list_entries);
+	memb_proc_list_add (instance, &instance->my_id);
 
 	memb_join_message_send (instance);
 
@@ -2226,6 +2772,7 @@ static void memb_state_gather_enter (
 
 	instance->memb_state = MEMB_STATE_GATHER;
 	instance->stats.gather_entered++;
+	reconf_event_record (instance, TOTEM_RECONF_GATHER);
 
 	if (gather_from == TOTEMSRP_GSFROM_THE_CONSENSUS_TIMEOUT_EXPIRED) {
 		/*
@@ -2280,6 +2827,7 @@ static void memb_state_commit_enter (
 
 	instance->stats.commit_entered++;
 	instance->stats.continuous_gather = 0;
+	reconf_event_record (instance, TOTEM_RECONF_COMMIT);
 
 	/*
 	 * reset all flow control variables since we are starting a new ring
@@ -2287,6 +2835,7 @@ static void memb_state_commit_enter (
 	instance->my_trc = 0;
 	instance->my_pbl = 0;
 	instance->my_cbl = 0;
+	instance->fcc_token_rx_last = 0;
 	/*
 	 * commit token sent after callback that token target has been set
 	 */
@@ -2315,7 +2864,9 @@ static void memb_state_recovery_enter (
 
 	instance->my_high_ring_delivered = 0;
 
-	sq_reinit (&instance->recovery_sort_queue, SEQNO_START_MSG);
+	sqb_reinit (&instance->recovery_sort_queue, SEQNO_START_MSG);
+	sqb_shrink (&instance->recovery_sort_queue, SEQNO_START_MSG,
+		QUEUE_RTR_ITEMS_SIZE_MIN);
 	cs_queue_reinit (&instance->retrans_message_queue);
 
 	low_ring_aru = instance->old_ring_state_high_seq_received;
@@ -2410,7 +2961,10 @@ static void memb_state_recovery_enter (
 	}
 
 	/*
-	 * Copy all old ring messages to instance->retrans_message_queue
+	 * Queue all old ring messages for origination in the new ring.  Only
+	 * references are queued, the messages are encapsulated as the token
+	 * allows them to be sent so entering recovery doesn't copy the whole
+	 * backlog at once.
 	 */
 	range = instance->old_ring_state_high_seq_received - low_ring_aru;
 	if (range == 0) {
@@ -2422,7 +2976,7 @@ static void memb_state_recovery_enter (
 	assert (range < QUEUE_RTR_ITEMS_SIZE_MAX);
 
 	log_printf (instance->totemsrp_log_level_debug,
-		"copying all old ring messages from %x-%x.",
+		"queueing all old ring messages from %x-%x.",
 		low_ring_aru + 1, instance->old_ring_state_high_seq_received);
 
 	for (i = 1; i <= range; i++) {
@@ -2431,7 +2985,7 @@ static void memb_state_recovery_enter (
 		void *ptr;
 		int res;
 
-		res = sq_item_get (&instance->regular_sort_queue,
+		res = sqb_item_get (&instance->regular_sort_queue,
 			low_ring_aru + i, &ptr);
 		if (res != 0) {
 			continue;
@@ -2439,24 +2993,9 @@ static void memb_state_recovery_enter (
 		sort_queue_item = ptr;
 		messages_originated++;
 		memset (&message_item, 0, sizeof (struct message_item));
-	// TODO	 LEAK
-		message_item.mcast = totemsrp_buffer_alloc (instance);
-		assert (message_item.mcast);
-		memset(message_item.mcast, 0, sizeof (struct mcast));
-		message_item.mcast->header.magic = TOTEM_MH_MAGIC;
-		message_item.mcast->header.version = TOTEM_MH_VERSION;
-		message_item.mcast->header.type = MESSAGE_TYPE_MCAST;
-		message_item.mcast->system_from = instance->my_id;
-		message_item.mcast->header.encapsulated = MESSAGE_ENCAPSULATED;
-
-		message_item.mcast->header.nodeid = instance->my_id.nodeid;
-		assert (message_item.mcast->header.nodeid);
-		memcpy (&message_item.mcast->ring_id, &instance->my_ring_id,
-			sizeof (struct memb_ring_id));
-		message_item.msg_len = sort_queue_item->msg_len + sizeof (struct mcast);
-		memcpy (((char *)message_item.mcast) + sizeof (struct mcast),
-			sort_queue_item->mcast,
-			sort_queue_item->msg_len);
+		message_item.mcast = sort_queue_item->mcast;
+		message_item.msg_len = sort_queue_item->msg_len;
+		message_item.recovery_reference = 1;
 		cs_queue_item_add (&instance->retrans_message_queue, &message_item);
 	}
 	log_printf (instance->totemsrp_log_level_debug,
@@ -2481,6 +3020,7 @@ originated:
 	instance->memb_state = MEMB_STATE_RECOVERY;
 	instance->stats.recovery_entered++;
 	instance->stats.continuous_gather = 0;
+	reconf_event_record (instance, TOTEM_RECONF_RECOVERY);
 
 	return;
 }
@@ -2494,6 +3034,56 @@ void totemsrp_event_signal (void *srp_context, enum totem_event_type type, int v
 	return;
 }
 
+/*
+ * Queues of all lanes in use for new messages, indexed by enum totem_lane
+ */
+static struct cs_queue *mcast_queues_get (
+	struct totemsrp_instance *instance)
+{
+	if (instance->waiting_trans_ack) {
+		return (instance->new_message_queue_trans);
+	}
+	return (instance->new_message_queue);
+}
+
+static enum totem_lane mcast_lane_get (int guarantee)
+{
+	if (guarantee & TOTEM_MCAST_PRIORITY_HIGH) {
+		return (TOTEM_LANE_HIGH);
+	}
+	return (TOTEM_LANE_NORMAL);
+}
+
+static void lane_queue_depth_update (
+	struct totemsrp_instance *instance,
+	enum totem_lane lane)
+{
+	totemsrp_lane_stats_t *lane_stats = &instance->stats.lane[lane];
+
+	lane_stats->queue_depth = cs_queue_used (&mcast_queues_get (instance)[lane]);
+	if (lane_stats->queue_depth > lane_stats->queue_depth_max) {
+		lane_stats->queue_depth_max = lane_stats->queue_depth;
+	}
+}
+
+static void mcast_header_init (
+	struct totemsrp_instance *instance,
+	struct mcast *mcast,
+	int guarantee)
+{
+	memset(mcast, 0, sizeof (struct mcast));
+	mcast->header.magic = TOTEM_MH_MAGIC;
+	mcast->header.version = TOTEM_MH_VERSION;
+	mcast->header.type = MESSAGE_TYPE_MCAST;
+	mcast->header.encapsulated = MESSAGE_NOT_ENCAPSULATED;
+
+	mcast->header.nodeid = instance->my_id.nodeid;
+	assert (mcast->header.nodeid);
+
+	mcast->guarantee = guarantee & TOTEM_MCAST_GUARANTEE_MASK;
+	mcast->system_from = instance->my_id;
+}
+
 int totemsrp_mcast (
 	void *srp_context,
 	struct iovec *iovec,
@@ -2505,13 +3095,11 @@ int totemsrp_mcast (
 	struct message_item message_item;
 	char *addr;
 	unsigned int addr_idx;
+	enum totem_lane lane;
 	struct cs_queue *queue_use;
 
-	if (instance->waiting_trans_ack) {
-		queue_use = &instance->new_message_queue_trans;
-	} else {
-		queue_use = &instance->new_message_queue;
-	}
+	lane = mcast_lane_get (guarantee);
+	queue_use = &mcast_queues_get (instance)[lane];
 
 	if (cs_queue_is_full (queue_use)) {
 		log_printf (instance->totemsrp_log_level_debug, "queue full");
@@ -2531,17 +3119,7 @@ int totemsrp_mcast (
 	/*
 	 * Set mcast header
 	 */
-	memset(message_item.mcast, 0, sizeof (struct mcast));
-	message_item.mcast->header.magic = TOTEM_MH_MAGIC;
-	message_item.mcast->header.version = TOTEM_MH_VERSION;
-	message_item.mcast->header.type = MESSAGE_TYPE_MCAST;
-	message_item.mcast->header.encapsulated = MESSAGE_NOT_ENCAPSULATED;
-
-	message_item.mcast->header.nodeid = instance->my_id.nodeid;
-	assert (message_item.mcast->header.nodeid);
-
-	message_item.mcast->guarantee = guarantee;
-	message_item.mcast->system_from = instance->my_id;
+	mcast_header_init (instance, message_item.mcast, guarantee);
 
 	addr = (char *)message_item.mcast;
 	addr_idx = sizeof (struct mcast);
@@ -2551,10 +3129,13 @@ int totemsrp_mcast (
 	}
 
 	message_item.msg_len = addr_idx;
+	message_item.submit_time = qb_util_nano_current_get ();
 
 	log_printf (instance->totemsrp_log_level_trace, "mcasted message added to pending queue");
 	instance->stats.mcast_tx++;
+	instance->stats.mcast_tx_copy_bytes += addr_idx - sizeof (struct mcast);
 	cs_queue_item_add (queue_use, &message_item);
+	lane_queue_depth_update (instance, lane);
 
 	return (0);
 
@@ -2562,21 +3143,89 @@ error_mcast:
 	return (-1);
 }
 
+void *totemsrp_mcast_buffer_alloc (
+	void *srp_context,
+	size_t *payload_len_max)
+{
+	struct totemsrp_instance *instance = (struct totemsrp_instance *)srp_context;
+	char *buffer;
+
+	buffer = totemsrp_buffer_alloc (instance);
+	if (buffer == NULL) {
+		return (NULL);
+	}
+
+	*payload_len_max = FRAME_SIZE_MAX - sizeof (struct mcast);
+	return (buffer + sizeof (struct mcast));
+}
+
+int totemsrp_mcast_buffer_submit (
+	void *srp_context,
+	void *payload,
+	size_t payload_len,
+	int guarantee)
+{
+	struct totemsrp_instance *instance = (struct totemsrp_instance *)srp_context;
+	struct message_item message_item;
+	enum totem_lane lane;
+	struct cs_queue *queue_use;
+
+	assert (payload_len <= FRAME_SIZE_MAX - sizeof (struct mcast));
+
+	lane = mcast_lane_get (guarantee);
+	queue_use = &mcast_queues_get (instance)[lane];
+
+	if (cs_queue_is_full (queue_use)) {
+		log_printf (instance->totemsrp_log_level_debug, "queue full");
+		return (-1);
+	}
+
+	/*
+	 * The payload was built in place, only the header is left to fill in
+	 */
+	memset (&message_item, 0, sizeof (struct message_item));
+	message_item.mcast = (struct mcast *)((char *)payload - sizeof (struct mcast));
+	mcast_header_init (instance, message_item.mcast, guarantee);
+	message_item.msg_len = sizeof (struct mcast) + payload_len;
+	message_item.submit_time = qb_util_nano_current_get ();
+
+	log_printf (instance->totemsrp_log_level_trace, "mcasted message added to pending queue");
+	instance->stats.mcast_tx++;
+	instance->stats.mcast_tx_zerocopy++;
+	cs_queue_item_add (queue_use, &message_item);
+	lane_queue_depth_update (instance, lane);
+
+	return (0);
+}
+
+void totemsrp_mcast_buffer_release (
+	void *srp_context,
+	void *payload)
+{
+	struct totemsrp_instance *instance = (struct totemsrp_instance *)srp_context;
+
+	totemsrp_buffer_release (instance, (char *)payload - sizeof (struct mcast));
+}
+
 /*
- * Determine if there is room to queue a new message
+ * Determine if there is room to queue a new message, whatever its lane
  */
 int totemsrp_avail (void *srp_context)
 {
 	struct totemsrp_instance *instance = (struct totemsrp_instance *)srp_context;
+	struct cs_queue *queues;
 	int avail;
-	struct cs_queue *queue_use;
+	int lane_avail;
+	int i;
 
-	if (instance->waiting_trans_ack) {
-		queue_use = &instance->new_message_queue_trans;
-	} else {
-		queue_use = &instance->new_message_queue;
+	queues = mcast_queues_get (instance);
+	cs_queue_avail (&queues[0], &avail);
+	for (i = 1; i < TOTEM_LANE_MAX; i++) {
+		cs_queue_avail (&queues[i], &lane_avail);
+		if (lane_avail < avail) {
+			avail = lane_avail;
+		}
 	}
-	cs_queue_avail (queue_use, &avail);
 
 	return (avail);
 }
@@ -2595,7 +3244,7 @@ static int orf_token_remcast (
 	int res;
 	void *ptr;
 
-	struct sq *sort_queue;
+	struct sqb *sort_queue;
 
 	if (instance->memb_state == MEMB_STATE_RECOVERY) {
 		sort_queue = &instance->recovery_sort_queue;
@@ -2603,7 +3252,7 @@ static int orf_token_remcast (
 		sort_queue = &instance->regular_sort_queue;
 	}
 
-	res = sq_in_range (sort_queue, seq);
+	res = sqb_in_range (sort_queue, seq);
 	if (res == 0) {
 		log_printf (instance->totemsrp_log_level_debug, "sq not in range");
 		return (-1);
@@ -2612,7 +3261,7 @@ static int orf_token_remcast (
 	/*
 	 * Get RTR item at seq, if not available, return
 	 */
-	res = sq_item_get (sort_queue, seq, &ptr);
+	res = sqb_item_get (sort_queue, seq, &ptr);
 	if (res != 0) {
 		return -1;
 	}
@@ -2666,18 +3315,25 @@ static void messages_free (
 	for (i = 1; i <= range; i++) {
 		void *ptr;
 
-		res = sq_item_get (&instance->regular_sort_queue,
+		res = sqb_item_get (&instance->regular_sort_queue,
 			instance->last_released + i, &ptr);
 		if (res == 0) {
 			regular_message = ptr;
+			if (instance->regular_sort_queue_bytes >= regular_message->msg_len) {
+				instance->regular_sort_queue_bytes -= regular_message->msg_len;
+			} else {
+				instance->regular_sort_queue_bytes = 0;
+			}
 			totemsrp_buffer_release (instance, regular_message->mcast);
 		}
-		sq_items_release (&instance->regular_sort_queue,
-			instance->last_released + i);
 
 		log_release = 1;
 	}
+	if (range) {
+		sqb_items_release (&instance->regular_sort_queue, release_to);
+	}
 	instance->last_released += range;
+	instance->stats.sort_queue_bytes = instance->regular_sort_queue_bytes;
 
  	if (log_release) {
 		log_printf (instance->totemsrp_log_level_trace,
@@ -2685,14 +3341,69 @@ static void messages_free (
 	}
 }
 
+/*
+ * Give memory back once the backlog is gone, the ring still has to cover
+ * everything up to token_seq
+ */
+static void regular_sort_queue_shrink (
+	struct totemsrp_instance *instance,
+	unsigned int token_seq)
+{
+	unsigned int size;
+
+	size = sqb_size_get (&instance->regular_sort_queue);
+	if (size == QUEUE_RTR_ITEMS_SIZE_MIN) {
+		return;
+	}
+	if (sq_lt_compare (token_seq, instance->my_high_seq_received)) {
+		token_seq = instance->my_high_seq_received;
+	}
+	sqb_shrink (&instance->regular_sort_queue, token_seq, QUEUE_RTR_ITEMS_SIZE_MIN);
+	if (sqb_size_get (&instance->regular_sort_queue) != size) {
+		log_printf (instance->totemsrp_log_level_trace,
+			"regular sort queue shrunk to %u items",
+			sqb_size_get (&instance->regular_sort_queue));
+		instance->stats.sort_queue_size = sqb_size_get (&instance->regular_sort_queue);
+	}
+}
+
+/*
+ * Grow sort_queue so seq fits in it.  The ring follows the backlog in
+ * flight instead of being allocated for the worst case up front.
+ */
+static int sort_queue_reserve (
+	struct totemsrp_instance *instance,
+	struct sqb *sort_queue,
+	unsigned int seq)
+{
+	unsigned int size;
+	int res;
+
+	size = sqb_size_get (sort_queue);
+	res = sqb_grow (sort_queue, seq, QUEUE_RTR_ITEMS_SIZE_MAX);
+	if (res == -ENOMEM) {
+		log_printf (instance->totemsrp_log_level_warning,
+			"unable to grow sort queue past %u items", size);
+	}
+	if (res != 0 || sqb_size_get (sort_queue) == size) {
+		return (res);
+	}
+
+	log_printf (instance->totemsrp_log_level_trace,
+		"%s sort queue grown to %u items",
+		sort_queue == &instance->regular_sort_queue ? "regular" : "recovery",
+		sqb_size_get (sort_queue));
+	if (sort_queue == &instance->regular_sort_queue) {
+		instance->stats.sort_queue_size = sqb_size_get (sort_queue);
+	}
+	return (0);
+}
+
 static void update_aru (
 	struct totemsrp_instance *instance)
 {
-	unsigned int i;
-	int res;
-	struct sq *sort_queue;
+	struct sqb *sort_queue;
 	unsigned int range;
-	unsigned int my_aru_saved = 0;
 
 	if (instance->memb_state == MEMB_STATE_RECOVERY) {
 		sort_queue = &instance->recovery_sort_queue;
@@ -2702,56 +3413,139 @@ static void update_aru (
 
 	range = instance->my_high_seq_received - instance->my_aru;
 
-	my_aru_saved = instance->my_aru;
-	for (i = 1; i <= range; i++) {
+	/*
+	 * Advance aru up to the first hole
+	 */
+	instance->my_aru += sqb_items_contiguous (sort_queue,
+		instance->my_aru + 1, range);
+}
+
+/*
+ * Encapsulate an old ring message referenced by a recovery item in a new
+ * ring message, the item then owns the new message
+ */
+static void recovery_message_encapsulate (
+	struct totemsrp_instance *instance,
+	struct message_item *message_item)
+{
+	struct mcast *mcast;
+
+	mcast = totemsrp_buffer_alloc (instance);
+	assert (mcast);
+	memset (mcast, 0, sizeof (struct mcast));
+	mcast->header.magic = TOTEM_MH_MAGIC;
+	mcast->header.version = TOTEM_MH_VERSION;
+	mcast->header.type = MESSAGE_TYPE_MCAST;
+	mcast->system_from = instance->my_id;
+	mcast->header.encapsulated = MESSAGE_ENCAPSULATED;
+
+	mcast->header.nodeid = instance->my_id.nodeid;
+	assert (mcast->header.nodeid);
+	memcpy (((char *)mcast) + sizeof (struct mcast),
+		message_item->mcast,
+		message_item->msg_len);
+
+	message_item->mcast = mcast;
+	message_item->msg_len += sizeof (struct mcast);
+	message_item->recovery_reference = 0;
+}
+
+static void fec_xor (
+	char *dst,
+	const void *src,
+	unsigned int len)
+{
+	const char *src_char = src;
+	unsigned int i;
+
+	for (i = 0; i < len; i++) {
+		dst[i] ^= src_char[i];
+	}
+}
+
+/*
+ * Sends the parity of the messages added to the group since the last parity
+ */
+static void fec_parity_send (struct totemsrp_instance *instance)
+{
+	struct mcast_parity *parity = instance->fec_parity;
+
+	if (parity->count == 0) {
+		return;
+	}
+
+	parity->header.magic = TOTEM_MH_MAGIC;
+	parity->header.version = TOTEM_MH_VERSION;
+	parity->header.type = MESSAGE_TYPE_MCAST_PARITY;
+	parity->header.encapsulated = 0;
+	parity->header.nodeid = instance->my_id.nodeid;
+	memcpy (&parity->ring_id, &instance->my_ring_id, sizeof (struct memb_ring_id));
+
+	/*
+	 * Parity of messages close to the frame size doesn't fit in a frame
+	 */
+	if (sizeof (struct mcast_parity) + parity->parity_len <= FRAME_SIZE_MAX) {
+		totemnet_mcast_noflush_send (instance->totemnet_context,
+			parity, sizeof (struct mcast_parity) + parity->parity_len);
+		instance->stats.mcast_fec_tx++;
+	}
+	parity->count = 0;
+}
+
+static void fec_parity_add (
+	struct totemsrp_instance *instance,
+	const struct mcast *mcast,
+	unsigned int msg_len)
+{
+	struct mcast_parity *parity = instance->fec_parity;
+	char *parity_data = (char *)instance->fec_parity + sizeof (struct mcast_parity);
 
-		void *ptr;
+	if (parity->count == 0) {
+		parity->seq = mcast->seq;
+		parity->msg_len_xor = 0;
+		parity->parity_len = 0;
+	}
+	if (msg_len > parity->parity_len) {
+		memset (parity_data + parity->parity_len, 0, msg_len - parity->parity_len);
+		parity->parity_len = msg_len;
+	}
+	fec_xor (parity_data, mcast, msg_len);
+	parity->msg_len_xor ^= msg_len;
+	parity->count++;
 
-		res = sq_item_get (sort_queue, my_aru_saved + i, &ptr);
-		/*
-		 * If hole, stop updating aru
-		 */
-		if (res != 0) {
-			break;
-		}
+	if (parity->count >= instance->totem_config->fec_group_size) {
+		fec_parity_send (instance);
 	}
-	instance->my_aru += i - 1;
 }
 
 /*
- * Multicasts pending messages onto the ring (requires orf_token possession)
+ * Multicasts up to mcasts_allowed messages of mcast_queue onto the ring
  */
-static int orf_token_mcast (
+static int orf_token_mcast_queue (
 	struct totemsrp_instance *instance,
 	struct orf_token *token,
-	int fcc_mcasts_allowed)
+	struct cs_queue *mcast_queue,
+	struct sqb *sort_queue,
+	totemsrp_lane_stats_t *lane_stats,
+	int mcasts_allowed)
 {
 	struct message_item *message_item = 0;
-	struct cs_queue *mcast_queue;
-	struct sq *sort_queue;
 	struct sort_queue_item sort_queue_item;
 	struct mcast *mcast;
-	unsigned int fcc_mcast_current;
-
-	if (instance->memb_state == MEMB_STATE_RECOVERY) {
-		mcast_queue = &instance->retrans_message_queue;
-		sort_queue = &instance->recovery_sort_queue;
-		reset_token_retransmit_timeout (instance); // REVIEWED
-	} else {
-		if (instance->waiting_trans_ack) {
-			mcast_queue = &instance->new_message_queue_trans;
-		} else {
-			mcast_queue = &instance->new_message_queue;
-		}
+	uint64_t wait_us;
+	int mcast_current;
 
-		sort_queue = &instance->regular_sort_queue;
-	}
-
-	for (fcc_mcast_current = 0; fcc_mcast_current < fcc_mcasts_allowed; fcc_mcast_current++) {
+	for (mcast_current = 0; mcast_current < mcasts_allowed; mcast_current++) {
 		if (cs_queue_is_empty (mcast_queue)) {
 			break;
 		}
+		if (sort_queue_reserve (instance, sort_queue, token->seq + 1) != 0) {
+			break;
+		}
 		message_item = (struct message_item *)cs_queue_item_get (mcast_queue);
+		if (message_item->recovery_reference) {
+			recovery_message_encapsulate (instance, message_item);
+		}
 
 		message_item->mcast->seq = ++token->seq;
 		message_item->mcast->this_seqno = instance->global_seqno++;
@@ -2762,6 +3556,23 @@ static int orf_token_mcast (
 		memset (&sort_queue_item, 0, sizeof (struct sort_queue_item));
 		sort_queue_item.mcast = message_item->mcast;
 		sort_queue_item.msg_len = message_item->msg_len;
+		if (message_item->submit_time != 0) {
+			sort_queue_item.submit_time = message_item->submit_time;
+			sort_queue_item.send_time = qb_util_nano_current_get ();
+			latency_record (instance, TOTEM_LATENCY_QUEUE,
+				sort_queue_item.send_time - sort_queue_item.submit_time);
+			if (lane_stats != NULL) {
+				wait_us = (sort_queue_item.send_time -
+					sort_queue_item.submit_time) / QB_TIME_NS_IN_USEC;
+				lane_stats->wait_sum_us += wait_us;
+				if (wait_us > lane_stats->wait_max_us) {
+					lane_stats->wait_max_us = wait_us;
+				}
+			}
+		}
+		if (lane_stats != NULL) {
+			lane_stats->mcast_tx++;
+		}
 
 		mcast = sort_queue_item.mcast;
 
@@ -2770,13 +3581,22 @@ static int orf_token_mcast (
 		/*
 		 * Add message to retransmit queue
 		 */
-		sq_item_add (sort_queue, &sort_queue_item, message_item->mcast->seq);
+		sqb_item_add (sort_queue, &sort_queue_item, message_item->mcast->seq);
+		if (sort_queue == &instance->regular_sort_queue) {
+			instance->regular_sort_queue_bytes += message_item->msg_len;
+		}
 
 		totemnet_mcast_noflush_send (
 			instance->totemnet_context,
 			message_item->mcast,
 			message_item->msg_len);
 
+		if (instance->totem_config->fec_group_size > 0 &&
+		    instance->memb_state == MEMB_STATE_OPERATIONAL) {
+			fec_parity_add (instance, message_item->mcast,
+				message_item->msg_len);
+		}
+
 		/*
 		 * Delete item from pending queue
 		 */
@@ -2788,6 +3608,79 @@ static int orf_token_mcast (
 		instance->my_high_seq_received = token->seq;
 	}
 
+	return (mcast_current);
+}
+
+/*
+ * Multicasts pending messages onto the ring (requires orf_token possession)
+ */
+static int orf_token_mcast (
+	struct totemsrp_instance *instance,
+	struct orf_token *token,
+	int fcc_mcasts_allowed)
+{
+	struct cs_queue *mcast_queues;
+	int high_allowed;
+	int normal_reserve;
+	int fcc_mcast_current;
+	int normal_mcast_current;
+
+	if (instance->memb_state == MEMB_STATE_RECOVERY) {
+		reset_token_retransmit_timeout (instance); // REVIEWED
+
+		fcc_mcast_current = orf_token_mcast_queue (instance, token,
+			&instance->retrans_message_queue,
+			&instance->recovery_sort_queue,
+			NULL, fcc_mcasts_allowed);
+	} else {
+		mcast_queues = mcast_queues_get (instance);
+
+		/*
+		 * The high priority lane is served first.  While bulk messages
+		 * are waiting a share of the window is kept for them so they
+		 * are not starved, when the window is too small to be shared
+		 * bulk gets all of it on every other token.
+		 */
+		high_allowed = fcc_mcasts_allowed;
+		if (!cs_queue_is_empty (&mcast_queues[TOTEM_LANE_NORMAL])) {
+			normal_reserve = fcc_mcasts_allowed / LANE_NORMAL_RESERVE_SHARE;
+			if (normal_reserve == 0 && instance->lane_normal_skipped) {
+				normal_reserve = fcc_mcasts_allowed;
+			}
+			high_allowed -= normal_reserve;
+		}
+
+		fcc_mcast_current = orf_token_mcast_queue (instance, token,
+			&mcast_queues[TOTEM_LANE_HIGH],
+			&instance->regular_sort_queue,
+			&instance->stats.lane[TOTEM_LANE_HIGH],
+			high_allowed);
+
+		normal_mcast_current = orf_token_mcast_queue (instance, token,
+			&mcast_queues[TOTEM_LANE_NORMAL],
+			&instance->regular_sort_queue,
+			&instance->stats.lane[TOTEM_LANE_NORMAL],
+			fcc_mcasts_allowed - fcc_mcast_current);
+
+		if (!cs_queue_is_empty (&mcast_queues[TOTEM_LANE_NORMAL])) {
+			instance->lane_normal_skipped = (normal_mcast_current == 0);
+			if (fcc_mcast_current > 0) {
+				instance->stats.lane_normal_deferred++;
+			}
+		} else {
+			instance->lane_normal_skipped = 0;
+		}
+		fcc_mcast_current += normal_mcast_current;
+
+		lane_queue_depth_update (instance, TOTEM_LANE_HIGH);
+		lane_queue_depth_update (instance, TOTEM_LANE_NORMAL);
+	}
+
+	/*
+	 * Groups never span tokens, the next holder continues the sequence
+	 */
+	fec_parity_send (instance);
+
 	update_aru (instance);
 
 	/*
@@ -2800,6 +3693,125 @@ static int orf_token_mcast (
  * Remulticasts messages in orf_token's retransmit list (requires orf_token)
  * Modify's orf_token's rtr to include retransmits required by this process
  */
+static int rtr_ranges_contain (
+	const struct totemsrp_instance *instance,
+	unsigned int seq)
+{
+	int i;
+
+	for (i = 0; i < instance->rtr_range_entries; i++) {
+		if (seq - instance->rtr_ranges[i].seq < instance->rtr_ranges[i].count) {
+			return (1);
+		}
+	}
+	return (0);
+}
+
+/*
+ * Add count messages starting at seq to a retransmit range list, extending
+ * an adjacent range when possible
+ */
+static int rtr_ranges_add (
+	struct rtr_range *rtr_ranges,
+	int *rtr_range_entries,
+	unsigned int seq,
+	unsigned int count)
+{
+	int i;
+
+	for (i = 0; i < *rtr_range_entries; i++) {
+		if (rtr_ranges[i].seq + rtr_ranges[i].count == seq) {
+			rtr_ranges[i].count += count;
+			return (0);
+		}
+		if (seq + count == rtr_ranges[i].seq) {
+			rtr_ranges[i].seq = seq;
+			rtr_ranges[i].count += count;
+			return (0);
+		}
+	}
+
+	if (*rtr_range_entries == RETRANSMIT_RANGES_MAX) {
+		return (-1);
+	}
+	rtr_ranges[*rtr_range_entries].seq = seq;
+	rtr_ranges[*rtr_range_entries].count = count;
+	*rtr_range_entries += 1;
+
+	return (0);
+}
+
+/*
+ * Retransmit messages requested by the token's retransmit ranges and
+ * remove the ones sent from the ranges
+ */
+static void orf_token_rtr_ranges_remcast (
+	struct totemsrp_instance *instance,
+	struct sqb *sort_queue,
+	unsigned int fcc_allowed)
+{
+	struct rtr_range rtr_ranges[RETRANSMIT_RANGES_MAX];
+	int rtr_range_entries = 0;
+	unsigned int run_start;
+	unsigned int missing;
+	unsigned int seq;
+	unsigned int end;
+	int i;
+
+	for (i = 0; i < instance->rtr_range_entries; i++) {
+		run_start = instance->rtr_ranges[i].seq;
+		end = run_start + instance->rtr_ranges[i].count;
+
+		seq = run_start;
+		while (seq != end && instance->fcc_remcast_current < fcc_allowed) {
+			if (sqb_in_range (sort_queue, seq) == 0) {
+				/*
+				 * Skip the part of the range outside the sort
+				 * queue in one step
+				 */
+				if (sort_queue->head_seqid - seq < end - seq) {
+					seq = sort_queue->head_seqid;
+				} else {
+					seq = end;
+				}
+				continue;
+			}
+
+			/*
+			 * Skip messages this processor is missing as well
+			 */
+			missing = sqb_items_missing (sort_queue, seq, end - seq);
+			if (missing) {
+				seq += missing;
+				continue;
+			}
+
+			if (orf_token_remcast (instance, seq) == 0) {
+				instance->stats.mcast_retx++;
+				instance->stats.mcast_retx_ranges++;
+				instance->fcc_remcast_current++;
+
+				if (seq != run_start &&
+				    rtr_ranges_add (rtr_ranges, &rtr_range_entries,
+				    run_start, seq - run_start) == -1) {
+					instance->stats.rtr_ranges_dropped++;
+				}
+				run_start = seq + 1;
+			}
+			seq += 1;
+		}
+		if (run_start != end &&
+		    rtr_ranges_add (rtr_ranges, &rtr_range_entries,
+		    run_start, end - run_start) == -1) {
+			instance->stats.rtr_ranges_dropped++;
+		}
+	}
+
+	memcpy (instance->rtr_ranges, rtr_ranges,
+		sizeof (struct rtr_range) * rtr_range_entries);
+	instance->rtr_range_entries = rtr_range_entries;
+}
+
 static int orf_token_rtr (
 	struct totemsrp_instance *instance,
 	struct orf_token *orf_token,
@@ -2808,7 +3820,7 @@ static int orf_token_rtr (
 	unsigned int res;
 	unsigned int i, j;
 	unsigned int found;
-	struct sq *sort_queue;
+	struct sqb *sort_queue;
 	struct rtr_item *rtr_list;
 	unsigned int range = 0;
 	char retransmit_msg[1024];
@@ -2834,6 +3846,14 @@ static int orf_token_rtr (
 		log_printf (instance->totemsrp_log_level_notice,
 			"%s", retransmit_msg);
 	}
+	if (instance->rtr_range_entries) {
+		log_printf (instance->totemsrp_log_level_debug,
+			"Retransmit Ranges %d", instance->rtr_range_entries);
+	}
+
+	if (sq_lt_compare (instance->my_aru, instance->my_high_seq_received)) {
+		instance->stats.rtr_pending_rotations++;
+	}
 
 	/*
 	 * Retransmit messages on orf_token's RTR list from RTR queue
@@ -2868,63 +3888,94 @@ static int orf_token_rtr (
 			i += 1;
 		}
 	}
+
+	/*
+	 * Retransmit messages requested by ranges with what is left
+	 */
+	orf_token_rtr_ranges_remcast (instance, sort_queue, *fcc_allowed);
+
 	*fcc_allowed = *fcc_allowed - instance->fcc_remcast_current;
 
 	/*
-	 * Add messages to retransmit to RTR list
-	 * but only retry if there is room in the retransmit list
+	 * Add messages to retransmit to RTR list, or to the retransmit
+	 * ranges once the list is full, but only retry if there is room
 	 */
 
 	range = orf_token->seq - instance->my_aru;
 	assert (range < QUEUE_RTR_ITEMS_SIZE_MAX);
 
-	for (i = 1; (orf_token->rtr_list_entries < RETRANSMIT_ENTRIES_MAX) &&
+	/*
+	 * Messages past the end of the ring can only be requested once it
+	 * covers them
+	 */
+	sort_queue_reserve (instance, sort_queue, orf_token->seq);
+
+	for (i = 1; (orf_token->rtr_list_entries < RETRANSMIT_ENTRIES_MAX ||
+		(instance->totem_config->retransmit_ranges &&
+		instance->rtr_range_entries < RETRANSMIT_RANGES_MAX)) &&
 		(i <= range); i++) {
 
 		/*
 		 * Ensure message is within the sort queue range
 		 */
-		res = sq_in_range (sort_queue, instance->my_aru + i);
+		res = sqb_in_range (sort_queue, instance->my_aru + i);
 		if (res == 0) {
 			break;
 		}
 
 		/*
-		 * Find if a message is missing from this processor
+		 * Skip over messages already received by this processor
 		 */
-		res = sq_item_inuse (sort_queue, instance->my_aru + i);
-		if (res == 0) {
+		i += sqb_items_contiguous (sort_queue, instance->my_aru + i,
+			range - i + 1);
+		if (i > range || sqb_in_range (sort_queue, instance->my_aru + i) == 0) {
+			break;
+		}
+
+		/*
+		 * Message is missing from this processor.
+		 * Determine how many times we have missed receiving
+		 * this sequence number.  sqb_item_miss_count increments
+		 * a counter for the sequence number.  The miss count
+		 * will be returned and compared.  This allows time for
+		 * delayed multicast messages to be received before
+		 * declaring the message is missing and requesting a
+		 * retransmit.
+		 */
+		res = sqb_item_miss_count (sort_queue, instance->my_aru + i);
+		if (res < instance->totem_config->miss_count_const) {
+			continue;
+		}
+
+		/*
+		 * Determine if missing message is already in retransmit list
+		 */
+		found = 0;
+		for (j = 0; j < orf_token->rtr_list_entries; j++) {
+			if (instance->my_aru + i == rtr_list[j].seq) {
+				found = 1;
+			}
+		}
+		if (found == 0) {
+			found = rtr_ranges_contain (instance, instance->my_aru + i);
+		}
+		if (found == 0 &&
+		    orf_token->rtr_list_entries < RETRANSMIT_ENTRIES_MAX) {
 			/*
-			 * Determine how many times we have missed receiving
-			 * this sequence number.  sq_item_miss_count increments
-			 * a counter for the sequence number.  The miss count
-			 * will be returned and compared.  This allows time for
-			 * delayed multicast messages to be received before
-			 * declaring the message is missing and requesting a
-			 * retransmit.
+			 * Missing message not found in current retransmit list so add it
 			 */
-			res = sq_item_miss_count (sort_queue, instance->my_aru + i);
-			if (res < instance->totem_config->miss_count_const) {
-				continue;
-			}
-
+			memcpy (&rtr_list[orf_token->rtr_list_entries].ring_id,
+				&instance->my_ring_id, sizeof (struct memb_ring_id));
+			rtr_list[orf_token->rtr_list_entries].seq = instance->my_aru + i;
+			orf_token->rtr_list_entries++;
+		} else
+		if (found == 0) {
 			/*
-			 * Determine if missing message is already in retransmit list
+			 * Retransmit list is full, request it through the ranges
 			 */
-			found = 0;
-			for (j = 0; j < orf_token->rtr_list_entries; j++) {
-				if (instance->my_aru + i == rtr_list[j].seq) {
-					found = 1;
-				}
-			}
-			if (found == 0) {
-				/*
-				 * Missing message not found in current retransmit list so add it
-				 */
-				memcpy (&rtr_list[orf_token->rtr_list_entries].ring_id,
-					&instance->my_ring_id, sizeof (struct memb_ring_id));
-				rtr_list[orf_token->rtr_list_entries].seq = instance->my_aru + i;
-				orf_token->rtr_list_entries++;
+			if (rtr_ranges_add (instance->rtr_ranges,
+			    &instance->rtr_range_entries, instance->my_aru + i, 1) == -1) {
+				instance->stats.rtr_ranges_dropped++;
 			}
 		}
 	}
@@ -2995,6 +4046,111 @@ static void timer_function_merge_detect_timeout(void *data)
 	}
 }
 
+/*
+ * Append the retransmit ranges extension at buf, returns its size
+ */
+static unsigned int orf_token_rtr_ranges_build (
+	struct totemsrp_instance *instance,
+	void *buf)
+{
+	struct orf_token_rtr_ranges *rtr_ranges = (struct orf_token_rtr_ranges *)buf;
+
+	rtr_ranges->magic = TOTEM_RTR_RANGES_MAGIC;
+	rtr_ranges->version = TOTEM_MH_VERSION;
+	rtr_ranges->reserved = 0;
+	memcpy (&rtr_ranges->ring_id, &instance->my_ring_id, sizeof (struct memb_ring_id));
+	rtr_ranges->rtr_range_entries = instance->rtr_range_entries;
+	memcpy (&rtr_ranges->rtr_range[0], instance->rtr_ranges,
+		sizeof (struct rtr_range) * instance->rtr_range_entries);
+
+	return (sizeof (struct orf_token_rtr_ranges) +
+		sizeof (struct rtr_range) * instance->rtr_range_entries);
+}
+
+/*
+ * Pick up the retransmit ranges extension following rtr_list, if present
+ */
+static void orf_token_rtr_ranges_parse (
+	struct totemsrp_instance *instance,
+	const void *msg,
+	size_t msg_len,
+	int endian_conversion_needed)
+{
+	const struct orf_token *token = (const struct orf_token *)msg;
+	const struct rtr_range *rtr_range;
+	struct orf_token_rtr_ranges rtr_ranges;
+	size_t offset;
+	int rtr_entries;
+	int i;
+
+	instance->rtr_range_entries = 0;
+
+	if (instance->totem_config->retransmit_ranges == 0) {
+		return;
+	}
+
+	if (endian_conversion_needed) {
+		rtr_entries = swab32(token->rtr_list_entries);
+	} else {
+		rtr_entries = token->rtr_list_entries;
+	}
+
+	offset = sizeof (struct orf_token) + rtr_entries * sizeof (struct rtr_item);
+	if (msg_len < offset + sizeof (struct orf_token_rtr_ranges)) {
+		return;
+	}
+
+	memcpy (&rtr_ranges, (const char *)msg + offset, sizeof (struct orf_token_rtr_ranges));
+	if (endian_conversion_needed) {
+		rtr_ranges.magic = swab16 (rtr_ranges.magic);
+		rtr_ranges.ring_id.rep = swab32 (rtr_ranges.ring_id.rep);
+		rtr_ranges.ring_id.seq = swab64 (rtr_ranges.ring_id.seq);
+		rtr_ranges.rtr_range_entries = swab32 (rtr_ranges.rtr_range_entries);
+	}
+
+	if (rtr_ranges.magic != TOTEM_RTR_RANGES_MAGIC ||
+	    rtr_ranges.version != TOTEM_MH_VERSION ||
+	    rtr_ranges.rtr_range_entries < 0 ||
+	    rtr_ranges.rtr_range_entries > RETRANSMIT_RANGES_MAX ||
+	    msg_len < offset + sizeof (struct orf_token_rtr_ranges) +
+	    rtr_ranges.rtr_range_entries * sizeof (struct rtr_range)) {
+		log_printf (instance->totemsrp_log_level_security,
+		    "Received orf_token retransmit ranges are corrupted...  ignoring.");
+		return;
+	}
+
+	/*
+	 * Ranges of a previous ring are worthless
+	 */
+	if (memcmp (&rtr_ranges.ring_id, &instance->my_ring_id,
+		sizeof (struct memb_ring_id)) != 0) {
+		return;
+	}
+
+	rtr_range = (const struct rtr_range *)((const char *)msg + offset +
+		sizeof (struct orf_token_rtr_ranges));
+	for (i = 0; i < rtr_ranges.rtr_range_entries; i++) {
+		if (endian_conversion_needed) {
+			instance->rtr_ranges[i].seq = swab32 (rtr_range[i].seq);
+			instance->rtr_ranges[i].count = swab32 (rtr_range[i].count);
+		} else {
+			instance->rtr_ranges[i].seq = rtr_range[i].seq;
+			instance->rtr_ranges[i].count = rtr_range[i].count;
+		}
+
+		/*
+		 * A range can't be empty or longer than the largest sort queue
+		 */
+		if (instance->rtr_ranges[i].count == 0 ||
+		    instance->rtr_ranges[i].count > QUEUE_RTR_ITEMS_SIZE_MAX) {
+			log_printf (instance->totemsrp_log_level_security,
+			    "Received orf_token retransmit ranges are corrupted...  ignoring.");
+			return;
+		}
+	}
+	instance->rtr_range_entries = rtr_ranges.rtr_range_entries;
+}
+
 /*
  * Send orf_token to next member (requires orf_token)
  */
@@ -3009,6 +4165,12 @@ static int token_send (
 	orf_token_size = sizeof (struct orf_token) +
 		(orf_token->rtr_list_entries * sizeof (struct rtr_item));
 
+	if (instance->rtr_range_entries &&
+	    instance->totem_config->retransmit_ranges) {
+		orf_token_size += orf_token_rtr_ranges_build (instance,
+			(char *)orf_token + orf_token_size);
+	}
+
 	orf_token->header.nodeid = instance->my_id.nodeid;
 	memcpy (instance->orf_token_retransmit, orf_token, orf_token_size);
 	instance->orf_token_retransmit_size = orf_token_size;
@@ -3091,6 +4253,7 @@ static int orf_token_send_initial (struct totemsrp_instance *instance)
 	orf_token.backlog = 0;
 
 	orf_token.rtr_list_entries = 0;
+	instance->rtr_range_entries = 0;
 
 	res = token_send (instance, &orf_token, 1);
 
@@ -3245,9 +4408,7 @@ static int memb_lowest_in_config (struct totemsrp_instance *instance)
 	int i;
 	unsigned int lowest_nodeid;
 
-	memb_set_subtract (token_memb, &token_memb_entries,
-		instance->my_proc_list, instance->my_proc_list_entries,
-		instance->my_failed_list, instance->my_failed_list_entries);
+	memb_proc_minus_failed (instance, token_memb, &token_memb_entries);
 
 	/*
 	 * find representative by searching for smallest identifier
@@ -3288,9 +4449,7 @@ static void memb_state_commit_token_create (
 	log_printf (instance->totemsrp_log_level_debug,
 		"Creating commit token because I am the rep.");
 
-	memb_set_subtract (token_memb, &token_memb_entries,
-		instance->my_proc_list, instance->my_proc_list_entries,
-		instance->my_failed_list, instance->my_failed_list_entries);
+	memb_proc_minus_failed (instance, token_memb, &token_memb_entries);
 
 	memset (instance->commit_token, 0, sizeof (struct memb_commit_token));
 	instance->commit_token->header.magic = TOTEM_MH_MAGIC;
@@ -3403,9 +4562,7 @@ static void memb_leave_message_send (struct totemsrp_instance *instance)
 	 * add us to the failed list, and remove us from
 	 * the members list
 	 */
-	memb_set_merge(
-		       &instance->my_id, 1,
-		       instance->my_failed_list, &instance->my_failed_list_entries);
+	memb_failed_list_add (instance, &instance->my_id);
 
 	memb_set_subtract (active_memb, &active_memb_entries,
 			   instance->my_proc_list, instance->my_proc_list_entries,
@@ -3557,32 +4714,116 @@ static void token_callbacks_execute (
 	case TOTEM_CALLBACK_TOKEN_RECEIVED:
 		callback_listhead = &instance->token_callback_received_listhead;
 		break;
-	case TOTEM_CALLBACK_TOKEN_SENT:
-		callback_listhead = &instance->token_callback_sent_listhead;
+	case TOTEM_CALLBACK_TOKEN_SENT:
+		callback_listhead = &instance->token_callback_sent_listhead;
+		break;
+	default:
+		assert (0);
+	}
+
+	qb_list_for_each_safe(list, tmp_iter, callback_listhead) {
+		token_callback_instance = qb_list_entry (list, struct token_callback_instance, list);
+		del = token_callback_instance->delete;
+		if (del == 1) {
+			qb_list_del (list);
+		}
+
+		res = token_callback_instance->callback_fn (
+			token_callback_instance->callback_type,
+			token_callback_instance->data);
+		/*
+		 * This callback failed to execute, try it again on the next token
+		 */
+		if (res == -1 && del == 1) {
+			qb_list_add (list, callback_listhead);
+		} else	if (del) {
+			free (token_callback_instance);
+		}
+	}
+}
+
+/*
+ * Latency statistics of locally originated messages
+ */
+static void latency_record (
+	struct totemsrp_instance *instance,
+	enum totem_latency_type type,
+	uint64_t nsec)
+{
+	totemsrp_latency_stats_t *latency = &instance->stats.latency[type];
+	uint64_t usec = nsec / QB_TIME_NS_IN_USEC;
+
+	latency->count++;
+	latency->sum_us += usec;
+	if (usec > latency->max_us) {
+		latency->max_us = usec;
+	}
+	latency->bucket[totem_latency_bucket (usec)]++;
+}
+
+/*
+ * Timeline of membership reconfigurations, from the first event (usually
+ * the token loss) until the services finished synchronization
+ */
+static void reconf_event_record (
+	struct totemsrp_instance *instance,
+	enum totem_reconf_event event)
+{
+	totemsrp_stats_t *stats = &instance->stats;
+	totemsrp_reconf_stats_t *reconf;
+	uint64_t usec = qb_util_nano_current_get () / QB_TIME_NS_IN_USEC;
+	int i;
+
+	if (instance->reconf_in_progress == 0 || stats->reconf_entries == 0) {
+		if (event == TOTEM_RECONF_SYNC_DONE) {
+			return;
+		}
+		stats->reconf_latest = (stats->reconf_latest + 1) % TOTEM_RECONF_HISTORY_MAX;
+		if (stats->reconf_entries < TOTEM_RECONF_HISTORY_MAX) {
+			stats->reconf_entries++;
+		}
+		memset (&stats->reconf[stats->reconf_latest], 0, sizeof (totemsrp_reconf_stats_t));
+		instance->reconf_in_progress = 1;
+	}
+	reconf = &stats->reconf[stats->reconf_latest];
+
+	switch (event) {
+	case TOTEM_RECONF_GATHER:
+		reconf->gather_entered++;
+		if (reconf->timestamp_us[TOTEM_RECONF_COMMIT] != 0) {
+			/*
+			 * The ring being formed was lost, only the steps of the
+			 * final attempt are kept
+			 */
+			for (i = TOTEM_RECONF_CONSENSUS; i <= TOTEM_RECONF_OPERATIONAL; i++) {
+				reconf->timestamp_us[i] = 0;
+			}
+		}
+		break;
+	case TOTEM_RECONF_OPERATIONAL:
+		reconf->ring_seq = instance->my_ring_id.seq;
+		reconf->ring_rep = instance->my_ring_id.rep;
+		reconf->members = instance->my_memb_entries;
 		break;
 	default:
-		assert (0);
+		break;
 	}
 
-	qb_list_for_each_safe(list, tmp_iter, callback_listhead) {
-		token_callback_instance = qb_list_entry (list, struct token_callback_instance, list);
-		del = token_callback_instance->delete;
-		if (del == 1) {
-			qb_list_del (list);
-		}
+	if (reconf->timestamp_us[event] == 0) {
+		reconf->timestamp_us[event] = usec;
+	}
 
-		res = token_callback_instance->callback_fn (
-			token_callback_instance->callback_type,
-			token_callback_instance->data);
-		/*
-		 * This callback failed to execute, try it again on the next token
-		 */
-		if (res == -1 && del == 1) {
-			qb_list_add (list, callback_listhead);
-		} else	if (del) {
-			free (token_callback_instance);
+	if (event == TOTEM_RECONF_OPERATIONAL || event == TOTEM_RECONF_SYNC_DONE) {
+		for (i = 0; i < TOTEM_RECONF_EVENT_MAX; i++) {
+			if (reconf->timestamp_us[i] != 0) {
+				reconf->duration_us = usec - reconf->timestamp_us[i];
+				break;
+			}
 		}
 	}
+	if (event == TOTEM_RECONF_SYNC_DONE) {
+		instance->reconf_in_progress = 0;
+	}
 }
 
 /*
@@ -3592,19 +4833,16 @@ static unsigned int backlog_get (struct totemsrp_instance *instance)
 {
 	unsigned int backlog = 0;
 	struct cs_queue *queue_use = NULL;
+	int i;
 
 	if (instance->memb_state == MEMB_STATE_OPERATIONAL) {
-		if (instance->waiting_trans_ack) {
-			queue_use = &instance->new_message_queue_trans;
-		} else {
-			queue_use = &instance->new_message_queue;
+		queue_use = mcast_queues_get (instance);
+		for (i = 0; i < TOTEM_LANE_MAX; i++) {
+			backlog += cs_queue_used (&queue_use[i]);
 		}
 	} else
 	if (instance->memb_state == MEMB_STATE_RECOVERY) {
 		queue_use = &instance->retrans_message_queue;
-	}
-
-	if (queue_use != NULL) {
 		backlog = cs_queue_used (queue_use);
 	}
 
@@ -3612,6 +4850,59 @@ static unsigned int backlog_get (struct totemsrp_instance *instance)
 	return (backlog);
 }
 
+/*
+ * Adjust the effective window once per token rotation: back off by a quarter
+ * when other processors request retransmissions or a busy rotation took longer
+ * than max_network_delay, grow additively while there is a backlog.
+ */
+static void fcc_adaptive_update (
+	struct totemsrp_instance *instance,
+	struct orf_token *token)
+{
+	struct totem_config *totem_config = instance->totem_config;
+	unsigned int window_size = instance->fcc_window_size;
+	uint64_t time_now;
+	uint64_t rotation = 0;
+
+	time_now = qb_util_nano_current_get ();
+	if (instance->fcc_token_rx_last != 0) {
+		rotation = time_now - instance->fcc_token_rx_last;
+	}
+	instance->fcc_token_rx_last = time_now;
+
+	if (window_size == 0) {
+		window_size = totem_config->window_size;
+	}
+
+	if (token->rtr_list_entries > 0 || instance->rtr_range_entries > 0 ||
+	    (token->fcc > 0 &&
+	    rotation > (uint64_t)totem_config->max_network_delay * QB_TIME_NS_IN_MSEC)) {
+		window_size -= window_size / 4;
+		instance->stats.fcc_window_decreases++;
+	} else
+	if (token->backlog > 0 || instance->my_cbl > 0) {
+		window_size += FCC_ADAPTIVE_INCREASE;
+		instance->stats.fcc_window_increases++;
+	}
+
+	if (window_size < totem_config->window_size_min) {
+		window_size = totem_config->window_size_min;
+	}
+	if (window_size > totem_config->window_size_max) {
+		window_size = totem_config->window_size_max;
+	}
+
+	instance->fcc_window_size = window_size;
+	instance->fcc_max_messages = ((uint64_t)totem_config->max_messages * window_size) /
+		totem_config->window_size;
+	if (instance->fcc_max_messages == 0) {
+		instance->fcc_max_messages = 1;
+	}
+	if (instance->fcc_max_messages > window_size) {
+		instance->fcc_max_messages = window_size;
+	}
+}
+
 static int fcc_calculate (
 	struct totemsrp_instance *instance,
 	struct orf_token *token)
@@ -3619,20 +4910,33 @@ static int fcc_calculate (
 	unsigned int transmits_allowed;
 	unsigned int backlog_calc;
 
-	transmits_allowed = instance->totem_config->max_messages;
+	instance->my_cbl = backlog_get (instance);
 
-	if (transmits_allowed > instance->totem_config->window_size - token->fcc) {
-		transmits_allowed = instance->totem_config->window_size - token->fcc;
+	if (instance->totem_config->window_size_adaptive) {
+		fcc_adaptive_update (instance, token);
+	} else {
+		instance->fcc_window_size = instance->totem_config->window_size;
+		instance->fcc_max_messages = instance->totem_config->max_messages;
 	}
+	instance->stats.fcc_window_size = instance->fcc_window_size;
+	instance->stats.fcc_max_messages = instance->fcc_max_messages;
+	instance->stats.token[instance->stats.latest_token].window_size = instance->fcc_window_size;
 
-	instance->my_cbl = backlog_get (instance);
+	transmits_allowed = instance->fcc_max_messages;
+
+	if (token->fcc >= instance->fcc_window_size) {
+		transmits_allowed = 0;
+	} else
+	if (transmits_allowed > instance->fcc_window_size - token->fcc) {
+		transmits_allowed = instance->fcc_window_size - token->fcc;
+	}
 
 	/*
 	 * Only do backlog calculation if there is a backlog otherwise
 	 * we would result in div by zero
 	 */
 	if (token->backlog + instance->my_cbl - instance->my_pbl) {
-		backlog_calc = (instance->totem_config->window_size * instance->my_pbl) /
+		backlog_calc = (instance->fcc_window_size * instance->my_pbl) /
 			(token->backlog + instance->my_cbl - instance->my_pbl);
 		if (backlog_calc > 0 && transmits_allowed > backlog_calc) {
 			transmits_allowed = backlog_calc;
@@ -3643,7 +4947,7 @@ static int fcc_calculate (
 }
 
 /*
- * don't overflow the RTR sort queue
+ * don't overflow the RTR sort queue, neither its ring nor its byte budget
  */
 static void fcc_rtr_limit (
 	struct totemsrp_instance *instance,
@@ -3651,16 +4955,28 @@ static void fcc_rtr_limit (
 	unsigned int *transmits_allowed)
 {
 	int check = QUEUE_RTR_ITEMS_SIZE_MAX;
-	check -= (*transmits_allowed + instance->totem_config->window_size);
+	check -= (*transmits_allowed + instance->fcc_window_size);
 	assert (check >= 0);
 	if (sq_lt_compare (instance->last_released +
 		QUEUE_RTR_ITEMS_SIZE_MAX - *transmits_allowed -
-		instance->totem_config->window_size,
+		instance->fcc_window_size,
 
 			token->seq)) {
 
 			*transmits_allowed = 0;
 	}
+
+	/*
+	 * Old ring messages held during recovery must not stop recovery
+	 */
+	if (instance->memb_state == MEMB_STATE_OPERATIONAL &&
+	    *transmits_allowed > 0 &&
+	    instance->regular_sort_queue_bytes >=
+	    instance->totem_config->sort_queue_bytes) {
+
+		*transmits_allowed = 0;
+		instance->stats.sort_queue_full++;
+	}
 }
 
 static void fcc_token_update (
@@ -3866,12 +5182,15 @@ static int message_handler_orf_token (
 {
 	char token_storage[1500];
 	char token_convert[1500];
+	const void *token_msg = msg;
 	struct orf_token *token = NULL;
 	int forward_token;
 	unsigned int transmits_allowed;
 	unsigned int mcasted_retransmit;
 	unsigned int mcasted_regular;
 	unsigned int last_aru;
+	unsigned int token_hold_idle_last;
+	int seq_unchanged;
 
 #ifdef GIVEINFO
 	uint64_t tv_current;
@@ -3912,13 +5231,14 @@ static int message_handler_orf_token (
 	token = (struct orf_token *)token_storage;
 	memcpy (token, msg, sizeof (struct orf_token));
 	memcpy (&token->rtr_list[0], (char *)msg + sizeof (struct orf_token),
-		sizeof (struct rtr_item) * RETRANSMIT_ENTRIES_MAX);
+		sizeof (struct rtr_item) * token->rtr_list_entries);
 
 
 	/*
 	 * Handle merge detection timeout
 	 */
-	if (token->seq == instance->my_last_seq) {
+	seq_unchanged = (token->seq == instance->my_last_seq);
+	if (seq_unchanged) {
 		start_merge_detect_timeout (instance);
 		instance->my_seq_unchanged += 1;
 	} else {
@@ -3970,6 +5290,7 @@ static int message_handler_orf_token (
 
 	case MEMB_STATE_OPERATIONAL:
 		messages_free (instance, token->aru);
+		regular_sort_queue_shrink (instance, token->seq);
 		/*
 		 * Do NOT add break, this case should also execute code in gather case.
 		 */
@@ -4004,11 +5325,32 @@ static int message_handler_orf_token (
 			return (0); /* discard token */
 		}
 
+		/*
+		 * Only an accepted token may replace the retransmit ranges
+		 */
+		orf_token_rtr_ranges_parse (instance, token_msg, msg_len,
+			endian_conversion_needed);
+
 		/*
 		 * Token is valid so trigger callbacks
 		 */
 		token_callbacks_execute (instance, TOTEM_CALLBACK_TOKEN_RECEIVED);
 
+		if (instance->memb_state == MEMB_STATE_OPERATIONAL) {
+			/*
+			 * Rotations around a longer idle hold say nothing
+			 * about the ring, leave them out of the accrual
+			 * failure detector
+			 */
+			token_hold_idle_last = instance->token_hold_idle;
+			token_hold_idle_update (instance, seq_unchanged);
+			if (token_hold_idle_last || instance->token_hold_idle) {
+				instance->token_interval_rx_last = 0;
+			} else {
+				token_interval_sample (instance);
+			}
+		}
+
 		last_aru = instance->my_last_aru;
 		instance->my_last_aru = token->aru;
 
@@ -4063,9 +5405,7 @@ printf ("token seq %d\n", token->seq);
 
 			instance->failed_to_recv = 1;
 
-			memb_set_merge (&instance->my_id, 1,
-				instance->my_failed_list,
-				&instance->my_failed_list_entries);
+			memb_failed_list_add (instance, &instance->my_id);
 
 			memb_state_gather_enter (instance, TOTEMSRP_GSFROM_FAILED_TO_RECEIVE);
 		} else {
@@ -4184,7 +5524,8 @@ static void messages_deliver_to_app (
 	unsigned int i;
 	int res;
 	struct mcast *mcast_in;
-	struct mcast mcast_header;
+	const struct mcast *mcast_header;
+	struct mcast mcast_converted;
 	unsigned int range = 0;
 	int endian_conversion_required;
 	unsigned int my_high_delivered_stored = 0;
@@ -4200,6 +5541,14 @@ static void messages_deliver_to_app (
 	assert (range < QUEUE_RTR_ITEMS_SIZE_MAX);
 	my_high_delivered_stored = instance->my_high_delivered;
 
+	/*
+	 * Unless holes are skipped, delivery stops at the first hole
+	 */
+	if (skip == 0) {
+		range = sqb_items_contiguous (&instance->regular_sort_queue,
+			my_high_delivered_stored + 1, range);
+	}
+
 	/*
 	 * Deliver messages in order from rtr queue to pending delivery queue
 	 */
@@ -4210,13 +5559,13 @@ static void messages_deliver_to_app (
 		/*
 		 * If out of range of sort queue, stop assembly
 		 */
-		res = sq_in_range (&instance->regular_sort_queue,
+		res = sqb_in_range (&instance->regular_sort_queue,
 			my_high_delivered_stored + i);
 		if (res == 0) {
 			break;
 		}
 
-		res = sq_item_get (&instance->regular_sort_queue,
+		res = sqb_item_get (&instance->regular_sort_queue,
 			my_high_delivered_stored + i, &ptr);
 		/*
 		 * If hole, stop assembly
@@ -4237,15 +5586,19 @@ static void messages_deliver_to_app (
 		mcast_in = sort_queue_item_p->mcast;
 		assert (mcast_in != (struct mcast *)0xdeadbeef);
 
+		/*
+		 * The header is only copied when it has to be converted
+		 */
 		endian_conversion_required = 0;
+		mcast_header = mcast_in;
 		if (mcast_in->header.magic != TOTEM_MH_MAGIC) {
 			endian_conversion_required = 1;
-			mcast_endian_convert (mcast_in, &mcast_header);
-		} else {
-			memcpy (&mcast_header, mcast_in, sizeof (struct mcast));
+			mcast_endian_convert (mcast_in, &mcast_converted);
+			mcast_header = &mcast_converted;
+			instance->stats.endian_conversions++;
 		}
 
-		aligned_system_from = mcast_header.system_from;
+		aligned_system_from = mcast_header->system_from;
 
 		/*
 		 * Skip messages not originated in instance->my_deliver_memb
@@ -4266,13 +5619,22 @@ static void messages_deliver_to_app (
 		 */
 		log_printf (instance->totemsrp_log_level_trace,
 			"Delivering MCAST message with seq %x to pending delivery queue",
-			mcast_header.seq);
+			mcast_header->seq);
+
+		if (sort_queue_item_p->submit_time != 0) {
+			uint64_t time_now = qb_util_nano_current_get ();
+
+			latency_record (instance, TOTEM_LATENCY_ORDER,
+				time_now - sort_queue_item_p->send_time);
+			latency_record (instance, TOTEM_LATENCY_DELIVERY,
+				time_now - sort_queue_item_p->submit_time);
+		}
 
 		/*
 		 * Message is locally originated multicast
 		 */
 		instance->totemsrp_deliver_fn (
-			mcast_header.header.nodeid,
+			mcast_header->header.nodeid,
 			((char *)sort_queue_item_p->mcast) + sizeof (struct mcast),
 			sort_queue_item_p->msg_len - sizeof (struct mcast),
 			endian_conversion_required);
@@ -4287,23 +5649,48 @@ static int message_handler_mcast (
 	const void *msg,
 	size_t msg_len,
 	int endian_conversion_needed)
+{
+#ifdef TEST_DROP_MCAST_PERCENTAGE
+	if (random()%100 < TEST_DROP_MCAST_PERCENTAGE) {
+		return (0);
+	}
+#endif
+
+	return (mcast_receive (instance, msg, msg_len, endian_conversion_needed, 0));
+}
+
+/*
+ * Handles a multicast message received from the network or reconstructed
+ * from parity (fec_recovered)
+ */
+static int mcast_receive (
+	struct totemsrp_instance *instance,
+	const void *msg,
+	size_t msg_len,
+	int endian_conversion_needed,
+	int fec_recovered)
 {
 	struct sort_queue_item sort_queue_item;
-	struct sq *sort_queue;
-	struct mcast mcast_header;
+	struct sqb *sort_queue;
+	const struct mcast *mcast_header;
+	struct mcast mcast_converted;
 	struct srp_addr aligned_system_from;
 
 	if (check_mcast_sanity(instance, msg, msg_len, endian_conversion_needed) == -1) {
 		return (0);
 	}
 
+	/*
+	 * The header is only copied when it has to be converted
+	 */
+	mcast_header = msg;
 	if (endian_conversion_needed) {
-		mcast_endian_convert (msg, &mcast_header);
-	} else {
-		memcpy (&mcast_header, msg, sizeof (struct mcast));
+		mcast_endian_convert (msg, &mcast_converted);
+		mcast_header = &mcast_converted;
+		instance->stats.endian_conversions++;
 	}
 
-	if (mcast_header.header.encapsulated == MESSAGE_ENCAPSULATED) {
+	if (mcast_header->header.encapsulated == MESSAGE_ENCAPSULATED) {
 		sort_queue = &instance->recovery_sort_queue;
 	} else {
 		sort_queue = &instance->regular_sort_queue;
@@ -4311,37 +5698,25 @@ static int message_handler_mcast (
 
 	assert (msg_len <= FRAME_SIZE_MAX);
 
-#ifdef TEST_DROP_MCAST_PERCENTAGE
-	if (random()%100 < TEST_DROP_MCAST_PERCENTAGE) {
-		return (0);
-	}
-#endif
-
 	/*
 	 * If the message is foreign execute the switch below
 	 */
-	if (memcmp (&instance->my_ring_id, &mcast_header.ring_id,
+	if (memcmp (&instance->my_ring_id, &mcast_header->ring_id,
 		sizeof (struct memb_ring_id)) != 0) {
 
-		aligned_system_from = mcast_header.system_from;
+		aligned_system_from = mcast_header->system_from;
 
 		switch (instance->memb_state) {
 		case MEMB_STATE_OPERATIONAL:
-			memb_set_merge (
-				&aligned_system_from, 1,
-				instance->my_proc_list, &instance->my_proc_list_entries);
+			memb_proc_list_add (instance, &aligned_system_from);
 			memb_state_gather_enter (instance, TOTEMSRP_GSFROM_FOREIGN_MESSAGE_IN_OPERATIONAL_STATE);
 			break;
 
 		case MEMB_STATE_GATHER:
-			if (!memb_set_subset (
-				&aligned_system_from,
-				1,
-				instance->my_proc_list,
-				instance->my_proc_list_entries)) {
+			if (!memb_nodeset_isset (instance, &instance->my_proc_set,
+				&aligned_system_from)) {
 
-				memb_set_merge (&aligned_system_from, 1,
-					instance->my_proc_list, &instance->my_proc_list_entries);
+				memb_proc_list_add (instance, &aligned_system_from);
 				memb_state_gather_enter (instance, TOTEMSRP_GSFROM_FOREIGN_MESSAGE_IN_GATHER_STATE);
 				return (0);
 			}
@@ -4362,22 +5737,23 @@ static int message_handler_mcast (
 
 	log_printf (instance->totemsrp_log_level_trace,
 		"Received ringid (" CS_PRI_RING_ID ") seq %x",
-		mcast_header.ring_id.rep,
-		(uint64_t)mcast_header.ring_id.seq,
-		mcast_header.seq);
+		mcast_header->ring_id.rep,
+		(uint64_t)mcast_header->ring_id.seq,
+		mcast_header->seq);
 
 	/*
 	 * Add mcast message to rtr queue if not already in rtr queue
 	 * otherwise free io vectors
 	 */
 	if (msg_len > 0 && msg_len <= FRAME_SIZE_MAX &&
-		sq_in_range (sort_queue, mcast_header.seq) &&
-		sq_item_inuse (sort_queue, mcast_header.seq) == 0) {
+		sort_queue_reserve (instance, sort_queue, mcast_header->seq) == 0 &&
+		sqb_item_inuse (sort_queue, mcast_header->seq) == 0) {
 
 		/*
 		 * Allocate new multicast memory block
 		 */
 // TODO LEAK
+		memset (&sort_queue_item, 0, sizeof (struct sort_queue_item));
 		sort_queue_item.mcast = totemsrp_buffer_alloc (instance);
 		if (sort_queue_item.mcast == NULL) {
 			return (-1); /* error here is corrected by the algorithm */
@@ -4386,11 +5762,21 @@ static int message_handler_mcast (
 		sort_queue_item.msg_len = msg_len;
 
 		if (sq_lt_compare (instance->my_high_seq_received,
-			mcast_header.seq)) {
-			instance->my_high_seq_received = mcast_header.seq;
+			mcast_header->seq)) {
+			instance->my_high_seq_received = mcast_header->seq;
+		}
+
+		if (fec_recovered) {
+			instance->stats.mcast_fec_recovered++;
+		} else if (sqb_item_miss_count_get (sort_queue, mcast_header->seq) >=
+		    instance->totem_config->miss_count_const) {
+			instance->stats.mcast_rtr_recovered++;
 		}
 
-		sq_item_add (sort_queue, &sort_queue_item, mcast_header.seq);
+		sqb_item_add (sort_queue, &sort_queue_item, mcast_header->seq);
+		if (sort_queue == &instance->regular_sort_queue) {
+			instance->regular_sort_queue_bytes += msg_len;
+		}
 	}
 
 	update_aru (instance);
@@ -4402,6 +5788,138 @@ static int message_handler_mcast (
 	return (0);
 }
 
+/*
+ * Reconstructs the message of a parity group this processor is missing,
+ * which saves a token rotation to request and receive a retransmit.  Only
+ * a single missing message can be recovered, more holes are left to the
+ * retransmit list.
+ */
+static int message_handler_mcast_parity (
+	struct totemsrp_instance *instance,
+	const void *msg,
+	size_t msg_len,
+	int endian_conversion_needed)
+{
+	struct mcast_parity mcast_parity;
+	struct sort_queue_item *sort_queue_item;
+	struct mcast recovered_header;
+	unsigned int missing_seq = 0;
+	unsigned int missing = 0;
+	unsigned int recovered_len;
+	unsigned int seq;
+	unsigned int i;
+	void *ptr;
+
+#ifdef TEST_DROP_MCAST_PERCENTAGE
+	if (random()%100 < TEST_DROP_MCAST_PERCENTAGE) {
+		return (0);
+	}
+#endif
+
+	if (msg_len < sizeof (struct mcast_parity)) {
+		log_printf (instance->totemsrp_log_level_security,
+			"Received message is too short...  ignoring %u.",
+			(unsigned int)msg_len);
+		return (0);
+	}
+
+	if (endian_conversion_needed) {
+		mcast_parity_endian_convert (msg, &mcast_parity);
+	} else {
+		memcpy (&mcast_parity, msg, sizeof (struct mcast_parity));
+	}
+
+	if (mcast_parity.count == 0 || mcast_parity.count > FEC_GROUP_SIZE_MAX ||
+	    mcast_parity.parity_len < sizeof (struct mcast) ||
+	    mcast_parity.parity_len > FRAME_SIZE_MAX ||
+	    mcast_parity.parity_len != msg_len - sizeof (struct mcast_parity)) {
+		log_printf (instance->totemsrp_log_level_security,
+			"Received parity message is malformed...  ignoring.");
+		return (0);
+	}
+
+	/*
+	 * Parity of other rings is of no use, foreign messages are
+	 * detected from the multicasts themselves
+	 */
+	if (instance->memb_state != MEMB_STATE_OPERATIONAL ||
+	    memcmp (&instance->my_ring_id, &mcast_parity.ring_id,
+		sizeof (struct memb_ring_id)) != 0) {
+		return (0);
+	}
+
+	for (i = 0; i < mcast_parity.count; i++) {
+		seq = mcast_parity.seq + i;
+		if (sq_lte_compare (seq, instance->my_aru)) {
+			continue;
+		}
+		if (sqb_in_range (&instance->regular_sort_queue, seq) == 0 ||
+		    sqb_item_inuse (&instance->regular_sort_queue, seq) == 0) {
+			missing_seq = seq;
+			if (++missing > 1) {
+				return (0);
+			}
+		}
+	}
+	if (missing == 0) {
+		return (0);
+	}
+
+	/*
+	 * Messages are kept as received, so they XOR out of the parity as
+	 * they were XORed in by the sender
+	 */
+	memcpy (instance->fec_recovery_buffer,
+		((const char *)msg) + sizeof (struct mcast_parity),
+		mcast_parity.parity_len);
+	recovered_len = mcast_parity.msg_len_xor;
+	for (i = 0; i < mcast_parity.count; i++) {
+		seq = mcast_parity.seq + i;
+		if (seq == missing_seq) {
+			continue;
+		}
+		if (sqb_item_get (&instance->regular_sort_queue, seq, &ptr) != 0) {
+			/*
+			 * Already released, which needs every message of
+			 * the group to be received
+			 */
+			return (0);
+		}
+		sort_queue_item = ptr;
+		if (sort_queue_item->msg_len > mcast_parity.parity_len) {
+			return (0);
+		}
+		fec_xor (instance->fec_recovery_buffer, sort_queue_item->mcast,
+			sort_queue_item->msg_len);
+		recovered_len ^= sort_queue_item->msg_len;
+	}
+
+	if (recovered_len < sizeof (struct mcast) ||
+	    recovered_len > mcast_parity.parity_len) {
+		return (0);
+	}
+	memcpy (&recovered_header, instance->fec_recovery_buffer, sizeof (struct mcast));
+	endian_conversion_needed = 0;
+	if (recovered_header.header.magic == swab16 (TOTEM_MH_MAGIC)) {
+		mcast_endian_convert ((struct mcast *)instance->fec_recovery_buffer,
+			&recovered_header);
+		endian_conversion_needed = 1;
+	}
+	if (recovered_header.header.magic != TOTEM_MH_MAGIC ||
+	    recovered_header.header.type != MESSAGE_TYPE_MCAST ||
+	    recovered_header.seq != missing_seq) {
+		log_printf (instance->totemsrp_log_level_debug,
+			"parity of %x-%x doesn't match the messages received",
+			mcast_parity.seq, mcast_parity.seq + mcast_parity.count - 1);
+		return (0);
+	}
+
+	log_printf (instance->totemsrp_log_level_trace,
+		"recovered message %x from parity", missing_seq);
+	return (mcast_receive (instance, instance->fec_recovery_buffer,
+		recovered_len, endian_conversion_needed, 1));
+}
+
 static int message_handler_memb_merge_detect (
 	struct totemsrp_instance *instance,
 	const void *msg,
@@ -4438,20 +5956,15 @@ static int message_handler_memb_merge_detect (
 	 */
 	switch (instance->memb_state) {
 	case MEMB_STATE_OPERATIONAL:
-		memb_set_merge (&aligned_system_from, 1,
-			instance->my_proc_list, &instance->my_proc_list_entries);
+		memb_proc_list_add (instance, &aligned_system_from);
 		memb_state_gather_enter (instance, TOTEMSRP_GSFROM_MERGE_DURING_OPERATIONAL_STATE);
 		break;
 
 	case MEMB_STATE_GATHER:
-		if (!memb_set_subset (
-			&aligned_system_from,
-			1,
-			instance->my_proc_list,
-			instance->my_proc_list_entries)) {
+		if (!memb_nodeset_isset (instance, &instance->my_proc_set,
+			&aligned_system_from)) {
 
-			memb_set_merge (&aligned_system_from, 1,
-				instance->my_proc_list, &instance->my_proc_list_entries);
+			memb_proc_list_add (instance, &aligned_system_from);
 			memb_state_gather_enter (instance, TOTEMSRP_GSFROM_MERGE_DURING_GATHER_STATE);
 			return (0);
 		}
@@ -4475,9 +5988,8 @@ static void memb_join_process (
 	struct srp_addr *proc_list;
 	struct srp_addr *failed_list;
 	int gather_entered = 0;
-	int fail_minus_memb_entries = 0;
-	struct srp_addr fail_minus_memb[PROCESSOR_COUNT_MAX];
 	struct srp_addr aligned_system_from;
+	int i;
 
 	proc_list = (struct srp_addr *)memb_join->end_of_memb_join;
 	failed_list = proc_list + memb_join->proc_list_entries;
@@ -4519,25 +6031,28 @@ static void memb_join_process (
 
 	}
 
-	if (memb_set_equal (proc_list,
+	if (memb_list_equal (instance, proc_list,
 		memb_join->proc_list_entries,
-		instance->my_proc_list,
-		instance->my_proc_list_entries) &&
+		&instance->my_proc_set) &&
 
-	memb_set_equal (failed_list,
+	memb_list_equal (instance, failed_list,
 		memb_join->failed_list_entries,
-		instance->my_failed_list,
-		instance->my_failed_list_entries)) {
+		&instance->my_failed_set)) {
 
 		if (memb_join->header.nodeid != LEAVE_DUMMY_NODEID) {
 			memb_consensus_set (instance, &aligned_system_from);
 		}
+		if (instance->memb_state == MEMB_STATE_GATHER &&
+		    memb_consensus_agreed (instance)) {
+			reconf_event_record (instance, TOTEM_RECONF_CONSENSUS);
+		}
 
 		if (memb_consensus_agreed (instance) && instance->failed_to_recv == 1) {
 				instance->failed_to_recv = 0;
 				instance->my_proc_list[0] = instance->my_id;
 				instance->my_proc_list_entries = 1;
 				instance->my_failed_list_entries = 0;
+				memb_index_rebuild (instance);
 
 				memb_state_commit_token_create (instance);
 
@@ -4554,60 +6069,49 @@ static void memb_join_process (
 			goto out;
 		}
 	} else
-	if (memb_set_subset (proc_list,
+	if (memb_list_subset (instance, proc_list,
 		memb_join->proc_list_entries,
-		instance->my_proc_list,
-		instance->my_proc_list_entries) &&
+		&instance->my_proc_set) &&
 
-		memb_set_subset (failed_list,
+		memb_list_subset (instance, failed_list,
 		memb_join->failed_list_entries,
-		instance->my_failed_list,
-		instance->my_failed_list_entries)) {
+		&instance->my_failed_set)) {
 
 		goto out;
 	} else
-	if (memb_set_subset (&aligned_system_from, 1,
-		instance->my_failed_list, instance->my_failed_list_entries)) {
+	if (memb_nodeset_isset (instance, &instance->my_failed_set,
+		&aligned_system_from)) {
 
 		goto out;
 	} else {
-		memb_set_merge (proc_list,
-			memb_join->proc_list_entries,
-			instance->my_proc_list, &instance->my_proc_list_entries);
+		memb_proc_list_merge (instance, proc_list,
+			memb_join->proc_list_entries);
 
 		if (memb_set_subset (
 			&instance->my_id, 1,
 			failed_list, memb_join->failed_list_entries)) {
 
-			memb_set_merge (
-				&aligned_system_from, 1,
-				instance->my_failed_list, &instance->my_failed_list_entries);
+			memb_failed_list_add (instance, &aligned_system_from);
 		} else {
-			if (memb_set_subset (
-				&aligned_system_from, 1,
-				instance->my_memb_list,
-				instance->my_memb_entries)) {
-
-				if (memb_set_subset (
-					&aligned_system_from, 1,
-					instance->my_failed_list,
-					instance->my_failed_list_entries) == 0) {
-
-					memb_set_merge (failed_list,
-						memb_join->failed_list_entries,
-						instance->my_failed_list, &instance->my_failed_list_entries);
+			if (memb_nodeset_isset (instance, &instance->my_memb_set,
+				&aligned_system_from)) {
+
+				if (memb_nodeset_isset (instance, &instance->my_failed_set,
+					&aligned_system_from) == 0) {
+
+					memb_failed_list_merge (instance, failed_list,
+						memb_join->failed_list_entries);
 				} else {
-					memb_set_subtract (fail_minus_memb,
-						&fail_minus_memb_entries,
-						failed_list,
-						memb_join->failed_list_entries,
-						instance->my_memb_list,
-						instance->my_memb_entries);
-
-					memb_set_merge (fail_minus_memb,
-						fail_minus_memb_entries,
-						instance->my_failed_list,
-						&instance->my_failed_list_entries);
+					/*
+					 * Merge failed_list minus my_memb_list
+					 */
+					for (i = 0; i < memb_join->failed_list_entries; i++) {
+						if (memb_nodeset_isset (instance, &instance->my_memb_set,
+							&failed_list[i]) == 0) {
+
+							memb_failed_list_add (instance, &failed_list[i]);
+						}
+					}
 				}
 			}
 		}
@@ -4734,6 +6238,22 @@ static void mcast_endian_convert (const struct mcast *in, struct mcast *out)
 	out->system_from = srp_addr_endian_convert(in->system_from);
 }
 
+static void mcast_parity_endian_convert (const struct mcast_parity *in, struct mcast_parity *out)
+{
+	out->header.magic = TOTEM_MH_MAGIC;
+	out->header.version = TOTEM_MH_VERSION;
+	out->header.type = in->header.type;
+	out->header.nodeid = swab32 (in->header.nodeid);
+	out->header.encapsulated = in->header.encapsulated;
+
+	out->ring_id.rep = swab32 (in->ring_id.rep);
+	out->ring_id.seq = swab64 (in->ring_id.seq);
+	out->seq = swab32 (in->seq);
+	out->count = swab32 (in->count);
+	out->msg_len_xor = swab32 (in->msg_len_xor);
+	out->parity_len = swab32 (in->parity_len);
+}
+
 static void memb_merge_detect_endian_convert (
 	const struct memb_merge_detect *in,
 	struct memb_merge_detect *out)
@@ -4770,8 +6290,7 @@ static int ignore_join_under_operational (
 	 * In operational state, my_proc_list is exactly the same as
 	 * my_memb_list.
 	 */
-	if ((memb_set_subset (&aligned_system_from, 1,
-	    instance->my_memb_list, instance->my_memb_entries)) &&
+	if (memb_nodeset_isset (instance, &instance->my_memb_set, &aligned_system_from) &&
 	    (ring_seq < instance->my_ring_id.seq)) {
 		return (1);
 	}
@@ -4895,9 +6414,7 @@ static int message_handler_memb_commit_token (
 			break;
 
 		case MEMB_STATE_GATHER:
-			memb_set_subtract (sub, &sub_entries,
-				instance->my_proc_list, instance->my_proc_list_entries,
-				instance->my_failed_list, instance->my_failed_list_entries);
+			memb_proc_minus_failed (instance, sub, &sub_entries);
 
 			if (memb_set_equal (addr,
 				memb_commit_token->addr_entries,
@@ -4964,12 +6481,48 @@ static int message_handler_token_hold_cancel (
 
 		instance->my_seq_unchanged = 0;
 		if (instance->my_ring_id.rep == instance->my_id.nodeid) {
+			instance->token_idle_rotations = 0;
+			cancel_token_hold_retransmit_timeout (instance);
 			timer_function_token_retransmit_timeout (instance);
 		}
 	}
 	return (0);
 }
 
+static int message_handler_payload (
+	struct totemsrp_instance *instance,
+	const void *msg,
+	size_t msg_len,
+	int endian_conversion_needed)
+{
+	const struct payload_message *payload_message = msg;
+	unsigned int nodeid;
+
+	if (msg_len <= sizeof (struct payload_message)) {
+		log_printf (instance->totemsrp_log_level_security,
+			"Received message is too short...  ignoring %u.",
+			(unsigned int)msg_len);
+		return (0);
+	}
+
+	if (instance->totemsrp_payload_deliver_fn == NULL) {
+		instance->stats.rx_msg_dropped++;
+		return (0);
+	}
+
+	nodeid = payload_message->header.nodeid;
+	if (endian_conversion_needed) {
+		nodeid = swab32 (nodeid);
+	}
+
+	instance->totemsrp_payload_deliver_fn (nodeid,
+		(const char *)msg + sizeof (struct payload_message),
+		msg_len - sizeof (struct payload_message),
+		endian_conversion_needed);
+
+	return (0);
+}
+
 static int check_message_header_validity(
 	void *context,
 	const void *msg,
@@ -5084,6 +6637,11 @@ int main_deliver_fn (
 	case MESSAGE_TYPE_TOKEN_HOLD_CANCEL:
 		instance->stats.token_hold_cancel_rx++;
 		break;
+	case MESSAGE_TYPE_MCAST_PARITY:
+		instance->stats.mcast_fec_rx++;
+		break;
+	case MESSAGE_TYPE_PAYLOAD:
+		break;
 	default:
 		log_printf (instance->totemsrp_log_level_security,
 		    "Message received from %s has wrong type...  ignoring %d.\n",
@@ -5196,6 +6754,61 @@ void totemsrp_service_ready_register (
 	instance->totemsrp_service_ready_fn = totem_service_ready;
 }
 
+void totemsrp_payload_register (
+	void *context,
+	void (*payload_deliver_fn) (
+		unsigned int nodeid,
+		const void *msg,
+		unsigned int msg_len,
+		int endian_conversion_required))
+{
+	struct totemsrp_instance *instance = (struct totemsrp_instance *)context;
+
+	instance->totemsrp_payload_deliver_fn = payload_deliver_fn;
+}
+
+int totemsrp_payload_available (void *context)
+{
+	struct totemsrp_instance *instance = (struct totemsrp_instance *)context;
+
+	return (totemnet_unicast_available (instance->totemnet_context));
+}
+
+/*
+ * Send side channel data straight to one node, the upper layer takes care
+ * of loss and of nodes leaving
+ */
+int totemsrp_payload_send (
+	void *context,
+	unsigned int nodeid,
+	const struct iovec *iovec,
+	unsigned int iov_len)
+{
+	struct totemsrp_instance *instance = (struct totemsrp_instance *)context;
+	char buf[FRAME_SIZE_MAX];
+	struct payload_message *payload_message = (struct payload_message *)buf;
+	size_t len = sizeof (struct payload_message);
+	unsigned int i;
+
+	for (i = 0; i < iov_len; i++) {
+		if (len + iovec[i].iov_len > sizeof (buf)) {
+			return (-1);
+		}
+		memcpy (&buf[len], iovec[i].iov_base, iovec[i].iov_len);
+		len += iovec[i].iov_len;
+	}
+
+	payload_message->header.magic = TOTEM_MH_MAGIC;
+	payload_message->header.version = TOTEM_MH_VERSION;
+	payload_message->header.type = MESSAGE_TYPE_PAYLOAD;
+	payload_message->header.encapsulated = 0;
+	payload_message->header.nodeid = instance->my_id.nodeid;
+	payload_message->header.target_nodeid = 0;
+
+	return (totemnet_unicast_send (instance->totemnet_context, nodeid,
+		buf, len));
+}
+
 int totemsrp_member_add (
         void *context,
         const struct totem_ip_address *member,
@@ -5235,6 +6848,7 @@ void totemsrp_trans_ack (void *context)
 
 	instance->waiting_trans_ack = 0;
 	instance->totemsrp_waiting_trans_ack_cb_fn (0);
+	reconf_event_record (instance, TOTEM_RECONF_SYNC_DONE);
 }
 
 
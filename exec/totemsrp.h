@@ -80,6 +80,29 @@ int totemsrp_mcast (
 	unsigned int iov_len,
 	int priority);
 
+/**
+ * Zero copy multicast
+ *
+ * totemsrp_mcast_buffer_alloc returns the payload area of a new transport
+ * buffer (up to *payload_len_max bytes).  The caller builds the message in
+ * place and hands the buffer over with totemsrp_mcast_buffer_submit, after
+ * which it is owned by totemsrp.  If submit fails or the message is
+ * abandoned the buffer must be returned with totemsrp_mcast_buffer_release.
+ */
+void *totemsrp_mcast_buffer_alloc (
+	void *srp_context,
+	size_t *payload_len_max);
+
+int totemsrp_mcast_buffer_submit (
+	void *srp_context,
+	void *payload,
+	size_t payload_len,
+	int priority);
+
+void totemsrp_mcast_buffer_release (
+	void *srp_context,
+	void *payload);
+
 /**
  * Return number of available messages that can be queued
  */
@@ -128,6 +151,23 @@ void totemsrp_service_ready_register (
 	void *srp_context,
 	void (*totem_service_ready) (void));
 
+void totemsrp_payload_register (
+	void *srp_context,
+	void (*payload_deliver_fn) (
+		unsigned int nodeid,
+		const void *msg,
+		unsigned int msg_len,
+		int endian_conversion_required));
+
+extern int totemsrp_payload_available (
+	void *srp_context);
+
+extern int totemsrp_payload_send (
+	void *srp_context,
+	unsigned int nodeid,
+	const struct iovec *iovec,
+	unsigned int iov_len);
+
 extern int totemsrp_iface_set (
 	void *srp_context,
 	const struct totem_ip_address *interface_addr,
@@ -0,0 +1,465 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Checks of totemsrp internals
+ *
+ * totemsrp.c is included, so its static functions can be called on an
+ * instance set up by totemsrp_initialize() with the in-process loopback
+ * transport.  Every check prints its name and the program exits with 1 if
+ * any of them failed.
+ */
+
+#include "totemsrp.c"
+
+#define TEST_NODEID		1
+
+#define TEST_TOKEN_SIZE		1500
+
+static int failures;
+
+static void check (int ok, const char *name)
+{
+	printf ("%s: %s\n", ok ? "PASS" : "FAIL", name);
+	if (!ok) {
+		failures++;
+	}
+}
+
+static void test_log_printf (
+	int level,
+	int subsys,
+	const char *function_name,
+	const char *file_name,
+	int file_line,
+	const char *format,
+	...) __attribute__((format(printf, 6, 7)));
+
+static void test_log_printf (
+	int level,
+	int subsys,
+	const char *function_name,
+	const char *file_name,
+	int file_line,
+	const char *format,
+	...)
+{
+}
+
+static void test_ring_id_create_or_load (
+	struct memb_ring_id *memb_ring_id,
+	unsigned int nodeid)
+{
+	memb_ring_id->rep = nodeid;
+	memb_ring_id->seq = 0;
+}
+
+static void test_ring_id_store (
+	const struct memb_ring_id *memb_ring_id,
+	unsigned int nodeid)
+{
+}
+
+static void test_deliver_fn (
+	unsigned int nodeid,
+	const void *msg,
+	unsigned int msg_len,
+	int endian_conversion_required)
+{
+}
+
+static void test_confchg_fn (
+	enum totem_configuration_type configuration_type,
+	const unsigned int *member_list, size_t member_list_entries,
+	const unsigned int *left_list, size_t left_list_entries,
+	const unsigned int *joined_list, size_t joined_list_entries,
+	const struct memb_ring_id *ring_id)
+{
+}
+
+static void test_waiting_trans_ack_fn (int waiting_trans_ack)
+{
+}
+
+static void test_config_init (struct totem_config *totem_config)
+{
+	memset (totem_config, 0, sizeof (struct totem_config));
+
+	totem_config->interfaces = calloc (INTERFACE_MAX, sizeof (struct totem_interface));
+	assert (totem_config->interfaces != NULL);
+	totem_config->interfaces[0].configured = 1;
+	totemip_parse (&totem_config->interfaces[0].bindnet, "127.0.0.1", TOTEM_IP_VERSION_4);
+
+	totem_config->node_id = TEST_NODEID;
+	totem_config->transport_number = TOTEM_TRANSPORT_LOOP;
+
+	totem_config->token_timeout = 1000;
+	totem_config->token_retransmits_before_loss_const = 4;
+	totem_config->token_retransmit_timeout = 238;
+	totem_config->token_hold_timeout = 180;
+	totem_config->join_timeout = 50;
+	totem_config->consensus_timeout = 1200;
+	totem_config->merge_timeout = 200;
+	totem_config->downcheck_timeout = 1000;
+	totem_config->fail_to_recv_const = 2500;
+	totem_config->seqno_unchanged_const = 30;
+	totem_config->max_network_delay = 50;
+	totem_config->miss_count_const = 5;
+	totem_config->retransmit_ranges = 1;
+	totem_config->sort_queue_bytes = 64 * 1024 * 1024;
+	totem_config->buffer_pool_size = 16;
+	totem_config->window_size = 50;
+	totem_config->max_messages = 17;
+	totem_config->net_mtu = 1500;
+
+	totem_config->totem_logging_configuration.log_printf = test_log_printf;
+
+	totem_config->totem_memb_ring_id_create_or_load = test_ring_id_create_or_load;
+	totem_config->totem_memb_ring_id_store = test_ring_id_store;
+
+	totemsrp_net_mtu_adjust (totem_config);
+}
+
+static const struct rtr_range test_ranges[] = {
+	{ 1000, 5 }, { 1200, 1 }, { 0xfffffff0, 0x20 }
+};
+
+#define TEST_RANGES (sizeof (test_ranges) / sizeof (test_ranges[0]))
+
+static int ranges_match (
+	const struct totemsrp_instance *instance,
+	const struct rtr_range *rtr_ranges,
+	int rtr_range_entries)
+{
+	return (instance->rtr_range_entries == rtr_range_entries &&
+		memcmp (instance->rtr_ranges, rtr_ranges,
+		sizeof (struct rtr_range) * rtr_range_entries) == 0);
+}
+
+/*
+ * Token of the current ring with two rtr_list entries and test_ranges in
+ * the extension, returns its length
+ */
+static size_t token_build (
+	struct totemsrp_instance *instance,
+	char *buf)
+{
+	struct orf_token *token = (struct orf_token *)buf;
+	size_t len;
+
+	memset (buf, 0, TEST_TOKEN_SIZE);
+	token->header.magic = TOTEM_MH_MAGIC;
+	token->header.version = TOTEM_MH_VERSION;
+	token->header.type = MESSAGE_TYPE_ORF_TOKEN;
+	token->header.nodeid = TEST_NODEID + 1;
+	token->seq = instance->my_aru;
+	token->aru = instance->my_aru;
+	token->token_seq = instance->my_token_seq + 1;
+	memcpy (&token->ring_id, &instance->my_ring_id, sizeof (struct memb_ring_id));
+	token->rtr_list_entries = 2;
+	token->rtr_list[0].seq = 900;
+	memcpy (&token->rtr_list[0].ring_id, &instance->my_ring_id, sizeof (struct memb_ring_id));
+	token->rtr_list[1].seq = 901;
+	memcpy (&token->rtr_list[1].ring_id, &instance->my_ring_id, sizeof (struct memb_ring_id));
+	len = sizeof (struct orf_token) + 2 * sizeof (struct rtr_item);
+
+	memcpy (instance->rtr_ranges, test_ranges, sizeof (test_ranges));
+	instance->rtr_range_entries = TEST_RANGES;
+	len += orf_token_rtr_ranges_build (instance, buf + len);
+	instance->rtr_range_entries = 0;
+
+	return (len);
+}
+
+/*
+ * Byte swap the fields of a token built by token_build the extension parser
+ * looks at
+ */
+static void token_swab (char *buf)
+{
+	struct orf_token *token = (struct orf_token *)buf;
+	struct orf_token_rtr_ranges *rtr_ranges;
+	int i;
+
+	rtr_ranges = (struct orf_token_rtr_ranges *)(buf + sizeof (struct orf_token) +
+		token->rtr_list_entries * sizeof (struct rtr_item));
+	token->rtr_list_entries = swab32 (token->rtr_list_entries);
+	for (i = 0; i < rtr_ranges->rtr_range_entries; i++) {
+		rtr_ranges->rtr_range[i].seq = swab32 (rtr_ranges->rtr_range[i].seq);
+		rtr_ranges->rtr_range[i].count = swab32 (rtr_ranges->rtr_range[i].count);
+	}
+	rtr_ranges->magic = swab16 (rtr_ranges->magic);
+	rtr_ranges->ring_id.rep = swab32 (rtr_ranges->ring_id.rep);
+	rtr_ranges->ring_id.seq = swab64 (rtr_ranges->ring_id.seq);
+	rtr_ranges->rtr_range_entries = swab32 (rtr_ranges->rtr_range_entries);
+}
+
+static void test_rtr_ranges_parse (struct totemsrp_instance *instance)
+{
+	char buf[TEST_TOKEN_SIZE];
+	struct orf_token_rtr_ranges *rtr_ranges;
+	size_t len;
+
+	len = token_build (instance, buf);
+	orf_token_rtr_ranges_parse (instance, buf, len, 0);
+	check (ranges_match (instance, test_ranges, TEST_RANGES),
+		"retransmit ranges round trip");
+
+	len = token_build (instance, buf);
+	token_swab (buf);
+	orf_token_rtr_ranges_parse (instance, buf, len, 1);
+	check (ranges_match (instance, test_ranges, TEST_RANGES),
+		"retransmit ranges round trip with endian conversion");
+
+	len = token_build (instance, buf);
+	orf_token_rtr_ranges_parse (instance, buf, len - 1, 0);
+	check (instance->rtr_range_entries == 0,
+		"truncated retransmit ranges are ignored");
+
+	len = token_build (instance, buf);
+	rtr_ranges = (struct orf_token_rtr_ranges *)(buf + sizeof (struct orf_token) +
+		2 * sizeof (struct rtr_item));
+	rtr_ranges->rtr_range_entries = RETRANSMIT_RANGES_MAX + 1;
+	orf_token_rtr_ranges_parse (instance, buf, len, 0);
+	check (instance->rtr_range_entries == 0,
+		"too many retransmit ranges are ignored");
+
+	len = token_build (instance, buf);
+	rtr_ranges->rtr_range[1].count = 0;
+	orf_token_rtr_ranges_parse (instance, buf, len, 0);
+	check (instance->rtr_range_entries == 0,
+		"empty retransmit range is ignored");
+
+	len = token_build (instance, buf);
+	rtr_ranges->rtr_range[1].count = QUEUE_RTR_ITEMS_SIZE_MAX + 1;
+	orf_token_rtr_ranges_parse (instance, buf, len, 0);
+	check (instance->rtr_range_entries == 0,
+		"retransmit range longer than a sort queue is ignored");
+
+	/*
+	 * Ranges outside the sort queue are skipped and kept as requested
+	 */
+	{
+		struct rtr_range outside[2];
+
+		outside[0].seq = instance->regular_sort_queue.head_seqid +
+			sqb_size_get (&instance->regular_sort_queue);
+		outside[0].count = QUEUE_RTR_ITEMS_SIZE_MAX;
+		outside[1].seq = instance->regular_sort_queue.head_seqid - QUEUE_RTR_ITEMS_SIZE_MAX;
+		outside[1].count = QUEUE_RTR_ITEMS_SIZE_MAX;
+		memcpy (instance->rtr_ranges, outside, sizeof (outside));
+		instance->rtr_range_entries = 2;
+		instance->fcc_remcast_current = 0;
+		orf_token_rtr_ranges_remcast (instance, &instance->regular_sort_queue, 100);
+		check (ranges_match (instance, outside, 2) &&
+			instance->fcc_remcast_current == 0,
+			"retransmit ranges outside the sort queue are kept");
+		instance->rtr_range_entries = 0;
+	}
+
+	len = token_build (instance, buf);
+	instance->my_ring_id.seq += 4;
+	orf_token_rtr_ranges_parse (instance, buf, len, 0);
+	instance->my_ring_id.seq -= 4;
+	check (instance->rtr_range_entries == 0,
+		"retransmit ranges of another ring are ignored");
+
+	len = token_build (instance, buf);
+	instance->totem_config->retransmit_ranges = 0;
+	orf_token_rtr_ranges_parse (instance, buf, len, 0);
+	instance->totem_config->retransmit_ranges = 1;
+	check (instance->rtr_range_entries == 0,
+		"retransmit ranges are ignored when disabled");
+}
+
+/*
+ * Only a token accepted for processing may replace the retransmit ranges
+ * of the instance
+ */
+static void test_rtr_ranges_token (struct totemsrp_instance *instance)
+{
+	const struct rtr_range current = { 3000, 2 };
+	struct orf_token *token;
+	char buf[TEST_TOKEN_SIZE];
+	size_t len;
+
+	len = token_build (instance, buf);
+	instance->rtr_ranges[0] = current;
+	instance->rtr_range_entries = 1;
+	instance->orf_token_discard = 1;
+	message_handler_orf_token (instance, buf, len, 0);
+	instance->orf_token_discard = 0;
+	check (ranges_match (instance, &current, 1),
+		"discarded token keeps the retransmit ranges");
+
+	len = token_build (instance, buf);
+	token = (struct orf_token *)buf;
+	token->ring_id.seq += 4;
+	instance->rtr_ranges[0] = current;
+	instance->rtr_range_entries = 1;
+	message_handler_orf_token (instance, buf, len, 0);
+	check (ranges_match (instance, &current, 1),
+		"token of another ring keeps the retransmit ranges");
+
+	len = token_build (instance, buf);
+	token->token_seq = instance->my_token_seq;
+	instance->rtr_ranges[0] = current;
+	instance->rtr_range_entries = 1;
+	message_handler_orf_token (instance, buf, len, 0);
+	check (ranges_match (instance, &current, 1),
+		"retransmitted token keeps the retransmit ranges");
+
+	len = token_build (instance, buf);
+	instance->rtr_ranges[0] = current;
+	instance->rtr_range_entries = 1;
+	message_handler_orf_token (instance, buf, len, 0);
+	check (ranges_match (instance, test_ranges, TEST_RANGES),
+		"accepted token replaces the retransmit ranges");
+}
+
+/*
+ * A message of the old ring beyond the end of the shrunk regular sort queue
+ * must grow the queue instead of landing in the slot of another message
+ */
+static void test_recovery_to_regular (struct totemsrp_instance *instance)
+{
+	const unsigned int old_seq = QUEUE_RTR_ITEMS_SIZE_MIN + 476;
+	char recovery_msg[2 * sizeof (struct mcast)];
+	char regular_msg[sizeof (struct mcast)];
+	struct sort_queue_item item;
+	struct sort_queue_item *added;
+	struct mcast *mcast;
+	void *ptr;
+
+	memset (recovery_msg, 0, sizeof (recovery_msg));
+	mcast = (struct mcast *)recovery_msg;
+	mcast->header.encapsulated = MESSAGE_ENCAPSULATED;
+	mcast = (struct mcast *)(recovery_msg + sizeof (struct mcast));
+	memcpy (&mcast->ring_id, &instance->my_old_ring_id, sizeof (struct memb_ring_id));
+	mcast->seq = old_seq;
+
+	memset (&item, 0, sizeof (item));
+	item.mcast = (struct mcast *)recovery_msg;
+	item.msg_len = sizeof (recovery_msg);
+	sqb_item_add (&instance->recovery_sort_queue, &item, SEQNO_START_MSG + 1);
+
+	memset (regular_msg, 0, sizeof (regular_msg));
+	item.mcast = (struct mcast *)regular_msg;
+	item.msg_len = sizeof (regular_msg);
+	sqb_item_add (&instance->regular_sort_queue, &item,
+		old_seq - QUEUE_RTR_ITEMS_SIZE_MIN);
+
+	instance->my_aru = SEQNO_START_MSG + 1;
+	instance->old_ring_state_high_seq_received = SEQNO_START_MSG;
+	deliver_messages_from_recovery_to_regular (instance);
+
+	check (sqb_size_get (&instance->regular_sort_queue) > QUEUE_RTR_ITEMS_SIZE_MIN &&
+		sqb_item_inuse (&instance->regular_sort_queue, old_seq),
+		"old ring message grows the regular sort queue");
+	sqb_item_get (&instance->regular_sort_queue,
+		old_seq - QUEUE_RTR_ITEMS_SIZE_MIN, &ptr);
+	added = ptr;
+	check (added->mcast == (struct mcast *)regular_msg,
+		"old ring message keeps the other messages");
+	check (instance->old_ring_state_high_seq_received == old_seq,
+		"old ring message raises the highest seq received");
+
+	sqb_reinit (&instance->regular_sort_queue, SEQNO_START_MSG);
+	sqb_reinit (&instance->recovery_sort_queue, SEQNO_START_MSG);
+}
+
+/*
+ * While the rep holds the token of an idle ring for longer and longer, the
+ * token timeout of every processor must cover the hold of the rotation it
+ * waits for
+ */
+static void test_token_hold_idle (struct totemsrp_instance *instance)
+{
+	struct totem_config *totem_config = instance->totem_config;
+	enum memb_state memb_state = instance->memb_state;
+	unsigned int timeout;
+	unsigned int hold_next;
+	unsigned int rotations;
+	int covered = 1;
+
+	totem_config->token_hold_idle_max = 60000;
+	instance->memb_state = MEMB_STATE_OPERATIONAL;
+	for (rotations = 0; rotations < totem_config->seqno_unchanged_const + 64; rotations++) {
+		instance->token_idle_rotations = rotations;
+		timeout = token_timeout_get (instance) + token_hold_idle_extra_get (instance);
+		hold_next = token_hold_idle_rotation_get (instance, rotations + 1);
+		if (timeout <= hold_next + totem_config->token_hold_timeout) {
+			covered = 0;
+		}
+	}
+	check (covered, "token timeout covers the next idle hold");
+	check (token_hold_idle_get (instance) == totem_config->token_hold_idle_max,
+		"idle hold grows up to token_hold_idle_max");
+
+	instance->token_idle_rotations = 0;
+	instance->memb_state = memb_state;
+	totem_config->token_hold_idle_max = 0;
+}
+
+int main (void)
+{
+	struct totem_config totem_config;
+	totempg_stats_t stats;
+	struct totemsrp_instance *instance;
+	qb_loop_t *loop;
+	void *srp_context;
+
+	loop = qb_loop_create ();
+	assert (loop != NULL);
+
+	test_config_init (&totem_config);
+	memset (&stats, 0, sizeof (stats));
+	if (totemsrp_initialize (loop, &srp_context, &totem_config, &stats,
+		test_deliver_fn, test_confchg_fn, test_waiting_trans_ack_fn) == -1) {
+		fprintf (stderr, "cannot initialize totemsrp\n");
+		return (1);
+	}
+	instance = (struct totemsrp_instance *)srp_context;
+	instance->my_ring_id.rep = TEST_NODEID;
+	instance->my_ring_id.seq = 4;
+
+	test_rtr_ranges_parse (instance);
+	test_rtr_ranges_token (instance);
+	test_recovery_to_regular (instance);
+	test_token_hold_idle (instance);
+
+	totemsrp_finalize (srp_context);
+	qb_loop_destroy (loop);
+	free (totem_config.interfaces);
+
+	return (failures ? 1 : 0);
+}
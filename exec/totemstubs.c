@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Hooks of the daemon which the totem objects call, for the programs that
+ * run totemsrp without the daemon, totempg and the configuration map
+ */
+
+#include <config.h>
+
+#include <stdint.h>
+
+#include <corosync/icmap.h>
+
+#include "totemconfig.h"
+#include "main.h"
+
+void stats_knet_add_member (knet_node_id_t nodeid, uint8_t link);
+
+void stats_knet_del_member (knet_node_id_t nodeid, uint8_t link);
+
+void stats_knet_add_handle (void);
+
+int totemconfig_commit_new_params (
+	struct totem_config *totem_config,
+	icmap_map_t map)
+{
+	return (0);
+}
+
+const char *corosync_get_config_file (void)
+{
+	return ("");
+}
+
+void stats_knet_add_member (knet_node_id_t nodeid, uint8_t link)
+{
+}
+
+void stats_knet_del_member (knet_node_id_t nodeid, uint8_t link)
+{
+}
+
+void stats_knet_add_handle (void)
+{
+}
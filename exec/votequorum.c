@@ -1686,7 +1686,7 @@ static int votequorum_exec_send_reconfigure(uint8_t param, unsigned int nodeid,
 	iov[0].iov_base = (void *)&req_exec_quorum_reconfigure;
 	iov[0].iov_len = sizeof(req_exec_quorum_reconfigure);
 
-	ret = corosync_api->totem_mcast (iov, 1, TOTEM_AGREED);
+	ret = corosync_api->totem_mcast (iov, 1, TOTEM_AGREED | TOTEM_PRIORITY_HIGH);
 
 	LEAVE();
 	return ret;
@@ -1721,7 +1721,7 @@ static int votequorum_exec_send_nodeinfo(uint32_t nodeid)
 	iov[0].iov_base = (void *)&req_exec_quorum_nodeinfo;
 	iov[0].iov_len = sizeof(req_exec_quorum_nodeinfo);
 
-	ret = corosync_api->totem_mcast (iov, 1, TOTEM_AGREED);
+	ret = corosync_api->totem_mcast (iov, 1, TOTEM_AGREED | TOTEM_PRIORITY_HIGH);
 
 	LEAVE();
 	return ret;
@@ -1747,7 +1747,7 @@ static int votequorum_exec_send_qdevice_reconfigure(const char *oldname, const c
 	iov[0].iov_base = (void *)&req_exec_quorum_qdevice_reconfigure;
 	iov[0].iov_len = sizeof(req_exec_quorum_qdevice_reconfigure);
 
-	ret = corosync_api->totem_mcast (iov, 1, TOTEM_AGREED);
+	ret = corosync_api->totem_mcast (iov, 1, TOTEM_AGREED | TOTEM_PRIORITY_HIGH);
 
 	LEAVE();
 	return ret;
@@ -1771,7 +1771,7 @@ static int votequorum_exec_send_qdevice_reg(uint32_t operation, const char *qdev
 	iov[0].iov_base = (void *)&req_exec_quorum_qdevice_reg;
 	iov[0].iov_len = sizeof(req_exec_quorum_qdevice_reg);
 
-	ret = corosync_api->totem_mcast (iov, 1, TOTEM_AGREED);
+	ret = corosync_api->totem_mcast (iov, 1, TOTEM_AGREED | TOTEM_PRIORITY_HIGH);
 
 	LEAVE();
 	return ret;
@@ -43,6 +43,7 @@
 #include <corosync/hdb.h>
 #include <qb/qbloop.h>
 #include <corosync/swab.h>
+#include <corosync/totem/totemmcast.h>
 
 /**
  * @brief The mar_message_source_t struct
@@ -101,6 +102,10 @@ struct corosync_tpg_group {
 
 #define TOTEM_AGREED	0
 #define TOTEM_SAFE	1
+/*
+ * May be or'ed into the guarantee to send ahead of bulk traffic
+ */
+#define TOTEM_PRIORITY_HIGH	TOTEM_MCAST_PRIORITY_HIGH
 
 #define MILLI_2_NANO_SECONDS 1000000ULL
 
@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef NODESET_H_DEFINED
+#define NODESET_H_DEFINED
+
+/*
+ * Compact node sets
+ *
+ * Node ids are sparse 32 bit values, so they are first mapped to a small
+ * dense index by struct nodeset_index.  The index keeps the node id of every
+ * index (in order of insertion, so indexes never move) and a sorted array of
+ * node ids with their indexes used for lookup by binary search.  A nodeset is
+ * then a bitmap keyed by that index, which makes membership tests O(1) and
+ * set algebra (subset, equality, difference) a handful of word operations.
+ *
+ * All sets used together must be keyed by the same index.  The index only
+ * grows, users rebuild it from their live sets when it fills up.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#define NODESET_INDEX_MAX	1536
+#define NODESET_BITS_PER_WORD	64
+#define NODESET_WORDS		(NODESET_INDEX_MAX / NODESET_BITS_PER_WORD)
+
+/**
+ * @brief The nodeset_index struct
+ */
+struct nodeset_index {
+	unsigned int nodeid[NODESET_INDEX_MAX];
+	unsigned int sorted_nodeid[NODESET_INDEX_MAX];
+	unsigned short sorted[NODESET_INDEX_MAX];
+	unsigned int entries;
+};
+
+/**
+ * @brief The nodeset struct
+ */
+struct nodeset {
+	uint64_t bits[NODESET_WORDS];
+	unsigned int count;
+};
+
+/**
+ * @brief nodeset_index_init
+ * @param ni
+ */
+static inline void nodeset_index_init (struct nodeset_index *ni)
+{
+	ni->entries = 0;
+}
+
+/**
+ * @brief nodeset_index_position - position of nodeid in the sorted array
+ * @param ni
+ * @param nodeid
+ * @return first position with node id not lower than nodeid
+ */
+static inline unsigned int nodeset_index_position (
+	const struct nodeset_index *ni,
+	unsigned int nodeid)
+{
+	const unsigned int *base = ni->sorted_nodeid;
+	unsigned int entries = ni->entries;
+	unsigned int half;
+
+	if (entries == 0) {
+		return (0);
+	}
+
+	/*
+	 * Branch free lower bound, the compiler turns the step into a cmov
+	 */
+	while (entries > 1) {
+		half = entries / 2;
+		base = (base[half] < nodeid) ? base + half : base;
+		entries -= half;
+	}
+	return ((base - ni->sorted_nodeid) + (*base < nodeid));
+}
+
+/**
+ * @brief nodeset_index_lookup
+ * @param ni
+ * @param nodeid
+ * @return index of nodeid or -1 if nodeid is not indexed
+ */
+static inline int nodeset_index_lookup (
+	const struct nodeset_index *ni,
+	unsigned int nodeid)
+{
+	unsigned int position;
+
+	position = nodeset_index_position (ni, nodeid);
+	if (position < ni->entries &&
+	    ni->sorted_nodeid[position] == nodeid) {
+		return (ni->sorted[position]);
+	}
+	return (-1);
+}
+
+/**
+ * @brief nodeset_index_add - index nodeid if it is not indexed yet
+ * @param ni
+ * @param nodeid
+ * @return index of nodeid or -1 if the index is full
+ */
+static inline int nodeset_index_add (
+	struct nodeset_index *ni,
+	unsigned int nodeid)
+{
+	unsigned int position;
+	unsigned int new_index;
+
+	position = nodeset_index_position (ni, nodeid);
+	if (position < ni->entries &&
+	    ni->sorted_nodeid[position] == nodeid) {
+		return (ni->sorted[position]);
+	}
+	if (ni->entries == NODESET_INDEX_MAX) {
+		return (-1);
+	}
+
+	new_index = ni->entries;
+	ni->nodeid[new_index] = nodeid;
+	memmove (&ni->sorted_nodeid[position + 1], &ni->sorted_nodeid[position],
+		(ni->entries - position) * sizeof (ni->sorted_nodeid[0]));
+	memmove (&ni->sorted[position + 1], &ni->sorted[position],
+		(ni->entries - position) * sizeof (ni->sorted[0]));
+	ni->sorted_nodeid[position] = nodeid;
+	ni->sorted[position] = new_index;
+	ni->entries++;
+
+	return (new_index);
+}
+
+/**
+ * @brief nodeset_index_free_entries
+ * @param ni
+ * @return number of node ids which can still be indexed
+ */
+static inline unsigned int nodeset_index_free_entries (
+	const struct nodeset_index *ni)
+{
+	return (NODESET_INDEX_MAX - ni->entries);
+}
+
+/**
+ * @brief nodeset_clear
+ * @param set
+ */
+static inline void nodeset_clear (struct nodeset *set)
+{
+	memset (set, 0, sizeof (struct nodeset));
+}
+
+/**
+ * @brief nodeset_isset
+ * @param set
+ * @param idx index of the node, negative values are never set
+ * @return
+ */
+static inline int nodeset_isset (
+	const struct nodeset *set,
+	int idx)
+{
+	if (idx < 0 || idx >= NODESET_INDEX_MAX) {
+		return (0);
+	}
+	return ((set->bits[idx / NODESET_BITS_PER_WORD] >>
+		(idx % NODESET_BITS_PER_WORD)) & 1);
+}
+
+/**
+ * @brief nodeset_set
+ * @param set
+ * @param idx
+ * @return 1 if the node was added, 0 if it already was in the set or idx is
+ * out of range
+ */
+static inline int nodeset_set (
+	struct nodeset *set,
+	int idx)
+{
+	if (idx < 0 || idx >= NODESET_INDEX_MAX || nodeset_isset (set, idx)) {
+		return (0);
+	}
+	set->bits[idx / NODESET_BITS_PER_WORD] |=
+		(uint64_t)1 << (idx % NODESET_BITS_PER_WORD);
+	set->count++;
+	return (1);
+}
+
+/**
+ * @brief nodeset_unset
+ * @param set
+ * @param idx
+ */
+static inline void nodeset_unset (
+	struct nodeset *set,
+	int idx)
+{
+	if (idx < 0 || idx >= NODESET_INDEX_MAX || nodeset_isset (set, idx) == 0) {
+		return;
+	}
+	set->bits[idx / NODESET_BITS_PER_WORD] &=
+		~((uint64_t)1 << (idx % NODESET_BITS_PER_WORD));
+	set->count--;
+}
+
+/**
+ * @brief nodeset_subset
+ * @param subset
+ * @param fullset
+ * @return 1 if every node of subset is in fullset
+ */
+static inline int nodeset_subset (
+	const struct nodeset *subset,
+	const struct nodeset *fullset)
+{
+	unsigned int i;
+
+	if (subset->count > fullset->count) {
+		return (0);
+	}
+	for (i = 0; i < NODESET_WORDS; i++) {
+		if (subset->bits[i] & ~fullset->bits[i]) {
+			return (0);
+		}
+	}
+	return (1);
+}
+
+/**
+ * @brief nodeset_equal
+ * @param set1
+ * @param set2
+ * @return
+ */
+static inline int nodeset_equal (
+	const struct nodeset *set1,
+	const struct nodeset *set2)
+{
+	if (set1->count != set2->count) {
+		return (0);
+	}
+	return (memcmp (set1->bits, set2->bits, sizeof (set1->bits)) == 0);
+}
+
+/**
+ * @brief nodeset_subtract - out = one minus two
+ * @param out may be the same as one or two
+ * @param one
+ * @param two
+ */
+static inline void nodeset_subtract (
+	struct nodeset *out,
+	const struct nodeset *one,
+	const struct nodeset *two)
+{
+	unsigned int i;
+
+	out->count = 0;
+	for (i = 0; i < NODESET_WORDS; i++) {
+		out->bits[i] = one->bits[i] & ~two->bits[i];
+		out->count += __builtin_popcountll (out->bits[i]);
+	}
+}
+
+/**
+ * @brief nodeset_next - iterate over the nodes of a set
+ * @param set
+ * @param idx first index to consider
+ * @return lowest index not lower than idx which is in the set or -1
+ */
+static inline int nodeset_next (
+	const struct nodeset *set,
+	int idx)
+{
+	unsigned int word;
+	uint64_t bits;
+
+	if (idx < 0) {
+		idx = 0;
+	}
+	if (idx >= NODESET_INDEX_MAX) {
+		return (-1);
+	}
+	word = idx / NODESET_BITS_PER_WORD;
+	bits = set->bits[word] & (~(uint64_t)0 << (idx % NODESET_BITS_PER_WORD));
+	while (bits == 0) {
+		if (++word == NODESET_WORDS) {
+			return (-1);
+		}
+		bits = set->bits[word];
+	}
+	return (word * NODESET_BITS_PER_WORD + __builtin_ctzll (bits));
+}
+
+#endif /* NODESET_H_DEFINED */
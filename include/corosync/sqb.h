@@ -0,0 +1,632 @@
+/*
+ * Copyright (c) 2003-2004 MontaVista Software, Inc.
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef SORTQUEUE_BITMAP_H_DEFINED
+#define SORTQUEUE_BITMAP_H_DEFINED
+
+/*
+ * Bitmap backed sort queue
+ *
+ * Same semantics as struct sq (see sq.h) but the ring is always a power of
+ * two in size and the in-use state of every slot is kept in a dense bitmap.
+ * This allows the hot paths of totemsrp (aru calculation, retransmit list
+ * generation and delivery) to skip over runs of received or missing
+ * messages one 64 bit word at a time instead of probing every seqid.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <corosync/sq.h>
+
+#define SQB_BITS_PER_WORD	64
+
+/**
+ * @brief The sqb struct
+ */
+struct sqb {
+	unsigned int head;
+	unsigned int size;
+	unsigned int mask;
+	void *items;
+	uint64_t *items_inuse;
+	unsigned int *items_miss_count;
+	unsigned int size_per_item;
+	unsigned int head_seqid;
+	unsigned int item_count;
+};
+
+/**
+ * @brief sqb_words - number of bitmap words needed for the whole ring
+ * @param sqb
+ * @return
+ */
+static inline unsigned int sqb_words (const struct sqb *sqb)
+{
+	return (sqb->size / SQB_BITS_PER_WORD);
+}
+
+/**
+ * @brief sqb_seqid_position - ring position of seq_id
+ * @param sqb
+ * @param seq_id
+ * @return
+ */
+static inline unsigned int sqb_seqid_position (
+	const struct sqb *sqb,
+	unsigned int seq_id)
+{
+	/*
+	 * size divides 2^32 so unsigned wrap of the seqid space is harmless
+	 */
+	return ((sqb->head + (seq_id - sqb->head_seqid)) & sqb->mask);
+}
+
+/**
+ * @brief sqb_init
+ * @param sqb
+ * @param item_count minimal number of items, rounded up to a power of two
+ * @param size_per_item
+ * @param head_seqid
+ * @return
+ */
+static inline int sqb_init (
+	struct sqb *sqb,
+	int item_count,
+	int size_per_item,
+	int head_seqid)
+{
+	unsigned int size;
+
+	size = SQB_BITS_PER_WORD;
+	while (size < (unsigned int)item_count) {
+		size <<= 1;
+	}
+
+	sqb->head = 0;
+	sqb->size = size;
+	sqb->mask = size - 1;
+	sqb->size_per_item = size_per_item;
+	sqb->head_seqid = head_seqid;
+	sqb->item_count = size;
+	sqb->items_inuse = NULL;
+	sqb->items_miss_count = NULL;
+
+	sqb->items = malloc (size * size_per_item);
+	if (sqb->items == NULL) {
+		return (-ENOMEM);
+	}
+	memset (sqb->items, 0, size * size_per_item);
+
+	if ((sqb->items_inuse = malloc (sqb_words (sqb) * sizeof (uint64_t)))
+	    == NULL) {
+		return (-ENOMEM);
+	}
+	if ((sqb->items_miss_count = malloc (size * sizeof (unsigned int)))
+	    == NULL) {
+		return (-ENOMEM);
+	}
+	memset (sqb->items_inuse, 0, sqb_words (sqb) * sizeof (uint64_t));
+	memset (sqb->items_miss_count, 0, size * sizeof (unsigned int));
+	return (0);
+}
+
+/**
+ * @brief sqb_reinit
+ * @param sqb
+ * @param head_seqid
+ */
+static inline void sqb_reinit (struct sqb *sqb, unsigned int head_seqid)
+{
+	sqb->head = 0;
+	sqb->head_seqid = head_seqid;
+
+	memset (sqb->items, 0, sqb->item_count * sqb->size_per_item);
+	memset (sqb->items_inuse, 0, sqb_words (sqb) * sizeof (uint64_t));
+	memset (sqb->items_miss_count, 0, sqb->item_count * sizeof (unsigned int));
+}
+
+/**
+ * @brief sqb_copy
+ * @param sqb_dest resized to the size of sqb_src if needed
+ * @param sqb_src
+ * @return
+ */
+static inline int sqb_copy (struct sqb *sqb_dest, const struct sqb *sqb_src)
+{
+	void *items;
+	uint64_t *items_inuse;
+	unsigned int *items_miss_count;
+
+	if (sqb_dest->size != sqb_src->size) {
+		items = malloc (sqb_src->size * sqb_src->size_per_item);
+		items_inuse = malloc (sqb_words (sqb_src) * sizeof (uint64_t));
+		items_miss_count = malloc (sqb_src->size * sizeof (unsigned int));
+		if (items == NULL || items_inuse == NULL || items_miss_count == NULL) {
+			free (items);
+			free (items_inuse);
+			free (items_miss_count);
+			return (-ENOMEM);
+		}
+		free (sqb_dest->items);
+		free (sqb_dest->items_inuse);
+		free (sqb_dest->items_miss_count);
+		sqb_dest->items = items;
+		sqb_dest->items_inuse = items_inuse;
+		sqb_dest->items_miss_count = items_miss_count;
+		sqb_dest->size = sqb_src->size;
+		sqb_dest->mask = sqb_src->mask;
+		sqb_dest->item_count = sqb_src->item_count;
+	}
+
+	sqb_dest->head = sqb_src->head;
+	sqb_dest->size_per_item = sqb_src->size_per_item;
+	sqb_dest->head_seqid = sqb_src->head_seqid;
+	memcpy (sqb_dest->items, sqb_src->items,
+		sqb_src->item_count * sqb_src->size_per_item);
+	memcpy (sqb_dest->items_inuse, sqb_src->items_inuse,
+		sqb_words (sqb_src) * sizeof (uint64_t));
+	memcpy (sqb_dest->items_miss_count, sqb_src->items_miss_count,
+		sqb_src->item_count * sizeof (unsigned int));
+	return (0);
+}
+
+/**
+ * @brief sqb_free
+ * @param sqb
+ */
+static inline void sqb_free (struct sqb *sqb) {
+	free (sqb->items);
+	free (sqb->items_inuse);
+	free (sqb->items_miss_count);
+}
+
+/**
+ * @brief sqb_bit_isset
+ * @param sqb
+ * @param sqb_position
+ * @return
+ */
+static inline int sqb_bit_isset (
+	const struct sqb *sqb,
+	unsigned int sqb_position)
+{
+	return ((sqb->items_inuse[sqb_position / SQB_BITS_PER_WORD] >>
+		(sqb_position % SQB_BITS_PER_WORD)) & 1);
+}
+
+/**
+ * @brief sqb_item_add
+ * @param sqb
+ * @param item
+ * @param seqid
+ * @return
+ */
+static inline void *sqb_item_add (
+	struct sqb *sqb,
+	void *item,
+	unsigned int seqid)
+{
+	char *sqb_item;
+	unsigned int sqb_position;
+
+	sqb_position = sqb_seqid_position (sqb, seqid);
+
+	sqb_item = sqb->items;
+	sqb_item += sqb_position * sqb->size_per_item;
+	assert (sqb_bit_isset (sqb, sqb_position) == 0);
+	memcpy (sqb_item, item, sqb->size_per_item);
+	sqb->items_inuse[sqb_position / SQB_BITS_PER_WORD] |=
+		(uint64_t)1 << (sqb_position % SQB_BITS_PER_WORD);
+	sqb->items_miss_count[sqb_position] = 0;
+
+	return (sqb_item);
+}
+
+/**
+ * @brief sqb_item_inuse
+ * @param sqb
+ * @param seq_id
+ * @return
+ */
+static inline unsigned int sqb_item_inuse (
+	const struct sqb *sqb,
+	unsigned int seq_id)
+{
+	return (sqb_bit_isset (sqb, sqb_seqid_position (sqb, seq_id)));
+}
+
+/**
+ * @brief sqb_item_miss_count
+ * @param sqb
+ * @param seq_id
+ * @return
+ */
+static inline unsigned int sqb_item_miss_count (
+	const struct sqb *sqb,
+	unsigned int seq_id)
+{
+	unsigned int sqb_position;
+
+	sqb_position = sqb_seqid_position (sqb, seq_id);
+	sqb->items_miss_count[sqb_position]++;
+	return (sqb->items_miss_count[sqb_position]);
+}
+
+/**
+ * @brief sqb_item_miss_count_get - miss count of seq_id without counting
+ * @param sqb
+ * @param seq_id
+ * @return
+ */
+static inline unsigned int sqb_item_miss_count_get (
+	const struct sqb *sqb,
+	unsigned int seq_id)
+{
+	return (sqb->items_miss_count[sqb_seqid_position (sqb, seq_id)]);
+}
+
+/**
+ * @brief sqb_size_get
+ * @param sqb
+ * @return
+ */
+static inline unsigned int sqb_size_get (
+	const struct sqb *sqb)
+{
+	return sqb->size;
+}
+
+/**
+ * @brief sqb_in_range
+ * @param sqb
+ * @param seq_id
+ * @return
+ */
+static inline unsigned int sqb_in_range (
+	const struct sqb *sqb,
+	unsigned int seq_id)
+{
+	return ((seq_id - sqb->head_seqid) < sqb->size);
+}
+
+/**
+ * @brief sqb_item_get
+ * @param sqb
+ * @param seq_id
+ * @param sqb_item_out
+ * @return
+ */
+static inline unsigned int sqb_item_get (
+	const struct sqb *sqb,
+	unsigned int seq_id,
+	void **sqb_item_out)
+{
+	char *sqb_item;
+	unsigned int sqb_position;
+
+	if (seq_id > ADJUST_ROLLOVER_POINT) {
+		assert ((seq_id - ADJUST_ROLLOVER_POINT) <
+			((sqb->head_seqid - ADJUST_ROLLOVER_POINT) + sqb->size));
+	} else {
+		assert (seq_id < (sqb->head_seqid + sqb->size));
+	}
+	sqb_position = sqb_seqid_position (sqb, seq_id);
+
+	if (sqb_bit_isset (sqb, sqb_position) == 0) {
+		return (ENOENT);
+	}
+	sqb_item = sqb->items;
+	sqb_item += sqb_position * sqb->size_per_item;
+	*sqb_item_out = sqb_item;
+	return (0);
+}
+
+/**
+ * @brief sqb_run_length - length of a run of slots with the same in-use state
+ * @param sqb
+ * @param seq_id first seqid of the run
+ * @param count maximum number of seqids to examine
+ * @param inuse 1 to count present items, 0 to count holes
+ * @return number of consecutive seqids starting at seq_id whose in-use
+ *	state equals inuse.  Never extends past the end of the queue.
+ */
+static inline unsigned int sqb_run_length (
+	const struct sqb *sqb,
+	unsigned int seq_id,
+	unsigned int count,
+	int inuse)
+{
+	unsigned int sqb_position;
+	unsigned int bit;
+	unsigned int avail;
+	unsigned int found;
+	unsigned int run = 0;
+	uint64_t word;
+
+	if (sqb_in_range (sqb, seq_id) == 0) {
+		return (0);
+	}
+	if (count > sqb->size - (seq_id - sqb->head_seqid)) {
+		count = sqb->size - (seq_id - sqb->head_seqid);
+	}
+
+	sqb_position = sqb_seqid_position (sqb, seq_id);
+	while (run < count) {
+		bit = sqb_position % SQB_BITS_PER_WORD;
+		avail = SQB_BITS_PER_WORD - bit;
+
+		word = sqb->items_inuse[sqb_position / SQB_BITS_PER_WORD];
+		if (inuse == 0) {
+			word = ~word;
+		}
+		/*
+		 * Bits shifted in from the top are zero and therefore end
+		 * the run, which is what we want as they belong to the next
+		 * word anyway.
+		 */
+		word = ~(word >> bit);
+		if (word == 0) {
+			found = SQB_BITS_PER_WORD;
+		} else {
+			found = __builtin_ctzll (word);
+		}
+
+		if (found >= count - run) {
+			return (count);
+		}
+		run += found;
+		if (found < avail) {
+			break;
+		}
+		sqb_position = (sqb_position + avail) & sqb->mask;
+	}
+	return (run);
+}
+
+/**
+ * @brief sqb_items_contiguous - number of items present starting at seq_id
+ * @param sqb
+ * @param seq_id
+ * @param count
+ * @return
+ */
+static inline unsigned int sqb_items_contiguous (
+	const struct sqb *sqb,
+	unsigned int seq_id,
+	unsigned int count)
+{
+	return (sqb_run_length (sqb, seq_id, count, 1));
+}
+
+/**
+ * @brief sqb_items_missing - number of holes starting at seq_id
+ * @param sqb
+ * @param seq_id
+ * @param count
+ * @return
+ */
+static inline unsigned int sqb_items_missing (
+	const struct sqb *sqb,
+	unsigned int seq_id,
+	unsigned int count)
+{
+	return (sqb_run_length (sqb, seq_id, count, 0));
+}
+
+/**
+ * @brief sqb_bits_clear - clear count in-use bits starting at sqb_position
+ * @param sqb
+ * @param sqb_position
+ * @param count
+ */
+static inline void sqb_bits_clear (
+	struct sqb *sqb,
+	unsigned int sqb_position,
+	unsigned int count)
+{
+	unsigned int bit;
+	unsigned int chunk;
+	uint64_t mask;
+
+	while (count) {
+		bit = sqb_position % SQB_BITS_PER_WORD;
+		chunk = SQB_BITS_PER_WORD - bit;
+		if (chunk > count) {
+			chunk = count;
+		}
+		if (chunk == SQB_BITS_PER_WORD) {
+			mask = ~(uint64_t)0;
+		} else {
+			mask = (((uint64_t)1 << chunk) - 1) << bit;
+		}
+		sqb->items_inuse[sqb_position / SQB_BITS_PER_WORD] &= ~mask;
+
+		count -= chunk;
+		sqb_position = (sqb_position + chunk) & sqb->mask;
+	}
+}
+
+/**
+ * @brief sqb_items_release - release all items up to and including seqid
+ * @param sqb
+ * @param seqid
+ */
+static inline void sqb_items_release (struct sqb *sqb, unsigned int seqid)
+{
+	unsigned int oldhead;
+	unsigned int count;
+
+	oldhead = sqb->head;
+	count = seqid - sqb->head_seqid + 1;
+	if (count > sqb->size) {
+		count = sqb->size;
+	}
+
+	sqb_bits_clear (sqb, oldhead, count);
+	if (oldhead + count > sqb->size) {
+		memset (&sqb->items_miss_count[oldhead], 0,
+			(sqb->size - oldhead) * sizeof (unsigned int));
+		memset (sqb->items_miss_count, 0,
+			(oldhead + count - sqb->size) * sizeof (unsigned int));
+	} else {
+		memset (&sqb->items_miss_count[oldhead], 0,
+			count * sizeof (unsigned int));
+	}
+
+	sqb->head = (oldhead + count) & sqb->mask;
+	sqb->head_seqid = seqid + 1;
+}
+
+/**
+ * @brief sqb_resize - move the queue to a ring of a different size
+ * @param sqb
+ * @param size new size, a power of two not lower than SQB_BITS_PER_WORD.
+ *	When shrinking, no item may be present past the new size.
+ * @return
+ *
+ * Items keep their seqid, the head of the new ring is at position zero.
+ */
+static inline int sqb_resize (struct sqb *sqb, unsigned int size)
+{
+	char *items;
+	uint64_t *items_inuse;
+	unsigned int *items_miss_count;
+	unsigned int old_position;
+	unsigned int i;
+
+	items = malloc (size * sqb->size_per_item);
+	items_inuse = malloc (size / SQB_BITS_PER_WORD * sizeof (uint64_t));
+	items_miss_count = malloc (size * sizeof (unsigned int));
+	if (items == NULL || items_inuse == NULL || items_miss_count == NULL) {
+		free (items);
+		free (items_inuse);
+		free (items_miss_count);
+		return (-ENOMEM);
+	}
+	memset (items, 0, size * sqb->size_per_item);
+	memset (items_inuse, 0, size / SQB_BITS_PER_WORD * sizeof (uint64_t));
+	memset (items_miss_count, 0, size * sizeof (unsigned int));
+
+	for (i = 0; i < sqb->size; i++) {
+		old_position = (sqb->head + i) & sqb->mask;
+		if (i >= size) {
+			assert (sqb_bit_isset (sqb, old_position) == 0);
+			continue;
+		}
+		items_miss_count[i] = sqb->items_miss_count[old_position];
+		if (sqb_bit_isset (sqb, old_position) == 0) {
+			continue;
+		}
+		memcpy (items + i * sqb->size_per_item,
+			(char *)sqb->items + old_position * sqb->size_per_item,
+			sqb->size_per_item);
+		items_inuse[i / SQB_BITS_PER_WORD] |=
+			(uint64_t)1 << (i % SQB_BITS_PER_WORD);
+	}
+
+	free (sqb->items);
+	free (sqb->items_inuse);
+	free (sqb->items_miss_count);
+	sqb->items = items;
+	sqb->items_inuse = items_inuse;
+	sqb->items_miss_count = items_miss_count;
+	sqb->head = 0;
+	sqb->size = size;
+	sqb->mask = size - 1;
+	sqb->item_count = size;
+	return (0);
+}
+
+/**
+ * @brief sqb_grow - grow the ring until seq_id is in range
+ * @param sqb
+ * @param seq_id
+ * @param size_max the ring never grows past this size
+ * @return 0 if seq_id is in range, -ERANGE if it would need a ring larger
+ *	than size_max or -ENOMEM
+ */
+static inline int sqb_grow (
+	struct sqb *sqb,
+	unsigned int seq_id,
+	unsigned int size_max)
+{
+	unsigned int size;
+
+	if (sqb_in_range (sqb, seq_id)) {
+		return (0);
+	}
+	size = sqb->size;
+	while (size < size_max && (seq_id - sqb->head_seqid) >= size) {
+		size <<= 1;
+	}
+	if ((seq_id - sqb->head_seqid) >= size) {
+		return (-ERANGE);
+	}
+	return (sqb_resize (sqb, size));
+}
+
+/**
+ * @brief sqb_shrink - halve the ring while it is mostly unused
+ * @param sqb
+ * @param seq_id highest seqid that may still be added
+ * @param size_min the ring never shrinks below this size
+ * @return
+ *
+ * The ring is only halved while the range up to seq_id fits in a quarter of
+ * it, so alternating sqb_grow and sqb_shrink calls do not thrash.
+ */
+static inline int sqb_shrink (
+	struct sqb *sqb,
+	unsigned int seq_id,
+	unsigned int size_min)
+{
+	unsigned int size;
+	unsigned int range;
+
+	range = seq_id - sqb->head_seqid + 1;
+	if (range > sqb->size) {
+		return (0);
+	}
+	size = sqb->size;
+	while (size / 2 >= size_min && size / 2 >= SQB_BITS_PER_WORD &&
+	    range <= size / 4) {
+		size >>= 1;
+	}
+	if (size == sqb->size) {
+		return (0);
+	}
+	return (sqb_resize (sqb, size));
+}
+
+#endif /* SORTQUEUE_BITMAP_H_DEFINED */
@@ -38,6 +38,7 @@
 #include <libknet.h>
 #include <corosync/hdb.h>
 #include <corosync/totem/totemstats.h>
+#include <corosync/totem/totemmcast.h>
 
 #ifdef HAVE_SMALL_MEMORY_FOOTPRINT
 #define PROCESSOR_COUNT_MAX	16
@@ -51,6 +52,13 @@
 
 #define FRAME_SIZE_MAX		KNET_MAX_PACKET_SIZE
 
+#define TOTEM_MCAST_GUARANTEE_MASK	0xff
+
+/*
+ * Largest number of multicasts covered by one parity message
+ */
+#define FEC_GROUP_SIZE_MAX	64
+
 #define CONFIG_STRING_LEN_MAX   128
 /*
  * Estimation of required buffer size for totemudp and totemudpu - it should be at least
@@ -142,7 +150,8 @@ enum { TOTEM_LINK_MODE_BYTES = 64 };
 typedef enum {
 	TOTEM_TRANSPORT_UDP = 0,
 	TOTEM_TRANSPORT_UDPU = 1,
-	TOTEM_TRANSPORT_KNET = 2
+	TOTEM_TRANSPORT_KNET = 2,
+	TOTEM_TRANSPORT_LOOP = 3	/* in-process only, not selectable in corosync.conf */
 } totem_transport_t;
 
 #define MEMB_RING_ID
@@ -183,6 +192,12 @@ struct totem_config {
 
 	unsigned int token_warning;
 
+	unsigned int token_coefficient;
+
+	unsigned int token_adaptive;
+
+	unsigned int token_phi_threshold;
+
 	unsigned int token_retransmit_timeout;
 
 	unsigned int token_hold_timeout;
@@ -219,6 +234,12 @@ struct totem_config {
 
 	unsigned int max_messages;
 
+	unsigned int window_size_adaptive;
+
+	unsigned int window_size_min;
+
+	unsigned int window_size_max;
+
 	unsigned int broadcast_use;
 
 	char crypto_model[CONFIG_STRING_LEN_MAX];
@@ -247,6 +268,32 @@ struct totem_config {
 
 	unsigned int cancel_token_hold_on_retransmit;
 
+	unsigned int retransmit_ranges;
+
+	unsigned int priority_lanes;
+
+	unsigned int sort_queue_bytes;
+
+	unsigned int fec_group_size;
+
+	unsigned int side_channel_threshold;
+
+	unsigned int buffer_pool_size;
+
+	unsigned int buffer_pool_prefill;
+
+	unsigned int token_hold_idle_max;
+
+	unsigned int coalesce_delay;
+
+	unsigned int coalesce_bytes;
+
+	char compression_model[CONFIG_STRING_LEN_MAX];
+
+	unsigned int compression_threshold;
+
+	unsigned int compression_level;
+
 	unsigned char ip_dscp;
 
 	void (*totem_memb_ring_id_create_or_load) (
@@ -59,6 +59,7 @@ struct totempg_group {
 
 #define TOTEMPG_AGREED			0
 #define TOTEMPG_SAFE			1
+#define TOTEMPG_PRIORITY_HIGH		TOTEM_MCAST_PRIORITY_HIGH
 
 /**
  * Initialize the totem process groups abstraction
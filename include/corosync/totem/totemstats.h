@@ -48,8 +48,125 @@ typedef struct {
 	uint64_t rx;
 	uint64_t tx;
 	int backlog_calc;
+	unsigned int window_size;
 } totemsrp_token_stats_t;
 
+/*
+ * Log-linear latency histogram in microseconds. Values below
+ * TOTEM_LATENCY_SUB_BUCKETS have a bucket each, every following power of two
+ * is split into TOTEM_LATENCY_SUB_BUCKETS linear buckets. Values above the
+ * last bucket are counted in the last bucket.
+ */
+#define TOTEM_LATENCY_SUB_BUCKETS_BITS 2
+#define TOTEM_LATENCY_SUB_BUCKETS (1 << TOTEM_LATENCY_SUB_BUCKETS_BITS)
+#define TOTEM_LATENCY_BUCKETS (24 * TOTEM_LATENCY_SUB_BUCKETS)
+
+enum totem_latency_type {
+	TOTEM_LATENCY_QUEUE,		/* totemsrp_mcast () to send on the token */
+	TOTEM_LATENCY_ORDER,		/* send on the token to delivery */
+	TOTEM_LATENCY_DELIVERY,		/* totemsrp_mcast () to delivery */
+	TOTEM_LATENCY_MAX
+};
+
+typedef struct {
+	uint64_t count;
+	uint64_t sum_us;
+	uint64_t max_us;
+	uint64_t p50_us;
+	uint64_t p90_us;
+	uint64_t p99_us;
+	uint64_t bucket[TOTEM_LATENCY_BUCKETS];
+} totemsrp_latency_stats_t;
+
+static inline unsigned int totem_latency_bucket (uint64_t usec)
+{
+	unsigned int msb;
+	unsigned int bucket;
+
+	if (usec < TOTEM_LATENCY_SUB_BUCKETS) {
+		return (usec);
+	}
+	msb = 63 - __builtin_clzll (usec);
+	bucket = (msb - TOTEM_LATENCY_SUB_BUCKETS_BITS + 1) * TOTEM_LATENCY_SUB_BUCKETS +
+		((usec >> (msb - TOTEM_LATENCY_SUB_BUCKETS_BITS)) & (TOTEM_LATENCY_SUB_BUCKETS - 1));
+	if (bucket >= TOTEM_LATENCY_BUCKETS) {
+		bucket = TOTEM_LATENCY_BUCKETS - 1;
+	}
+	return (bucket);
+}
+
+/*
+ * Smallest value (in microseconds) counted in bucket
+ */
+static inline uint64_t totem_latency_bucket_lower (unsigned int bucket)
+{
+	if (bucket < TOTEM_LATENCY_SUB_BUCKETS) {
+		return (bucket);
+	}
+	return ((uint64_t)(TOTEM_LATENCY_SUB_BUCKETS + bucket % TOTEM_LATENCY_SUB_BUCKETS) <<
+		(bucket / TOTEM_LATENCY_SUB_BUCKETS - 1));
+}
+
+/*
+ * Suspicion level (phi) of the token accrual failure detector after
+ * elapsed_us without token, given the mean and standard deviation of the
+ * token inter-arrival time. Uses the logistic approximation of the normal
+ * distribution, phi = -log10 (P (interval > elapsed_us)), with the small
+ * log10 (1 + e) term left out so no libm is needed.
+ */
+#define TOTEM_PHI_LN10 2.302585
+
+static inline double totem_phi_get (uint64_t elapsed_us, uint64_t mean_us, uint64_t stddev_us)
+{
+	double y;
+
+	if (stddev_us == 0 || elapsed_us <= mean_us) {
+		return (0.0);
+	}
+	y = (double)(elapsed_us - mean_us) / stddev_us;
+	return (y * (1.5976 + 0.070566 * y * y) / TOTEM_PHI_LN10);
+}
+
+/*
+ * Submission lanes of the new message queue, higher lanes are served first
+ */
+enum totem_lane {
+	TOTEM_LANE_NORMAL,
+	TOTEM_LANE_HIGH,
+	TOTEM_LANE_MAX
+};
+
+typedef struct {
+	uint64_t mcast_tx;		/* messages sent on the token */
+	uint64_t wait_sum_us;		/* time spent in the queue */
+	uint64_t wait_max_us;
+	uint32_t queue_depth;
+	uint32_t queue_depth_max;
+} totemsrp_lane_stats_t;
+
+/*
+ * Steps of a membership reconfiguration, in the order they normally happen
+ */
+enum totem_reconf_event {
+	TOTEM_RECONF_TOKEN_LOST,	/* token timeout in OPERATIONAL */
+	TOTEM_RECONF_GATHER,
+	TOTEM_RECONF_CONSENSUS,		/* all members of the join agreed */
+	TOTEM_RECONF_COMMIT,
+	TOTEM_RECONF_RECOVERY,
+	TOTEM_RECONF_OPERATIONAL,
+	TOTEM_RECONF_SYNC_DONE,		/* services finished synchronization */
+	TOTEM_RECONF_EVENT_MAX
+};
+
+typedef struct {
+	uint64_t ring_seq;		/* ring formed by the reconfiguration */
+	uint32_t ring_rep;
+	uint32_t members;
+	uint32_t gather_entered;	/* gather rounds needed */
+	uint64_t duration_us;		/* first event to last event */
+	uint64_t timestamp_us[TOTEM_RECONF_EVENT_MAX];	/* monotonic, 0 if not reached */
+} totemsrp_reconf_stats_t;
+
 typedef struct {
 	totem_stats_header_t hdr;
 	uint64_t orf_token_tx;
@@ -60,7 +177,13 @@ typedef struct {
 	uint64_t memb_join_rx;
 	uint64_t mcast_tx;
 	uint64_t mcast_retx;
+	uint64_t mcast_retx_ranges;
+	uint64_t rtr_ranges_dropped;
 	uint64_t mcast_rx;
+	uint64_t mcast_fec_tx;
+	uint64_t mcast_fec_rx;
+	uint64_t mcast_fec_recovered;	/* reconstructed from parity */
+	uint64_t mcast_rtr_recovered;	/* received after a retransmit request */
 	uint64_t memb_commit_token_tx;
 	uint64_t memb_commit_token_rx;
 	uint64_t token_hold_cancel_tx;
@@ -75,6 +198,12 @@ typedef struct {
 	uint64_t recovery_token_lost;
 	uint64_t consensus_timeouts;
 	uint64_t rx_msg_dropped;
+	uint64_t endian_conversions;	/* headers of other byte order converted */
+	uint64_t rtr_pending_rotations;
+	uint64_t mcast_tx_copy_bytes;
+	uint64_t mcast_tx_zerocopy;
+	uint64_t fcc_window_increases;
+	uint64_t fcc_window_decreases;
 	uint32_t continuous_gather;
 	uint32_t continuous_sendmsg_failures;
 	uint64_t time_since_token_last_received; // relative time
@@ -83,6 +212,38 @@ typedef struct {
 	uint32_t mtt_rx_token;
 	uint32_t avg_token_workload;
 	uint32_t avg_backlog_calc;
+	uint32_t fcc_window_size;
+	uint32_t fcc_max_messages;
+	uint32_t avg_fcc_window_size;
+	uint32_t min_fcc_window_size;
+	uint32_t max_fcc_window_size;
+
+	uint64_t token_interval_mean_us;	/* smoothed token inter-arrival time */
+	uint64_t token_interval_stddev_us;	/* and its deviation, see totem_phi_get */
+	uint32_t token_timeout_effective;	/* ms, differs from token with token_adaptive */
+	float    token_phi;			/* current suspicion level */
+	uint64_t token_adaptive_lost;		/* token losses before the token timeout */
+	uint32_t token_hold_idle;		/* ms, token hold grown on an idle ring, 0 if not */
+
+	totemsrp_latency_stats_t latency[TOTEM_LATENCY_MAX];
+
+	totemsrp_lane_stats_t lane[TOTEM_LANE_MAX];
+	uint64_t lane_normal_deferred;	/* tokens with bulk left behind */
+
+	uint32_t sort_queue_size;	/* items the regular sort queue can hold */
+	uint64_t sort_queue_bytes;	/* message bytes it holds */
+	uint64_t sort_queue_full;	/* tokens not sent on due to sort_queue_bytes */
+
+	uint64_t buffer_pool_hits;	/* transport buffers reused from the pool */
+	uint64_t buffer_alloc_failures;
+	uint32_t buffer_pool_free;	/* buffers in the pool */
+	uint32_t buffers_in_use;
+	uint32_t buffers_in_use_max;	/* high-water mark of buffers_in_use */
+
+	uint32_t reconf_latest;
+	uint32_t reconf_entries;
+#define TOTEM_RECONF_HISTORY_MAX 10
+	totemsrp_reconf_stats_t reconf[TOTEM_RECONF_HISTORY_MAX];
 
 	int earliest_token;
 	int latest_token;
@@ -96,6 +257,33 @@ typedef struct {
 	totemsrp_stats_t *srp;
 	uint32_t msg_reserved;
 	uint32_t msg_queue_avail;
+	uint64_t fragment_copy_bytes;
+	uint64_t mcast_copy_bytes;
+	uint64_t mcast_msgs;		/* messages sent through the ring */
+	uint64_t mcast_frames;		/* and the packets they were packed in */
+	uint64_t coalesce_deferred;	/* token visits which kept packed messages */
+	uint32_t coalesce_delay_us_avg;	/* wait of the first message of a packet */
+	uint64_t coalesce_delay_us_max;
+	uint64_t payload_tx;		/* messages sent through the side channel */
+	uint64_t payload_rx;		/* and delivered */
+	uint64_t payload_stalled;	/* data not obtained within the retain time */
+	uint64_t payload_dropped;	/* held by no member after a membership change */
+	uint64_t payload_chunk_tx;
+	uint64_t payload_chunk_rx;
+	uint64_t payload_chunk_retx;	/* chunks sent again on request */
+	uint64_t payload_nack_tx;
+	uint64_t payload_hold_us_max;	/* longest wait for payload data */
+	uint32_t payload_held;		/* deliveries waiting for payload data */
+	uint64_t assembly_bytes;	/* held by assembly buffers */
+	uint64_t assembly_bytes_max;
+	uint32_t assembly_in_use;
+	uint64_t compress_tx;		/* messages sent compressed */
+	uint64_t compress_rx;		/* and delivered */
+	uint64_t compress_bytes_saved;
+	uint64_t compress_incompressible; /* sent as is, compression didn't help */
+	uint64_t compress_errors;	/* dropped, could not be decompressed */
+	uint64_t compress_cpu_us;
+	uint64_t decompress_cpu_us;
 } totempg_stats_t;
 
 
@@ -32,6 +32,15 @@
  * THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+/*
+ * Sends messages of growing sizes for 10 seconds each and prints the
+ * throughput.  -s only sends messages of the given size, up to 1MB, e.g.
+ * -s 1000000 for the largest messages of the default run.  The copied column
+ * is the number of bytes totempg of the local node copied per byte of data
+ * sent (stats.pg.fragment_copy_bytes and mcast_copy_bytes), it is left out
+ * when the stats map is not readable.
+ */
+
 #include <config.h>
 
 #include <stdio.h>
@@ -56,9 +65,14 @@
 
 #include <corosync/corotypes.h>
 #include <corosync/cpg.h>
+#include <corosync/cmap.h>
 
 static cpg_handle_t handle;
 
+static cmap_handle_t stats_handle;
+
+static int stats_available;
+
 static pthread_t thread;
 
 #ifndef timersub
@@ -105,6 +119,24 @@ static cpg_callbacks_t callbacks = {
 #define ONE_MEG 1048576
 static char data[ONE_MEG];
 
+/*
+ * Bytes totempg copied while packing and fragmenting messages
+ */
+static int copy_bytes_get (uint64_t *copy_bytes)
+{
+	uint64_t fragment_copy_bytes;
+	uint64_t mcast_copy_bytes;
+
+	if (cmap_get_uint64 (stats_handle, "stats.pg.fragment_copy_bytes",
+		&fragment_copy_bytes) != CS_OK ||
+	    cmap_get_uint64 (stats_handle, "stats.pg.mcast_copy_bytes",
+		&mcast_copy_bytes) != CS_OK) {
+		return (-1);
+	}
+	*copy_bytes = fragment_copy_bytes + mcast_copy_bytes;
+	return (0);
+}
+
 static void cpg_benchmark (
 	cpg_handle_t handle_in,
 	int write_size)
@@ -112,20 +144,31 @@ static void cpg_benchmark (
 	struct timeval tv1, tv2, tv_elapsed;
 	struct iovec iov;
 	unsigned int res;
+	unsigned int sent = 0;
+	uint64_t copy_bytes_start = 0;
+	uint64_t copy_bytes_end = 0;
+	int copy_bytes_valid;
 
 	alarm_notice = 0;
 	iov.iov_base = data;
 	iov.iov_len = write_size;
 
 	write_count = 0;
+	copy_bytes_valid = stats_available &&
+		copy_bytes_get (&copy_bytes_start) == 0;
 	alarm (10);
 
 	gettimeofday (&tv1, NULL);
 	do {
 		res = cpg_mcast_joined (handle_in, CPG_TYPE_AGREED, &iov, 1);
+		if (res == CS_OK) {
+			sent++;
+		}
 	} while (alarm_notice == 0 && (res == CS_OK || res == CS_ERR_TRY_AGAIN));
 	gettimeofday (&tv2, NULL);
 	timersub (&tv2, &tv1, &tv_elapsed);
+	copy_bytes_valid = copy_bytes_valid &&
+		copy_bytes_get (&copy_bytes_end) == 0;
 
 	printf ("%5d messages received ", write_count);
 	printf ("%5d bytes per write ", write_size);
@@ -133,8 +176,14 @@ static void cpg_benchmark (
 		(tv_elapsed.tv_sec + (tv_elapsed.tv_usec / 1000000.0)));
 	printf ("%9.3f TP/s ",
 		((float)write_count) /  (tv_elapsed.tv_sec + (tv_elapsed.tv_usec / 1000000.0)));
-	printf ("%7.3f MB/s.\n",
+	printf ("%7.3f MB/s",
 		((float)write_count) * ((float)write_size) /  ((tv_elapsed.tv_sec + (tv_elapsed.tv_usec / 1000000.0)) * 1000000.0));
+	if (copy_bytes_valid && sent > 0) {
+		printf (" %8.5f copied/byte",
+			(double)(copy_bytes_end - copy_bytes_start) /
+			((double)sent * write_size));
+	}
+	printf (".\n");
 }
 
 static void sigalrm_handler (int num)
@@ -153,11 +202,34 @@ static void* dispatch_thread (void *arg)
 	return NULL;
 }
 
-int main (void) {
+static void usage (const char *name)
+{
+	printf ("usage: %s [-s size]\n", name);
+}
+
+int main (int argc, char *argv[]) {
 	unsigned int size;
+	unsigned int fixed_size = 0;
 	int i;
+	int opt;
 	unsigned int res;
 
+	while ((opt = getopt (argc, argv, "s:h")) != -1) {
+		switch (opt) {
+		case 's':
+			fixed_size = atoi (optarg);
+			if (fixed_size == 0 || fixed_size > ONE_MEG) {
+				fprintf (stderr, "size must be between 1 and %d\n", ONE_MEG);
+				exit (1);
+			}
+			break;
+		case 'h':
+		default:
+			usage (argv[0]);
+			exit (opt == 'h' ? 0 : 1);
+		}
+	}
+
 	qb_log_init("cpgbench", LOG_USER, LOG_EMERG);
 	qb_log_ctl(QB_LOG_SYSLOG, QB_LOG_CONF_ENABLED, QB_FALSE);
 	qb_log_filter_ctl(QB_LOG_STDERR, QB_LOG_FILTER_ADD,
@@ -173,13 +245,18 @@ int main (void) {
 	}
 	pthread_create (&thread, NULL, dispatch_thread, NULL);
 
+	stats_available = (cmap_initialize_map (&stats_handle, CMAP_MAP_STATS) == CS_OK);
+
 	res = cpg_join (handle, &group_name);
 	if (res != CS_OK) {
 		printf ("cpg_join failed with result %d\n", res);
 		exit (1);
 	}
 
-	for (i = 0; i < 10; i++) { /* number of repetitions - up to 50k */
+	if (fixed_size) {
+		cpg_benchmark (handle, fixed_size);
+	}
+	for (i = 0; i < 10 && fixed_size == 0; i++) { /* number of repetitions - up to 50k */
 		cpg_benchmark (handle, size);
 		signal (SIGALRM, sigalrm_handler);
 		size *= 5;
@@ -188,6 +265,10 @@ int main (void) {
 		}
 	}
 
+	if (stats_available) {
+		cmap_finalize (stats_handle);
+	}
+
 	res = cpg_finalize (handle);
 	if (res != CS_OK) {
 		printf ("cpg_finalize failed with result %d\n", res);
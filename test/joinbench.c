@@ -0,0 +1,375 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Replay of a join message storm against the membership set algebra of
+ * totemsrp.  Every node of the ring sends a join carrying the full proc
+ * list (in its own order) and a small failed list, the receiver runs the
+ * comparisons memb_join_process does for each of them: proc and failed list
+ * equality, subset checks, consensus update and the consensus agreed test.
+ * The nested loop implementation over srp_addr arrays is compared against
+ * the nodeset bitmaps.
+ *
+ * usage: joinbench [-n nodes] [-f failed] [-r rounds]
+ *        without -n the storm is replayed for 64, 128 and 384 nodes
+ */
+
+#include <config.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <corosync/nodeset.h>
+
+#define BENCH_NODES_MAX		384
+
+struct bench_list {
+	unsigned int nodeid[BENCH_NODES_MAX];
+	int entries;
+};
+
+static unsigned int failed = 2;
+static unsigned int rounds = 200;
+
+static unsigned long long sink;
+
+static unsigned long long nsec_now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+/*
+ * Array implementation, same algorithms as the former memb_set_* functions
+ */
+static int array_isset (const struct bench_list *list, unsigned int nodeid)
+{
+	int i;
+
+	for (i = 0; i < list->entries; i++) {
+		if (list->nodeid[i] == nodeid) {
+			return (1);
+		}
+	}
+	return (0);
+}
+
+static int array_equal (const struct bench_list *set1, const struct bench_list *set2)
+{
+	int i;
+
+	if (set1->entries != set2->entries) {
+		return (0);
+	}
+	for (i = 0; i < set2->entries; i++) {
+		if (array_isset (set1, set2->nodeid[i]) == 0) {
+			return (0);
+		}
+	}
+	return (1);
+}
+
+static int array_subset (const struct bench_list *subset, const struct bench_list *fullset)
+{
+	int i;
+
+	if (subset->entries > fullset->entries) {
+		return (0);
+	}
+	for (i = 0; i < subset->entries; i++) {
+		if (array_isset (fullset, subset->nodeid[i]) == 0) {
+			return (0);
+		}
+	}
+	return (1);
+}
+
+static void array_merge (const struct bench_list *subset, struct bench_list *fullset)
+{
+	int i;
+
+	for (i = 0; i < subset->entries; i++) {
+		if (array_isset (fullset, subset->nodeid[i]) == 0) {
+			fullset->nodeid[fullset->entries++] = subset->nodeid[i];
+		}
+	}
+}
+
+static int array_consensus_agreed (
+	const struct bench_list *proc,
+	const struct bench_list *failed_list,
+	const struct bench_list *consensus)
+{
+	int i;
+
+	for (i = 0; i < proc->entries; i++) {
+		if (array_isset (failed_list, proc->nodeid[i]) == 0 &&
+		    array_isset (consensus, proc->nodeid[i]) == 0) {
+			return (0);
+		}
+	}
+	return (1);
+}
+
+/*
+ * Nodeset implementation, same algorithms as memb_list_* in totemsrp
+ */
+static struct nodeset_index node_index;
+
+static int set_list_subset (const struct bench_list *list, const struct nodeset *set)
+{
+	int i;
+
+	if (list->entries > (int)set->count) {
+		return (0);
+	}
+	for (i = 0; i < list->entries; i++) {
+		if (nodeset_isset (set, nodeset_index_lookup (&node_index, list->nodeid[i])) == 0) {
+			return (0);
+		}
+	}
+	return (1);
+}
+
+static int set_list_equal (const struct bench_list *list, const struct nodeset *set)
+{
+	struct nodeset list_set;
+	int i;
+	int idx;
+
+	if (list->entries != (int)set->count) {
+		return (0);
+	}
+	nodeset_clear (&list_set);
+	for (i = 0; i < list->entries; i++) {
+		idx = nodeset_index_lookup (&node_index, list->nodeid[i]);
+		if (idx >= 0) {
+			nodeset_set (&list_set, idx);
+		}
+	}
+	return (nodeset_subset (set, &list_set));
+}
+
+static void set_list_merge (const struct bench_list *list, struct nodeset *set)
+{
+	int i;
+
+	for (i = 0; i < list->entries; i++) {
+		nodeset_set (set, nodeset_index_add (&node_index, list->nodeid[i]));
+	}
+}
+
+/*
+ * Build the joins of one storm: node ids are sparse, every sender lists
+ * the proc list in a different order
+ */
+static void storm_build (
+	struct bench_list *joins_proc,
+	struct bench_list *joins_failed,
+	unsigned int nodes)
+{
+	unsigned int i, j, k;
+	unsigned int tmp;
+
+	for (i = 0; i < nodes; i++) {
+		joins_proc[i].entries = nodes;
+		for (j = 0; j < nodes; j++) {
+			joins_proc[i].nodeid[j] = (j + 1) * 7919;
+		}
+		for (j = nodes - 1; j > 0; j--) {
+			k = rand () % (j + 1);
+			tmp = joins_proc[i].nodeid[j];
+			joins_proc[i].nodeid[j] = joins_proc[i].nodeid[k];
+			joins_proc[i].nodeid[k] = tmp;
+		}
+		joins_failed[i].entries = failed;
+		for (j = 0; j < failed; j++) {
+			joins_failed[i].nodeid[j] = (nodes - j) * 7919;
+		}
+	}
+}
+
+static unsigned long long bench_array (
+	const struct bench_list *joins_proc,
+	const struct bench_list *joins_failed,
+	unsigned int nodes,
+	unsigned long long *agreed)
+{
+	static struct bench_list proc, failed_list, consensus;
+	unsigned long long start;
+	unsigned int r, i;
+
+	start = nsec_now ();
+	for (r = 0; r < rounds; r++) {
+		proc.entries = 1;
+		proc.nodeid[0] = 7919;
+		failed_list.entries = 0;
+		consensus.entries = 0;
+
+		for (i = 0; i < nodes; i++) {
+			if (array_equal (&joins_proc[i], &proc) &&
+			    array_equal (&joins_failed[i], &failed_list)) {
+				if (array_isset (&consensus, joins_proc[i].nodeid[0]) == 0) {
+					consensus.nodeid[consensus.entries++] = joins_proc[i].nodeid[0];
+				}
+				*agreed += array_consensus_agreed (&proc, &failed_list, &consensus);
+			} else
+			if (array_subset (&joins_proc[i], &proc) &&
+			    array_subset (&joins_failed[i], &failed_list)) {
+				sink++;
+			} else {
+				array_merge (&joins_proc[i], &proc);
+				array_merge (&joins_failed[i], &failed_list);
+			}
+		}
+	}
+	return (nsec_now () - start);
+}
+
+static unsigned long long bench_nodeset (
+	const struct bench_list *joins_proc,
+	const struct bench_list *joins_failed,
+	unsigned int nodes,
+	unsigned long long *agreed)
+{
+	static struct nodeset proc, failed_set, consensus, token_memb;
+	unsigned long long start;
+	unsigned int r, i;
+
+	start = nsec_now ();
+	for (r = 0; r < rounds; r++) {
+		nodeset_index_init (&node_index);
+		nodeset_clear (&proc);
+		nodeset_clear (&failed_set);
+		nodeset_clear (&consensus);
+		nodeset_set (&proc, nodeset_index_add (&node_index, 7919));
+
+		for (i = 0; i < nodes; i++) {
+			if (set_list_equal (&joins_proc[i], &proc) &&
+			    set_list_equal (&joins_failed[i], &failed_set)) {
+				nodeset_set (&consensus,
+				    nodeset_index_add (&node_index, joins_proc[i].nodeid[0]));
+				nodeset_subtract (&token_memb, &proc, &failed_set);
+				*agreed += nodeset_subset (&token_memb, &consensus);
+			} else
+			if (set_list_subset (&joins_proc[i], &proc) &&
+			    set_list_subset (&joins_failed[i], &failed_set)) {
+				sink++;
+			} else {
+				set_list_merge (&joins_proc[i], &proc);
+				set_list_merge (&joins_failed[i], &failed_set);
+			}
+		}
+	}
+	return (nsec_now () - start);
+}
+
+static void bench (unsigned int nodes)
+{
+	static struct bench_list joins_proc[BENCH_NODES_MAX];
+	static struct bench_list joins_failed[BENCH_NODES_MAX];
+	unsigned long long array_ns, nodeset_ns;
+	unsigned long long array_agreed = 0;
+	unsigned long long nodeset_agreed = 0;
+
+	storm_build (joins_proc, joins_failed, nodes);
+
+	array_ns = bench_array (joins_proc, joins_failed, nodes, &array_agreed);
+	nodeset_ns = bench_nodeset (joins_proc, joins_failed, nodes, &nodeset_agreed);
+
+	/*
+	 * Both implementations must reach the same decisions
+	 */
+	assert (array_agreed == nodeset_agreed);
+
+	printf ("nodes %3u: array %10.2f us/storm nodeset %10.2f us/storm speedup %.2fx\n",
+		nodes,
+		(double)array_ns / rounds / 1000.0,
+		(double)nodeset_ns / rounds / 1000.0,
+		(double)array_ns / (double)nodeset_ns);
+}
+
+static void usage (const char *name)
+{
+	printf ("usage: %s [-n nodes] [-f failed] [-r rounds]\n", name);
+}
+
+int main (int argc, char *argv[])
+{
+	unsigned int nodes = 0;
+	int opt;
+
+	while ((opt = getopt (argc, argv, "n:f:r:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			nodes = atoi (optarg);
+			break;
+		case 'f':
+			failed = atoi (optarg);
+			break;
+		case 'r':
+			rounds = atoi (optarg);
+			break;
+		case 'h':
+		default:
+			usage (argv[0]);
+			exit (1);
+		}
+	}
+
+	if (nodes > BENCH_NODES_MAX || failed >= BENCH_NODES_MAX || rounds == 0) {
+		usage (argv[0]);
+		exit (1);
+	}
+
+	if (nodes != 0) {
+		if (failed >= nodes) {
+			usage (argv[0]);
+			exit (1);
+		}
+		bench (nodes);
+	} else {
+		bench (64);
+		bench (128);
+		bench (384);
+	}
+	printf ("(%llu)\n", sink & 1);
+
+	return (0);
+}
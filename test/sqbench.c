@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Microbenchmark of the per seqid struct sq against the bitmap backed
+ * struct sqb.  Each round fills a window of the queue (with optional loss),
+ * then runs the same scans totemsrp does on every token: aru calculation,
+ * retransmit hole search and in order delivery up to the first hole, and
+ * finally releases the window.
+ *
+ * usage: sqbench [-w window] [-l loss_percent] [-r rounds]
+ */
+
+#include <config.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <corosync/sq.h>
+#include <corosync/sqb.h>
+
+#define QUEUE_ITEMS		16384
+
+struct bench_item {
+	void *mcast;
+	unsigned int msg_len;
+};
+
+static unsigned int window = 1000;
+static unsigned int loss = 1;
+static unsigned int rounds = 2000;
+
+static unsigned long long sink;
+
+static unsigned long long nsec_now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static int seq_dropped (unsigned int seq)
+{
+	/*
+	 * Deterministic pseudo random loss so both queues see the same holes
+	 */
+	return (loss && ((seq * 2654435761U) >> 7) % 100 < loss);
+}
+
+static unsigned long long bench_sq (void)
+{
+	struct sq sq;
+	struct bench_item item;
+	unsigned long long start;
+	unsigned int base = 0;
+	unsigned int r, i;
+	void *ptr;
+
+	if (sq_init (&sq, QUEUE_ITEMS, sizeof (struct bench_item), 0) != 0) {
+		fprintf (stderr, "sq_init failed\n");
+		exit (1);
+	}
+	memset (&item, 0, sizeof (item));
+
+	start = nsec_now ();
+	for (r = 0; r < rounds; r++) {
+		for (i = 1; i <= window; i++) {
+			if (!seq_dropped (base + i)) {
+				sq_item_add (&sq, &item, base + i);
+			}
+		}
+
+		/*
+		 * aru
+		 */
+		for (i = 1; i <= window; i++) {
+			if (sq_item_get (&sq, base + i, &ptr) != 0) {
+				break;
+			}
+		}
+		sink += i;
+
+		/*
+		 * retransmit list
+		 */
+		for (i = 1; i <= window; i++) {
+			if (sq_in_range (&sq, base + i) == 0) {
+				break;
+			}
+			if (sq_item_inuse (&sq, base + i) == 0) {
+				sink += sq_item_miss_count (&sq, base + i);
+			}
+		}
+
+		/*
+		 * delivery
+		 */
+		for (i = 1; i <= window; i++) {
+			if (sq_in_range (&sq, base + i) == 0) {
+				break;
+			}
+			if (sq_item_get (&sq, base + i, &ptr) != 0) {
+				break;
+			}
+			sink += (unsigned long)ptr;
+		}
+
+		sq_items_release (&sq, base + window);
+		base += window;
+	}
+	start = nsec_now () - start;
+	sq_free (&sq);
+
+	return (start);
+}
+
+static unsigned long long bench_sqb (void)
+{
+	struct sqb sqb;
+	struct bench_item item;
+	unsigned long long start;
+	unsigned int base = 0;
+	unsigned int range;
+	unsigned int r, i;
+	void *ptr;
+
+	if (sqb_init (&sqb, QUEUE_ITEMS, sizeof (struct bench_item), 0) != 0) {
+		fprintf (stderr, "sqb_init failed\n");
+		exit (1);
+	}
+	memset (&item, 0, sizeof (item));
+
+	start = nsec_now ();
+	for (r = 0; r < rounds; r++) {
+		for (i = 1; i <= window; i++) {
+			if (!seq_dropped (base + i)) {
+				sqb_item_add (&sqb, &item, base + i);
+			}
+		}
+
+		/*
+		 * aru
+		 */
+		sink += sqb_items_contiguous (&sqb, base + 1, window) + 1;
+
+		/*
+		 * retransmit list
+		 */
+		for (i = 1; i <= window; i++) {
+			i += sqb_items_contiguous (&sqb, base + i, window - i + 1);
+			if (i > window) {
+				break;
+			}
+			sink += sqb_item_miss_count (&sqb, base + i);
+		}
+
+		/*
+		 * delivery
+		 */
+		range = sqb_items_contiguous (&sqb, base + 1, window);
+		for (i = 1; i <= range; i++) {
+			if (sqb_item_get (&sqb, base + i, &ptr) != 0) {
+				break;
+			}
+			sink += (unsigned long)ptr;
+		}
+
+		sqb_items_release (&sqb, base + window);
+		base += window;
+	}
+	start = nsec_now () - start;
+	sqb_free (&sqb);
+
+	return (start);
+}
+
+static void usage (const char *name)
+{
+	printf ("usage: %s [-w window] [-l loss_percent] [-r rounds]\n", name);
+}
+
+int main (int argc, char *argv[])
+{
+	unsigned long long sq_ns, sqb_ns;
+	int opt;
+
+	while ((opt = getopt (argc, argv, "w:l:r:h")) != -1) {
+		switch (opt) {
+		case 'w':
+			window = atoi (optarg);
+			break;
+		case 'l':
+			loss = atoi (optarg);
+			break;
+		case 'r':
+			rounds = atoi (optarg);
+			break;
+		case 'h':
+		default:
+			usage (argv[0]);
+			exit (1);
+		}
+	}
+
+	if (window == 0 || window >= QUEUE_ITEMS || loss > 100) {
+		usage (argv[0]);
+		exit (1);
+	}
+
+	sq_ns = bench_sq ();
+	sqb_ns = bench_sqb ();
+
+	printf ("window %u loss %u%% rounds %u\n", window, loss, rounds);
+	printf ("sq  %10.2f ns/seq\n", (double)sq_ns / ((double)rounds * window));
+	printf ("sqb %10.2f ns/seq\n", (double)sqb_ns / ((double)rounds * window));
+	printf ("speedup %.2fx (%llu)\n", (double)sq_ns / (double)sqb_ns, sink & 1);
+
+	return (0);
+}
@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2026 Red Hat, Inc.
+ *
+ * All rights reserved.
+ *
+ * This software licensed under BSD license, the text of which follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ * - Neither the name of the MontaVista Software, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Measure how many token rotations are needed to recover from message loss,
+ * with and without the retransmit ranges token extension.
+ *
+ * Build corosync with loss injection (see TEST_DROP_MCAST_PERCENTAGE in
+ * exec/totemsrp.c), for example
+ *   make CFLAGS="-DTEST_DROP_MCAST_PERCENTAGE=5"
+ * start it on at least two nodes and run this test on all of them at the same
+ * time.  Each node sends a burst of messages twice, first with
+ * totem.retransmit_ranges set to no and then to yes, and prints the number of
+ * rotations during which it was missing messages.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <sys/uio.h>
+
+#include <corosync/corotypes.h>
+#include <corosync/cpg.h>
+#include <corosync/cmap.h>
+
+struct srp_counters {
+	uint64_t orf_token_rx;
+	uint64_t rtr_pending_rotations;
+	uint64_t mcast_retx;
+	uint64_t mcast_retx_ranges;
+};
+
+static unsigned int my_nodeid;
+
+static unsigned int delivered;
+
+static unsigned char buffer[200000];
+
+static struct cpg_name group_name = {
+	.value = "testrtrloss",
+	.length = 11
+};
+
+static void rtrloss_deliver_fn (
+	cpg_handle_t handle,
+	const struct cpg_name *name,
+	uint32_t nodeid,
+	uint32_t pid,
+	void *msg,
+	size_t msg_len)
+{
+	if (nodeid == my_nodeid && pid == getpid ()) {
+		delivered++;
+	}
+}
+
+static cpg_callbacks_t callbacks = {
+	.cpg_deliver_fn = rtrloss_deliver_fn,
+	.cpg_confchg_fn = NULL
+};
+
+static int counters_get (cmap_handle_t stats_handle, struct srp_counters *counters)
+{
+	if (cmap_get_uint64 (stats_handle, "stats.srp.orf_token_rx",
+		&counters->orf_token_rx) != CS_OK ||
+	    cmap_get_uint64 (stats_handle, "stats.srp.rtr_pending_rotations",
+		&counters->rtr_pending_rotations) != CS_OK ||
+	    cmap_get_uint64 (stats_handle, "stats.srp.mcast_retx",
+		&counters->mcast_retx) != CS_OK ||
+	    cmap_get_uint64 (stats_handle, "stats.srp.mcast_retx_ranges",
+		&counters->mcast_retx_ranges) != CS_OK) {
+		return (-1);
+	}
+	return (0);
+}
+
+static int burst_send (cpg_handle_t handle, unsigned int msg_count, size_t msg_size)
+{
+	struct iovec iov;
+	unsigned int sent = 0;
+	cs_error_t res;
+
+	iov.iov_base = buffer;
+	iov.iov_len = msg_size;
+
+	delivered = 0;
+	while (sent < msg_count) {
+		res = cpg_mcast_joined (handle, CPG_TYPE_AGREED, &iov, 1);
+		if (res == CS_ERR_TRY_AGAIN) {
+			cpg_dispatch (handle, CS_DISPATCH_ALL);
+			continue;
+		}
+		if (res != CS_OK) {
+			fprintf (stderr, "cpg_mcast_joined failed: %d\n", res);
+			return (-1);
+		}
+		sent++;
+	}
+
+	while (delivered < msg_count) {
+		if (cpg_dispatch (handle, CS_DISPATCH_ONE) != CS_OK) {
+			return (-1);
+		}
+	}
+	return (0);
+}
+
+static void usage (const char *name)
+{
+	printf ("usage: %s [-n messages] [-s size]\n", name);
+}
+
+int main (int argc, char *argv[])
+{
+	cpg_handle_t handle;
+	cmap_handle_t cmap_handle;
+	cmap_handle_t stats_handle;
+	struct srp_counters before, after;
+	const char *modes[] = { "no", "yes" };
+	unsigned int msg_count = 10000;
+	size_t msg_size = 1000;
+	cs_error_t res;
+	int opt;
+	int i;
+
+	while ((opt = getopt (argc, argv, "n:s:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			msg_count = atoi (optarg);
+			break;
+		case 's':
+			msg_size = atoi (optarg);
+			break;
+		case 'h':
+		default:
+			usage (argv[0]);
+			exit (1);
+		}
+	}
+	if (msg_size == 0 || msg_size > sizeof (buffer)) {
+		usage (argv[0]);
+		exit (1);
+	}
+
+	res = cpg_initialize (&handle, &callbacks);
+	if (res != CS_OK) {
+		fprintf (stderr, "cpg_initialize failed: %d\n", res);
+		exit (1);
+	}
+	res = cpg_local_get (handle, &my_nodeid);
+	if (res != CS_OK) {
+		fprintf (stderr, "cpg_local_get failed: %d\n", res);
+		exit (1);
+	}
+	res = cpg_join (handle, &group_name);
+	if (res != CS_OK) {
+		fprintf (stderr, "cpg_join failed: %d\n", res);
+		exit (1);
+	}
+	if (cmap_initialize (&cmap_handle) != CS_OK ||
+	    cmap_initialize_map (&stats_handle, CMAP_MAP_STATS) != CS_OK) {
+		fprintf (stderr, "cmap_initialize failed\n");
+		exit (1);
+	}
+
+	printf ("%-8s %10s %10s %10s %10s\n", "ranges", "rotations",
+		"pending", "retx", "retx_rng");
+	for (i = 0; i < 2; i++) {
+		if (cmap_set_string (cmap_handle, "totem.retransmit_ranges",
+			modes[i]) != CS_OK) {
+			fprintf (stderr, "cannot set totem.retransmit_ranges\n");
+			exit (1);
+		}
+		sleep (1);
+
+		if (counters_get (stats_handle, &before) == -1) {
+			fprintf (stderr, "cannot read stats.srp, is corosync too old?\n");
+			exit (1);
+		}
+		if (burst_send (handle, msg_count, msg_size) == -1) {
+			exit (1);
+		}
+		if (counters_get (stats_handle, &after) == -1) {
+			exit (1);
+		}
+
+		printf ("%-8s %10"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64"\n",
+			modes[i],
+			after.orf_token_rx - before.orf_token_rx,
+			after.rtr_pending_rotations - before.rtr_pending_rotations,
+			after.mcast_retx - before.mcast_retx,
+			after.mcast_retx_ranges - before.mcast_retx_ranges);
+	}
+
+	cmap_delete (cmap_handle, "totem.retransmit_ranges");
+	cpg_finalize (handle);
+	cmap_finalize (cmap_handle);
+	cmap_finalize (stats_handle);
+
+	return (0);
+}